@@ -31,6 +31,9 @@
 
 #include "stir/modelling/ParametricDiscretisedDensity.h"
 #include "stir/IO/InterfileOutputFileFormat.h"
+#ifdef HAVE_ZLIB
+#include "stir/IO/InterfileCompressedOutputFileFormat.h"
+#endif
 #include "stir/IO/ITKOutputFileFormat.h"
 #include "stir/IO/InterfileDynamicDiscretisedDensityOutputFileFormat.h"
 #include "stir/IO/InterfileDynamicDiscretisedDensityInputFileFormat.h"
@@ -78,6 +81,9 @@
 START_NAMESPACE_STIR
 
 static InterfileOutputFileFormat::RegisterIt dummy1;
+#ifdef HAVE_ZLIB
+static InterfileCompressedOutputFileFormat::RegisterIt dummy1compressed;
+#endif
 #ifdef HAVE_ITK
 static ITKOutputFileFormat::RegisterIt dummyITK1;
 #endif
@@ -21,6 +21,7 @@
 #include "stir/IO/FileSignature.h"
 #include "stir/error.h"
 #include "stir/FilePath.h"
+#include "stir/warning.h"
 
 START_NAMESPACE_STIR
 
@@ -56,6 +57,7 @@ InputStreamFromROOTFile::set_defaults()
     low_energy_window = 0.f;
     up_energy_window = 1000.f;
     read_optional_root_fields=false;
+    read_cache_size_in_MB = 100;
 }
 
 void
@@ -70,14 +72,41 @@ InputStreamFromROOTFile::initialise_keymap()
     this->parser.add_key("low energy window (keV)", &this->low_energy_window);
     this->parser.add_key("upper energy window (keV)", &this->up_energy_window);
     this->parser.add_key("read optional ROOT fields", &this->read_optional_root_fields);
+    this->parser.add_key("read cache size (MB)", &this->read_cache_size_in_MB);
 }
 
 bool
 InputStreamFromROOTFile::post_processing()
 {
+    if (this->read_cache_size_in_MB < 0)
+    {
+        warning("InputStreamFromROOTFile: 'read cache size (MB)' should be non-negative");
+        return true;
+    }
     return false;
 }
 
+Succeeded
+InputStreamFromROOTFile::enable_implicit_multi_threading(unsigned int num_threads)
+{
+#ifdef R__USE_IMT
+    ROOT::EnableImplicitMT(static_cast<UInt_t>(num_threads));
+    return Succeeded::yes;
+#else
+    warning("InputStreamFromROOTFile: ROOT was compiled without support for implicit multi-threading.\n"
+            "Baskets will be decompressed sequentially.");
+    return Succeeded::no;
+#endif
+}
+
+void
+InputStreamFromROOTFile::disable_implicit_multi_threading()
+{
+#ifdef R__USE_IMT
+    ROOT::DisableImplicitMT();
+#endif
+}
+
 Succeeded
 InputStreamFromROOTFile::set_up(const std::string & header_path)
 {
@@ -96,36 +125,40 @@ InputStreamFromROOTFile::set_up(const std::string & header_path)
 
     stream_ptr = new TChain(this->chain_name.c_str());
     stream_ptr->Add(fullfilename.c_str());
-    stream_ptr->SetBranchAddress("time1", &time1);
-    stream_ptr->SetBranchAddress("time2", &time2);
-    stream_ptr->SetBranchAddress("eventID1",&eventID1);
-    stream_ptr->SetBranchAddress("eventID2",&eventID2);
-    stream_ptr->SetBranchAddress("energy1", &energy1);
-    stream_ptr->SetBranchAddress("energy2", &energy2);
-    stream_ptr->SetBranchAddress("comptonPhantom1", &comptonphantom1);
-    stream_ptr->SetBranchAddress("comptonPhantom2", &comptonphantom2);
+    // Only read the branches that we need (set via set_branch_address).
+    // The TTreeCache then reads the baskets of these branches in bulk.
+    stream_ptr->SetBranchStatus("*", 0);
+    stream_ptr->SetCacheSize(static_cast<Long64_t>(this->read_cache_size_in_MB)*1024*1024);
+    set_branch_address("time1", &time1);
+    set_branch_address("time2", &time2);
+    set_branch_address("eventID1", &eventID1);
+    set_branch_address("eventID2", &eventID2);
+    set_branch_address("energy1", &energy1);
+    set_branch_address("energy2", &energy2);
+    set_branch_address("comptonPhantom1", &comptonphantom1);
+    set_branch_address("comptonPhantom2", &comptonphantom2);
 
     if (read_optional_root_fields)
     {
-        stream_ptr->SetBranchAddress("axialPos",&axialPos);
-        stream_ptr->SetBranchAddress("globalPosX1",&globalPosX1);
-        stream_ptr->SetBranchAddress("globalPosX2",&globalPosX2);
-        stream_ptr->SetBranchAddress("globalPosY1",&globalPosY1);
-        stream_ptr->SetBranchAddress("globalPosY2",&globalPosY2);
-        stream_ptr->SetBranchAddress("globalPosZ1",&globalPosZ1);
-        stream_ptr->SetBranchAddress("globalPosZ2",&globalPosZ2);
-        stream_ptr->SetBranchAddress("rotationAngle",&rotation_angle);
-        stream_ptr->SetBranchAddress("runID",&runID);
-        stream_ptr->SetBranchAddress("sinogramS",&sinogramS);
-        stream_ptr->SetBranchAddress("sinogramTheta",&sinogramTheta);
-        stream_ptr->SetBranchAddress("sourceID1",&sourceID1);
-        stream_ptr->SetBranchAddress("sourceID2",&sourceID2);
-        stream_ptr->SetBranchAddress("sourcePosX1",&sourcePosX1);
-        stream_ptr->SetBranchAddress("sourcePosX2",&sourcePosX2);
-        stream_ptr->SetBranchAddress("sourcePosY1",&sourcePosY1);
-        stream_ptr->SetBranchAddress("sourcePosY2",&sourcePosY2);
-        stream_ptr->SetBranchAddress("sourcePosZ1",&sourcePosZ1);
-        stream_ptr->SetBranchAddress("sourcePosZ2",&sourcePosZ2);
+        set_branch_address("axialPos", &axialPos);
+        set_branch_address("globalPosX1", &globalPosX1);
+        set_branch_address("globalPosX2", &globalPosX2);
+        set_branch_address("globalPosY1", &globalPosY1);
+        set_branch_address("globalPosY2", &globalPosY2);
+        set_branch_address("globalPosZ1", &globalPosZ1);
+        set_branch_address("globalPosZ2", &globalPosZ2);
+        set_branch_address("rotationAngle", &rotation_angle);
+        set_branch_address("runID", &runID);
+        set_branch_address("sinogramS", &sinogramS);
+        set_branch_address("sinogramTheta", &sinogramTheta);
+        set_branch_address("sourceID1", &sourceID1);
+        set_branch_address("sourceID2", &sourceID2);
+        set_branch_address("sourcePosX1", &sourcePosX1);
+        set_branch_address("sourcePosX2", &sourcePosX2);
+        set_branch_address("sourcePosY1", &sourcePosY1);
+        set_branch_address("sourcePosY2", &sourcePosY2);
+        set_branch_address("sourcePosZ1", &sourcePosZ1);
+        set_branch_address("sourcePosZ2", &sourcePosZ2);
     }
 
     return Succeeded::yes;
@@ -191,14 +191,14 @@ set_up(const std::string & header_path)
         return Succeeded::no;
     }
 
-    stream_ptr->SetBranchAddress("crystalID1",&crystalID1);
-    stream_ptr->SetBranchAddress("crystalID2",&crystalID2);
-    stream_ptr->SetBranchAddress("submoduleID1",&submoduleID1);
-    stream_ptr->SetBranchAddress("submoduleID2",&submoduleID2);
-    stream_ptr->SetBranchAddress("moduleID1",&moduleID1);
-    stream_ptr->SetBranchAddress("moduleID2",&moduleID2);
-    stream_ptr->SetBranchAddress("rsectorID1",&rsectorID1);
-    stream_ptr->SetBranchAddress("rsectorID2",&rsectorID2);
+    set_branch_address("crystalID1", &crystalID1);
+    set_branch_address("crystalID2", &crystalID2);
+    set_branch_address("submoduleID1", &submoduleID1);
+    set_branch_address("submoduleID2", &submoduleID2);
+    set_branch_address("moduleID1", &moduleID1);
+    set_branch_address("moduleID2", &moduleID2);
+    set_branch_address("rsectorID1", &rsectorID1);
+    set_branch_address("rsectorID2", &rsectorID2);
 
     nentries = static_cast<unsigned long int>(stream_ptr->GetEntries());
     if (nentries == 0)
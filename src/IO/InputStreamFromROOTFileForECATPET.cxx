@@ -165,10 +165,10 @@ set_up(const std::string & header_path )
         return Succeeded::no;
     }
 
-    stream_ptr->SetBranchAddress("crystalID1",&crystalID1);
-    stream_ptr->SetBranchAddress("crystalID2",&crystalID2);
-    stream_ptr->SetBranchAddress("blockID1",&blockID1);
-    stream_ptr->SetBranchAddress("blockID2",&blockID2);
+    set_branch_address("crystalID1", &crystalID1);
+    set_branch_address("crystalID2", &crystalID2);
+    set_branch_address("blockID1", &blockID1);
+    set_branch_address("blockID2", &blockID2);
 
     nentries = static_cast<unsigned long int>(stream_ptr->GetEntries());
     if (nentries == 0)
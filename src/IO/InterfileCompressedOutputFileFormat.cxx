@@ -0,0 +1,133 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup InterfileIO
+  \brief Implementation of class stir::InterfileCompressedOutputFileFormat
+
+*/
+
+#include "stir/IO/InterfileCompressedOutputFileFormat.h"
+#include "stir/IO/interfile.h"
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/NumericType.h"
+#include "stir/ByteOrder.h"
+#include "stir/Succeeded.h"
+#include "stir/utilities.h"
+#include "stir/warning.h"
+
+START_NAMESPACE_STIR
+
+
+const char * const 
+InterfileCompressedOutputFileFormat::registered_name = "Interfile compressed";
+
+InterfileCompressedOutputFileFormat::
+InterfileCompressedOutputFileFormat(const int compression_level_v,
+                                    const bool byte_shuffle_v)
+{
+  set_defaults();
+  this->compression_level = compression_level_v;
+  this->byte_shuffle = byte_shuffle_v;
+}
+
+void 
+InterfileCompressedOutputFileFormat::
+set_defaults()
+{
+  base_type::set_defaults();
+  this->file_byte_order = ByteOrder::little_endian;
+  this->type_of_numbers = NumericType::FLOAT;
+  this->compression_level = 6;
+  this->byte_shuffle = true;
+
+  set_key_values();
+}
+
+void 
+InterfileCompressedOutputFileFormat::
+initialise_keymap()
+{
+  parser.add_start_key("Interfile compressed Output File Format Parameters");
+  parser.add_stop_key("End Interfile compressed Output File Format Parameters");
+  parser.add_key("compression level", &this->compression_level);
+  parser.add_key("byte shuffle", &this->byte_shuffle);
+  base_type::initialise_keymap();
+}
+
+bool 
+InterfileCompressedOutputFileFormat::
+post_processing()
+{
+  if (base_type::post_processing())
+    return true;
+  if (this->compression_level < 1 || this->compression_level > 9)
+    {
+      warning("InterfileCompressedOutputFileFormat: compression level should be between 1 and 9 but is %d",
+              this->compression_level);
+      return true;
+    }
+  return false;
+}
+
+NumericType 
+InterfileCompressedOutputFileFormat::
+set_type_of_numbers(const NumericType& new_type, const bool warn)
+{
+  if (new_type != NumericType::FLOAT)
+    {
+      if (warn)
+        warning("InterfileCompressedOutputFileFormat: output type of numbers is currently fixed to float\n");
+    }
+  this->type_of_numbers = NumericType::FLOAT;
+  return this->type_of_numbers;
+}
+
+ByteOrder 
+InterfileCompressedOutputFileFormat::
+set_byte_order(const ByteOrder& new_byte_order, const bool warn) 
+{
+  if (new_byte_order != ByteOrder::little_endian)
+    {
+      if (warn)
+        warning("InterfileCompressedOutputFileFormat: byte_order is currently fixed to little-endian\n");
+    }
+  this->file_byte_order = ByteOrder::little_endian;
+  return this->file_byte_order;
+}
+
+Succeeded  
+InterfileCompressedOutputFileFormat::
+actual_write_to_file(std::string& filename, 
+                     const DiscretisedDensity<3,float>& density) const
+{
+  if (this->scale_to_write_data != 0 && this->scale_to_write_data != 1)
+    warning("InterfileCompressedOutputFileFormat: scale_to_write_data is ignored, as data are written as floats");
+
+  // dynamic_cast will throw an exception when it's not valid
+  const Succeeded success =
+    write_basic_interfile_compressed(filename,
+                                     dynamic_cast<const VoxelsOnCartesianGrid<float>& >(density),
+                                     this->compression_level,
+                                     this->byte_shuffle);
+  if (success == Succeeded::yes)
+    replace_extension(filename, ".hv");
+  return success;
+}
+
+END_NAMESPACE_STIR
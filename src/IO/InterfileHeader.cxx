@@ -235,6 +235,14 @@ InterfileHeader::InterfileHeader()
   add_key("start horizontal bed position (mm)", &bed_position_horizontal);
   bed_position_vertical = 0.F;
   add_key("start vertical bed position (mm)", &bed_position_vertical);
+
+  data_compression_values.push_back("none");
+  data_compression_values.push_back("deflate");
+  data_compression_index = 0;
+  add_key("data compression",
+    KeyArgument::ASCIIlist,
+    &data_compression_index,
+    &data_compression_values);
 }
 
 
@@ -271,6 +279,11 @@ bool InterfileHeader::post_processing()
   
   file_byte_order = byte_order_index==0 ? 
     ByteOrder::little_endian : ByteOrder::big_endian;
+
+  if (data_compression_index < 0 ||
+      static_cast<ASCIIlist_type::size_type>(data_compression_index) >= data_compression_values.size())
+  { warning("Interfile error: unsupported 'data compression'\n"); return true; }
+  data_compression = data_compression_values[data_compression_index];
   
   // KT 07/10/2002 more extensive error checking for matrix_size keyword
   if (matrix_size.size()==0)
@@ -44,6 +44,14 @@
 #include "stir/CartesianCoordinate3D.h"
 #include "stir/VoxelsOnCartesianGrid.h"
 #include "stir/ProjDataFromStream.h"
+#include "stir/ProjDataMemoryMapped.h"
+#ifdef HAVE_ZLIB
+#include "stir/ProjDataCompressed.h"
+#include "stir/deflate_float_blocks.h"
+#endif
+#ifdef HAVE_PREAD
+#include "stir/ProjDataPositionalIO.h"
+#endif
 #include "stir/ProjDataInfoCylindricalArcCorr.h"
 #include "stir/Scanner.h"
 #include "stir/Succeeded.h"
@@ -139,6 +147,80 @@ create_image_and_header_from(InterfileImageHeader& hdr,
      voxel_size);
 }
 
+#ifdef HAVE_ZLIB
+// help function
+// reads an image stored as compressed blocks (one per plane), see write_basic_interfile_compressed()
+static Succeeded
+read_compressed_image_data(VoxelsOnCartesianGrid<float>& image,
+                           const char * const full_data_file_name,
+                           const std::streamoff offset)
+{
+  ifstream data_in(full_data_file_name, ios::in | ios::binary);
+  if (!data_in)
+    {
+      warning("read_interfile_image: error opening file %s", full_data_file_name);
+      return Succeeded::no;
+    }
+  const int min_z = image.get_min_z();
+  const int num_planes = image.get_max_z() - min_z + 1;
+  vector<detail::DeflateBlockInfo> blocks(static_cast<std::size_t>(num_planes));
+  bool byte_shuffle = false;
+  boost::uint64_t data_end = 0;
+  if (detail::read_deflate_block_index(data_in, offset, blocks, byte_shuffle, data_end) == Succeeded::no)
+    return Succeeded::no;
+
+  // first read all blocks, as the stream cannot be used in parallel
+  vector<vector<unsigned char> > compressed(blocks.size());
+  for (std::size_t i=0; i<blocks.size(); ++i)
+    {
+      if (blocks[i].size == 0)
+        continue;
+      compressed[i].resize(static_cast<std::size_t>(blocks[i].size));
+      data_in.seekg(offset + static_cast<std::streamoff>(blocks[i].offset));
+      data_in.read(reinterpret_cast<char *>(&compressed[i][0]),
+                   static_cast<std::streamsize>(blocks[i].size));
+    }
+  if (!data_in)
+    {
+      warning("read_interfile_image: error reading compressed data from %s", full_data_file_name);
+      return Succeeded::no;
+    }
+
+  const std::size_t num_values_in_plane =
+    static_cast<std::size_t>(image.get_y_size()) * image.get_x_size();
+  int num_errors = 0;
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i=0; i<num_planes; ++i)
+    {
+      Array<2,float>& plane = image[min_z + i];
+      if (blocks[i].size == 0)
+        {
+          plane.fill(0.F);
+          continue;
+        }
+      vector<float> buffer(num_values_in_plane);
+      if (detail::inflate_float_block(&buffer[0], num_values_in_plane, compressed[i], byte_shuffle)
+          == Succeeded::no)
+        {
+#ifdef STIR_OPENMP
+#pragma omp atomic
+#endif
+          ++num_errors;
+          continue;
+        }
+      vector<float>::const_iterator buffer_iter = buffer.begin();
+      for (int y=plane.get_min_index(); y<=plane.get_max_index(); ++y)
+        {
+          std::copy(buffer_iter, buffer_iter + plane[y].size(), plane[y].begin());
+          buffer_iter += plane[y].size();
+        }
+    }
+  return num_errors == 0 ? Succeeded::yes : Succeeded::no;
+}
+#endif
+
 VoxelsOnCartesianGrid<float> *
 read_interfile_image(istream& input,
 		     const string&  directory_for_data)
@@ -150,7 +232,34 @@ read_interfile_image(istream& input,
                                  full_data_file_name,
                                  input,
                                  directory_for_data);
-  
+
+  if (hdr.data_compression != "none")
+    {
+#ifdef HAVE_ZLIB
+      if (hdr.type_of_numbers != NumericType::FLOAT || hdr.file_byte_order != ByteOrder::little_endian)
+        {
+          warning("read_interfile_image: compressed data have to be stored as little-endian floats");
+          delete image_ptr;
+          return 0;
+        }
+      if (read_compressed_image_data(*image_ptr, full_data_file_name, hdr.data_offset_each_dataset[0])
+          == Succeeded::no)
+        {
+          warning("read_interfile_image: error reading compressed data");
+          delete image_ptr;
+          return 0;
+        }
+      for (int i=0; i< hdr.matrix_size[2][0]; i++)
+        if (hdr.image_scaling_factors[0][i]!= 1)
+          (*image_ptr)[i] *= static_cast<float>(hdr.image_scaling_factors[0][i]);
+      return image_ptr;
+#else
+      warning("read_interfile_image: data are compressed, but STIR was compiled without zlib");
+      delete image_ptr;
+      return 0;
+#endif
+    }
+
   ifstream data_in;
   open_read_binary(data_in, full_data_file_name);
 
@@ -200,6 +309,8 @@ read_interfile_dynamic_image(istream& input,
                                             directory_for_data));
   if (is_null_ptr(image_sptr))
     error("Error parsing dynamic image");
+  if (hdr.data_compression != "none")
+    error("read_interfile_dynamic_image: compressed data are not supported");
 
   shared_ptr<Scanner> scanner_sptr(Scanner::get_scanner_from_name(hdr.get_exam_info_sptr()->originating_system));
 
@@ -259,6 +370,8 @@ read_interfile_parametric_image(istream& input,
                                             directory_for_data));
   if (is_null_ptr(image_sptr))
     error("Error parsing parametric image");
+  if (hdr.data_compression != "none")
+    error("read_interfile_parametric_image: compressed data are not supported");
 
   shared_ptr<Scanner> scanner_sptr(Scanner::get_scanner_from_name(hdr.get_exam_info_sptr()->originating_system));
 
@@ -504,14 +617,15 @@ static void  write_interfile_modality(std::ostream& output_header, const ExamInf
     output_header << "!imaging modality := " << exam_info.imaging_modality.get_name() << '\n';
 }
 
-static void interfile_create_filenames(const std::string& filename, std::string& data_name, std::string& header_name)
+static void interfile_create_filenames(const std::string& filename, std::string& data_name, std::string& header_name,
+                                       const std::string& data_extension = ".v")
 {
   data_name=filename;
   string::size_type pos=find_pos_of_extension(filename);
   if (pos!=string::npos && filename.substr(pos)==".hv")
-    replace_extension(data_name, ".v");
+    replace_extension(data_name, data_extension);
   else
-    add_extension(data_name, ".v");
+    add_extension(data_name, data_extension);
 
   header_name=filename;
   replace_extension(header_name, ".hv");
@@ -530,7 +644,8 @@ write_basic_interfile_image_header(const string& header_file_name,
 				   const ByteOrder byte_order,
 				   const VectorWithOffset<float>& scaling_factors,
 				   const VectorWithOffset<unsigned long>& file_offsets,
-                   const std::vector<std::string>& data_type_descriptions)
+                   const std::vector<std::string>& data_type_descriptions,
+                   const std::string& data_compression)
 {
   CartesianCoordinate3D<int> min_indices;
   CartesianCoordinate3D<int> max_indices;
@@ -584,6 +699,8 @@ write_basic_interfile_image_header(const string& header_file_name,
      ? "LITTLEENDIAN"
      : "BIGENDIAN")
 		<< endl;
+  if (data_compression != "none")
+    output_header << "data compression := " << data_compression << endl;
 
   if (is_spect)
     {
@@ -680,6 +797,8 @@ write_basic_interfile_image_header(const string& header_file_name,
 
   
   // temporary copy to make an old-style header to satisfy Analyze
+  // (not for compressed data, which Analyze cannot read)
+  if (data_compression == "none")
   {
     string header_name = header_file_name;
     replace_extension(header_name, ".ahv");
@@ -875,6 +994,84 @@ write_basic_interfile(const string& filename,
 			  scale, byte_order);
 }
 
+#ifdef HAVE_ZLIB
+Succeeded
+write_basic_interfile_compressed(const string& filename,
+                                 const VoxelsOnCartesianGrid<float>& image,
+                                 const int compression_level,
+                                 const bool byte_shuffle)
+{
+  std::string data_name, header_name;
+  interfile_create_filenames(filename, data_name, header_name, ".vz");
+
+  // compress every plane as a separate block
+  const int min_z = image.get_min_z();
+  const int num_planes = image.get_max_z() - min_z + 1;
+  const std::size_t num_values_in_plane =
+    static_cast<std::size_t>(image.get_y_size()) * image.get_x_size();
+  vector<vector<unsigned char> > compressed(static_cast<std::size_t>(num_planes));
+  int num_errors = 0;
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i=0; i<num_planes; ++i)
+    {
+      const Array<2,float>& plane = image[min_z + i];
+      vector<float> buffer;
+      buffer.reserve(num_values_in_plane);
+      for (int y=plane.get_min_index(); y<=plane.get_max_index(); ++y)
+        buffer.insert(buffer.end(), plane[y].begin(), plane[y].end());
+      if (detail::deflate_float_block(compressed[i], &buffer[0], num_values_in_plane,
+                                      compression_level, byte_shuffle) == Succeeded::no)
+        {
+#ifdef STIR_OPENMP
+#pragma omp atomic
+#endif
+          ++num_errors;
+        }
+    }
+  if (num_errors > 0)
+    return Succeeded::no;
+
+  ofstream output_data;
+  open_write_binary(output_data, data_name.c_str());
+  vector<detail::DeflateBlockInfo> blocks(compressed.size());
+  boost::uint64_t data_end = 0;
+  for (std::size_t i=0; i<compressed.size(); ++i)
+    {
+      output_data.write(reinterpret_cast<const char *>(&compressed[i][0]),
+                        static_cast<std::streamsize>(compressed[i].size()));
+      blocks[i].offset = data_end;
+      blocks[i].size = compressed[i].size();
+      data_end += compressed[i].size();
+    }
+  if (!output_data ||
+      detail::write_deflate_block_index(output_data, blocks, byte_shuffle) == Succeeded::no)
+    {
+      warning("write_basic_interfile_compressed: error writing data to %s", data_name.c_str());
+      return Succeeded::no;
+    }
+
+  VectorWithOffset<float> scaling_factors(1);
+  scaling_factors.fill(1.F);
+  VectorWithOffset<unsigned long> file_offsets(1);
+  file_offsets.fill(0);
+  return
+    write_basic_interfile_image_header(header_name,
+                                       data_name,
+                                       image.get_exam_info(),
+                                       image.get_index_range(),
+                                       image.get_grid_spacing(),
+                                       image.get_origin(),
+                                       NumericType::FLOAT,
+                                       ByteOrder::little_endian,
+                                       scaling_factors,
+                                       file_offsets,
+                                       std::vector<std::string>(),
+                                       "deflate");
+}
+#endif
+
 Succeeded
 write_basic_interfile(const string& filename,
               const ParametricVoxelsOnCartesianGrid &image,
@@ -1029,6 +1226,14 @@ read_interfile_PDFS_Siemens(istream& input,
   // KT 14/01/2000 added directory capability
   // prepend directory_for_data to the data_file_name from the header
 
+  if (hdr.compression)
+    {
+      // the Siemens compression scheme is not documented, so we cannot decode it
+      warning("Siemens projection data is compressed. This is not supported by STIR.\n"
+              "Please decompress the data with the Siemens tools first.");
+      return 0;
+    }
+
   char full_data_file_name[max_filename_length];
   strcpy(full_data_file_name, hdr.data_file_name.c_str());
   prepend_directory_name(full_data_file_name, directory_for_data.c_str());
@@ -1040,9 +1245,6 @@ read_interfile_PDFS_Siemens(istream& input,
     return 0;
     }
 
-  if (hdr.compression)
-    warning("Siemens projection data is compressed. Reading of raw data will fail.");
-
   return new ProjDataFromStream(hdr.get_exam_info_sptr(),
     hdr.data_info_ptr->create_shared_clone(),
     data_in,
@@ -1092,6 +1294,12 @@ read_interfile_PDFS(istream& input,
       warning("Interfile parsing of PET projection data failed");
       return 0;
     }
+  if (hdr.data_compression != "none")
+    {
+      warning("read_interfile_PDFS: projection data are compressed. Use ProjData::read_from_file()\n"
+              "(which needs STIR to be compiled with zlib).");
+      return 0;
+    }
 
   // KT 14/01/2000 added directory capability
   // prepend directory_for_data to the data_file_name from the header
@@ -1147,10 +1355,191 @@ read_interfile_PDFS(const string& filename,
   return read_interfile_PDFS(image_stream, directory_name, open_mode);
 }
 
-Succeeded 
-write_basic_interfile_PDFS_header(const string& header_file_name,
-				  const string& data_file_name,
-				  const ProjDataFromStream& pdfs)
+//! parse the header of STIR PET projection data stored as uncompressed floats
+/*! Helper for read_interfile_PDFS_memory_mapped() and read_interfile_PDFS_positional_io().
+    Returns \c false (with a warning) if the data are not suitable. Otherwise \a hdr
+    is filled in, and \a full_data_file_name is set (including the directory of the header).
+*/
+static bool
+parse_interfile_PDFS_header_for_floats(InterfilePDFSHeader& hdr,
+                                       string& full_data_file_name,
+                                       const string& filename,
+                                       const char * const caller)
+{
+  ifstream header_stream(filename.c_str());
+  if (!header_stream)
+    {
+      error("%s: couldn't open file %s\n", caller, filename.c_str());
+    }
+
+  {
+    MinimalInterfileHeader minimal_hdr;
+    if (!minimal_hdr.parse(header_stream, false)) // parse without warnings
+      {
+        warning("Interfile parsing failed");
+        return false;
+      }
+    if (minimal_hdr.get_exam_info_ptr()->imaging_modality.get_modality() == ImagingModality::NM ||
+        !minimal_hdr.siemens_mi_version.empty())
+      {
+        warning("%s: only supported for STIR PET projection data", caller);
+        return false;
+      }
+    header_stream.seekg(0);
+  }
+
+  if (!hdr.parse(header_stream))
+    {
+      warning("Interfile parsing of PET projection data failed");
+      return false;
+    }
+  if (hdr.type_of_numbers != NumericType::FLOAT)
+    {
+      warning("%s: data in %s are not stored as floats",
+              caller, filename.c_str());
+      return false;
+    }
+  if (hdr.data_compression != "none")
+    {
+      warning("%s: data in %s are compressed",
+              caller, filename.c_str());
+      return false;
+    }
+
+  char directory_name[max_filename_length];
+  get_directory_name(directory_name, filename.c_str());
+  char data_file_name[max_filename_length];
+  strcpy(data_file_name, hdr.data_file_name.c_str());
+  prepend_directory_name(data_file_name, directory_name);
+  full_data_file_name = data_file_name;
+
+  for (unsigned int i=1; i<hdr.image_scaling_factors[0].size(); i++)
+    if (hdr.image_scaling_factors[0][0] != hdr.image_scaling_factors[0][i])
+      {
+        warning("Interfile warning: all image scaling factors should be equal \n"
+                "at the moment. Using the first scale factor only.\n");
+        break;
+      }
+
+  assert(hdr.data_info_ptr !=0);
+  return true;
+}
+
+ProjDataMemoryMapped*
+read_interfile_PDFS_memory_mapped(const string& filename,
+                                  const ios::openmode open_mode)
+{
+  InterfilePDFSHeader hdr;
+  string full_data_file_name;
+  if (!parse_interfile_PDFS_header_for_floats(hdr, full_data_file_name, filename,
+                                              "read_interfile_PDFS_memory_mapped"))
+    return 0;
+
+  return new ProjDataMemoryMapped(hdr.get_exam_info_sptr(),
+                                  hdr.data_info_ptr->create_shared_clone(),
+                                  full_data_file_name,
+                                  hdr.data_offset_each_dataset[0],
+                                  hdr.segment_sequence,
+                                  hdr.storage_order,
+                                  hdr.file_byte_order,
+                                  static_cast<float>(hdr.image_scaling_factors[0][0]),
+                                  open_mode);
+}
+
+#ifdef HAVE_PREAD
+ProjDataPositionalIO*
+read_interfile_PDFS_positional_io(const string& filename,
+                                  const ios::openmode open_mode)
+{
+  InterfilePDFSHeader hdr;
+  string full_data_file_name;
+  if (!parse_interfile_PDFS_header_for_floats(hdr, full_data_file_name, filename,
+                                              "read_interfile_PDFS_positional_io"))
+    return 0;
+
+  return new ProjDataPositionalIO(hdr.get_exam_info_sptr(),
+                                  hdr.data_info_ptr->create_shared_clone(),
+                                  full_data_file_name,
+                                  hdr.data_offset_each_dataset[0],
+                                  hdr.segment_sequence,
+                                  hdr.storage_order,
+                                  hdr.file_byte_order,
+                                  static_cast<float>(hdr.image_scaling_factors[0][0]),
+                                  open_mode);
+}
+#endif
+
+#ifdef HAVE_ZLIB
+ProjDataCompressed*
+read_interfile_PDFS_compressed(const string& filename,
+                               const ios::openmode open_mode)
+{
+  ifstream header_stream(filename.c_str());
+  if (!header_stream)
+    {
+      error("read_interfile_PDFS_compressed: couldn't open file %s\n", filename.c_str());
+    }
+
+  {
+    MinimalInterfileHeader hdr;
+    if (!hdr.parse(header_stream, false)) // parse without warnings
+      return 0;
+    if (hdr.get_exam_info_ptr()->imaging_modality.get_modality() == ImagingModality::NM ||
+        !hdr.siemens_mi_version.empty())
+      return 0;
+    header_stream.seekg(0);
+  }
+  {
+    // check if the data are compressed (without warnings, as this is done
+    // for all Interfile projection data)
+    InterfilePDFSHeader hdr;
+    if (!hdr.parse(header_stream, false) || hdr.data_compression == "none")
+      return 0;
+    header_stream.clear();
+    header_stream.seekg(0);
+  }
+
+  InterfilePDFSHeader hdr;
+  if (!hdr.parse(header_stream))
+    {
+      warning("Interfile parsing of PET projection data failed");
+      return 0;
+    }
+
+  char directory_name[max_filename_length];
+  get_directory_name(directory_name, filename.c_str());
+  char full_data_file_name[max_filename_length];
+  strcpy(full_data_file_name, hdr.data_file_name.c_str());
+  prepend_directory_name(full_data_file_name, directory_name);
+
+  for (unsigned int i=0; i<hdr.image_scaling_factors[0].size(); i++)
+    if (hdr.image_scaling_factors[0][i] != 1)
+      error("read_interfile_PDFS_compressed: image scaling factors different from 1 are not supported for compressed data");
+
+  assert(hdr.data_info_ptr !=0);
+
+  shared_ptr<iostream> data_in(new fstream (full_data_file_name, open_mode | ios::binary));
+  if (!data_in->good())
+    {
+      warning("interfile parsing: error opening file %s",full_data_file_name);
+      return 0;
+    }
+
+  return new ProjDataCompressed(hdr.get_exam_info_sptr(),
+                                hdr.data_info_ptr->create_shared_clone(),
+                                data_in,
+                                hdr.data_offset_each_dataset[0],
+                                hdr.segment_sequence,
+                                open_mode);
+}
+#endif
+
+//! write the header for \a pdfs, with an optional "data compression" keyword
+static Succeeded
+write_interfile_PDFS_header(const string& header_file_name,
+                            const string& data_file_name,
+                            const ProjDataFromStream& pdfs,
+                            const string& data_compression)
 {
 
   string header_name = header_file_name;
@@ -1211,6 +1600,8 @@ write_basic_interfile_PDFS_header(const string& header_file_name,
      ? "LITTLEENDIAN"
      : "BIGENDIAN")
 		<< endl;
+  if (data_compression != "none")
+    output_header << "data compression := " << data_compression << endl;
 
   
   if (is_spect)
@@ -1432,6 +1823,37 @@ write_basic_interfile_PDFS_header(const string& header_file_name,
   return Succeeded::yes;
 }
 
+Succeeded 
+write_basic_interfile_PDFS_header(const string& header_file_name,
+				  const string& data_file_name,
+				  const ProjDataFromStream& pdfs)
+{
+  return
+    write_interfile_PDFS_header(header_file_name, data_file_name, pdfs, "none");
+}
+
+#ifdef HAVE_ZLIB
+Succeeded 
+write_basic_interfile_PDFS_header(const string& header_file_name,
+				  const string& data_file_name,
+				  const ProjDataCompressed& pdc)
+{
+  // ProjDataCompressed stores floats in little endian, sinogram by sinogram.
+  // We use a ProjDataFromStream (without stream) to write the header with that information.
+  const ProjDataFromStream pdfs(pdc.get_exam_info_sptr(),
+                                pdc.get_proj_data_info_sptr()->create_shared_clone(),
+                                shared_ptr<iostream>(),
+                                pdc.get_offset_in_stream(),
+                                pdc.get_segment_sequence_in_stream(),
+                                ProjDataFromStream::Segment_AxialPos_View_TangPos,
+                                NumericType::FLOAT,
+                                ByteOrder::little_endian,
+                                1.F);
+  return
+    write_interfile_PDFS_header(header_file_name, data_file_name, pdfs, "deflate");
+}
+#endif
+
 Succeeded
 write_basic_interfile_PDFS_header(const string& data_filename,
 			    const ProjDataFromStream& pdfs)
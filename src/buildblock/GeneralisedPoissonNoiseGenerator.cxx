@@ -28,6 +28,7 @@
 #include "stir/SegmentByView.h"
 #include "stir/Succeeded.h"
 #include "stir/round.h"
+#include "stir/numerics/Philox4x32.h"
 
 #include <boost/random/uniform_01.hpp>
 #include <boost/random/normal_distribution.hpp>
@@ -42,7 +43,8 @@ GeneralisedPoissonNoiseGenerator::
 GeneralisedPoissonNoiseGenerator(const float scaling_factor,
                                  const bool preserve_mean)
   : scaling_factor(scaling_factor),
-    preserve_mean(preserve_mean)
+    preserve_mean(preserve_mean),
+    use_counter_based_generator(false)
 {
   this->seed(43u);
 }
@@ -54,6 +56,22 @@ seed(unsigned int value)
   if (value==unsigned(0))
    error("Seed value has to be non-zero");
   this->generator.seed(static_cast<poisson_result_type>(value));
+  this->counter_based_seed = value;
+  this->next_index = 0;
+}
+
+void
+GeneralisedPoissonNoiseGenerator::
+set_use_counter_based_generator(const bool value)
+{
+  this->use_counter_based_generator = value;
+}
+
+bool
+GeneralisedPoissonNoiseGenerator::
+get_use_counter_based_generator() const
+{
+  return this->use_counter_based_generator;
 }
 
 // function that generates a Poisson noise realisation, i.e. without
@@ -116,10 +134,72 @@ generate_scaled_poisson_random(const float mu, const float scaling_factor, const
     : static_cast<float>(random_poisson);
 }
 
+// same as generate_poisson_random, but using 2 uniform random numbers
+// computed from the index with the counter-based generator
+static unsigned int
+generate_poisson_random_counter_based(const float mu, const unsigned int seed, const boost::uint64_t index)
+{
+  Philox4x32::counter_type counter;
+  counter.v[0] = static_cast<Philox4x32::value_type>(index);
+  counter.v[1] = static_cast<Philox4x32::value_type>(index >> 32);
+  counter.v[2] = 0;
+  counter.v[3] = 0;
+  Philox4x32::key_type key;
+  key.v[0] = seed;
+  key.v[1] = 0;
+  const Philox4x32::counter_type random_bits = Philox4x32::generate(counter, key);
+  const double u1 = Philox4x32::to_uniform01(random_bits.v[0], random_bits.v[1]);
+  const double u2 = Philox4x32::to_uniform01(random_bits.v[2], random_bits.v[3]);
+
+  if (mu > 60.F)
+  {
+    // normal distribution with mean=mu and sigma=sqrt(mu) using the Box-Muller transform
+    // (1-u1 is in (0,1], avoiding log(0))
+    const double normal01 = sqrt(-2*log(1-u1)) * cos(2*_PI*u2);
+    const double random=normal01*sqrt(mu) + mu;
+
+    return static_cast<unsigned>(random<=0 ? 0 : round(random));
+  }
+  else
+  {
+    // prevent problems of n growing too large (or even to infinity) 
+    // when u is very close to 1
+    const double u = std::min(u1, 1-1.E-6);
+  
+    const double upper = exp(mu)*u;
+    double accum = 1.;
+    double term = 1.; 
+    unsigned int n = 1;
+  
+    while(accum <upper)
+    {
+      accum += (term *= mu/n); 
+      n++;
+    }
+    
+    return (n - 1);
+  }
+}
+
+float
+GeneralisedPoissonNoiseGenerator::
+generate_scaled_poisson_random_counter_based(const float mu, const boost::uint64_t index) const
+{
+  const unsigned int random_poisson =
+    generate_poisson_random_counter_based(mu*scaling_factor, this->counter_based_seed, index);
+  return
+    preserve_mean
+    ? random_poisson / scaling_factor
+    : static_cast<float>(random_poisson);
+}
+
 float
 GeneralisedPoissonNoiseGenerator::
 generate_random(const float mu)
 {
+  if (this->use_counter_based_generator)
+    return
+      generate_scaled_poisson_random_counter_based(mu, this->next_index++);
   return
     generate_scaled_poisson_random(mu, scaling_factor, preserve_mean);
 }
@@ -137,6 +217,7 @@ generate_random(ProjData& output_projdata,
     SegmentByView<float> seg_output= 
       output_projdata.get_empty_segment_by_view(seg);
   
+    // in counter-based mode, the index continues over segments
     this->generate_random(seg_output, input_projdata.get_segment_by_view(seg));
     if (output_projdata.set_segment(seg_output) == Succeeded::no)
       error("Problem writing to projection data");
@@ -39,6 +39,13 @@
 #include "stir/IO/interfile.h"
 #include "stir/ProjDataInterfile.h"
 #include "stir/ProjDataFromStream.h" // needed for converting ProjDataFromStream* to ProjData*
+#include "stir/ProjDataMemoryMapped.h" // needed for converting ProjDataMemoryMapped* to ProjData*
+#ifdef HAVE_ZLIB
+#include "stir/ProjDataCompressed.h" // needed for converting ProjDataCompressed* to ProjData*
+#endif
+#ifdef HAVE_PREAD
+#include "stir/ProjDataPositionalIO.h" // needed for converting ProjDataPositionalIO* to ProjData*
+#endif
 
 #ifndef STIR_USE_GE_IO
 #include "stir/ProjDataGEAdvance.h"
@@ -85,7 +92,12 @@ START_NAMESPACE_STIR
    Currently supported:
    <ul>
    <li> GE VOLPET data (via class ProjDataVOLPET)
-   <li> Interfile (using  read_interfile_PDFS())
+   <li> Interfile (using  read_interfile_PDFS()). If the filename is followed by
+        \c ",mmap", the data file is memory-mapped using read_interfile_PDFS_memory_mapped().
+        If it is followed by \c ",pread", the data file is accessed with positional I/O
+        using read_interfile_PDFS_positional_io() (when available).
+        Compressed data (with <tt>data compression := deflate</tt>) are read via
+        read_interfile_PDFS_compressed() (only when STIR is compiled with zlib).
    <li> ECAT 7 3D sinograms and attenuation files 
    </ul>
 
@@ -185,9 +197,35 @@ read_from_file(const string& filename,
 #ifndef NDEBUG
     warning("ProjData::read_from_file trying to read %s as Interfile", filename.c_str());
 #endif
-    shared_ptr<ProjData> ptr(read_interfile_PDFS(filename, openmode));
-    if (!is_null_ptr(ptr))
-      return ptr;
+    if (filename.substr(actual_filename.size()) == ",mmap")
+      {
+        shared_ptr<ProjData> ptr(read_interfile_PDFS_memory_mapped(actual_filename, openmode));
+        if (!is_null_ptr(ptr))
+          return ptr;
+      }
+    else if (filename.substr(actual_filename.size()) == ",pread")
+      {
+#ifdef HAVE_PREAD
+        shared_ptr<ProjData> ptr(read_interfile_PDFS_positional_io(actual_filename, openmode));
+        if (!is_null_ptr(ptr))
+          return ptr;
+#else
+        error("ProjData::read_from_file: positional I/O (\",pread\") is not supported on this system");
+#endif
+      }
+    else
+      {
+#ifdef HAVE_ZLIB
+        {
+          shared_ptr<ProjData> ptr(read_interfile_PDFS_compressed(filename, openmode));
+          if (!is_null_ptr(ptr))
+            return ptr;
+        }
+#endif
+        shared_ptr<ProjData> ptr(read_interfile_PDFS(filename, openmode));
+        if (!is_null_ptr(ptr))
+          return ptr;
+      }
   }
 
 
@@ -305,6 +343,12 @@ ProjData::set_related_viewgrams( const RelatedViewgrams<float>& viewgrams)
   return Succeeded::yes;
 }
 
+bool
+ProjData::supports_concurrent_access() const
+{
+  return false;
+}
+
 #if 0
   for (int i=0; i<viewgrams.get_num_viewgrams(); ++i)
   {
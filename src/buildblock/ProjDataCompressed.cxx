@@ -0,0 +1,547 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projdata
+  \brief Implementations for non-inline functions of class stir::ProjDataCompressed
+*/
+
+#include "stir/ProjDataCompressed.h"
+#include "stir/deflate_float_blocks.h"
+#include "stir/Succeeded.h"
+#include "stir/Viewgram.h"
+#include "stir/Sinogram.h"
+#include "stir/SegmentBySinogram.h"
+#include "stir/SegmentByView.h"
+#include "stir/IndexRange2D.h"
+#include "stir/is_null_ptr.h"
+#include "stir/error.h"
+#include "stir/warning.h"
+#include <algorithm>
+
+#ifndef STIR_NO_NAMESPACES
+using std::vector;
+using std::size_t;
+using std::streamoff;
+#endif
+
+START_NAMESPACE_STIR
+
+const std::size_t
+ProjDataCompressed::
+max_num_unmodified_cached_segments;
+
+ProjDataCompressed::
+ProjDataCompressed(shared_ptr<ExamInfo> const& exam_info_sptr,
+                   shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                   shared_ptr<std::iostream> const& s,
+                   const streamoff offset_v,
+                   const vector<int>& segment_sequence_in_stream,
+                   const std::ios::openmode open_mode,
+                   const int compression_level_v,
+                   const bool byte_shuffle_v)
+  : ProjData(exam_info_sptr, proj_data_info_sptr),
+    sino_stream(s),
+    offset(offset_v),
+    segment_sequence(segment_sequence_in_stream),
+    writable((open_mode & std::ios::out) != 0),
+    compression_level(compression_level_v),
+    byte_shuffle(byte_shuffle_v),
+    data_end(0),
+    index_modified(false)
+{
+  this->initialise();
+}
+
+ProjDataCompressed::
+ProjDataCompressed(shared_ptr<ExamInfo> const& exam_info_sptr,
+                   shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                   shared_ptr<std::iostream> const& s,
+                   const streamoff offset_v,
+                   const std::ios::openmode open_mode,
+                   const int compression_level_v,
+                   const bool byte_shuffle_v)
+  : ProjData(exam_info_sptr, proj_data_info_sptr),
+    sino_stream(s),
+    offset(offset_v),
+    writable((open_mode & std::ios::out) != 0),
+    compression_level(compression_level_v),
+    byte_shuffle(byte_shuffle_v),
+    data_end(0),
+    index_modified(false)
+{
+  for (int segment_num = this->get_min_segment_num();
+       segment_num <= this->get_max_segment_num();
+       ++segment_num)
+    this->segment_sequence.push_back(segment_num);
+  this->initialise();
+}
+
+void
+ProjDataCompressed::
+initialise()
+{
+  if (is_null_ptr(this->sino_stream) || !this->sino_stream->good())
+    error("ProjDataCompressed: error with the stream");
+  if (static_cast<int>(this->segment_sequence.size()) != this->get_num_segments())
+    error("ProjDataCompressed: segment sequence has wrong size");
+  if (this->compression_level < 1 || this->compression_level > 9)
+    error("ProjDataCompressed: compression level should be between 1 and 9 but is %d",
+          this->compression_level);
+
+  // find the first block of every segment
+  size_t num_blocks = 0;
+  this->segment_first_block.resize(this->segment_sequence.size());
+  for (size_t i=0; i<this->segment_sequence.size(); ++i)
+    {
+      this->segment_first_block[i] = num_blocks;
+      num_blocks += static_cast<size_t>(this->get_num_axial_poss(this->segment_sequence[i]));
+    }
+  this->blocks.resize(num_blocks);
+  this->cached_segments.resize(this->segment_sequence.size());
+  this->cached_segment_is_modified.resize(this->segment_sequence.size(), false);
+
+  this->sino_stream->seekg(0, std::ios::end);
+  const streamoff end_of_stream = static_cast<streamoff>(this->sino_stream->tellg());
+  if (end_of_stream <= this->offset)
+    {
+      // new data
+      if (!this->writable)
+        error("ProjDataCompressed: stream is empty but was not opened for writing");
+      // make sure that the index is written, even if no data are set
+      this->index_modified = true;
+    }
+  else if (this->read_index() == Succeeded::no)
+    error("ProjDataCompressed: error reading the index of the compressed data");
+}
+
+ProjDataCompressed::
+~ProjDataCompressed()
+{
+  if (this->writable)
+    this->flush();
+}
+
+bool
+ProjDataCompressed::
+is_writable() const
+{
+  return this->writable;
+}
+
+boost::uint64_t
+ProjDataCompressed::
+get_compressed_size() const
+{
+  boost::uint64_t size = 0;
+  for (vector<BlockInfo>::const_iterator iter = this->blocks.begin(); iter != this->blocks.end(); ++iter)
+    size += iter->size;
+  return size;
+}
+
+Succeeded
+ProjDataCompressed::
+read_index()
+{
+  return
+    detail::read_deflate_block_index(*this->sino_stream, this->offset,
+                                     this->blocks, this->byte_shuffle, this->data_end);
+}
+
+Succeeded
+ProjDataCompressed::
+flush()
+{
+  if (!this->writable)
+    return Succeeded::yes;
+  for (size_t i=0; i<this->cached_segments.size(); ++i)
+    if (this->cached_segment_is_modified[i])
+      {
+        if (this->write_segment(*this->cached_segments[i]) == Succeeded::no)
+          return Succeeded::no;
+        // free the memory
+        this->cached_segments[i].reset();
+        this->cached_segment_is_modified[i] = false;
+      }
+  std::iostream& s = *this->sino_stream;
+  if (this->index_modified)
+    {
+      // the index is written after the last block. It will be overwritten
+      // when new blocks are appended (and then written again)
+      s.seekp(this->offset + static_cast<streamoff>(this->data_end));
+      if (detail::write_deflate_block_index(s, this->blocks, this->byte_shuffle) == Succeeded::no)
+        return Succeeded::no;
+      this->index_modified = false;
+    }
+  s.flush();
+  if (!s)
+    {
+      warning("ProjDataCompressed: error writing the index");
+      return Succeeded::no;
+    }
+  return Succeeded::yes;
+}
+
+size_t
+ProjDataCompressed::
+get_segment_index(const int segment_num) const
+{
+  const vector<int>::const_iterator iter =
+    std::find(segment_sequence.begin(), segment_sequence.end(), segment_num);
+  if (iter == segment_sequence.end())
+    error("ProjDataCompressed: segment_num out of range : %d", segment_num);
+  return static_cast<size_t>(iter - segment_sequence.begin());
+}
+
+size_t
+ProjDataCompressed::
+get_block_num(const int segment_num, const int axial_pos_num) const
+{
+  const size_t segment_index = get_segment_index(segment_num);
+  if (axial_pos_num < get_min_axial_pos_num(segment_num) || axial_pos_num > get_max_axial_pos_num(segment_num))
+    error("ProjDataCompressed: axial_pos_num out of range : %d", axial_pos_num);
+  return
+    segment_first_block[segment_index] +
+    static_cast<size_t>(axial_pos_num - get_min_axial_pos_num(segment_num));
+}
+
+SegmentBySinogram<float>&
+ProjDataCompressed::
+get_cached_segment(const int segment_num) const
+{
+  const size_t segment_index = get_segment_index(segment_num);
+  if (is_null_ptr(this->cached_segments[segment_index]))
+    {
+      this->cached_segments[segment_index].reset(new SegmentBySinogram<float>(get_segment_by_sinogram(segment_num)));
+      this->unmodified_cached_segments.push_back(segment_index);
+      if (this->unmodified_cached_segments.size() > max_num_unmodified_cached_segments)
+        {
+          this->cached_segments[this->unmodified_cached_segments.front()].reset();
+          this->unmodified_cached_segments.pop_front();
+        }
+    }
+  return *this->cached_segments[segment_index];
+}
+
+void
+ProjDataCompressed::
+remove_cached_segment(const size_t segment_index)
+{
+  this->cached_segments[segment_index].reset();
+  this->cached_segment_is_modified[segment_index] = false;
+  this->unmodified_cached_segments.erase(std::remove(this->unmodified_cached_segments.begin(),
+                                                     this->unmodified_cached_segments.end(),
+                                                     segment_index),
+                                         this->unmodified_cached_segments.end());
+}
+
+Succeeded
+ProjDataCompressed::
+read_block(Array<2,float>& sinogram, const size_t block_num) const
+{
+  const BlockInfo block = this->blocks[block_num];
+  if (block.size == 0)
+    {
+      sinogram.fill(0.F);
+      return Succeeded::yes;
+    }
+
+  vector<unsigned char> compressed(static_cast<size_t>(block.size));
+  bool read_ok;
+#ifdef STIR_OPENMP
+#pragma omp critical(PROJDATACOMPRESSED_STREAM)
+#endif
+  {
+    this->sino_stream->seekg(this->offset + static_cast<streamoff>(block.offset));
+    this->sino_stream->read(reinterpret_cast<char *>(&compressed[0]), static_cast<std::streamsize>(block.size));
+    read_ok = !this->sino_stream->fail();
+    this->sino_stream->clear();
+  }
+  if (!read_ok)
+    {
+      warning("ProjDataCompressed: error reading block %lu from stream", static_cast<unsigned long>(block_num));
+      return Succeeded::no;
+    }
+
+  const size_t num_elements = static_cast<size_t>(get_num_views()) * get_num_tangential_poss();
+  vector<float> buffer(num_elements);
+  if (detail::inflate_float_block(&buffer[0], num_elements, compressed, this->byte_shuffle) == Succeeded::no)
+    {
+      warning("ProjDataCompressed: error decompressing block %lu", static_cast<unsigned long>(block_num));
+      return Succeeded::no;
+    }
+
+  vector<float>::iterator buffer_iter = buffer.begin();
+  for (int view_num = sinogram.get_min_index(); view_num <= sinogram.get_max_index(); ++view_num)
+    {
+      Array<1,float>& row = sinogram[view_num];
+      for (Array<1,float>::iterator iter = row.begin(); iter != row.end(); ++iter, ++buffer_iter)
+        *iter = *buffer_iter;
+    }
+  return Succeeded::yes;
+}
+
+Succeeded
+ProjDataCompressed::
+compress_block(vector<unsigned char>& compressed, const Array<2,float>& sinogram) const
+{
+  const size_t num_elements = static_cast<size_t>(get_num_views()) * get_num_tangential_poss();
+  vector<float> buffer;
+  buffer.reserve(num_elements);
+  for (int view_num = sinogram.get_min_index(); view_num <= sinogram.get_max_index(); ++view_num)
+    buffer.insert(buffer.end(), sinogram[view_num].begin(), sinogram[view_num].end());
+  assert(buffer.size() == num_elements);
+  return
+    detail::deflate_float_block(compressed, &buffer[0], num_elements,
+                                this->compression_level, this->byte_shuffle);
+}
+
+Succeeded
+ProjDataCompressed::
+append_block(const vector<unsigned char>& compressed, const size_t block_num)
+{
+  bool write_ok;
+#ifdef STIR_OPENMP
+#pragma omp critical(PROJDATACOMPRESSED_STREAM)
+#endif
+  {
+    this->sino_stream->seekp(this->offset + static_cast<streamoff>(this->data_end));
+    this->sino_stream->write(reinterpret_cast<const char *>(&compressed[0]),
+                             static_cast<std::streamsize>(compressed.size()));
+    write_ok = !this->sino_stream->fail();
+    if (write_ok)
+      {
+        this->blocks[block_num].offset = this->data_end;
+        this->blocks[block_num].size = compressed.size();
+        this->data_end += compressed.size();
+        this->index_modified = true;
+      }
+  }
+  if (!write_ok)
+    {
+      warning("ProjDataCompressed: error writing block %lu to stream", static_cast<unsigned long>(block_num));
+      return Succeeded::no;
+    }
+  return Succeeded::yes;
+}
+
+Succeeded
+ProjDataCompressed::
+write_block(const Array<2,float>& sinogram, const size_t block_num)
+{
+  vector<unsigned char> compressed;
+  if (compress_block(compressed, sinogram) == Succeeded::no)
+    return Succeeded::no;
+  return append_block(compressed, block_num);
+}
+
+Viewgram<float>
+ProjDataCompressed::
+get_viewgram(const int view_num, const int segment_num,
+             const bool make_num_tangential_poss_odd) const
+{
+  if (view_num < get_min_view_num() || view_num > get_max_view_num())
+    error("ProjDataCompressed: view_num out of range : %d", view_num);
+  // every sinogram needs to be decompressed, so keep them for the other viewgrams
+  Viewgram<float> viewgram = get_cached_segment(segment_num).get_viewgram(view_num);
+
+  if (make_num_tangential_poss_odd && (get_num_tangential_poss()%2==0))
+    {
+      const int new_max_tangential_pos = get_max_tangential_pos_num() + 1;
+      viewgram.grow(IndexRange2D(get_min_axial_pos_num(segment_num),
+                                 get_max_axial_pos_num(segment_num),
+                                 get_min_tangential_pos_num(),
+                                 new_max_tangential_pos));
+    }
+  return viewgram;
+}
+
+Sinogram<float>
+ProjDataCompressed::
+get_sinogram(const int ax_pos_num, const int segment_num,
+             const bool make_num_tangential_poss_odd) const
+{
+  Sinogram<float> sinogram(proj_data_info_ptr, ax_pos_num, segment_num);
+  const size_t block_num = get_block_num(segment_num, ax_pos_num);
+  const shared_ptr<SegmentBySinogram<float> > cached_segment_sptr =
+    this->cached_segments[get_segment_index(segment_num)];
+  if (!is_null_ptr(cached_segment_sptr))
+    sinogram = cached_segment_sptr->get_sinogram(ax_pos_num);
+  else if (read_block(sinogram, block_num) == Succeeded::no)
+    error("ProjDataCompressed: error reading sinogram %d of segment %d", ax_pos_num, segment_num);
+
+  if (make_num_tangential_poss_odd && (get_num_tangential_poss()%2==0))
+    {
+      const int new_max_tangential_pos = get_max_tangential_pos_num() + 1;
+      sinogram.grow(IndexRange2D(get_min_view_num(),
+                                 get_max_view_num(),
+                                 get_min_tangential_pos_num(),
+                                 new_max_tangential_pos));
+    }
+  return sinogram;
+}
+
+Succeeded
+ProjDataCompressed::
+set_viewgram(const Viewgram<float>& v)
+{
+  if (!this->writable)
+    {
+      warning("ProjDataCompressed::set_viewgram: stream was opened read-only");
+      return Succeeded::no;
+    }
+  if (*get_proj_data_info_ptr() != *(v.get_proj_data_info_ptr()))
+    {
+      warning("ProjDataCompressed::set_viewgram: viewgram has incompatible ProjDataInfo");
+      return Succeeded::no;
+    }
+  const int segment_num = v.get_segment_num();
+  const size_t segment_index = get_segment_index(segment_num);
+  // modify the segment in memory. It is written by flush()
+  get_cached_segment(segment_num).set_viewgram(v);
+  if (!this->cached_segment_is_modified[segment_index])
+    {
+      this->cached_segment_is_modified[segment_index] = true;
+      this->unmodified_cached_segments.erase(std::remove(this->unmodified_cached_segments.begin(),
+                                                         this->unmodified_cached_segments.end(),
+                                                         segment_index),
+                                             this->unmodified_cached_segments.end());
+    }
+  return Succeeded::yes;
+}
+
+Succeeded
+ProjDataCompressed::
+set_sinogram(const Sinogram<float>& s)
+{
+  if (!this->writable)
+    {
+      warning("ProjDataCompressed::set_sinogram: stream was opened read-only");
+      return Succeeded::no;
+    }
+  if (*get_proj_data_info_ptr() != *(s.get_proj_data_info_ptr()))
+    {
+      warning("ProjDataCompressed::set_sinogram: sinogram has incompatible ProjDataInfo");
+      return Succeeded::no;
+    }
+  const int segment_num = s.get_segment_num();
+  const size_t segment_index = get_segment_index(segment_num);
+  if (!is_null_ptr(this->cached_segments[segment_index]))
+    {
+      this->cached_segments[segment_index]->set_sinogram(s);
+      // a modified segment will be written by flush()
+      if (this->cached_segment_is_modified[segment_index])
+        return Succeeded::yes;
+    }
+  return
+    write_block(s, get_block_num(segment_num, s.get_axial_pos_num()));
+}
+
+SegmentBySinogram<float>
+ProjDataCompressed::
+get_segment_by_sinogram(const int segment_num) const
+{
+  const shared_ptr<SegmentBySinogram<float> > cached_segment_sptr =
+    this->cached_segments[get_segment_index(segment_num)];
+  if (!is_null_ptr(cached_segment_sptr))
+    return *cached_segment_sptr;
+
+  SegmentBySinogram<float> segment =
+    proj_data_info_ptr->get_empty_segment_by_sinogram(segment_num, false);
+  const int min_ax_pos_num = get_min_axial_pos_num(segment_num);
+  const int max_ax_pos_num = get_max_axial_pos_num(segment_num);
+  const size_t first_block_num = get_block_num(segment_num, min_ax_pos_num);
+  int num_errors = 0;
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int ax_pos_num = min_ax_pos_num; ax_pos_num <= max_ax_pos_num; ++ax_pos_num)
+    if (read_block(segment[ax_pos_num], first_block_num + static_cast<size_t>(ax_pos_num - min_ax_pos_num))
+        == Succeeded::no)
+      {
+#ifdef STIR_OPENMP
+#pragma omp atomic
+#endif
+        ++num_errors;
+      }
+  if (num_errors > 0)
+    error("ProjDataCompressed: error reading segment %d", segment_num);
+  return segment;
+}
+
+SegmentByView<float>
+ProjDataCompressed::
+get_segment_by_view(const int segment_num) const
+{
+  return SegmentByView<float>(get_segment_by_sinogram(segment_num));
+}
+
+Succeeded
+ProjDataCompressed::
+set_segment(const SegmentBySinogram<float>& segment)
+{
+  if (!this->writable)
+    {
+      warning("ProjDataCompressed::set_segment: stream was opened read-only");
+      return Succeeded::no;
+    }
+  if (*get_proj_data_info_ptr() != *(segment.get_proj_data_info_ptr()))
+    {
+      warning("ProjDataCompressed::set_segment: segment has incompatible ProjDataInfo");
+      return Succeeded::no;
+    }
+  // the whole segment is overwritten, so the segment in memory is no longer needed
+  this->remove_cached_segment(get_segment_index(segment.get_segment_num()));
+  return write_segment(segment);
+}
+
+Succeeded
+ProjDataCompressed::
+write_segment(const SegmentBySinogram<float>& segment)
+{
+  const int segment_num = segment.get_segment_num();
+  const int min_ax_pos_num = get_min_axial_pos_num(segment_num);
+  const int max_ax_pos_num = get_max_axial_pos_num(segment_num);
+  const size_t first_block_num = get_block_num(segment_num, min_ax_pos_num);
+  int num_errors = 0;
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int ax_pos_num = min_ax_pos_num; ax_pos_num <= max_ax_pos_num; ++ax_pos_num)
+    {
+      vector<unsigned char> compressed;
+      if (compress_block(compressed, segment[ax_pos_num]) == Succeeded::no ||
+          append_block(compressed, first_block_num + static_cast<size_t>(ax_pos_num - min_ax_pos_num))
+          == Succeeded::no)
+        {
+#ifdef STIR_OPENMP
+#pragma omp atomic
+#endif
+          ++num_errors;
+        }
+    }
+  return num_errors == 0 ? Succeeded::yes : Succeeded::no;
+}
+
+Succeeded
+ProjDataCompressed::
+set_segment(const SegmentByView<float>& segment)
+{
+  return set_segment(SegmentBySinogram<float>(segment));
+}
+
+END_NAMESPACE_STIR
@@ -0,0 +1,79 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projdata
+  \brief Implementations for non-inline functions of class stir::ProjDataInterfileCompressed
+*/
+
+#include "stir/ProjDataInterfileCompressed.h"
+#include "stir/utilities.h"
+#include "stir/IO/interfile.h"
+#include "stir/Succeeded.h"
+#include "stir/error.h"
+#include <fstream>
+
+#ifndef STIR_NO_NAMESPACES
+using std::string;
+using std::ios;
+#endif
+
+START_NAMESPACE_STIR
+
+string
+ProjDataInterfileCompressed::
+get_data_filename(const string& filename)
+{
+  string data_name=filename;
+  string::size_type pos=find_pos_of_extension(filename);
+  if (pos!=string::npos && filename.substr(pos)==".hs")
+    replace_extension(data_name, ".sz");
+  else
+    add_extension(data_name, ".sz");
+  return data_name;
+}
+
+shared_ptr<std::iostream>
+ProjDataInterfileCompressed::
+create_stream(const string& filename)
+{
+  const string data_name = get_data_filename(filename);
+  shared_ptr<std::iostream> sino_stream(
+    new std::fstream(data_name.c_str(), ios::in|ios::out|ios::trunc|ios::binary));
+  if (!sino_stream->good())
+    error("ProjDataInterfileCompressed: error opening output file %s", data_name.c_str());
+  return sino_stream;
+}
+
+ProjDataInterfileCompressed::
+ProjDataInterfileCompressed(shared_ptr<ExamInfo> const& exam_info_sptr,
+                            shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                            const string& filename,
+                            const int compression_level,
+                            const bool byte_shuffle)
+  : ProjDataCompressed(exam_info_sptr, proj_data_info_sptr,
+                       create_stream(filename), 0,
+                       ios::in|ios::out, compression_level, byte_shuffle)
+{
+  const string data_name = get_data_filename(filename);
+  string header_name = data_name;
+  replace_extension(header_name, ".hs");
+  if (write_basic_interfile_PDFS_header(header_name, data_name, *this) == Succeeded::no)
+    error("ProjDataInterfileCompressed: error writing header %s", header_name.c_str());
+}
+
+END_NAMESPACE_STIR
@@ -0,0 +1,281 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projdata
+  \brief Implementations for non-inline functions of class stir::ProjDataMemoryMapped
+*/
+
+#include "stir/ProjDataMemoryMapped.h"
+#include "stir/Succeeded.h"
+#include "stir/Viewgram.h"
+#include "stir/Sinogram.h"
+#include "stir/IndexRange2D.h"
+#include "stir/error.h"
+#include "stir/warning.h"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cstring>
+
+#ifndef STIR_NO_NAMESPACES
+using std::vector;
+using std::string;
+using std::size_t;
+using std::streamoff;
+#endif
+
+START_NAMESPACE_STIR
+
+ProjDataMemoryMapped::
+ProjDataMemoryMapped(shared_ptr<ExamInfo> const& exam_info_sptr,
+                     shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                     const string& filename_v,
+                     const streamoff offset,
+                     const vector<int>& segment_sequence_in_file,
+                     StorageOrder storage_order_v,
+                     ByteOrder byte_order,
+                     float scale_factor_v,
+                     const std::ios::openmode open_mode)
+  : ProjData(exam_info_sptr, proj_data_info_sptr),
+    filename(filename_v),
+    data_ptr(0),
+    writable((open_mode & std::ios::out) != 0),
+    storage_order(storage_order_v),
+    on_disk_byte_order(byte_order),
+    scale_factor(scale_factor_v),
+    layout(*proj_data_info_sptr, segment_sequence_in_file, storage_order_v, "ProjDataMemoryMapped")
+{
+  if (writable && scale_factor != 1.F)
+    error("ProjDataMemoryMapped: cannot write to file %s with a scale factor different from 1",
+          filename.c_str());
+  const size_t total_num_elements = this->layout.get_total_num_elements();
+
+  using namespace boost::interprocess;
+  const boost::interprocess::mode_t mode = writable ? read_write : read_only;
+  try
+    {
+      file_mapping mapping(filename.c_str(), mode);
+      // note: the mapping stays valid after mapping is destructed
+      this->region_sptr.reset(new mapped_region(mapping, mode));
+    }
+  catch (interprocess_exception& e)
+    {
+      error("ProjDataMemoryMapped: error mapping file %s: %s", filename.c_str(), e.what());
+    }
+
+  const size_t num_bytes_needed =
+    static_cast<size_t>(offset) + total_num_elements*sizeof(float);
+  if (this->region_sptr->get_size() < num_bytes_needed)
+    error("ProjDataMemoryMapped: file %s is too small (%lu bytes) for the projection data (%lu bytes needed)",
+          filename.c_str(),
+          static_cast<unsigned long>(this->region_sptr->get_size()),
+          static_cast<unsigned long>(num_bytes_needed));
+
+  this->data_ptr = static_cast<char *>(this->region_sptr->get_address()) + offset;
+  // tell the OS that we will generally read large chunks
+  this->region_sptr->advise(mapped_region::advice_sequential);
+}
+
+ProjDataMemoryMapped::
+~ProjDataMemoryMapped()
+{
+  if (this->writable)
+    this->flush();
+}
+
+bool
+ProjDataMemoryMapped::
+is_writable() const
+{
+  return this->writable;
+}
+
+bool
+ProjDataMemoryMapped::
+supports_concurrent_access() const
+{
+  return true;
+}
+
+Succeeded
+ProjDataMemoryMapped::
+flush()
+{
+  if (!this->writable)
+    return Succeeded::yes;
+  return this->region_sptr->flush() ? Succeeded::yes : Succeeded::no;
+}
+
+void
+ProjDataMemoryMapped::
+read_row(Array<1,float>& row, const size_t offset) const
+{
+  const size_t num_elements = static_cast<size_t>(get_num_tangential_poss());
+  // use memcpy as the data in the file might not be aligned
+  float * row_ptr = row.get_data_ptr();
+  std::memcpy(row_ptr, this->data_ptr + offset*sizeof(float), num_elements*sizeof(float));
+  if (!on_disk_byte_order.is_native_order())
+    for (size_t i=0; i<num_elements; ++i)
+      ByteOrder::swap_order(row_ptr[i]);
+  if (scale_factor != 1.F)
+    for (size_t i=0; i<num_elements; ++i)
+      row_ptr[i] *= scale_factor;
+  row.release_data_ptr();
+}
+
+void
+ProjDataMemoryMapped::
+write_row(const Array<1,float>& row, const size_t offset)
+{
+  const size_t num_elements = static_cast<size_t>(get_num_tangential_poss());
+  char * const out_ptr = this->data_ptr + offset*sizeof(float);
+  const float * row_ptr = row.get_const_data_ptr();
+  if (on_disk_byte_order.is_native_order())
+    std::memcpy(out_ptr, row_ptr, num_elements*sizeof(float));
+  else
+    for (size_t i=0; i<num_elements; ++i)
+      {
+        float value = row_ptr[i];
+        ByteOrder::swap_order(value);
+        std::memcpy(out_ptr + i*sizeof(float), &value, sizeof(float));
+      }
+  row.release_const_data_ptr();
+}
+
+Viewgram<float>
+ProjDataMemoryMapped::
+get_viewgram(const int view_num, const int segment_num,
+             const bool make_num_tangential_poss_odd) const
+{
+  Viewgram<float> viewgram(proj_data_info_ptr, view_num, segment_num);
+  for (int ax_pos_num = get_min_axial_pos_num(segment_num);
+       ax_pos_num <= get_max_axial_pos_num(segment_num);
+       ++ax_pos_num)
+    read_row(viewgram[ax_pos_num], layout.get_row_offset(segment_num, view_num, ax_pos_num));
+
+  if (make_num_tangential_poss_odd && (get_num_tangential_poss()%2==0))
+    {
+      const int new_max_tangential_pos = get_max_tangential_pos_num() + 1;
+      viewgram.grow(IndexRange2D(get_min_axial_pos_num(segment_num),
+                                 get_max_axial_pos_num(segment_num),
+                                 get_min_tangential_pos_num(),
+                                 new_max_tangential_pos));
+    }
+  return viewgram;
+}
+
+Sinogram<float>
+ProjDataMemoryMapped::
+get_sinogram(const int ax_pos_num, const int segment_num,
+             const bool make_num_tangential_poss_odd) const
+{
+  Sinogram<float> sinogram(proj_data_info_ptr, ax_pos_num, segment_num);
+  for (int view_num = get_min_view_num(); view_num <= get_max_view_num(); ++view_num)
+    read_row(sinogram[view_num], layout.get_row_offset(segment_num, view_num, ax_pos_num));
+
+  if (make_num_tangential_poss_odd && (get_num_tangential_poss()%2==0))
+    {
+      const int new_max_tangential_pos = get_max_tangential_pos_num() + 1;
+      sinogram.grow(IndexRange2D(get_min_view_num(),
+                                 get_max_view_num(),
+                                 get_min_tangential_pos_num(),
+                                 new_max_tangential_pos));
+    }
+  return sinogram;
+}
+
+Succeeded
+ProjDataMemoryMapped::
+set_viewgram(const Viewgram<float>& v)
+{
+  if (!this->writable)
+    {
+      warning("ProjDataMemoryMapped::set_viewgram: file %s was opened read-only", filename.c_str());
+      return Succeeded::no;
+    }
+  if (*get_proj_data_info_ptr() != *(v.get_proj_data_info_ptr()))
+    {
+      warning("ProjDataMemoryMapped::set_viewgram: viewgram has incompatible ProjDataInfo");
+      return Succeeded::no;
+    }
+  const int segment_num = v.get_segment_num();
+  const int view_num = v.get_view_num();
+  for (int ax_pos_num = get_min_axial_pos_num(segment_num);
+       ax_pos_num <= get_max_axial_pos_num(segment_num);
+       ++ax_pos_num)
+    write_row(v[ax_pos_num], layout.get_row_offset(segment_num, view_num, ax_pos_num));
+  return Succeeded::yes;
+}
+
+Succeeded
+ProjDataMemoryMapped::
+set_sinogram(const Sinogram<float>& s)
+{
+  if (!this->writable)
+    {
+      warning("ProjDataMemoryMapped::set_sinogram: file %s was opened read-only", filename.c_str());
+      return Succeeded::no;
+    }
+  if (*get_proj_data_info_ptr() != *(s.get_proj_data_info_ptr()))
+    {
+      warning("ProjDataMemoryMapped::set_sinogram: sinogram has incompatible ProjDataInfo");
+      return Succeeded::no;
+    }
+  const int segment_num = s.get_segment_num();
+  const int ax_pos_num = s.get_axial_pos_num();
+  for (int view_num = get_min_view_num(); view_num <= get_max_view_num(); ++view_num)
+    write_row(s[view_num], layout.get_row_offset(segment_num, view_num, ax_pos_num));
+  return Succeeded::yes;
+}
+
+float
+ProjDataMemoryMapped::
+get_bin_value(const Bin& bin) const
+{
+  if (bin.tangential_pos_num() < get_min_tangential_pos_num() ||
+      bin.tangential_pos_num() > get_max_tangential_pos_num())
+    error("ProjDataMemoryMapped: tangential_pos_num out of range : %d", bin.tangential_pos_num());
+  const size_t offset =
+    layout.get_row_offset(bin.segment_num(), bin.view_num(), bin.axial_pos_num()) +
+    (bin.tangential_pos_num() - get_min_tangential_pos_num());
+  float value;
+  std::memcpy(&value, this->data_ptr + offset*sizeof(float), sizeof(float));
+  on_disk_byte_order.swap_if_necessary(value);
+  return value * scale_factor;
+}
+
+const float *
+ProjDataMemoryMapped::
+get_const_data_ptr(const Bin& bin) const
+{
+  if (!on_disk_byte_order.is_native_order() || scale_factor != 1.F)
+    return 0;
+  if (bin.tangential_pos_num() < get_min_tangential_pos_num() ||
+      bin.tangential_pos_num() > get_max_tangential_pos_num())
+    error("ProjDataMemoryMapped: tangential_pos_num out of range : %d", bin.tangential_pos_num());
+  const size_t offset =
+    layout.get_row_offset(bin.segment_num(), bin.view_num(), bin.axial_pos_num()) +
+    (bin.tangential_pos_num() - get_min_tangential_pos_num());
+  const char * const ptr = this->data_ptr + offset*sizeof(float);
+  // check alignment
+  if (reinterpret_cast<std::size_t>(ptr) % sizeof(float) != 0)
+    return 0;
+  return reinterpret_cast<const float *>(ptr);
+}
+
+END_NAMESPACE_STIR
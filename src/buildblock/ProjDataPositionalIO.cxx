@@ -0,0 +1,319 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projdata
+  \brief Implementations for non-inline functions of class stir::ProjDataPositionalIO
+*/
+
+#include "stir/ProjDataPositionalIO.h"
+#include "stir/Succeeded.h"
+#include "stir/Viewgram.h"
+#include "stir/Sinogram.h"
+#include "stir/IndexRange2D.h"
+#include "stir/error.h"
+#include "stir/warning.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef STIR_NO_NAMESPACES
+using std::vector;
+using std::string;
+using std::size_t;
+using std::streamoff;
+#endif
+
+START_NAMESPACE_STIR
+
+// pread/pwrite can transfer less than asked for, or be interrupted, so we loop
+static bool
+pread_all(const int fd, char * buffer, size_t num_bytes, off_t file_offset)
+{
+  while (num_bytes > 0)
+    {
+      const ssize_t num_read = ::pread(fd, buffer, num_bytes, file_offset);
+      if (num_read < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+      if (num_read == 0)
+        return false; // end of file
+      buffer += num_read;
+      num_bytes -= static_cast<size_t>(num_read);
+      file_offset += num_read;
+    }
+  return true;
+}
+
+static bool
+pwrite_all(const int fd, const char * buffer, size_t num_bytes, off_t file_offset)
+{
+  while (num_bytes > 0)
+    {
+      const ssize_t num_written = ::pwrite(fd, buffer, num_bytes, file_offset);
+      if (num_written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+      buffer += num_written;
+      num_bytes -= static_cast<size_t>(num_written);
+      file_offset += num_written;
+    }
+  return true;
+}
+
+ProjDataPositionalIO::
+ProjDataPositionalIO(shared_ptr<ExamInfo> const& exam_info_sptr,
+                     shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                     const string& filename_v,
+                     const streamoff offset_v,
+                     const vector<int>& segment_sequence_in_file,
+                     StorageOrder storage_order_v,
+                     ByteOrder byte_order,
+                     float scale_factor_v,
+                     const std::ios::openmode open_mode)
+  : ProjData(exam_info_sptr, proj_data_info_sptr),
+    filename(filename_v),
+    file_descriptor(-1),
+    offset(offset_v),
+    writable((open_mode & std::ios::out) != 0),
+    storage_order(storage_order_v),
+    on_disk_byte_order(byte_order),
+    scale_factor(scale_factor_v),
+    layout(*proj_data_info_sptr, segment_sequence_in_file, storage_order_v, "ProjDataPositionalIO")
+{
+  if (writable && scale_factor != 1.F)
+    error("ProjDataPositionalIO: cannot write to file %s with a scale factor different from 1",
+          filename.c_str());
+  const size_t total_num_elements = this->layout.get_total_num_elements();
+
+  this->file_descriptor =
+    writable ? ::open(filename.c_str(), O_RDWR | O_CREAT, 0666) : ::open(filename.c_str(), O_RDONLY);
+  if (this->file_descriptor < 0)
+    error("ProjDataPositionalIO: error opening file %s: %s", filename.c_str(), std::strerror(errno));
+
+  if (!writable)
+    {
+      struct stat file_stat;
+      const size_t num_bytes_needed =
+        static_cast<size_t>(offset) + total_num_elements*sizeof(float);
+      if (::fstat(this->file_descriptor, &file_stat) != 0 ||
+          static_cast<size_t>(file_stat.st_size) < num_bytes_needed)
+        {
+          ::close(this->file_descriptor);
+          error("ProjDataPositionalIO: file %s is too small for the projection data (%lu bytes needed)",
+                filename.c_str(), static_cast<unsigned long>(num_bytes_needed));
+        }
+    }
+}
+
+ProjDataPositionalIO::
+~ProjDataPositionalIO()
+{
+  if (this->file_descriptor >= 0)
+    ::close(this->file_descriptor);
+}
+
+bool
+ProjDataPositionalIO::
+is_writable() const
+{
+  return this->writable;
+}
+
+bool
+ProjDataPositionalIO::
+supports_concurrent_access() const
+{
+  return true;
+}
+
+void
+ProjDataPositionalIO::
+read_rows(Array<2,float>& rows, const size_t first_offset, const size_t stride) const
+{
+  const size_t num_elements = static_cast<size_t>(get_num_tangential_poss());
+  const size_t num_rows = static_cast<size_t>(rows.get_length());
+  const off_t file_offset = static_cast<off_t>(this->offset + first_offset*sizeof(float));
+  // the rows of an Array<2,float> are not necessarily contiguous in memory, so read into a buffer
+  vector<float> buffer(num_rows * num_elements);
+  bool ok = true;
+  if (stride == num_elements)
+    ok = pread_all(this->file_descriptor, reinterpret_cast<char *>(&buffer[0]),
+                   buffer.size()*sizeof(float), file_offset);
+  else
+    for (size_t r=0; ok && r<num_rows; ++r)
+      ok = pread_all(this->file_descriptor, reinterpret_cast<char *>(&buffer[r*num_elements]),
+                     num_elements*sizeof(float),
+                     file_offset + static_cast<off_t>(r*stride*sizeof(float)));
+  if (!ok)
+    error("ProjDataPositionalIO: error reading from file %s", filename.c_str());
+
+  if (!on_disk_byte_order.is_native_order())
+    for (size_t i=0; i<buffer.size(); ++i)
+      ByteOrder::swap_order(buffer[i]);
+  if (scale_factor != 1.F)
+    for (size_t i=0; i<buffer.size(); ++i)
+      buffer[i] *= scale_factor;
+
+  size_t r = 0;
+  for (int row_num = rows.get_min_index(); row_num <= rows.get_max_index(); ++row_num, ++r)
+    std::copy(buffer.begin() + r*num_elements, buffer.begin() + (r+1)*num_elements,
+              rows[row_num].begin());
+}
+
+Succeeded
+ProjDataPositionalIO::
+write_rows(const Array<2,float>& rows, const size_t first_offset, const size_t stride)
+{
+  const size_t num_elements = static_cast<size_t>(get_num_tangential_poss());
+  const size_t num_rows = static_cast<size_t>(rows.get_length());
+  const off_t file_offset = static_cast<off_t>(this->offset + first_offset*sizeof(float));
+  vector<float> buffer(num_rows * num_elements);
+  size_t r = 0;
+  for (int row_num = rows.get_min_index(); row_num <= rows.get_max_index(); ++row_num, ++r)
+    std::copy(rows[row_num].begin(), rows[row_num].begin() + num_elements,
+              buffer.begin() + r*num_elements);
+  if (!on_disk_byte_order.is_native_order())
+    for (size_t i=0; i<buffer.size(); ++i)
+      ByteOrder::swap_order(buffer[i]);
+
+  bool ok = true;
+  if (stride == num_elements)
+    ok = pwrite_all(this->file_descriptor, reinterpret_cast<const char *>(&buffer[0]),
+                    buffer.size()*sizeof(float), file_offset);
+  else
+    for (size_t r=0; ok && r<num_rows; ++r)
+      ok = pwrite_all(this->file_descriptor, reinterpret_cast<const char *>(&buffer[r*num_elements]),
+                      num_elements*sizeof(float),
+                      file_offset + static_cast<off_t>(r*stride*sizeof(float)));
+  if (!ok)
+    {
+      warning("ProjDataPositionalIO: error writing to file %s: %s", filename.c_str(), std::strerror(errno));
+      return Succeeded::no;
+    }
+  return Succeeded::yes;
+}
+
+Viewgram<float>
+ProjDataPositionalIO::
+get_viewgram(const int view_num, const int segment_num,
+             const bool make_num_tangential_poss_odd) const
+{
+  Viewgram<float> viewgram(proj_data_info_ptr, view_num, segment_num);
+  const size_t stride = this->layout.get_viewgram_row_stride(segment_num);
+  read_rows(viewgram, layout.get_row_offset(segment_num, view_num, get_min_axial_pos_num(segment_num)), stride);
+
+  if (make_num_tangential_poss_odd && (get_num_tangential_poss()%2==0))
+    {
+      const int new_max_tangential_pos = get_max_tangential_pos_num() + 1;
+      viewgram.grow(IndexRange2D(get_min_axial_pos_num(segment_num),
+                                 get_max_axial_pos_num(segment_num),
+                                 get_min_tangential_pos_num(),
+                                 new_max_tangential_pos));
+    }
+  return viewgram;
+}
+
+Sinogram<float>
+ProjDataPositionalIO::
+get_sinogram(const int ax_pos_num, const int segment_num,
+             const bool make_num_tangential_poss_odd) const
+{
+  Sinogram<float> sinogram(proj_data_info_ptr, ax_pos_num, segment_num);
+  const size_t stride = this->layout.get_sinogram_row_stride(segment_num);
+  read_rows(sinogram, layout.get_row_offset(segment_num, get_min_view_num(), ax_pos_num), stride);
+
+  if (make_num_tangential_poss_odd && (get_num_tangential_poss()%2==0))
+    {
+      const int new_max_tangential_pos = get_max_tangential_pos_num() + 1;
+      sinogram.grow(IndexRange2D(get_min_view_num(),
+                                 get_max_view_num(),
+                                 get_min_tangential_pos_num(),
+                                 new_max_tangential_pos));
+    }
+  return sinogram;
+}
+
+Succeeded
+ProjDataPositionalIO::
+set_viewgram(const Viewgram<float>& v)
+{
+  if (!this->writable)
+    {
+      warning("ProjDataPositionalIO::set_viewgram: file %s was opened read-only", filename.c_str());
+      return Succeeded::no;
+    }
+  if (*get_proj_data_info_ptr() != *(v.get_proj_data_info_ptr()))
+    {
+      warning("ProjDataPositionalIO::set_viewgram: viewgram has incompatible ProjDataInfo");
+      return Succeeded::no;
+    }
+  const int segment_num = v.get_segment_num();
+  const size_t stride = this->layout.get_viewgram_row_stride(segment_num);
+  return
+    write_rows(v, layout.get_row_offset(segment_num, v.get_view_num(), get_min_axial_pos_num(segment_num)), stride);
+}
+
+Succeeded
+ProjDataPositionalIO::
+set_sinogram(const Sinogram<float>& s)
+{
+  if (!this->writable)
+    {
+      warning("ProjDataPositionalIO::set_sinogram: file %s was opened read-only", filename.c_str());
+      return Succeeded::no;
+    }
+  if (*get_proj_data_info_ptr() != *(s.get_proj_data_info_ptr()))
+    {
+      warning("ProjDataPositionalIO::set_sinogram: sinogram has incompatible ProjDataInfo");
+      return Succeeded::no;
+    }
+  const int segment_num = s.get_segment_num();
+  const size_t stride = this->layout.get_sinogram_row_stride(segment_num);
+  return
+    write_rows(s, layout.get_row_offset(segment_num, get_min_view_num(), s.get_axial_pos_num()), stride);
+}
+
+float
+ProjDataPositionalIO::
+get_bin_value(const Bin& bin) const
+{
+  if (bin.tangential_pos_num() < get_min_tangential_pos_num() ||
+      bin.tangential_pos_num() > get_max_tangential_pos_num())
+    error("ProjDataPositionalIO: tangential_pos_num out of range : %d", bin.tangential_pos_num());
+  const size_t element_offset =
+    layout.get_row_offset(bin.segment_num(), bin.view_num(), bin.axial_pos_num()) +
+    (bin.tangential_pos_num() - get_min_tangential_pos_num());
+  float value;
+  if (!pread_all(this->file_descriptor, reinterpret_cast<char *>(&value), sizeof(float),
+                 static_cast<off_t>(this->offset + element_offset*sizeof(float))))
+    error("ProjDataPositionalIO: error reading from file %s", filename.c_str());
+  on_disk_byte_order.swap_if_necessary(value);
+  return value * scale_factor;
+}
+
+END_NAMESPACE_STIR
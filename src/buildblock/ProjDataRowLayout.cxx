@@ -0,0 +1,123 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup buildblock_detail
+  \brief Implementation of class stir::detail::ProjDataRowLayout
+*/
+
+#include "stir/ProjDataRowLayout.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/error.h"
+#include <algorithm>
+
+#ifndef STIR_NO_NAMESPACES
+using std::vector;
+using std::string;
+using std::size_t;
+#endif
+
+START_NAMESPACE_STIR
+
+namespace detail
+{
+  ProjDataRowLayout::
+  ProjDataRowLayout(const ProjDataInfo& proj_data_info,
+                    const vector<int>& segment_sequence_v,
+                    const StorageOrder storage_order_v,
+                    const string& class_name_v)
+    : segment_sequence(segment_sequence_v),
+      storage_order(storage_order_v),
+      min_view_num(proj_data_info.get_min_view_num()),
+      num_views(proj_data_info.get_num_views()),
+      num_tangential_poss(proj_data_info.get_num_tangential_poss()),
+      total_num_elements(0),
+      class_name(class_name_v)
+  {
+    if (storage_order == ProjDataFromStream::Unsupported)
+      error("%s: unsupported storage order", class_name.c_str());
+    if (static_cast<int>(segment_sequence.size()) != proj_data_info.get_num_segments())
+      error("%s: segment sequence has wrong size", class_name.c_str());
+
+    // find offsets of the segments in the file
+    segment_offsets.resize(segment_sequence.size());
+    min_axial_pos_nums.resize(segment_sequence.size());
+    num_axial_poss.resize(segment_sequence.size());
+    for (size_t i=0; i<segment_sequence.size(); ++i)
+      {
+        segment_offsets[i] = total_num_elements;
+        min_axial_pos_nums[i] = proj_data_info.get_min_axial_pos_num(segment_sequence[i]);
+        num_axial_poss[i] = proj_data_info.get_num_axial_poss(segment_sequence[i]);
+        total_num_elements +=
+          static_cast<size_t>(num_axial_poss[i]) * num_views * num_tangential_poss;
+      }
+  }
+
+  size_t
+  ProjDataRowLayout::
+  find_segment_index(const int segment_num) const
+  {
+    const vector<int>::const_iterator iter =
+      std::find(segment_sequence.begin(), segment_sequence.end(), segment_num);
+    if (iter == segment_sequence.end())
+      error("%s: segment_num out of range : %d", class_name.c_str(), segment_num);
+    return static_cast<size_t>(iter - segment_sequence.begin());
+  }
+
+  size_t
+  ProjDataRowLayout::
+  get_row_offset(const int segment_num, const int view_num, const int axial_pos_num) const
+  {
+    const size_t i = find_segment_index(segment_num);
+    if (view_num < min_view_num || view_num >= min_view_num + num_views)
+      error("%s: view_num out of range : %d", class_name.c_str(), view_num);
+    if (axial_pos_num < min_axial_pos_nums[i] || axial_pos_num >= min_axial_pos_nums[i] + num_axial_poss[i])
+      error("%s: axial_pos_num out of range : %d", class_name.c_str(), axial_pos_num);
+
+    const size_t relative_view_num = static_cast<size_t>(view_num - min_view_num);
+    const size_t relative_axial_pos_num = static_cast<size_t>(axial_pos_num - min_axial_pos_nums[i]);
+    const size_t row_num =
+      storage_order == ProjDataFromStream::Segment_View_AxialPos_TangPos
+      ? relative_view_num * num_axial_poss[i] + relative_axial_pos_num
+      : relative_axial_pos_num * num_views + relative_view_num;
+    return segment_offsets[i] + row_num * num_tangential_poss;
+  }
+
+  size_t
+  ProjDataRowLayout::
+  get_viewgram_row_stride(const int segment_num) const
+  {
+    find_segment_index(segment_num);
+    return
+      storage_order == ProjDataFromStream::Segment_View_AxialPos_TangPos
+      ? static_cast<size_t>(num_tangential_poss)
+      : static_cast<size_t>(num_views) * num_tangential_poss;
+  }
+
+  size_t
+  ProjDataRowLayout::
+  get_sinogram_row_stride(const int segment_num) const
+  {
+    const size_t i = find_segment_index(segment_num);
+    return
+      storage_order == ProjDataFromStream::Segment_AxialPos_View_TangPos
+      ? static_cast<size_t>(num_tangential_poss)
+      : static_cast<size_t>(num_axial_poss[i]) * num_tangential_poss;
+  }
+}
+
+END_NAMESPACE_STIR
@@ -0,0 +1,241 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup buildblock_detail
+  \brief Implementation of functions to store \c float data as blocks compressed with zlib
+*/
+
+#include "stir/deflate_float_blocks.h"
+#include "stir/Succeeded.h"
+#include "stir/ByteOrder.h"
+#include "stir/warning.h"
+#include <zlib.h>
+#include <cstring>
+
+#ifndef STIR_NO_NAMESPACES
+using std::vector;
+using std::size_t;
+using std::streamoff;
+#endif
+
+START_NAMESPACE_STIR
+
+namespace detail
+{
+  //! magic string at the end of the data, after the index
+  static const char deflate_float_blocks_magic[] = "STIRPDZ1";
+  static const size_t deflate_float_blocks_magic_size = 8;
+  //! flag indicating that the bytes of the floats are shuffled
+  static const boost::uint64_t deflate_float_blocks_flag_byte_shuffle = 1;
+  //! byte order of all numbers in the stream
+  static const ByteOrder deflate_float_blocks_byte_order = ByteOrder::little_endian;
+
+  static void
+  write_uint64(std::ostream& s, boost::uint64_t value)
+  {
+    deflate_float_blocks_byte_order.swap_if_necessary(value);
+    s.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  static boost::uint64_t
+  read_uint64(std::istream& s)
+  {
+    boost::uint64_t value = 0;
+    s.read(reinterpret_cast<char *>(&value), sizeof(value));
+    deflate_float_blocks_byte_order.swap_if_necessary(value);
+    return value;
+  }
+
+  //! store byte \c k of every element contiguously
+  static void
+  shuffle_bytes(unsigned char * out, const unsigned char * in,
+                const size_t num_elements, const size_t element_size)
+  {
+    for (size_t k=0; k<element_size; ++k)
+      for (size_t i=0; i<num_elements; ++i)
+        out[k*num_elements + i] = in[i*element_size + k];
+  }
+
+  //! inverse of shuffle_bytes()
+  static void
+  unshuffle_bytes(unsigned char * out, const unsigned char * in,
+                  const size_t num_elements, const size_t element_size)
+  {
+    for (size_t k=0; k<element_size; ++k)
+      for (size_t i=0; i<num_elements; ++i)
+        out[i*element_size + k] = in[k*num_elements + i];
+  }
+
+  Succeeded
+  deflate_float_block(vector<unsigned char>& compressed,
+                      const float * const values, const size_t num_values,
+                      const int compression_level, const bool byte_shuffle)
+  {
+    const size_t num_bytes = num_values*sizeof(float);
+    vector<float> buffer(values, values + num_values);
+    if (!deflate_float_blocks_byte_order.is_native_order())
+      for (vector<float>::iterator iter = buffer.begin(); iter != buffer.end(); ++iter)
+        ByteOrder::swap_order(*iter);
+
+    const Bytef * uncompressed_ptr = reinterpret_cast<const Bytef *>(&buffer[0]);
+    vector<unsigned char> shuffled;
+    if (byte_shuffle)
+      {
+        shuffled.resize(num_bytes);
+        shuffle_bytes(&shuffled[0], reinterpret_cast<const unsigned char *>(&buffer[0]),
+                      num_values, sizeof(float));
+        uncompressed_ptr = &shuffled[0];
+      }
+
+    const uLong uncompressed_size = static_cast<uLong>(num_bytes);
+    uLongf compressed_size = compressBound(uncompressed_size);
+    compressed.resize(compressed_size);
+    const int ret =
+      compress2(&compressed[0], &compressed_size,
+                uncompressed_ptr, uncompressed_size,
+                compression_level);
+    if (ret != Z_OK)
+      {
+        warning("deflate_float_block: error compressing data (zlib error %d)", ret);
+        return Succeeded::no;
+      }
+    compressed.resize(compressed_size);
+    return Succeeded::yes;
+  }
+
+  Succeeded
+  inflate_float_block(float * const values, const size_t num_values,
+                      const vector<unsigned char>& compressed, const bool byte_shuffle)
+  {
+    const size_t num_bytes = num_values*sizeof(float);
+    vector<unsigned char> shuffled;
+    Bytef * uncompressed_ptr = reinterpret_cast<Bytef *>(values);
+    if (byte_shuffle)
+      {
+        shuffled.resize(num_bytes);
+        uncompressed_ptr = &shuffled[0];
+      }
+    uLongf uncompressed_size = static_cast<uLongf>(num_bytes);
+    const int ret =
+      uncompress(uncompressed_ptr, &uncompressed_size,
+                 &compressed[0], static_cast<uLong>(compressed.size()));
+    if (ret != Z_OK || uncompressed_size != num_bytes)
+      {
+        warning("inflate_float_block: error decompressing data (zlib error %d)", ret);
+        return Succeeded::no;
+      }
+    if (byte_shuffle)
+      unshuffle_bytes(reinterpret_cast<unsigned char *>(values), &shuffled[0],
+                      num_values, sizeof(float));
+    if (!deflate_float_blocks_byte_order.is_native_order())
+      for (size_t i=0; i<num_values; ++i)
+        ByteOrder::swap_order(values[i]);
+    return Succeeded::yes;
+  }
+
+  Succeeded
+  write_deflate_block_index(std::ostream& s,
+                            const vector<DeflateBlockInfo>& blocks,
+                            const bool byte_shuffle)
+  {
+    for (vector<DeflateBlockInfo>::const_iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+      {
+        write_uint64(s, iter->offset);
+        write_uint64(s, iter->size);
+      }
+    write_uint64(s, byte_shuffle ? deflate_float_blocks_flag_byte_shuffle : 0);
+    write_uint64(s, static_cast<boost::uint64_t>(blocks.size()));
+    s.write(deflate_float_blocks_magic, deflate_float_blocks_magic_size);
+    if (!s)
+      {
+        warning("write_deflate_block_index: error writing the index");
+        return Succeeded::no;
+      }
+    return Succeeded::yes;
+  }
+
+  Succeeded
+  read_deflate_block_index(std::istream& s, const streamoff offset,
+                           vector<DeflateBlockInfo>& blocks,
+                           bool& byte_shuffle,
+                           boost::uint64_t& data_end)
+  {
+    s.seekg(0, std::ios::end);
+    const boost::uint64_t stream_size =
+      static_cast<boost::uint64_t>(static_cast<streamoff>(s.tellg()) - offset);
+    const boost::uint64_t trailer_size = 16 + deflate_float_blocks_magic_size;
+    if (stream_size < trailer_size)
+      {
+        warning("read_deflate_block_index: stream is too small (%lu bytes) to contain an index",
+                static_cast<unsigned long>(stream_size));
+        return Succeeded::no;
+      }
+
+    s.seekg(offset + static_cast<streamoff>(stream_size - deflate_float_blocks_magic_size));
+    char magic[deflate_float_blocks_magic_size];
+    s.read(magic, deflate_float_blocks_magic_size);
+    if (!s || std::memcmp(magic, deflate_float_blocks_magic, deflate_float_blocks_magic_size) != 0)
+      {
+        warning("read_deflate_block_index: stream does not end with the expected signature");
+        return Succeeded::no;
+      }
+    s.seekg(offset + static_cast<streamoff>(stream_size - trailer_size));
+    const boost::uint64_t flags = read_uint64(s);
+    const boost::uint64_t num_blocks = read_uint64(s);
+    if (flags & ~deflate_float_blocks_flag_byte_shuffle)
+      {
+        warning("read_deflate_block_index: unsupported flags %lu in the stream",
+                static_cast<unsigned long>(flags));
+        return Succeeded::no;
+      }
+    byte_shuffle = (flags & deflate_float_blocks_flag_byte_shuffle) != 0;
+    if (num_blocks != blocks.size())
+      {
+        warning("read_deflate_block_index: number of blocks in the stream (%lu) does not match the expected number (%lu)",
+                static_cast<unsigned long>(num_blocks), static_cast<unsigned long>(blocks.size()));
+        return Succeeded::no;
+      }
+    const boost::uint64_t index_size = num_blocks*16;
+    if (stream_size < trailer_size + index_size)
+      {
+        warning("read_deflate_block_index: stream is too small for the index");
+        return Succeeded::no;
+      }
+
+    data_end = stream_size - trailer_size - index_size;
+    s.seekg(offset + static_cast<streamoff>(data_end));
+    for (vector<DeflateBlockInfo>::iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+      {
+        iter->offset = read_uint64(s);
+        iter->size = read_uint64(s);
+        if (iter->size > 0 && iter->offset + iter->size > data_end)
+          {
+            warning("read_deflate_block_index: index refers to data outside the stream");
+            return Succeeded::no;
+          }
+      }
+    if (!s)
+      {
+        warning("read_deflate_block_index: error reading the index");
+        return Succeeded::no;
+      }
+    return Succeeded::yes;
+  }
+}
+
+END_NAMESPACE_STIR
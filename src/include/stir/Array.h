@@ -44,6 +44,7 @@
 
 START_NAMESPACE_STIR
 class NumericType;
+template <int num_dimensions, typename elemT, class ExprT> class ArrayExpression;
 
 #ifdef ARRAY_FULL
 #ifndef ARRAY_FULL2
@@ -68,10 +69,22 @@ numeric operations are defined. In addition, two types of iterators are
 defined, one which iterators through the outer index, and one which
 iterates through all elements of the array.
 
-Array inherits its numeric operators from NumericVectorWithOffset.
+Array inherits its numeric assignment operators from NumericVectorWithOffset.
 In particular this means that operator+= etc. potentially grow
 the object. However, as grow() is a virtual function, Array::grow is
-called, which initialises new elements first to 0.
+called, which initialises new elements first to 0. The arithmetic operators
++,-,*,/ are evaluated lazily, see ArrayExpression.
+
+Arrays constructed from an IndexRange (or copied) allocate a single block of
+memory for all their elements. The lower-dimensional arrays are then "views"
+into that block, i.e. they do not own their memory (see 
+VectorWithOffset::owns_memory_for_data()). This helps the cache and allows
+access to all data via a single pointer, see get_full_data_ptr(). It is also
+possible to construct an Array that uses an existing block of memory.
+
+Note that resizing (or assigning an array with a different index range to)
+one of the lower-dimensional arrays will let that array allocate its own 
+memory. The Array is then no longer contiguous (see is_contiguous()).
 */
 
 template <int num_dimensions, typename elemT>
@@ -129,22 +142,51 @@ public:
   inline Array();
 
   //! Construct an Array of given range of indices, elements are initialised to 0
+  /*! All elements are stored in a single block of memory. */
   inline explicit Array(const IndexRange<num_dimensions>&);
-  
+
+  //! Construct an Array of given range of indices using existing data
+  /*! If \a copy_data is \c false, the Array will use the memory at \a data_ptr
+      (which has to be large enough for \c range.size_all() elements, stored in
+      the same order as begin_all() iterates through them). The caller has to
+      make sure that the memory stays valid during the lifetime of the Array.
+      Otherwise, the data is copied into a block of memory allocated by the Array.
+  */
+  inline Array(const IndexRange<num_dimensions>& range, elemT * const data_ptr, bool copy_data);
+
+  //! Copy constructor (allocates a single block of memory)
+  inline Array(const self& t);
+
 #ifndef SWIG
-  //! Construct an Array from an object of its base_type
-  inline Array(const base_type& t);
-#else
+  //! Construct an Array from an object of its base_type (allocates a single block of memory)
   // swig 2.0.4 gets confused by base_type (due to numeric template arguments)
-  // therefore, we declare this constructor using the "self" type, 
-  // i.e. it's just a copy-constructor.
-  // This is less powerful as in C++, but swig-generated interfaces don't need to know about the base_type anyway
-  inline Array(const self& t);
+  // so we only use the copy-constructor there.
+  inline Array(const base_type& t);
 #endif
   
   //! virtual destructor, frees up any allocated memory
   inline virtual ~Array();
 
+  //! Construct an Array by evaluating an ArrayExpression
+  template <class ExprT>
+  inline Array(const ArrayExpression<num_dimensions, elemT, ExprT>& expr);
+
+  //! assignment operator
+  /*! If the index ranges are the same, the data is copied into the existing
+      memory. Otherwise, a new block of memory is allocated.
+  */
+  inline self& operator=(const self& other);
+
+  //! assignment from an ArrayExpression (evaluated in a single loop)
+  /*! If the index ranges are the same, the result is written in the existing
+      memory. Otherwise, a new block of memory is allocated.
+  */
+  template <class ExprT>
+  inline self& operator=(const ArrayExpression<num_dimensions, elemT, ExprT>& expr);
+
+  //! swap content of 2 arrays (without copying any data)
+  inline void swap(self& other);
+
   /*! @name functions returning full_iterators*/
   //@{
   //! start value for iterating through all elements in the array, see full_iterator
@@ -171,6 +213,9 @@ public:
      need instantiation in Array.cxx.
   */
   //! change the array to a new range of indices, new elements are set to 0  
+  /*! If the range changes, a new block of memory is allocated and the data in 
+      the overlapping range is copied.
+  */
   inline virtual void 
     resize(const IndexRange<num_dimensions>& range);
 
@@ -239,6 +284,45 @@ public:
   inline const elemT&
     at(const BasicCoordinate<num_dimensions,int> &c) const;
   //@}
+
+  //! \name access to the data via a pointer
+  //@{
+  //! check if all elements are stored in a single block of memory (in the order of begin_all())
+  inline bool is_contiguous() const;
+
+  //! member function for access to the data via an elemT*
+  /*! Calls error() if the Array is not contiguous. 
+      As for VectorWithOffset::get_data_ptr(), you should not manipulate the
+      array between get_full_data_ptr() and release_full_data_ptr().
+  */
+  inline elemT* get_full_data_ptr();
+
+  //! member function for access to the data via a const elemT*
+  inline const elemT * get_const_full_data_ptr() const;
+
+  //! signal end of access to elemT*
+  inline void release_full_data_ptr();
+
+  //! signal end of access to const elemT*
+  inline void release_const_full_data_ptr() const;
+  //@}
+
+ protected:
+  //! (re)initialise the array with the given range, using existing data
+  /*! \see Array(const IndexRange<num_dimensions>&, elemT * const, bool) */
+  inline void init(const IndexRange<num_dimensions>& range, elemT * const data_ptr, bool copy_data);
+
+ private:
+  friend class Array<num_dimensions+1, elemT>;
+
+  //! allocate a single block of memory and set up the sub-arrays to use it
+  inline void _allocate_full_data(const IndexRange<num_dimensions>& range);
+  //! return a pointer to the first element (or 0 if there are none)
+  inline const elemT * _get_first_elem_ptr() const;
+  //! pointer to the block of memory that we allocated (or 0)
+  elemT * _allocated_full_data_ptr;
+  //! boolean to test if get_full_data_ptr is called
+  mutable bool _full_pointer_access;
 };
 
 
@@ -302,8 +386,20 @@ public:
   //! constructor given first and last indices, initialising elements to 0
   inline Array(const int min_index, const int max_index);
 
+  //! constructor given an IndexRange<1> using existing data
+  /*! \see VectorWithOffset::init() */
+  inline Array(const IndexRange<1>& range, elemT * const data_ptr, bool copy_data);
+
   //! constructor from basetype
   inline Array(const NumericVectorWithOffset<elemT,elemT> &il);
+
+  //! Construct an Array by evaluating an ArrayExpression
+  template <class ExprT>
+  inline Array(const ArrayExpression<1, elemT, ExprT>& expr);
+
+  //! assignment from an ArrayExpression (evaluated in a single loop)
+  template <class ExprT>
+  inline self& operator=(const ArrayExpression<1, elemT, ExprT>& expr);
   
   //! virtual destructor
   inline virtual ~Array();
@@ -362,42 +458,6 @@ public:
      BasicCoordinate<1, int>& min,
      BasicCoordinate<1, int>& max) const;
   
-#ifndef STIR_USE_BOOST
-  
-  /* KT 31/01/2000 I had to add these functions here, although they are 
-  in NumericVectorWithOffset already.
-  Reason: we allow addition (and similar operations) of tensors of 
-  different sizes. This implies that operator+= can call a 'grow'
-  on retval. For this to work, retval should be an Array, not 
-  its base_type (which happens if these function are not repeated
-  in this class).
-  Complicated...
-  */
-  //! elem by elem addition
-  inline self operator+ (const base_type &iv) const;
-  
-  //! elem by elem subtraction
-  inline self operator- (const base_type &iv) const;
-  
-  //! elem by elem multiplication
-  inline self operator* (const base_type &iv) const;
-  
-  //! elem by elem division
-  inline self operator/ (const base_type &iv) const;
-  
-  //! addition with an 'elemT'
-  inline self operator+ (const elemT a) const;
-  
-  //! subtraction with an 'elemT'
-  inline self operator- (const elemT a) const;
-  
-  //! multiplication with an 'elemT'
-  inline self operator* (const elemT a) const;
-  
-  //! division with an 'elemT'
-  inline self operator/ (const elemT a) const;
-
-#endif // boost
 
     //! allow array-style access, read/write
   inline elemT&	operator[] (int i);
@@ -426,7 +486,32 @@ public:
     at(const BasicCoordinate<1,int> &c) const;
   //@}
 
-  
+  //! \name access to the data via a pointer
+  /*! These are provided for compatibility with the multi-dimensional case, and 
+      call the corresponding VectorWithOffset functions.
+  */
+  //@{
+  //! always \c true for the 1D case
+  inline bool is_contiguous() const;
+
+  inline elemT* get_full_data_ptr();
+
+  inline const elemT * get_const_full_data_ptr() const;
+
+  inline void release_full_data_ptr();
+
+  inline void release_const_full_data_ptr() const;
+  //@}
+
+ protected:
+  //! (re)initialise the array with the given range, using existing data
+  inline void init(const IndexRange<1>& range, elemT * const data_ptr, bool copy_data);
+
+ private:
+  friend class Array<2, elemT>;
+
+  //! return a pointer to the first element (or 0 if there are none)
+  inline const elemT * _get_first_elem_ptr() const;
 };
 
 
@@ -471,6 +556,7 @@ END_NAMESPACE_STIR
 #  endif
 #endif
 
+#include "stir/ArrayExpression.h"
 #include "stir/Array.inl"
 
 
@@ -31,6 +31,7 @@
 // include for min,max definitions
 #include <algorithm>
 #include "stir/assign.h"
+#include "stir/error.h"
 
 START_NAMESPACE_STIR
 
@@ -38,18 +39,80 @@ START_NAMESPACE_STIR
  inlines for Array<num_dimensions, elemT>
  **********************************************/
 
+namespace detail
+{
+  //! copy elements in the overlapping index range of 2 arrays
+  template <typename elemT>
+  inline void
+  copy_overlapping_elements(Array<1, elemT>& to, const Array<1, elemT>& from)
+  {
+    const int min_index = std::max(to.get_min_index(), from.get_min_index());
+    const int max_index = std::min(to.get_max_index(), from.get_max_index());
+    if (min_index <= max_index)
+      std::copy(from.begin() + (min_index - from.get_min_index()),
+                from.begin() + (max_index + 1 - from.get_min_index()),
+                to.begin() + (min_index - to.get_min_index()));
+  }
+
+  template <int num_dimensions, typename elemT>
+  inline void
+  copy_overlapping_elements(Array<num_dimensions, elemT>& to, const Array<num_dimensions, elemT>& from)
+  {
+    const int min_index = std::max(to.get_min_index(), from.get_min_index());
+    const int max_index = std::min(to.get_max_index(), from.get_max_index());
+    for (int i=min_index; i<=max_index; ++i)
+      copy_overlapping_elements(to[i], from[i]);
+  }
+}
+
 template <int num_dimensions, typename elemT>
 void 
 Array<num_dimensions, elemT>::
-resize(const IndexRange<num_dimensions>& range)
+init(const IndexRange<num_dimensions>& range, elemT * const data_ptr, bool copy_data)
 {
+  if (copy_data)
+    {
+      this->_allocate_full_data(range);
+      std::copy(data_ptr, data_ptr + range.size_all(), this->_allocated_full_data_ptr);
+      return;
+    }
+  elemT * const old_allocated_full_data_ptr = this->_allocated_full_data_ptr;
   base_type::resize(range.get_min_index(), range.get_max_index());
   typename base_type::iterator iter = this->begin();
   typename IndexRange<num_dimensions>::const_iterator range_iter = range.begin();
+  elemT * current_data_ptr = data_ptr;
   for (;
        iter != this->end(); 
        ++iter, ++range_iter)
-    (*iter).resize(*range_iter);
+    {
+      (*iter).init(*range_iter, current_data_ptr, false);
+      current_data_ptr += range_iter->size_all();
+    }
+  this->_allocated_full_data_ptr = 0;
+  delete[] old_allocated_full_data_ptr;
+}
+
+template <int num_dimensions, typename elemT>
+void 
+Array<num_dimensions, elemT>::
+_allocate_full_data(const IndexRange<num_dimensions>& range)
+{
+  const size_t size = range.size_all();
+  elemT * const data_ptr = size==0 ? 0 : new elemT[size];
+  this->init(range, data_ptr, false);
+  this->_allocated_full_data_ptr = data_ptr;
+}
+
+template <int num_dimensions, typename elemT>
+void 
+Array<num_dimensions, elemT>::
+resize(const IndexRange<num_dimensions>& range)
+{
+  if (range == this->get_index_range())
+    return;
+  self new_array(range);
+  detail::copy_overlapping_elements(new_array, *this);
+  this->swap(new_array);
 }
 
 template <int num_dimensions, typename elemT>
@@ -62,30 +125,125 @@ grow(const IndexRange<num_dimensions>& range)
 
 template <int num_dimensions, typename elemT>
 Array<num_dimensions, elemT>::Array()
-: base_type()
+: base_type(),
+  _allocated_full_data_ptr(0),
+  _full_pointer_access(false)
 {}
 
 template <int num_dimensions, typename elemT>
 Array<num_dimensions, elemT>::Array(const IndexRange<num_dimensions>& range)
-: base_type()
+: base_type(),
+  _allocated_full_data_ptr(0),
+  _full_pointer_access(false)
 {
-  grow(range);
+  this->_allocate_full_data(range);
+  elemT * const end_of_data_ptr = this->_allocated_full_data_ptr + range.size_all();
+  for (elemT * data_ptr = this->_allocated_full_data_ptr; data_ptr != end_of_data_ptr; ++data_ptr)
+    assign(*data_ptr, 0);
+}
+
+template <int num_dimensions, typename elemT>
+Array<num_dimensions, elemT>::Array(const IndexRange<num_dimensions>& range,
+                                    elemT * const data_ptr, bool copy_data)
+: base_type(),
+  _allocated_full_data_ptr(0),
+  _full_pointer_access(false)
+{
+  this->init(range, data_ptr, copy_data);
 }
 
 template <int num_dimensions, typename elemT>
-#ifdef SWIG
-// swig-specific work-around (see Array.h)
 Array<num_dimensions, elemT>::Array(const self& t)
-#else
+: base_type(),
+  _allocated_full_data_ptr(0),
+  _full_pointer_access(false)
+{
+  this->_allocate_full_data(t.get_index_range());
+  for (int i=t.get_min_index(); i<=t.get_max_index(); ++i)
+    detail::copy_overlapping_elements((*this)[i], t[i]);
+}
+
+#ifndef SWIG
+template <int num_dimensions, typename elemT>
 Array<num_dimensions, elemT>::Array(const base_type& t)
+: base_type(),
+  _allocated_full_data_ptr(0),
+  _full_pointer_access(false)
+{
+  VectorWithOffset<IndexRange<num_dimensions-1> > 
+    range(t.get_min_index(), t.get_max_index());
+  for (int i=t.get_min_index(); i<=t.get_max_index(); ++i)
+    range[i] = t[i].get_index_range();
+  this->_allocate_full_data(IndexRange<num_dimensions>(range));
+  for (int i=t.get_min_index(); i<=t.get_max_index(); ++i)
+    detail::copy_overlapping_elements((*this)[i], t[i]);
+}
 #endif
-:  base_type(t)
-{}
 
 template <int num_dimensions, typename elemT>
 Array<num_dimensions, elemT>::~Array()
-{}
+{
+  // note: the sub-arrays do not own their memory, so will not delete it
+  delete[] this->_allocated_full_data_ptr;
+}
 
+template <int num_dimensions, typename elemT>
+Array<num_dimensions, elemT>&
+Array<num_dimensions, elemT>::operator=(const self& other)
+{
+  if (this == &other)
+    return *this;
+  if (this->get_index_range() == other.get_index_range())
+    {
+      detail::copy_overlapping_elements(*this, other);
+    }
+  else
+    {
+      self tmp(other);
+      this->swap(tmp);
+    }
+  return *this;
+}
+
+template <int num_dimensions, typename elemT>
+template <class ExprT>
+Array<num_dimensions, elemT>::Array(const ArrayExpression<num_dimensions, elemT, ExprT>& expr)
+: base_type(),
+  _allocated_full_data_ptr(0),
+  _full_pointer_access(false)
+{
+  this->_allocate_full_data(expr.get_index_range());
+  detail::assign_array_expression(*this, expr.get_expression());
+}
+
+template <int num_dimensions, typename elemT>
+template <class ExprT>
+Array<num_dimensions, elemT>&
+Array<num_dimensions, elemT>::operator=(const ArrayExpression<num_dimensions, elemT, ExprT>& expr)
+{
+  if (expr.get_index_range() == this->get_index_range())
+    {
+      // all operations are element-wise, so we can write into our own memory,
+      // even if we are one of the arguments of the expression
+      detail::assign_array_expression(*this, expr.get_expression());
+    }
+  else
+    {
+      self tmp(expr);
+      this->swap(tmp);
+    }
+  return *this;
+}
+
+template <int num_dimensions, typename elemT>
+void
+Array<num_dimensions, elemT>::swap(self& other)
+{
+  assert(!this->_full_pointer_access);
+  assert(!other._full_pointer_access);
+  base_type::swap(other);
+  std::swap(this->_allocated_full_data_ptr, other._allocated_full_data_ptr);
+}
 
 template <int num_dimensions, typename elemT>
 typename Array<num_dimensions, elemT>::full_iterator 
@@ -329,6 +487,75 @@ Array<num_dimensions,elemT>::at(const BasicCoordinate<num_dimensions,int> &c) co
   return (*this).at(c[1]).at(cut_first_dimension(c)); 
 }				    
 
+template <int num_dimensions, typename elemT>
+const elemT *
+Array<num_dimensions,elemT>::_get_first_elem_ptr() const
+{
+  for (int i=this->get_min_index(); i<=this->get_max_index(); ++i)
+    if ((*this)[i].size_all() > 0)
+      return (*this)[i]._get_first_elem_ptr();
+  return 0;
+}
+
+template <int num_dimensions, typename elemT>
+bool
+Array<num_dimensions,elemT>::is_contiguous() const
+{
+  const elemT * next_data_ptr = 0;
+  for (int i=this->get_min_index(); i<=this->get_max_index(); ++i)
+    {
+      const Array<num_dimensions-1, elemT>& sub_array = (*this)[i];
+      const size_t sub_size = sub_array.size_all();
+      if (sub_size == 0)
+        continue;
+      if (!sub_array.is_contiguous())
+        return false;
+      const elemT * const data_ptr = sub_array._get_first_elem_ptr();
+      if (next_data_ptr != 0 && data_ptr != next_data_ptr)
+        return false;
+      next_data_ptr = data_ptr + sub_size;
+    }
+  return true;
+}
+
+template <int num_dimensions, typename elemT>
+elemT *
+Array<num_dimensions,elemT>::get_full_data_ptr()
+{
+  assert(!this->_full_pointer_access);
+  if (!this->is_contiguous())
+    error("Array::get_full_data_ptr() called for a non-contiguous array.");
+  this->_full_pointer_access = true;
+  return const_cast<elemT *>(this->_get_first_elem_ptr());
+}
+
+template <int num_dimensions, typename elemT>
+const elemT *
+Array<num_dimensions,elemT>::get_const_full_data_ptr() const
+{
+  assert(!this->_full_pointer_access);
+  if (!this->is_contiguous())
+    error("Array::get_const_full_data_ptr() called for a non-contiguous array.");
+  this->_full_pointer_access = true;
+  return this->_get_first_elem_ptr();
+}
+
+template <int num_dimensions, typename elemT>
+void
+Array<num_dimensions,elemT>::release_full_data_ptr()
+{
+  assert(this->_full_pointer_access);
+  this->_full_pointer_access = false;
+}
+
+template <int num_dimensions, typename elemT>
+void
+Array<num_dimensions,elemT>::release_const_full_data_ptr() const
+{
+  assert(this->_full_pointer_access);
+  this->_full_pointer_access = false;
+}
+
 /**********************************************
  inlines for Array<1, elemT>
  **********************************************/
@@ -403,11 +630,94 @@ Array<1, elemT>::Array(const int min_index, const int max_index)
 }
 
 
+template <class elemT>
+Array<1, elemT>::Array(const IndexRange<1>& range, elemT * const data_ptr, bool copy_data)
+: base_type()
+{
+  this->init(range, data_ptr, copy_data);
+}
+
 template <class elemT>
 Array<1, elemT>::Array(const base_type &il)
 : base_type(il)
 {}
 
+template <class elemT>
+template <class ExprT>
+Array<1, elemT>::Array(const ArrayExpression<1, elemT, ExprT>& expr)
+: base_type()
+{
+  const IndexRange<1> range = expr.get_index_range();
+  base_type::resize(range.get_min_index(), range.get_max_index());
+  detail::assign_array_expression(*this, expr.get_expression());
+}
+
+template <class elemT>
+template <class ExprT>
+Array<1, elemT>&
+Array<1, elemT>::operator=(const ArrayExpression<1, elemT, ExprT>& expr)
+{
+  if (expr.get_index_range() == this->get_index_range())
+    {
+      detail::assign_array_expression(*this, expr.get_expression());
+    }
+  else
+    {
+      self tmp(expr);
+      this->swap(tmp);
+    }
+  return *this;
+}
+
+template <class elemT>
+void
+Array<1, elemT>::init(const IndexRange<1>& range, elemT * const data_ptr, bool copy_data)
+{
+  base_type::init(range.get_min_index(), range.get_max_index(), data_ptr, copy_data);
+}
+
+template <class elemT>
+const elemT *
+Array<1, elemT>::_get_first_elem_ptr() const
+{
+  return this->size()==0 ? 0 : &(*this->begin());
+}
+
+template <class elemT>
+bool
+Array<1, elemT>::is_contiguous() const
+{
+  return true;
+}
+
+template <class elemT>
+elemT *
+Array<1, elemT>::get_full_data_ptr()
+{
+  return this->get_data_ptr();
+}
+
+template <class elemT>
+const elemT *
+Array<1, elemT>::get_const_full_data_ptr() const
+{
+  return this->get_const_data_ptr();
+}
+
+template <class elemT>
+void
+Array<1, elemT>::release_full_data_ptr()
+{
+  this->release_data_ptr();
+}
+
+template <class elemT>
+void
+Array<1, elemT>::release_const_full_data_ptr() const
+{
+  this->release_const_data_ptr();
+}
+
 template <typename elemT>
 Array<1, elemT>::~Array()
 {}
@@ -558,89 +868,6 @@ Array<1, elemT>::get_regular_range(
   return range.get_regular_range(min,max);
 }
 
-#ifndef STIR_USE_BOOST
-
-/* KT 31/01/2000 I had to add these functions here, although they are 
-in NumericVectorWithOffset already.
-Reason: we allow addition (and similar operations) of tensors of 
-different sizes. This implies that operator+= can call a 'grow'
-on retval. For this to work, retval should be a Array, not 
-its base_type (which happens if these function are not repeated
-in this class).
-Complicated...
-*/
-template <class elemT> 
-Array<1, elemT>
-Array<1, elemT>::operator+ (const base_type &iv) const 
-{
-  this->check_state();
-  Array<1, elemT> retval(*this);
-  return retval += iv;
-};
-
-template <class elemT>
-Array<1, elemT>
-Array<1, elemT>::operator- (const base_type &iv) const 
-{
-  this->check_state();
-  Array<1, elemT> retval(*this);
-  return retval -= iv;      
-}
-template <class elemT>
-Array<1, elemT>
-Array<1, elemT>::operator* (const base_type &iv) const
-{
-  this->check_state();
-  Array<1, elemT> retval(*this);
-  return retval *= iv;      
-}
-
-template <class elemT>
-Array<1, elemT>
-Array<1, elemT>::operator/ (const base_type &iv) const
-{
-  this->check_state();
-  Array<1, elemT> retval(*this);
-  return retval /= iv;      
-}
-
-template <class elemT>
-Array<1, elemT>
-Array<1, elemT>::operator+ (const elemT a) const 
-{
-  this->check_state();
-  Array<1, elemT> retval(*this);
-  return (retval += a);
-};
-
-template <class elemT>
-Array<1, elemT>
-Array<1, elemT>::operator- (const elemT a) const 
-{
-  this->check_state();
-  Array<1, elemT> retval(*this);
-  return (retval -= a);
-};
-
-template <class elemT>
-Array<1, elemT>
-Array<1, elemT>::operator* (const elemT a) const 
-{
-  this->check_state();
-  Array<1, elemT> retval(*this);
-  return (retval *= a);
-};
-
-template <class elemT>
-Array<1, elemT>
-Array<1, elemT>::operator/ (const elemT a) const 
-{
-  this->check_state();
-  Array<1, elemT> retval(*this);
-  return (retval /= a);
-};  
-
-#endif // boost   
 
 template <typename elemT>    
 const elemT& Array<1,elemT>:: operator[] (int i) const
@@ -0,0 +1,340 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+
+#ifndef __stir_ArrayExpression_H__
+#define __stir_ArrayExpression_H__
+
+/*!
+  \file
+  \ingroup Array
+  \brief defines stir::ArrayExpression and the arithmetic operators for stir::Array
+
+  This file is included by stir/Array.h. There should be no need to include it yourself.
+*/
+
+#include "stir/IndexRange.h"
+#include "stir/assign.h"
+#include <algorithm>
+
+START_NAMESPACE_STIR
+
+template <int num_dimensions, typename elemT> class Array;
+
+namespace detail
+{
+  template <int num_dimensions, typename elemT, class LhsT, class RhsT, class OpT>
+  class ArrayBinaryExpression;
+
+  //! \name find the value of a 1D node without any range checks
+  //@{
+  template <typename elemT, class T>
+  inline elemT
+  array_expression_value_without_range_check(const T& t, const int i);
+  template <typename elemT, class LhsT, class RhsT, class OpT>
+  inline elemT
+  array_expression_value_without_range_check(const ArrayBinaryExpression<1, elemT, LhsT, RhsT, OpT>& t, const int i);
+  //@}
+
+  /*! \ingroup Array
+    \name Classes for the implementation of stir::ArrayExpression
+
+    These classes are the nodes of the expression tree. Every node knows its
+    index range, and can return the node for the next dimension via operator[].
+    At the 1D level, value() gives the actual value.
+
+    An element is "in range" for a node if it lies between get_min_index() and
+    get_max_index(). Scalars are in range for all indices, but do not contribute
+    to the index range of a node. Nodes can be default constructed, in which case
+    they have an empty range (this is used when an Array has a smaller range than
+    the expression).
+  */
+  //@{
+
+  //! node for a (const) Array
+  template <int num_dimensions, typename elemT>
+  class ArrayExpressionLeaf
+  {
+  public:
+    typedef ArrayExpressionLeaf<num_dimensions-1, elemT> sub_expression_type;
+
+    ArrayExpressionLeaf() : ptr(0) {}
+    explicit ArrayExpressionLeaf(const Array<num_dimensions, elemT>& array) : ptr(&array) {}
+
+    bool is_scalar() const { return false; }
+    bool empty() const { return ptr==0 || ptr->get_length()==0; }
+    int get_min_index() const { return ptr->get_min_index(); }
+    int get_max_index() const { return ptr->get_max_index(); }
+    bool is_in_range(const int i) const
+    { return !this->empty() && i>=this->get_min_index() && i<=this->get_max_index(); }
+    //! checks if the whole range \a min_index till \a max_index (in the outer dimension) can be used without range checks
+    bool covers(const int min_index, const int max_index) const
+    { return !this->empty() && this->get_min_index()<=min_index && this->get_max_index()>=max_index; }
+    sub_expression_type operator[](const int i) const
+    { return this->is_in_range(i) ? sub_expression_type((*ptr)[i]) : sub_expression_type(); }
+
+  private:
+    const Array<num_dimensions, elemT>* ptr;
+  };
+
+  //! node for a (const) Array, 1D specialisation
+  template <typename elemT>
+  class ArrayExpressionLeaf<1, elemT>
+  {
+  public:
+    ArrayExpressionLeaf() : ptr(0) {}
+    explicit ArrayExpressionLeaf(const Array<1, elemT>& array) : ptr(&array) {}
+
+    bool is_scalar() const { return false; }
+    bool empty() const { return ptr==0 || ptr->get_length()==0; }
+    int get_min_index() const { return ptr->get_min_index(); }
+    int get_max_index() const { return ptr->get_max_index(); }
+    bool is_in_range(const int i) const
+    { return !this->empty() && i>=this->get_min_index() && i<=this->get_max_index(); }
+    bool covers(const int min_index, const int max_index) const
+    { return !this->empty() && this->get_min_index()<=min_index && this->get_max_index()>=max_index; }
+    //! value at index \a i, which has to be in range
+    elemT value(const int i) const { return (*ptr)[i]; }
+
+  private:
+    const Array<1, elemT>* ptr;
+  };
+
+  //! node for a scalar
+  template <int num_dimensions, typename elemT>
+  class ArrayExpressionScalar
+  {
+  public:
+    typedef ArrayExpressionScalar<num_dimensions-1, elemT> sub_expression_type;
+
+    ArrayExpressionScalar() { assign(scalar, 0); }
+    explicit ArrayExpressionScalar(const elemT& scalar) : scalar(scalar) {}
+
+    bool is_scalar() const { return true; }
+    bool empty() const { return false; }
+    //! scalars do not have an index range, these functions are only there to make the code compile
+    int get_min_index() const { return 0; }
+    int get_max_index() const { return -1; }
+    bool is_in_range(const int) const { return true; }
+    bool covers(const int, const int) const { return true; }
+    sub_expression_type operator[](const int) const { return sub_expression_type(scalar); }
+    elemT value(const int) const { return scalar; }
+
+  private:
+    elemT scalar;
+  };
+
+  /*! \brief Operations used by ArrayBinaryExpression
+
+    \c apply_without_lhs() is used for elements where only the 2nd operand is in range.
+    Together with using the 1st operand when the 2nd is out of range, this
+    reproduces the growing behaviour of NumericVectorWithOffset::operator+=() etc.
+  */
+  struct ArrayExpressionPlus
+  {
+    template <typename elemT>
+    static elemT apply(const elemT& lhs, const elemT& rhs) { return lhs + rhs; }
+    template <typename elemT>
+    static elemT apply_without_lhs(const elemT& rhs) { return rhs; }
+  };
+
+  struct ArrayExpressionMinus
+  {
+    template <typename elemT>
+    static elemT apply(const elemT& lhs, const elemT& rhs) { return lhs - rhs; }
+    template <typename elemT>
+    static elemT apply_without_lhs(const elemT& rhs) { return -rhs; }
+  };
+
+  struct ArrayExpressionMultiplies
+  {
+    template <typename elemT>
+    static elemT apply(const elemT& lhs, const elemT& rhs) { return lhs * rhs; }
+    template <typename elemT>
+    static elemT apply_without_lhs(const elemT&) { elemT zero; assign(zero, 0); return zero; }
+  };
+
+  struct ArrayExpressionDivides
+  {
+    template <typename elemT>
+    static elemT apply(const elemT& lhs, const elemT& rhs) { return lhs / rhs; }
+    template <typename elemT>
+    static elemT apply_without_lhs(const elemT&) { elemT zero; assign(zero, 0); return zero; }
+  };
+
+  //! node for a binary operation
+  template <int num_dimensions, typename elemT, class LhsT, class RhsT, class OpT>
+  class ArrayBinaryExpression
+  {
+  public:
+    typedef ArrayBinaryExpression<num_dimensions-1, elemT,
+                                  typename LhsT::sub_expression_type,
+                                  typename RhsT::sub_expression_type,
+                                  OpT> sub_expression_type;
+
+    ArrayBinaryExpression() {}
+    ArrayBinaryExpression(const LhsT& lhs, const RhsT& rhs) : lhs(lhs), rhs(rhs) {}
+
+    bool is_scalar() const { return false; }
+    bool empty() const { return !has_range(lhs) && !has_range(rhs); }
+    int get_min_index() const
+    {
+      if (!has_range(lhs)) return rhs.get_min_index();
+      if (!has_range(rhs)) return lhs.get_min_index();
+      return std::min(lhs.get_min_index(), rhs.get_min_index());
+    }
+    int get_max_index() const
+    {
+      if (!has_range(lhs)) return rhs.get_max_index();
+      if (!has_range(rhs)) return lhs.get_max_index();
+      return std::max(lhs.get_max_index(), rhs.get_max_index());
+    }
+    bool is_in_range(const int i) const
+    { return !this->empty() && i>=this->get_min_index() && i<=this->get_max_index(); }
+    bool covers(const int min_index, const int max_index) const
+    { return lhs.covers(min_index, max_index) && rhs.covers(min_index, max_index); }
+    sub_expression_type operator[](const int i) const
+    { return sub_expression_type(lhs[i], rhs[i]); }
+
+  private:
+    LhsT lhs;
+    RhsT rhs;
+    template <class T>
+    static bool has_range(const T& t) { return !t.is_scalar() && !t.empty(); }
+  };
+
+  //! node for a binary operation, 1D specialisation
+  template <typename elemT, class LhsT, class RhsT, class OpT>
+  class ArrayBinaryExpression<1, elemT, LhsT, RhsT, OpT>
+  {
+  public:
+    ArrayBinaryExpression() {}
+    ArrayBinaryExpression(const LhsT& lhs, const RhsT& rhs) : lhs(lhs), rhs(rhs) {}
+
+    bool is_scalar() const { return false; }
+    bool empty() const { return !has_range(lhs) && !has_range(rhs); }
+    int get_min_index() const
+    {
+      if (!has_range(lhs)) return rhs.get_min_index();
+      if (!has_range(rhs)) return lhs.get_min_index();
+      return std::min(lhs.get_min_index(), rhs.get_min_index());
+    }
+    int get_max_index() const
+    {
+      if (!has_range(lhs)) return rhs.get_max_index();
+      if (!has_range(rhs)) return lhs.get_max_index();
+      return std::max(lhs.get_max_index(), rhs.get_max_index());
+    }
+    bool is_in_range(const int i) const
+    { return !this->empty() && i>=this->get_min_index() && i<=this->get_max_index(); }
+    bool covers(const int min_index, const int max_index) const
+    { return lhs.covers(min_index, max_index) && rhs.covers(min_index, max_index); }
+
+    //! value at index \a i, where elements outside the range of an operand are handled
+    elemT value(const int i) const
+    {
+      const bool lhs_in_range = lhs.is_in_range(i);
+      const bool rhs_in_range = rhs.is_in_range(i);
+      if (lhs_in_range)
+        return rhs_in_range ? OpT::apply(lhs.value(i), rhs.value(i)) : lhs.value(i);
+      if (rhs_in_range)
+        return OpT::template apply_without_lhs<elemT>(rhs.value(i));
+      elemT zero; assign(zero, 0); return zero;
+    }
+    //! value at index \a i, can only be used if covers() returned \c true for \a i
+    elemT value_without_range_check(const int i) const
+    {
+      return OpT::apply(array_expression_value_without_range_check<elemT>(lhs, i),
+                        array_expression_value_without_range_check<elemT>(rhs, i));
+    }
+
+  private:
+    LhsT lhs;
+    RhsT rhs;
+    template <class T>
+    static bool has_range(const T& t) { return !t.is_scalar() && !t.empty(); }
+  };
+  //@}
+
+
+  //! helper class to make a function argument non-deducible
+  template <class T>
+  struct ArrayExpressionNonDeduced { typedef T type; };
+
+  //! evaluate an expression into an Array with the same index range
+  template <typename elemT, class ExprT>
+  inline void assign_array_expression(Array<1, elemT>& array, const ExprT& expr);
+  template <int num_dimensions, typename elemT, class ExprT>
+  inline void assign_array_expression(Array<num_dimensions, elemT>& array, const ExprT& expr);
+  //! find the index range of an expression
+  template <typename elemT, class ExprT>
+  inline IndexRange<1> get_array_expression_index_range(const ExprT& expr, const Array<1,elemT>*);
+  template <int num_dimensions, typename elemT, class ExprT>
+  inline IndexRange<num_dimensions> get_array_expression_index_range(const ExprT& expr, const Array<num_dimensions,elemT>*);
+
+} // end of namespace detail
+
+/*!
+  \ingroup Array
+  \brief Class for lazy evaluation of arithmetic operations on Arrays
+
+  The arithmetic operators +,-,*,/ with Array arguments (and/or scalars of the
+  same element type) do not compute their result immediately, but return an
+  ArrayExpression. The result is only evaluated when assigned to an Array (or
+  used to construct one). In that case, all operations are performed in
+  a single loop over all elements, without any temporary arrays. For instance
+  \code
+  Array<3,float> result = a*x + b*y/z;
+  \endcode
+  with \c a and \c b floats and \c x, \c y, \c z 3D arrays will loop only once
+  over all elements. Similarly, <code>x += a*y;</code> does not create a temporary Array.
+
+  If the arguments have different index ranges, the result will have the same values
+  (and index range) as obtained with the arithmetic assignment operators, e.g.
+  <code>x + y</code> gives the same result as <code>Array<3,float> tmp(x); tmp += y;</code>.
+
+  \warning An ArrayExpression stores references to its Array arguments. It should
+  therefore not be stored but only be used to assign to an Array in the same statement.
+  If that statement assigns to one of the arguments, the result is still correct
+  (as all operations are element-wise).
+*/
+template <int num_dimensions, typename elemT, class ExprT>
+class ArrayExpression
+{
+ public:
+  typedef ExprT expression_type;
+
+  explicit ArrayExpression(const ExprT& expr) : expr(expr) {}
+
+  //! return the expression tree
+  const ExprT& get_expression() const { return expr; }
+
+  //! return the index range of the result
+  IndexRange<num_dimensions> get_index_range() const
+  {
+    return
+      detail::get_array_expression_index_range(expr, static_cast<const Array<num_dimensions,elemT>*>(0));
+  }
+
+ private:
+  ExprT expr;
+};
+
+END_NAMESPACE_STIR
+
+#include "stir/ArrayExpression.inl"
+
+#endif
@@ -0,0 +1,276 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup Array
+  \brief inline implementations for stir::ArrayExpression and the arithmetic operators for stir::Array
+*/
+
+START_NAMESPACE_STIR
+
+namespace detail
+{
+
+template <typename elemT, class T>
+elemT
+array_expression_value_without_range_check(const T& t, const int i)
+{
+  return t.value(i);
+}
+
+template <typename elemT, class LhsT, class RhsT, class OpT>
+elemT
+array_expression_value_without_range_check(const ArrayBinaryExpression<1, elemT, LhsT, RhsT, OpT>& t, const int i)
+{
+  return t.value_without_range_check(i);
+}
+
+template <typename elemT, class ExprT>
+void
+assign_array_expression(Array<1, elemT>& array, const ExprT& expr)
+{
+  if (array.get_length() == 0)
+    return;
+  const int min_index = array.get_min_index();
+  const int max_index = array.get_max_index();
+  typename Array<1, elemT>::iterator iter = array.begin();
+  if (expr.covers(min_index, max_index))
+    {
+      // fast loop
+      for (int i=min_index; i<=max_index; ++i, ++iter)
+        *iter = array_expression_value_without_range_check<elemT>(expr, i);
+    }
+  else
+    {
+      for (int i=min_index; i<=max_index; ++i, ++iter)
+        *iter = expr.value(i);
+    }
+}
+
+template <int num_dimensions, typename elemT, class ExprT>
+void
+assign_array_expression(Array<num_dimensions, elemT>& array, const ExprT& expr)
+{
+  for (int i=array.get_min_index(); i<=array.get_max_index(); ++i)
+    assign_array_expression(array[i], expr[i]);
+}
+
+template <typename elemT, class ExprT>
+IndexRange<1>
+get_array_expression_index_range(const ExprT& expr, const Array<1,elemT>*)
+{
+  if (expr.empty())
+    return IndexRange<1>(0,-1);
+  return IndexRange<1>(expr.get_min_index(), expr.get_max_index());
+}
+
+template <int num_dimensions, typename elemT, class ExprT>
+IndexRange<num_dimensions>
+get_array_expression_index_range(const ExprT& expr, const Array<num_dimensions,elemT>*)
+{
+  if (expr.empty())
+    return IndexRange<num_dimensions>();
+  VectorWithOffset<IndexRange<num_dimensions-1> >
+    range(expr.get_min_index(), expr.get_max_index());
+  for (int i=expr.get_min_index(); i<=expr.get_max_index(); ++i)
+    range[i] =
+      get_array_expression_index_range(expr[i], static_cast<const Array<num_dimensions-1,elemT>*>(0));
+  return IndexRange<num_dimensions>(range);
+}
+
+} // end of namespace detail
+
+/* The arithmetic operators.
+   We need versions for all combinations of Array, ArrayExpression and scalars.
+   To avoid repeating the same code for every operator, we use a macro.
+*/
+#define STIR_DEFINE_ARRAY_EXPRESSION_OPERATOR(OPERATOR, OPERATION)             \
+template <int num_dimensions, typename elemT>                                  \
+inline                                                                         \
+ArrayExpression<num_dimensions, elemT,                                         \
+  detail::ArrayBinaryExpression<num_dimensions, elemT,                         \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::OPERATION> >                                                       \
+OPERATOR(const Array<num_dimensions, elemT>& lhs,                              \
+         const Array<num_dimensions, elemT>& rhs)                              \
+{                                                                              \
+  typedef detail::ArrayBinaryExpression<num_dimensions, elemT,                 \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::OPERATION> expr_type;                                              \
+  return ArrayExpression<num_dimensions, elemT, expr_type>                     \
+    (expr_type(detail::ArrayExpressionLeaf<num_dimensions, elemT>(lhs),        \
+               detail::ArrayExpressionLeaf<num_dimensions, elemT>(rhs)));      \
+}                                                                              \
+                                                                               \
+template <int num_dimensions, typename elemT, class RhsT>                      \
+inline                                                                         \
+ArrayExpression<num_dimensions, elemT,                                         \
+  detail::ArrayBinaryExpression<num_dimensions, elemT,                         \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    RhsT,                                                                      \
+    detail::OPERATION> >                                                       \
+OPERATOR(const Array<num_dimensions, elemT>& lhs,                              \
+         const ArrayExpression<num_dimensions, elemT, RhsT>& rhs)              \
+{                                                                              \
+  typedef detail::ArrayBinaryExpression<num_dimensions, elemT,                 \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    RhsT,                                                                      \
+    detail::OPERATION> expr_type;                                              \
+  return ArrayExpression<num_dimensions, elemT, expr_type>                     \
+    (expr_type(detail::ArrayExpressionLeaf<num_dimensions, elemT>(lhs),        \
+               rhs.get_expression()));                                         \
+}                                                                              \
+                                                                               \
+template <int num_dimensions, typename elemT, class LhsT>                      \
+inline                                                                         \
+ArrayExpression<num_dimensions, elemT,                                         \
+  detail::ArrayBinaryExpression<num_dimensions, elemT,                         \
+    LhsT,                                                                      \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::OPERATION> >                                                       \
+OPERATOR(const ArrayExpression<num_dimensions, elemT, LhsT>& lhs,              \
+         const Array<num_dimensions, elemT>& rhs)                              \
+{                                                                              \
+  typedef detail::ArrayBinaryExpression<num_dimensions, elemT,                 \
+    LhsT,                                                                      \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::OPERATION> expr_type;                                              \
+  return ArrayExpression<num_dimensions, elemT, expr_type>                     \
+    (expr_type(lhs.get_expression(),                                           \
+               detail::ArrayExpressionLeaf<num_dimensions, elemT>(rhs)));      \
+}                                                                              \
+                                                                               \
+template <int num_dimensions, typename elemT, class LhsT, class RhsT>          \
+inline                                                                         \
+ArrayExpression<num_dimensions, elemT,                                         \
+  detail::ArrayBinaryExpression<num_dimensions, elemT,                         \
+    LhsT, RhsT, detail::OPERATION> >                                           \
+OPERATOR(const ArrayExpression<num_dimensions, elemT, LhsT>& lhs,              \
+         const ArrayExpression<num_dimensions, elemT, RhsT>& rhs)              \
+{                                                                              \
+  typedef detail::ArrayBinaryExpression<num_dimensions, elemT,                 \
+    LhsT, RhsT, detail::OPERATION> expr_type;                                  \
+  return ArrayExpression<num_dimensions, elemT, expr_type>                     \
+    (expr_type(lhs.get_expression(), rhs.get_expression()));                   \
+}                                                                              \
+                                                                               \
+template <int num_dimensions, typename elemT>                                  \
+inline                                                                         \
+ArrayExpression<num_dimensions, elemT,                                         \
+  detail::ArrayBinaryExpression<num_dimensions, elemT,                         \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::ArrayExpressionScalar<num_dimensions, elemT>,                      \
+    detail::OPERATION> >                                                       \
+OPERATOR(const Array<num_dimensions, elemT>& lhs,                              \
+         const typename detail::ArrayExpressionNonDeduced<elemT>::type& rhs)   \
+{                                                                              \
+  typedef detail::ArrayBinaryExpression<num_dimensions, elemT,                 \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::ArrayExpressionScalar<num_dimensions, elemT>,                      \
+    detail::OPERATION> expr_type;                                              \
+  return ArrayExpression<num_dimensions, elemT, expr_type>                     \
+    (expr_type(detail::ArrayExpressionLeaf<num_dimensions, elemT>(lhs),        \
+               detail::ArrayExpressionScalar<num_dimensions, elemT>(rhs)));    \
+}                                                                              \
+                                                                               \
+template <int num_dimensions, typename elemT>                                  \
+inline                                                                         \
+ArrayExpression<num_dimensions, elemT,                                         \
+  detail::ArrayBinaryExpression<num_dimensions, elemT,                         \
+    detail::ArrayExpressionScalar<num_dimensions, elemT>,                      \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::OPERATION> >                                                       \
+OPERATOR(const typename detail::ArrayExpressionNonDeduced<elemT>::type& lhs,   \
+         const Array<num_dimensions, elemT>& rhs)                              \
+{                                                                              \
+  typedef detail::ArrayBinaryExpression<num_dimensions, elemT,                 \
+    detail::ArrayExpressionScalar<num_dimensions, elemT>,                      \
+    detail::ArrayExpressionLeaf<num_dimensions, elemT>,                        \
+    detail::OPERATION> expr_type;                                              \
+  return ArrayExpression<num_dimensions, elemT, expr_type>                     \
+    (expr_type(detail::ArrayExpressionScalar<num_dimensions, elemT>(lhs),      \
+               detail::ArrayExpressionLeaf<num_dimensions, elemT>(rhs)));      \
+}                                                                              \
+                                                                               \
+template <int num_dimensions, typename elemT, class LhsT>                      \
+inline                                                                         \
+ArrayExpression<num_dimensions, elemT,                                         \
+  detail::ArrayBinaryExpression<num_dimensions, elemT,                         \
+    LhsT,                                                                      \
+    detail::ArrayExpressionScalar<num_dimensions, elemT>,                      \
+    detail::OPERATION> >                                                       \
+OPERATOR(const ArrayExpression<num_dimensions, elemT, LhsT>& lhs,              \
+         const typename detail::ArrayExpressionNonDeduced<elemT>::type& rhs)   \
+{                                                                              \
+  typedef detail::ArrayBinaryExpression<num_dimensions, elemT,                 \
+    LhsT,                                                                      \
+    detail::ArrayExpressionScalar<num_dimensions, elemT>,                      \
+    detail::OPERATION> expr_type;                                              \
+  return ArrayExpression<num_dimensions, elemT, expr_type>                     \
+    (expr_type(lhs.get_expression(),                                           \
+               detail::ArrayExpressionScalar<num_dimensions, elemT>(rhs)));    \
+}                                                                              \
+                                                                               \
+template <int num_dimensions, typename elemT, class RhsT>                      \
+inline                                                                         \
+ArrayExpression<num_dimensions, elemT,                                         \
+  detail::ArrayBinaryExpression<num_dimensions, elemT,                         \
+    detail::ArrayExpressionScalar<num_dimensions, elemT>,                      \
+    RhsT,                                                                      \
+    detail::OPERATION> >                                                       \
+OPERATOR(const typename detail::ArrayExpressionNonDeduced<elemT>::type& lhs,   \
+         const ArrayExpression<num_dimensions, elemT, RhsT>& rhs)              \
+{                                                                              \
+  typedef detail::ArrayBinaryExpression<num_dimensions, elemT,                 \
+    detail::ArrayExpressionScalar<num_dimensions, elemT>,                      \
+    RhsT,                                                                      \
+    detail::OPERATION> expr_type;                                              \
+  return ArrayExpression<num_dimensions, elemT, expr_type>                     \
+    (expr_type(detail::ArrayExpressionScalar<num_dimensions, elemT>(lhs),      \
+               rhs.get_expression()));                                         \
+}
+
+STIR_DEFINE_ARRAY_EXPRESSION_OPERATOR(operator+, ArrayExpressionPlus)
+STIR_DEFINE_ARRAY_EXPRESSION_OPERATOR(operator-, ArrayExpressionMinus)
+STIR_DEFINE_ARRAY_EXPRESSION_OPERATOR(operator*, ArrayExpressionMultiplies)
+STIR_DEFINE_ARRAY_EXPRESSION_OPERATOR(operator/, ArrayExpressionDivides)
+
+#undef STIR_DEFINE_ARRAY_EXPRESSION_OPERATOR
+
+/* Numeric assignment operators with an ArrayExpression argument.
+   These are defined as non-members such that they do not hide
+   NumericVectorWithOffset::operator+= etc.
+*/
+#define STIR_DEFINE_ARRAY_EXPRESSION_ASSIGNMENT_OPERATOR(OPERATOR, BINARY_OPERATOR) \
+template <int num_dimensions, typename elemT, class ExprT>                     \
+inline Array<num_dimensions, elemT>&                                           \
+OPERATOR(Array<num_dimensions, elemT>& lhs,                                    \
+         const ArrayExpression<num_dimensions, elemT, ExprT>& rhs)             \
+{                                                                              \
+  return lhs = BINARY_OPERATOR(lhs, rhs);                                      \
+}
+
+STIR_DEFINE_ARRAY_EXPRESSION_ASSIGNMENT_OPERATOR(operator+=, operator+)
+STIR_DEFINE_ARRAY_EXPRESSION_ASSIGNMENT_OPERATOR(operator-=, operator-)
+STIR_DEFINE_ARRAY_EXPRESSION_ASSIGNMENT_OPERATOR(operator*=, operator*)
+STIR_DEFINE_ARRAY_EXPRESSION_ASSIGNMENT_OPERATOR(operator/=, operator/)
+
+#undef STIR_DEFINE_ARRAY_EXPRESSION_ASSIGNMENT_OPERATOR
+
+END_NAMESPACE_STIR
@@ -23,8 +23,11 @@
 */
 
 #include "stir/ProjData.h"
+#include "stir/Array.h"
 
 #include <boost/random/mersenne_twister.hpp>
+#include <boost/cstdint.hpp>
+#include <cstddef>
 #include <boost/random/variate_generator.hpp>
 #include <algorithm>
 #include <boost/bind.hpp>
@@ -48,6 +51,22 @@ START_NAMESPACE_STIR
   be equal to <tt>scaling_factor*mean_of_input</tt>, otherwise it
   will be equal to mean_of_input, but then the output is no longer Poisson
   distributed.
+
+  \par Counter-based generation
+
+  By default, all random numbers are drawn from a single (static) Mersenne twister.
+  The result therefore depends on the order in which the numbers are drawn, and
+  generation cannot be parallelised. After calling
+  <tt>set_use_counter_based_generator(true)</tt>, the random number for every element
+  is computed with the Philox4x32 counter-based generator from the seed and the index
+  of the element (in the order of the full iterator of the array, and for
+  projection data, counting over all segments). Elements can then be generated in
+  any order, and when STIR is compiled with OpenMP, this is done in parallel.
+  The result is independent of the number of threads.
+
+  The index continues over successive calls of generate_random(), such that these give
+  different realisations. seed() resets the index to 0. A noise realisation of a data set
+  generated straight after seed() therefore only depends on the seed.
 */
 class GeneralisedPoissonNoiseGenerator
 {
@@ -62,6 +81,10 @@ class GeneralisedPoissonNoiseGenerator
   //! The seed value for the random number generator
   void seed(unsigned int);
 
+  //! Use the counter-based generator (see class documentation)
+  void set_use_counter_based_generator(const bool);
+  bool get_use_counter_based_generator() const;
+
   //! generate a random number according to a distribution with mean mu
   float generate_random(const float mu);
      
@@ -69,6 +92,12 @@ class GeneralisedPoissonNoiseGenerator
     void generate_random(Array<num_dimensions, elemTout>& array_out,
                          const Array<num_dimensions, elemTin>& array_in)
     {
+      if (this->use_counter_based_generator)
+        {
+          this->generate_random_counter_based(array_out, array_in, this->next_index);
+          this->next_index += array_in.size_all();
+          return;
+        }
       std::transform(array_in.begin_all(), array_in.end_all(),
                      array_out.begin_all(),
                      boost::bind(generate_scaled_poisson_random, _1, this->scaling_factor, this->preserve_mean));
@@ -82,10 +111,50 @@ class GeneralisedPoissonNoiseGenerator
   static base_generator_type generator;
   const float scaling_factor;
   const bool preserve_mean;
+  bool use_counter_based_generator;
+  unsigned int counter_based_seed;
+  //! index of the next element when using the counter-based generator
+  boost::uint64_t next_index;
 
   static unsigned int generate_poisson_random(const float mu);
   static float generate_scaled_poisson_random(const float mu, const float scaling_factor, const bool preserve_mean);
 
+  //! generate the random number for the element with index \a index using the counter-based generator
+  float generate_scaled_poisson_random_counter_based(const float mu, const boost::uint64_t index) const;
+
+  //! counter-based generation, where the element at position \c i uses the index <tt>first_index+i</tt>
+  template <int num_dimensions, class elemTout, class elemTin>
+    void generate_random_counter_based(Array<num_dimensions, elemTout>& array_out,
+                                       const Array<num_dimensions, elemTin>& array_in,
+                                       const boost::uint64_t first_index) const
+    {
+      assert(array_out.size_all() == array_in.size_all());
+      if (array_out.is_contiguous() && array_in.is_contiguous())
+        {
+          const std::ptrdiff_t num_elements = static_cast<std::ptrdiff_t>(array_in.size_all());
+          elemTout * const out_ptr = array_out.get_full_data_ptr();
+          const elemTin * const in_ptr = array_in.get_const_full_data_ptr();
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+          for (std::ptrdiff_t i=0; i<num_elements; ++i)
+            out_ptr[i] =
+              static_cast<elemTout>(generate_scaled_poisson_random_counter_based(static_cast<float>(in_ptr[i]),
+                                                                                 first_index + i));
+          array_out.release_full_data_ptr();
+          array_in.release_const_full_data_ptr();
+        }
+      else
+        {
+          typename Array<num_dimensions, elemTout>::full_iterator out_iter = array_out.begin_all();
+          typename Array<num_dimensions, elemTin>::const_full_iterator in_iter = array_in.begin_all_const();
+          for (boost::uint64_t index = first_index; in_iter != array_in.end_all_const(); ++in_iter, ++out_iter, ++index)
+            *out_iter =
+              static_cast<elemTout>(generate_scaled_poisson_random_counter_based(static_cast<float>(*in_iter),
+                                                                                 index));
+        }
+    }
+
 };
 
 END_NAMESPACE_STIR
@@ -66,8 +66,18 @@ START_NAMESPACE_STIR
         offset (num of detectors) := 0
         low energy window (keV) := 0
         upper energy window (keV):= 10000
+        read cache size (MB) := 100
        \endverbatim
 
+       Only the branches that are used by STIR are read from the file (all other
+       branches are disabled), and their baskets are read in bulk via ROOT's TTreeCache,
+       whose size is set by <tt>read cache size (MB)</tt>.
+
+       Baskets can be decompressed in parallel by ROOT's implicit multi-threading.
+       As this affects all ROOT I/O in the program, it is not a parameter of this
+       class, but has to be switched on explicitly by the application via
+       enable_implicit_multi_threading(), before opening the files.
+
         \warning The initial validation of the ROOT input was done with version 5.34.
 */
 
@@ -155,6 +165,18 @@ public:
     inline void set_upper_energy_window(float);
     //! Set the read_optional_root_fields flag
     inline void set_optional_ROOT_fields(bool);
+    //! Set the size of the read cache (in MB)
+    inline void set_read_cache_size_in_MB(int);
+
+    //! Enable ROOT's implicit multi-threading for the whole process
+    /*! ROOT will then decompress the baskets of all trees on a thread pool of
+        \a num_threads threads (0 lets ROOT choose). This has to be called before
+        the files are opened. Returns Succeeded::no (with a warning) if ROOT
+        was compiled without \c imt support.
+    */
+    static Succeeded enable_implicit_multi_threading(unsigned int num_threads = 0);
+    //! Disable ROOT's implicit multi-threading for the whole process
+    static void disable_implicit_multi_threading();
 
 protected:
 
@@ -162,6 +184,12 @@ protected:
     virtual void initialise_keymap();
     virtual bool post_processing();
 
+    //! Enable reading of a branch and set its address
+    /*! All branches are disabled by set_up(), so every branch that is needed
+        has to be set via this function. */
+    template <class T>
+    inline void set_branch_address(const char * const branch_name, T * const address);
+
     //! Input data file name
     std::string filename;
     //! The starting position.
@@ -206,6 +234,8 @@ protected:
     //! (<a href="http://wiki.opengatecollaboration.org/index.php/Users_Guide_V7.2:Digitizer_and_readout_parameters">here</a> )
     //! > the readout depth depends upon how the electronic readout functions.
     int singles_readout_depth;
+    //! Size of the TTreeCache (in MB)
+    int read_cache_size_in_MB;
 };
 
 END_NAMESPACE_STIR
@@ -154,4 +154,18 @@ InputStreamFromROOTFile::set_optional_ROOT_fields(bool val)
     read_optional_root_fields = val;
 }
 
+void
+InputStreamFromROOTFile::set_read_cache_size_in_MB(int val)
+{
+    read_cache_size_in_MB = val;
+}
+
+template <class T>
+void
+InputStreamFromROOTFile::set_branch_address(const char * const branch_name, T * const address)
+{
+    stream_ptr->SetBranchStatus(branch_name, 1);
+    stream_ptr->SetBranchAddress(branch_name, address);
+}
+
 END_NAMESPACE_STIR
@@ -44,9 +44,16 @@ START_NAMESPACE_STIR
     the function to find out what the size of the record is. In that case, all IO
     handling is completely generic and is implemented in this class.
 
-    Current implementation needs a \c max_size_of_record to allocate enough memory 
-    (on the stack) before reading. This is efficient in many cases, but impractical 
-    in others.
+    Data are read from the stream in large blocks into an internal buffer (which is
+    allocated once), and records are decoded from this buffer. This avoids an allocation
+    and calls to the stream for every record. Positions returned by save_get_position()
+    are positions in the stream (as before), i.e. they take into account what is still in the
+    buffer. Note that this means that the stream is not positioned at the end of the
+    last record read. The stream should therefore not be used by other code while this
+    object is in use.
+
+    The implementation needs a \c max_size_of_record to make sure that a complete record
+    is in the buffer before decoding it.
 
     \par Requirements
     \c RecordT needs to have the following member functions
@@ -61,7 +68,9 @@ START_NAMESPACE_STIR
                          const OptionsT options);
     \endcode
 
-    \todo Allow choosing between allocation with \c new or on the stack.
+    In addition to get_next_record(), get_next_records() decodes a batch of records in one call.
+    It decodes directly from the buffer as long as the buffer is guaranteed to contain a
+    complete record, and only refills the buffer when this is no longer the case.
 */
 template <class RecordT, class OptionsT>
 class InputStreamWithRecords
@@ -94,6 +103,17 @@ public:
   virtual 
     Succeeded get_next_record(RecordT& record) const;
 
+  //! read the next \a max_num_records records
+  /*! \a records has to point to (at least) \a max_num_records objects of type \c RecordT
+      (not of a derived type), as RecordT::size_of_record_at_ptr() and RecordT::init_from_data_ptr()
+      are called without virtual function dispatch. This allows the compiler to inline them.
+      \return the number of records read. If this is less than \a max_num_records,
+      the end of the data was reached, there was a read error, or a record could not be decoded
+      (as for get_next_record(), this record is skipped).
+  */
+  inline
+    std::size_t get_next_records(RecordT * const records, const std::size_t max_num_records) const;
+
   //! go back to starting position
   inline
     Succeeded reset();
@@ -106,6 +126,9 @@ public:
   SavedPosition save_get_position();
 
   //! set current "get" position to previously saved value
+  /*! If the position was saved after the end of the data was reached, a next call to
+      save_get_position() will again return a position that indicates the end of the data.
+  */
   inline
   Succeeded set_get_position(const SavedPosition&);
 
@@ -136,6 +159,25 @@ private:
   const std::size_t max_size_of_record;
 
   const OptionsT options;
+
+  //! buffer with data read from the stream
+  mutable std::vector<char> buffer;
+  //! position in the buffer of the next record
+  mutable std::size_t buffer_position;
+  //! number of bytes in the buffer that were read from the stream
+  mutable std::size_t buffer_end;
+  //! position in the stream corresponding to the start of the buffer
+  mutable std::streampos buffer_stream_position;
+  //! set when get_next_record() failed because there was no more data
+  mutable bool end_of_data_reached;
+
+  //! make sure that at least \a num_bytes are available in the buffer after \c buffer_position
+  /*! Reads more data from the stream if necessary.
+      \return \c false if there is not enough data left in the stream
+  */
+  inline bool fill_buffer(const std::size_t num_bytes) const;
+  //! empty the buffer and record the current position of the stream
+  inline void clear_buffer(const std::streampos stream_position);
 };
 
 END_NAMESPACE_STIR
@@ -28,10 +28,18 @@
 #include "stir/Succeeded.h"
 #include "stir/is_null_ptr.h"
 #include "stir/shared_ptr.h"
-#include "boost/shared_array.hpp"
 #include <fstream>
+#include <algorithm>
+#include <cstring>
 
 START_NAMESPACE_STIR
+
+namespace detail
+{
+  //! size of the buffer used by InputStreamWithRecords (unless records are larger)
+  static const std::size_t InputStreamWithRecords_buffer_size = 1<<20;
+}
+
 template <class RecordT, class OptionsT>
 InputStreamWithRecords<RecordT, OptionsT>::
 InputStreamWithRecords(const shared_ptr<std::istream>& stream_ptr,
@@ -41,7 +49,11 @@ InputStreamWithRecords(const shared_ptr<std::istream>& stream_ptr,
   : stream_ptr(stream_ptr),
     size_of_record_signature(size_of_record_signature),
     max_size_of_record(max_size_of_record),
-    options(options)
+    options(options),
+    buffer(std::max(detail::InputStreamWithRecords_buffer_size, 2*max_size_of_record)),
+    buffer_position(0),
+    buffer_end(0),
+    end_of_data_reached(false)
 {
   assert(size_of_record_signature<=max_size_of_record);
   if (is_null_ptr(stream_ptr))
@@ -49,6 +61,7 @@ InputStreamWithRecords(const shared_ptr<std::istream>& stream_ptr,
   starting_stream_position = stream_ptr->tellg();
   if (!stream_ptr->good())
     error("InputStreamWithRecords: error in tellg()\n");
+  clear_buffer(starting_stream_position);
 }
 
 template <class RecordT, class OptionsT>
@@ -62,7 +75,11 @@ InputStreamWithRecords(const std::string& filename,
     starting_stream_position(start_of_data),
     size_of_record_signature(size_of_record_signature),
     max_size_of_record(max_size_of_record),
-    options(options)
+    options(options),
+    buffer(std::max(detail::InputStreamWithRecords_buffer_size, 2*max_size_of_record)),
+    buffer_position(0),
+    buffer_end(0),
+    end_of_data_reached(false)
 {
   assert(size_of_record_signature<=max_size_of_record);
   std::fstream* s_ptr = new std::fstream;
@@ -73,6 +90,46 @@ InputStreamWithRecords(const std::string& filename,
 	  filename.c_str());
 }
 
+template <class RecordT, class OptionsT>
+void
+InputStreamWithRecords<RecordT, OptionsT>::
+clear_buffer(const std::streampos stream_position)
+{
+  this->buffer_position = 0;
+  this->buffer_end = 0;
+  this->buffer_stream_position = stream_position;
+  this->end_of_data_reached = false;
+}
+
+template <class RecordT, class OptionsT>
+bool
+InputStreamWithRecords<RecordT, OptionsT>::
+fill_buffer(const std::size_t num_bytes) const
+{
+  if (this->buffer_end - this->buffer_position >= num_bytes)
+    return true;
+
+  // move the remaining bytes to the start of the buffer
+  const std::size_t num_remaining_bytes = this->buffer_end - this->buffer_position;
+  if (num_remaining_bytes>0)
+    std::memmove(&this->buffer[0], &this->buffer[this->buffer_position], num_remaining_bytes);
+  this->buffer_stream_position += static_cast<std::streamoff>(this->buffer_position);
+  this->buffer_position = 0;
+  this->buffer_end = num_remaining_bytes;
+
+  if (stream_ptr->eof())
+    return false;
+  stream_ptr->read(&this->buffer[this->buffer_end],
+                   static_cast<std::streamsize>(this->buffer.size() - this->buffer_end));
+  this->buffer_end += static_cast<std::size_t>(stream_ptr->gcount());
+  if (stream_ptr->bad())
+    {
+      warning("Error after reading from list mode stream in get_next_record");
+      return false;
+    }
+  return this->buffer_end >= num_bytes;
+}
+
 template <class RecordT, class OptionsT>
 Succeeded
 InputStreamWithRecords<RecordT, OptionsT>::
@@ -81,30 +138,73 @@ get_next_record(RecordT& record) const
   if (is_null_ptr(stream_ptr))
     return Succeeded::no;
 
-  // rely on file caching by the C++ library or the OS
   assert(this->size_of_record_signature <= this->max_size_of_record);
-  boost::shared_array<char> data_sptr(new char[this->max_size_of_record]);
-  char * data_ptr = data_sptr.get();
-  stream_ptr->read(data_ptr, this->size_of_record_signature);
-  if (stream_ptr->gcount()<static_cast<std::streamsize>(this->size_of_record_signature))
-    return Succeeded::no; 
-  const std::size_t size_of_record = record.size_of_record_at_ptr(data_ptr, this->size_of_record_signature,options);
+  if (!this->fill_buffer(this->size_of_record_signature))
+    {
+      this->end_of_data_reached = true;
+      return Succeeded::no;
+    }
+  const std::size_t size_of_record =
+    record.size_of_record_at_ptr(&this->buffer[this->buffer_position], this->size_of_record_signature,options);
   assert(size_of_record <= this->max_size_of_record);
-  if (size_of_record > this->size_of_record_signature)
-    stream_ptr->read(data_ptr + this->size_of_record_signature,
-                     size_of_record - this->size_of_record_signature);
-  if (stream_ptr->eof())
-    return Succeeded::no; 
-  else if (stream_ptr->bad())
-    { 
-      warning("Error after reading from list mode stream in get_next_record");
-      return Succeeded::no; 
+  if (size_of_record > this->size_of_record_signature &&
+      !this->fill_buffer(size_of_record))
+    {
+      this->end_of_data_reached = true;
+      return Succeeded::no;
     }
+  const char * const data_ptr = &this->buffer[this->buffer_position];
+  this->buffer_position += size_of_record;
   return 
     record.init_from_data_ptr(data_ptr, size_of_record,options);
 }
 
+template <class RecordT, class OptionsT>
+std::size_t
+InputStreamWithRecords<RecordT, OptionsT>::
+get_next_records(RecordT * const records, const std::size_t max_num_records) const
+{
+  if (is_null_ptr(stream_ptr))
+    return 0;
+
+  std::size_t num_records = 0;
+  while (num_records < max_num_records)
+    {
+      // decode records directly from the buffer, as long as it is guaranteed to contain
+      // a complete record
+      const char * const buffer_ptr = &this->buffer[0];
+      std::size_t position = this->buffer_position;
+      while (num_records < max_num_records &&
+             position + this->max_size_of_record <= this->buffer_end)
+        {
+          // records[] contains objects of type RecordT (not of a derived type), so we can avoid
+          // virtual function calls (if any)
+          RecordT& record = records[num_records];
+          const std::size_t size_of_record =
+            record.RecordT::size_of_record_at_ptr(buffer_ptr + position, this->size_of_record_signature, options);
+          assert(size_of_record <= this->max_size_of_record);
+          const Succeeded success =
+            record.RecordT::init_from_data_ptr(buffer_ptr + position, size_of_record, options);
+          position += size_of_record;
+          if (success == Succeeded::no)
+            {
+              this->buffer_position = position;
+              return num_records;
+            }
+          ++num_records;
+        }
+      this->buffer_position = position;
+      if (num_records == max_num_records)
+        break;
 
+      // not enough data left in the buffer for the largest record, so use get_next_record(),
+      // which reads more data (or finds the end of the data)
+      if (InputStreamWithRecords<RecordT, OptionsT>::get_next_record(records[num_records]) == Succeeded::no)
+        break;
+      ++num_records;
+    }
+  return num_records;
+}
 
 template <class RecordT, class OptionsT>
 Succeeded
@@ -118,6 +218,7 @@ reset()
   if (stream_ptr->eof()) 
     stream_ptr->clear();
   stream_ptr->seekg(starting_stream_position, std::ios::beg);
+  clear_buffer(starting_stream_position);
   if (stream_ptr->bad())
     return Succeeded::no;
   else
@@ -131,19 +232,15 @@ InputStreamWithRecords<RecordT, OptionsT>::
 save_get_position() 
 {
   assert(!is_null_ptr(stream_ptr));
-  // TODO should somehow check if tellg() worked and return an error if it didn't
   std::streampos pos;
-  if (!stream_ptr->eof())
+  if (!this->end_of_data_reached)
     {
-      pos = stream_ptr->tellg();
-      if (!stream_ptr->good())
-	error("InputStreamWithRecords<RecordT, OptionsT>::save_get_position\n"
-	      "Error after getting position in file");
+      // position of the next record, i.e. taking the data in the buffer into account
+      pos = this->buffer_stream_position + static_cast<std::streamoff>(this->buffer_position);
     }
   else
     {
       // use -1 to signify eof 
-      // (this is probably the behaviour of tellg anyway, but this way we're sure).
       pos = std::streampos(-1); 
     }
   saved_get_positions.push_back(pos);
@@ -160,15 +257,19 @@ set_get_position(const typename InputStreamWithRecords<RecordT, OptionsT>::Saved
 
   assert(pos < saved_get_positions.size());
   stream_ptr->clear();
-  if (saved_get_positions[pos] == std::streampos(-1))
+  const bool go_to_end = saved_get_positions[pos] == std::streampos(-1);
+  if (go_to_end)
     stream_ptr->seekg(0, std::ios::end); // go to eof
   else
     stream_ptr->seekg(saved_get_positions[pos]);
     
   if (!stream_ptr->good())
     return Succeeded::no;
-  else
-    return Succeeded::yes;
+
+  clear_buffer(stream_ptr->tellg());
+  // keep the end-of-data marker, such that save_get_position() returns -1 again
+  this->end_of_data_reached = go_to_end;
+  return Succeeded::yes;
 }
 
 template <class RecordT, class OptionsT>
@@ -0,0 +1,104 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup InterfileIO
+  \brief Declaration of class stir::InterfileCompressedOutputFileFormat
+
+*/
+
+#ifndef __stir_IO_InterfileCompressedOutputFileFormat_H__
+#define __stir_IO_InterfileCompressedOutputFileFormat_H__
+
+#include "stir/IO/OutputFileFormat.h"
+#include "stir/RegisteredParsingObject.h"
+
+START_NAMESPACE_STIR
+
+template <int num_dimensions, typename elemT> class DiscretisedDensity;
+
+/*!
+  \ingroup InterfileIO
+  \brief 
+  Implementation of OutputFileFormat paradigm for Interfile images with compressed data.
+
+  Every plane is compressed with zlib as a separate block, see write_basic_interfile_compressed().
+  The header contains <tt>data compression := deflate</tt>, and the images can be read with
+  read_from_file() as any other Interfile image.
+
+  \par Parameters
+  \verbatim
+  Interfile compressed Output File Format Parameters:=
+    ; zlib compression level, from 1 (fastest) to 9 (best compression)
+    compression level := 6
+    ; group the bytes of all floats by significance before compression
+    byte shuffle := 1
+  End Interfile compressed Output File Format Parameters:=
+  \endverbatim
+
+  \warning Output always uses floats in little-endian byte order.
+  \warning This class is only available when STIR is compiled with zlib (\c HAVE_ZLIB).
+ */
+class InterfileCompressedOutputFileFormat : 
+  public RegisteredParsingObject<
+        InterfileCompressedOutputFileFormat,
+        OutputFileFormat<DiscretisedDensity<3,float> >,
+        OutputFileFormat<DiscretisedDensity<3,float> > >
+{
+ private:
+  typedef 
+     RegisteredParsingObject<
+        InterfileCompressedOutputFileFormat,
+        OutputFileFormat<DiscretisedDensity<3,float> >,
+        OutputFileFormat<DiscretisedDensity<3,float> > >
+    base_type;
+public :
+    //! Name which will be used when parsing an OutputFileFormat object
+  static const char * const registered_name;
+
+  InterfileCompressedOutputFileFormat(const int compression_level = 6,
+                                      const bool byte_shuffle = true);
+
+  //! Set type of numbers to be used for output
+  /*! Currently the return value will always be NumericType::FLOAT */
+  virtual NumericType set_type_of_numbers(const NumericType&, const bool warn = false);
+  //! Set byte order to be used for output
+  /*! Currently the return value will always be ByteOrder::little_endian */
+  virtual ByteOrder set_byte_order(const ByteOrder&, const bool warn = false);
+
+  int compression_level;
+  bool byte_shuffle;
+
+ protected:
+  virtual Succeeded  
+    actual_write_to_file(std::string& output_filename,
+		  const DiscretisedDensity<3,float>& density) const;
+
+
+  virtual void set_defaults();
+  virtual void initialise_keymap();
+  virtual bool post_processing();
+
+};
+
+
+
+END_NAMESPACE_STIR
+
+
+#endif
@@ -138,6 +138,10 @@ public :
   ASCIIlist_type process_status_values;
   int process_status_index;
 
+  //! compression of the data (\c none or \c deflate, see ProjDataCompressed and InterfileCompressedOutputFileFormat)
+  ASCIIlist_type data_compression_values;
+  int data_compression_index;
+
   // 'Final' variables
 
   std::string data_file_name;
@@ -146,6 +150,8 @@ public :
   NumericType		type_of_numbers;
   //! This will be determined from byte_order_index, or just keep its default value;
   ByteOrder file_byte_order;
+  //! data_compression_values[data_compression_index]
+  std::string data_compression;
 	
   int			num_dimensions;
   std::vector<std::string>	matrix_labels;
@@ -228,7 +234,7 @@ public:
   std::vector<int> num_rings_per_segment;
 
   std::vector<std::string> applied_corrections;
- 
+
   // derived values
   int num_segments;
   int num_views;
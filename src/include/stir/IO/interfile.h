@@ -52,6 +52,9 @@ template <typename elemT> class CartesianCoordinate3D;
 template <typename elemT> class Coordinate3D;
 template <typename elemT> class VoxelsOnCartesianGrid;
 class ProjDataFromStream;
+class ProjDataMemoryMapped;
+class ProjDataCompressed;
+class ProjDataPositionalIO;
 class DynamicDiscretisedDensity;
 template <typename elemT> class ParametricDiscretisedDensity;
 template <typename elemT> class VoxelsOnCartesianGrid;
@@ -136,6 +139,9 @@ read_interfile_parametric_image(const std::string& filename);
  with the correct voxel size (in z), which is probably non-confirming, and
  so will get other programs to read the voxel size incorrectly. 
  A relevant comment is written in each .ahv file.
+
+ If \a data_compression is not \c none, the <tt>data compression</tt> keyword is
+ written, and no .ahv file is created.
  */
 
 Succeeded 
@@ -149,7 +155,8 @@ write_basic_interfile_image_header(const std::string& header_file_name,
 				   const ByteOrder byte_order,
 				   const VectorWithOffset<float>& scaling_factors,
                    const VectorWithOffset<unsigned long>& file_offsets,
-                   const std::vector<std::string>& data_type_descriptions = std::vector<std::string>());
+                   const std::vector<std::string>& data_type_descriptions = std::vector<std::string>(),
+                   const std::string& data_compression = "none");
 
 
 //! a utility function that computes the file offsets of subsequent images
@@ -253,6 +260,25 @@ write_basic_interfile(const std::string& filename,
 		      const float scale= 0,
 		      const ByteOrder byte_order=ByteOrder::native);
 
+#ifdef HAVE_ZLIB
+//! This outputs an Interfile header and compressed data for an image
+/*!
+  \ingroup InterfileIO
+  The data are stored as little-endian floats, with every plane compressed
+  as a separate block with zlib (see stir/deflate_float_blocks.h). The header
+  contains <tt>data compression := deflate</tt>, such that read_interfile_image()
+  decompresses the planes (in parallel when STIR is compiled with OpenMP).
+
+  Extension .vz will be added to the parameter 'filename' (if no extension present).
+  Extension .hv will be used for the header filename.
+*/
+Succeeded
+write_basic_interfile_compressed(const std::string& filename,
+                                 const VoxelsOnCartesianGrid<float>& image,
+                                 const int compression_level = 6,
+                                 const bool byte_shuffle = true);
+#endif
+
 Succeeded
 write_basic_interfile(const std::string& filename,
               const ParametricDiscretisedDensity<VoxelsOnCartesianGrid<KineticParameters<2,float> > >& image,
@@ -299,6 +325,52 @@ ProjDataFromStream* read_interfile_PDFS(std::istream& input,
 ProjDataFromStream* read_interfile_PDFS(const std::string& filename,
 					const std::ios::openmode open_mode);
 
+//! This reads the first 3D sinogram from an Interfile header, memory-mapping the data file
+/*!
+  \ingroup InterfileIO
+  Only PET projection data stored as floats are supported. Returns 0 when the header
+  cannot be parsed or describes other data.
+
+  \warning it is up to the caller to deallocate the object
+
+  This should normally never be used. Use ProjData::read_from_file() instead
+  (with ",mmap" appended to the filename).
+*/
+ProjDataMemoryMapped* read_interfile_PDFS_memory_mapped(const std::string& filename,
+                                                       const std::ios::openmode open_mode);
+
+#ifdef HAVE_PREAD
+//! This reads the first 3D sinogram from an Interfile header, using positional I/O on the data file
+/*!
+  \ingroup InterfileIO
+  Only PET projection data stored as floats are supported. Returns 0 when the header
+  cannot be parsed or describes other data.
+
+  \warning it is up to the caller to deallocate the object
+
+  This should normally never be used. Use ProjData::read_from_file() instead
+  (with ",pread" appended to the filename).
+*/
+ProjDataPositionalIO* read_interfile_PDFS_positional_io(const std::string& filename,
+                                                        const std::ios::openmode open_mode);
+#endif
+
+#ifdef HAVE_ZLIB
+//! This reads the first 3D sinogram from an Interfile header with compressed data
+/*!
+  \ingroup InterfileIO
+  Only PET projection data with <tt>data compression := deflate</tt> are supported
+  (see ProjDataCompressed). Returns 0 without a warning when the header describes
+  uncompressed data, such that read_interfile_PDFS() can be tried next.
+
+  \warning it is up to the caller to deallocate the object
+
+  This should normally never be used. Use ProjData::read_from_file() instead.
+*/
+ProjDataCompressed* read_interfile_PDFS_compressed(const std::string& filename,
+                                                   const std::ios::openmode open_mode);
+#endif
+
 //! This writes an Interfile header appropriate for the ProjDataFromStream object.
 /*!
   \ingroup InterfileIO
@@ -319,6 +391,18 @@ Succeeded write_basic_interfile_PDFS_header(const std::string& header_filename,
 Succeeded write_basic_interfile_PDFS_header(const std::string& data_filename,
 			    const ProjDataFromStream& pdfs);
 
+#ifdef HAVE_ZLIB
+//! This writes an Interfile header appropriate for the ProjDataCompressed object.
+/*!
+  \ingroup InterfileIO
+  A .hs extension will be added to the header_file_name if none is present.
+ \return Succeeded::yes when succesful, Succeeded::no otherwise.
+*/
+Succeeded write_basic_interfile_PDFS_header(const std::string& header_filename,
+					    const std::string& data_filename,
+					    const ProjDataCompressed& pdc);
+#endif
+
 END_NAMESPACE_STIR
 
 #endif // __Interfile_h__
@@ -70,6 +70,15 @@ namespace detail
 		 IStreamT& s, Array<num_dimensions,elemT>& data, 
 		 const ByteOrder byte_order)
   {
+    if (data.is_contiguous())
+      {
+        // read all data in one go
+        Array<1,elemT> all_data(IndexRange<1>(static_cast<int>(data.size_all())),
+                                data.get_full_data_ptr(), /*copy_data*/ false);
+        const Succeeded success = read_data(s, all_data, byte_order);
+        data.release_full_data_ptr();
+        return success;
+      }
     for (typename Array<num_dimensions,elemT>::iterator iter= data.begin();
 	 iter != data.end();
 	 ++iter)
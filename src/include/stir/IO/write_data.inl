@@ -101,6 +101,25 @@ namespace detail
 					  const ByteOrder byte_order,
 					  const bool can_corrupt_data)
   {
+    if (typeid(OutputType) == typeid(elemT) && scale_factor==1 &&
+        data.is_contiguous())
+      {
+        // write all data in one go
+        const std::size_t num_elems = data.size_all();
+        if (num_elems == 0)
+          return Succeeded::yes;
+        // We do not use get_const_full_data_ptr() here, as that modifies the state of
+        // the array, which is not thread-safe when several threads write the same data.
+        // As the data is contiguous, the first element gives us a pointer to all of it.
+        // (const_cast is safe as write_data_1d restores the data unless can_corrupt_data is true)
+        elemT * const data_ptr = const_cast<elemT *>(&(*data.begin_all_const()));
+        Array<1,elemT> all_data(IndexRange<1>(static_cast<int>(num_elems)),
+                                data_ptr, /*copy_data*/ false);
+        return
+          write_data_with_fixed_scale_factor(s, all_data, output_type, 
+                                             scale_factor, byte_order,
+                                             can_corrupt_data);
+      }
     for (typename Array<num_dimensions,elemT>::const_iterator iter= data.begin();
 	 iter != data.end();
 	 ++iter)
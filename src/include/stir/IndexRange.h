@@ -114,6 +114,9 @@ public:
   inline bool operator==(const IndexRange<num_dimensions>&) const;
   inline bool operator!=(const IndexRange<num_dimensions>&) const;
 
+  //! return the total number of elements in this range
+  inline size_t size_all() const;
+
   //! checks if the range is 'regular'
   inline bool is_regular() const;
 
@@ -164,6 +167,9 @@ public:
 
   inline bool operator==(const IndexRange<1>& range2) const;
 
+  //! return the total number of elements in this range
+  inline size_t size_all() const;
+
   //! checks if the range is 'regular' (always true for the 1d case)
   inline bool is_regular() const;
 
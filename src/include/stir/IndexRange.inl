@@ -104,6 +104,17 @@ IndexRange<num_dimensions>::
   return !(*this==range2);
 }
 
+template <int num_dimensions>
+size_t
+IndexRange<num_dimensions>::
+  size_all() const
+{
+  size_t acc=0;
+  for (const_iterator iter=this->begin(); iter!=this->end(); ++iter)
+    acc += iter->size_all();
+  return acc;
+}
+
 template <int num_dimensions>
 bool
 IndexRange<num_dimensions>::
@@ -200,6 +211,12 @@ IndexRange<1>::operator==(const IndexRange<1>& range2) const
     get_length() == range2.get_length();
 }
 
+size_t
+IndexRange<1>::size_all() const
+{
+  return max>=min ? static_cast<size_t>(max-min+1) : size_t(0);
+}
+
 bool
 IndexRange<1>::is_regular() const
 {
@@ -74,6 +74,14 @@ class PoissonLogLikelihoodWithLinearModelForMean;
     \f[\sum_{b \in \rm{subset}} p_{bv} = 
        { \sum_b p_{bv} \over \rm{numsubsets} } \f]
 
+  The division, the thresholding of the update (see <code>minimum relative change</code> and
+  <code>maximum relative change</code>) and the multiplication are done in a single pass over the
+  voxels (split in 2 when the update image needs to be written or an inter-update filter is
+  applied). For images stored in a single block of memory (see Array::is_contiguous()), this pass
+  is multi-threaded when STIR is compiled with OpenMP. The work images are allocated in set_up()
+  and reused for every subiteration. The wall-clock time spent in computing the sub-gradient,
+  the prior gradient and the update is logged for every subiteration.
+
   \warning This class should be the last in a Reconstruction hierarchy.
 */
 template <typename TargetT>
@@ -198,6 +206,11 @@ public:
 private:
   friend void do_sensitivity(const char * const par_filename);
 
+  //! workspace for the numerator and the multiplicative update (allocated in set_up())
+  shared_ptr<TargetT> multiplicative_update_image_sptr;
+  //! workspace for the denominator when there is a prior (allocated in set_up())
+  shared_ptr<TargetT> denominator_sptr;
+
   PoissonLogLikelihoodWithLinearModelForMean<TargetT >&
     objective_function();
 
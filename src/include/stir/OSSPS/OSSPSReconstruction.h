@@ -86,6 +86,38 @@ START_NAMESPACE_STIR
   <code>relaxation_gamma</code>. Ahn and Fessler recommend to set \f$\alpha \approx 1\f$ and
   \f$\gamma\f$ small (e.g. 0.1).
 
+  \par Update
+  
+  After computing the subset gradient, the denominator (data term plus
+  the curvature of the penalty), the division, the relaxation, the update and
+  the clipping to <code>[0, upper_bound]</code> are done in a single pass over the image.
+  For images stored in a single block of memory (see Array::is_contiguous()), this pass
+  is multi-threaded when STIR is compiled with OpenMP. The images used for the update and
+  the denominator are allocated in set_up() and reused for every subiteration.
+
+  \par Caching the precomputed denominator
+
+  Computing the data term of the denominator needs a forward and back projection over all
+  data. When the keyword <code>precomputed denominator cache directory</code> is set (and
+  no <code>precomputed denominator</code> file is given), the data term is stored in that
+  directory after computing it, and read from there in subsequent runs with the same key.
+  The key consists of the characteristics of the image, the projection data info, a hash of
+  the content of the measured data, the type and parameters of the normalisation (which includes
+  attenuation) with a hash of its factors, the projectors, the segments and the time frame.
+  The prior is not part of the key, as the data term does not depend on it. Computing the
+  hashes needs a pass over the data, but no projections.
+
+  The file stores a byte-order marker; files written on a machine with different endianness
+  are ignored. The file is memory mapped, but its content is copied into the image, as the
+  image owns its memory.
+
+  The cache is only supported for DiscretisedDensity objects and
+  PoissonLogLikelihoodWithLinearModelForMeanAndProjData.
+  Example
+  \verbatim
+  precomputed denominator cache directory := /var/cache/stir
+  \endverbatim
+
   \warning This class should be the last in the Reconstruction hierarchy.
   \todo split into a preconditioned subgradient descent class and something that computes
   the preconditioner.
@@ -147,6 +179,19 @@ public:
   //! operations prior to the iterations
   virtual Succeeded set_up(shared_ptr <TargetT > const& target_image_ptr);
 
+  //! set the directory where the precomputed denominator is cached (see class documentation)
+  /*! An empty string disables the cache. */
+  void set_precomputed_denominator_cache_directory(const std::string&);
+
+  //! name of the file in the cache directory for the current set-up
+  /*! Returns an empty string when there is no cache directory, or when the cache is not
+      supported for this type of image or objective function. Only valid after set_up().
+  */
+  std::string get_precomputed_denominator_cache_filename() const;
+
+  //! the precomputed denominator (only available after set_up())
+  const TargetT& get_precomputed_denominator() const;
+
   //! the principal operations for updating the image iterates at each iteration
   virtual void update_estimate(TargetT &current_image_estimate);
  
@@ -165,6 +210,9 @@ public:
   /*! If not specified, the corresponding object will be computed. */
   std::string precomputed_denominator_filename;
 
+  //! optional directory where the precomputed denominator is cached between runs (see class documentation)
+  std::string precomputed_denominator_cache_directory;
+
 #if 0
   bool do_line_search;
 #endif
@@ -184,6 +232,23 @@ private:
   //! pointer to the precomputed denominator 
   shared_ptr<TargetT > precomputed_denominator_ptr;
 
+  //! the full denominator (including the penalty term), thresholded to be positive
+  /*! Allocated in set_up(). Recomputed at every subiteration when the curvature of the
+      penalty depends on the image, otherwise only at the first one.
+  */
+  shared_ptr<TargetT > denominator_sptr;
+
+  //! workspace for the subset gradient and the additive update (allocated in set_up())
+  shared_ptr<TargetT > update_sptr;
+
+  //! read the precomputed denominator from the cache directory
+  /*! \return Succeeded::no if there is no valid cache entry */
+  Succeeded read_precomputed_denominator_from_cache(TargetT& denominator) const;
+  //! write the precomputed denominator to the cache directory
+  Succeeded write_precomputed_denominator_to_cache(const TargetT& denominator) const;
+  //! name of the file in the cache directory and the key stored in it
+  std::string get_precomputed_denominator_cache_key(const TargetT& target) const;
+
   //! data corresponding to the gometric forward projection of an image full of ones
   /*! This is needed for the precomputed denominator. However, if the parameter is 
       not set, precompute_denominator_without_penalty_of_conditioner() will compute it.
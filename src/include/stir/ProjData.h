@@ -191,6 +191,22 @@ public:
     const bool make_num_tangential_poss_odd = false) const;
   //! Set related viewgrams
   virtual Succeeded set_related_viewgrams(const RelatedViewgrams<float>& viewgrams);
+
+  //! Check if different threads can read and write different viewgrams/sinograms at the same time
+  /*! If this returns \c false (the default), callers in multi-threaded code need to
+      serialise all calls to the get_* and set_* functions (e.g. with an OpenMP critical
+      section). Derived classes that do not use any shared state for I/O can return
+      \c true.
+
+      \warning Even if this returns \c true, it is only safe if the threads access
+      \e disjoint sets of bins. Reading and writing the \e same bins from different
+      threads is never safe, and neither is writing them from different threads.
+      Note that a sinogram and a viewgram (or a segment) always have bins in common.
+      Callers normally guarantee this by letting every thread handle different related
+      viewgrams, as found by detail::find_basic_vs_nums_in_subset(), as these do not
+      overlap.
+  */
+  virtual bool supports_concurrent_access() const;
   
 
   //! Get empty related viewgrams, where the symmetries_ptr specifies the symmetries to use
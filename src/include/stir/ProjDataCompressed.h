@@ -0,0 +1,213 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projdata
+  \brief Declaration of class stir::ProjDataCompressed
+*/
+#ifndef __stir_ProjDataCompressed_H__
+#define __stir_ProjDataCompressed_H__
+
+#include "stir/ProjData.h"
+#include "stir/shared_ptr.h"
+#include "stir/deflate_float_blocks.h"
+#include <boost/cstdint.hpp>
+#include <iostream>
+#include <vector>
+#include <deque>
+
+START_NAMESPACE_STIR
+
+class Succeeded;
+template <int num_dimensions, typename elemT> class Array;
+template <typename elemT> class SegmentBySinogram;
+
+/*!
+  \ingroup projdata
+  \brief A class which reads/writes projection data stored as compressed blocks in a stream
+
+  Every sinogram (i.e. every segment and axial position) is stored as a separate block,
+  compressed with zlib (deflate). An index with the position and size of every block
+  is stored at the end of the data. Reading a sinogram therefore only needs to read and
+  decompress a single block. Reading a viewgram needs one block per axial position, so
+  the whole segment is then decompressed and kept in memory, such that reading the other
+  viewgrams of the segment is fast. At most 2 of these (unmodified) segments are kept.
+
+  Optionally, the bytes of the floats are shuffled before compression: first the
+  first byte of every float is stored, then the second byte, etc. For smooth data,
+  this groups the bytes that change slowly (sign and exponent) together, which
+  often improves compression considerably.
+
+  \par Format
+  This is the format of stir/deflate_float_blocks.h, with one block per sinogram.
+  All numbers are stored in little endian byte order.
+  - the blocks, in the order in which they are written. The uncompressed
+    data of a block are the \c float values of the sinogram (view by view),
+    possibly byte-shuffled.
+  - the index: for every block (ordered according to \c segment_sequence_in_stream, and
+    then axial position) the offset of the block (relative to the start of the data)
+    and its compressed size, both as 64-bit integers. A size of 0 means that the block
+    has not been written yet, and the sinogram is then all zeroes.
+  - flags as 64-bit integer (1 if bytes are shuffled)
+  - the number of blocks as 64-bit integer
+  - the 8 characters \c STIRPDZ1
+
+  \par Writing
+  When the stream is opened with \c std::ios::out, set_sinogram() and the set_segment()
+  functions append new blocks to the data. Space used by a block that is overwritten is not
+  reclaimed, so it is most efficient to write every sinogram only once.
+  set_viewgram() modifies the segment in memory (decompressing it first if necessary).
+  Modified segments are only compressed and appended by flush() (which is called by the
+  destructor). Writing viewgram by viewgram therefore writes every sinogram once as well, but
+  needs memory for all segments that are written. flush() also writes the index.
+
+  Reading and writing blocks from/to the stream is serialised (using an OpenMP critical
+  section), but (de)compression runs in parallel when getting or setting
+  segments, and when decompressing a segment for a viewgram (when STIR is compiled with OpenMP).
+  As the segments in memory are shared, the member functions should not be called
+  concurrently (see ProjData::supports_concurrent_access()).
+
+  \warning This class is only available when STIR is compiled with zlib (\c HAVE_ZLIB).
+*/
+class ProjDataCompressed : public ProjData
+{
+public:
+  //! constructor from a stream
+  /*!
+    \param s stream with the data. If the stream is empty after \a offset, new data
+       are created (which requires \a open_mode to include \c std::ios::out).
+       Otherwise, the index is read from the end of the stream.
+    \param offset offset of the data in the stream (in bytes)
+    \param segment_sequence_in_stream order of the segments in the index
+    \param open_mode std::ios::in for read-only access. If std::ios::out is
+       included, the set_* functions are enabled.
+    \param compression_level zlib compression level used when writing (from 1 for
+       fastest to 9 for best compression)
+    \param byte_shuffle if \c true, new data are byte-shuffled before compression. This
+       is ignored for existing data (where the setting is read from the stream).
+
+    Calls error() if the index cannot be read or does not match the projection data info.
+  */
+  ProjDataCompressed(shared_ptr<ExamInfo> const& exam_info_sptr,
+                     shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                     shared_ptr<std::iostream> const& s,
+                     const std::streamoff offset,
+                     const std::vector<int>& segment_sequence_in_stream,
+                     const std::ios::openmode open_mode = std::ios::in,
+                     const int compression_level = 6,
+                     const bool byte_shuffle = true);
+
+  //! constructor from a stream, with the segments in increasing order (as ProjDataFromStream)
+  ProjDataCompressed(shared_ptr<ExamInfo> const& exam_info_sptr,
+                     shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                     shared_ptr<std::iostream> const& s,
+                     const std::streamoff offset = 0,
+                     const std::ios::openmode open_mode = std::ios::in,
+                     const int compression_level = 6,
+                     const bool byte_shuffle = true);
+
+  //! destructor calls flush() if the data are writable
+  virtual ~ProjDataCompressed();
+
+  //! Get & set viewgram
+  Viewgram<float> get_viewgram(const int view_num, const int segment_num,const bool make_num_tangential_poss_odd=false) const;
+  Succeeded set_viewgram(const Viewgram<float>& v);
+
+  //! Get & set sinogram
+  Sinogram<float> get_sinogram(const int ax_pos_num, const int segment_num,const bool make_num_tangential_poss_odd=false) const;
+  Succeeded set_sinogram(const Sinogram<float>& s);
+
+  //! Get & set segments
+  /*! These are overloaded to read and write sinogram by sinogram. */
+  SegmentBySinogram<float> get_segment_by_sinogram(const int segment_num) const;
+  SegmentByView<float> get_segment_by_view(const int segment_num) const;
+  Succeeded set_segment(const SegmentBySinogram<float>&);
+  Succeeded set_segment(const SegmentByView<float>&);
+
+  //! Write the modified segments and the index to the stream and flush it
+  Succeeded flush();
+
+  //! check if the data can be modified
+  bool is_writable() const;
+
+  //! Get the segment sequence
+  const std::vector<int>& get_segment_sequence_in_stream() const
+  { return segment_sequence; }
+
+  //! Get the offset of the data in the stream
+  std::streamoff get_offset_in_stream() const
+  { return offset; }
+
+  //! check if the data are byte-shuffled before compression
+  bool get_byte_shuffle() const
+  { return byte_shuffle; }
+
+  //! Get the total size of all compressed blocks (in bytes)
+  boost::uint64_t get_compressed_size() const;
+
+private:
+  typedef detail::DeflateBlockInfo BlockInfo;
+
+  shared_ptr<std::iostream> sino_stream;
+  std::streamoff offset;
+  std::vector<int> segment_sequence;
+  bool writable;
+  int compression_level;
+  bool byte_shuffle;
+  //! index of the first block of each segment, indexed as segment_sequence
+  std::vector<std::size_t> segment_first_block;
+  std::vector<BlockInfo> blocks;
+  //! end of the last block (relative to \c offset), where new blocks are written
+  boost::uint64_t data_end;
+  //! set when the index in the stream is out-of-date
+  bool index_modified;
+  //! decompressed segments, indexed as segment_sequence (0 if not in memory)
+  mutable std::vector<shared_ptr<SegmentBySinogram<float> > > cached_segments;
+  //! segments in memory that are modified and need to be written, indexed as segment_sequence
+  std::vector<bool> cached_segment_is_modified;
+  //! indices of the unmodified segments in memory, oldest first
+  mutable std::deque<std::size_t> unmodified_cached_segments;
+  //! maximum size of \c unmodified_cached_segments
+  static const std::size_t max_num_unmodified_cached_segments = 2;
+
+  void initialise();
+  Succeeded read_index();
+  //! index in segment_sequence
+  std::size_t get_segment_index(const int segment_num) const;
+  std::size_t get_block_num(const int segment_num, const int axial_pos_num) const;
+  //! get the segment from memory, decompressing it first if necessary
+  SegmentBySinogram<float>& get_cached_segment(const int segment_num) const;
+  //! remove a segment from memory (without writing it)
+  void remove_cached_segment(const std::size_t segment_index);
+  //! compress all sinograms of a segment and append them to the stream
+  Succeeded write_segment(const SegmentBySinogram<float>&);
+  //! decompress a block into a sinogram (which has to have the correct size)
+  /*! This function can be called in parallel. */
+  Succeeded read_block(Array<2,float>& sinogram, const std::size_t block_num) const;
+  //! compress a sinogram
+  /*! This function can be called in parallel. */
+  Succeeded compress_block(std::vector<unsigned char>& compressed, const Array<2,float>& sinogram) const;
+  //! append a compressed block to the stream and update the index
+  /*! This function can be called in parallel. */
+  Succeeded append_block(const std::vector<unsigned char>& compressed, const std::size_t block_num);
+  //! compress a sinogram and append it to the stream
+  Succeeded write_block(const Array<2,float>& sinogram, const std::size_t block_num);
+};
+
+END_NAMESPACE_STIR
+
+#endif
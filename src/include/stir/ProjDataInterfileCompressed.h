@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projdata
+  \brief Declaration of class stir::ProjDataInterfileCompressed
+*/
+#ifndef __stir_ProjDataInterfileCompressed_H__
+#define __stir_ProjDataInterfileCompressed_H__
+
+#include "stir/ProjDataCompressed.h"
+#include <string>
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup projdata
+  \brief A class which writes compressed projection data to a file, and creates the
+  corresponding Interfile header.
+
+  The header contains <tt>data compression := deflate</tt>, such that
+  ProjData::read_from_file() reads the data back as a ProjDataCompressed object.
+
+  \warning The class can ONLY be used to create a new file. Use ProjData::read_from_file() to
+  read a projection data file.
+  \warning This class is only available when STIR is compiled with zlib (\c HAVE_ZLIB).
+*/
+class ProjDataInterfileCompressed : public ProjDataCompressed
+{
+public:
+  //! constructor taking all necessary parameters
+  /*!
+    \param filename The name to use for the files. See below.
+    \param compression_level, byte_shuffle see ProjDataCompressed
+
+    \par file names that will be used
+    <ul>
+    <li> if \a filename has no extension or if \a filename has an extension .hs,
+         the extensions .sz and .hs will be used for binary file and header file.
+    <li> otherwise, \a filename will be used for the binary data, and its extension
+         will be replaced with .hs for the header file.
+    </ul>
+
+    \warning This call will create a new file for the binary data and the Intefile header.
+    Any existing files with the same file names will be overwritten without warning.
+  */
+  ProjDataInterfileCompressed(shared_ptr<ExamInfo> const& exam_info_sptr,
+                              shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                              const std::string& filename,
+                              const int compression_level = 6,
+                              const bool byte_shuffle = true);
+
+private:
+  static std::string get_data_filename(const std::string& filename);
+  static shared_ptr<std::iostream> create_stream(const std::string& filename);
+};
+
+END_NAMESPACE_STIR
+
+#endif
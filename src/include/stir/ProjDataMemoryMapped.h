@@ -0,0 +1,160 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projdata
+  \brief Declaration of class stir::ProjDataMemoryMapped
+*/
+
+#ifndef __stir_ProjDataMemoryMapped_H__
+#define __stir_ProjDataMemoryMapped_H__
+
+#include "stir/ProjData.h"
+#include "stir/ProjDataFromStream.h"
+#include "stir/ProjDataRowLayout.h"
+#include "stir/ByteOrder.h"
+#include "stir/shared_ptr.h"
+#include "stir/Bin.h"
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace boost { namespace interprocess { class mapped_region; } }
+
+START_NAMESPACE_STIR
+
+class Succeeded;
+template <int num_dimensions, typename elemT> class Array;
+
+/*!
+  \ingroup projdata
+  \brief A class which reads/writes projection data from/to a memory-mapped file.
+
+  The data file is mapped into the address space of the process
+  (using boost::interprocess). Reading a viewgram or sinogram is then a
+  copy from the mapped memory, avoiding the seeks and many small reads of
+  ProjDataFromStream. As the mapping is shared, different processes reading the
+  same file use the same pages of the operating system's file cache.
+
+  Only data stored as \c float are supported, but the byte order can be
+  different from the native one (at the cost of swapping bytes when copying)
+  and a scale factor can be used when reading.
+
+  When the file is opened read-only, the set_* functions fail. When it is
+  opened with \c std::ios::out, the set_* functions write directly in the mapped
+  memory, and the data will be in the file after flush() or when the object is
+  destructed. Writing is only supported when the scale factor is 1.
+
+  get_const_data_ptr() gives direct access to the data (without copying) when
+  they are stored in native byte order with scale factor 1.
+
+  Projection data in Interfile format can be read via
+  read_interfile_PDFS_memory_mapped(), or by appending \c ",mmap" to the
+  filename passed to ProjData::read_from_file().
+
+  \warning The data file cannot be larger than the address space
+  (which is only a problem on 32-bit systems).
+*/
+class ProjDataMemoryMapped : public ProjData
+{
+public:
+  typedef ProjDataFromStream::StorageOrder StorageOrder;
+
+  //! constructor mapping an existing file
+  /*!
+    \param filename name of the file with the (binary) data
+    \param offset offset of the data in the file (in bytes)
+    \param segment_sequence_in_file has to be set according to the order
+       in which the segments occur in the file (see ProjDataFromStream)
+    \param open_mode std::ios::in for read-only access. If std::ios::out is
+       included, the data will be mapped read-write.
+
+    Calls error() if the file cannot be mapped, or if it is too small.
+  */
+  ProjDataMemoryMapped(shared_ptr<ExamInfo> const& exam_info_sptr,
+                       shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                       const std::string& filename,
+                       const std::streamoff offset,
+                       const std::vector<int>& segment_sequence_in_file,
+                       StorageOrder storage_order = ProjDataFromStream::Segment_View_AxialPos_TangPos,
+                       ByteOrder byte_order = ByteOrder::native,
+                       float scale_factor = 1,
+                       const std::ios::openmode open_mode = std::ios::in);
+
+  virtual ~ProjDataMemoryMapped();
+
+  //! Get & set viewgram
+  Viewgram<float> get_viewgram(const int view_num, const int segment_num,const bool make_num_tangential_poss_odd=false) const;
+  Succeeded set_viewgram(const Viewgram<float>& v);
+
+  //! Get & set sinogram
+  Sinogram<float> get_sinogram(const int ax_pos_num, const int segment_num,const bool make_num_tangential_poss_odd=false) const;
+  Succeeded set_sinogram(const Sinogram<float>& s);
+
+  //! Get the value of a bin (without reading any other data)
+  float get_bin_value(const Bin& bin) const;
+
+  //! Returns a pointer to the data of the given bin in the mapped memory
+  /*! This only works when the data are stored in native byte order and
+      without scale factor, and when the data in the file are correctly aligned.
+      Otherwise, a null pointer is returned.
+
+      Elements in the same row (i.e. with the same segment, view and axial position
+      but different tangential position) are contiguous. The pointer remains
+      valid as long as this object exists.
+  */
+  const float * get_const_data_ptr(const Bin& bin) const;
+
+  //! Write any modified data to the file
+  Succeeded flush();
+
+  //! check if the data can be modified
+  bool is_writable() const;
+
+  //! Returns \c true, as all access is via the mapped memory
+  bool supports_concurrent_access() const;
+
+  //! Get the storage order
+  StorageOrder get_storage_order() const { return storage_order; }
+  //! Get the byte order in the file
+  ByteOrder get_byte_order_in_file() const { return on_disk_byte_order; }
+  //! Get the scale factor
+  float get_scale_factor() const { return scale_factor; }
+
+private:
+  std::string filename;
+  shared_ptr<boost::interprocess::mapped_region> region_sptr;
+  //! pointer to the start of the data (i.e. after the offset)
+  char * data_ptr;
+  bool writable;
+
+  StorageOrder storage_order;
+  ByteOrder on_disk_byte_order;
+  float scale_factor;
+
+  //! offsets (in number of elements) of the rows in the file
+  detail::ProjDataRowLayout layout;
+
+  //! copy one row of data from the mapped memory, handling byte order and scale factor
+  void read_row(Array<1,float>& row, const std::size_t offset) const;
+  //! copy one row of data to the mapped memory, handling byte order
+  void write_row(const Array<1,float>& row, const std::size_t offset);
+};
+
+END_NAMESPACE_STIR
+
+#endif
@@ -0,0 +1,140 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projdata
+  \brief Declaration of class stir::ProjDataPositionalIO
+*/
+
+#ifndef __stir_ProjDataPositionalIO_H__
+#define __stir_ProjDataPositionalIO_H__
+
+#include "stir/ProjData.h"
+#include "stir/ProjDataFromStream.h"
+#include "stir/ProjDataRowLayout.h"
+#include "stir/ByteOrder.h"
+#include "stir/Bin.h"
+#include <string>
+#include <vector>
+#include <iostream>
+
+START_NAMESPACE_STIR
+
+class Succeeded;
+template <int num_dimensions, typename elemT> class Array;
+
+/*!
+  \ingroup projdata
+  \brief A class which reads/writes projection data from/to a file using positional I/O.
+
+  Data are read and written with \c pread and \c pwrite on a file descriptor. These
+  do not use a shared file position (as opposed to the stream in ProjDataFromStream),
+  such that different threads can read and write different viewgrams or sinograms at
+  the same time without any locking (see supports_concurrent_access()).
+
+  Rows that are contiguous in the file (e.g. all rows of a viewgram for
+  ProjDataFromStream::Segment_View_AxialPos_TangPos) are read or written with a single
+  call.
+
+  As for ProjDataMemoryMapped, only data stored as \c float are supported, but the
+  byte order can be different from the native one and a scale factor can be used
+  when reading. Writing is only supported when the scale factor is 1.
+
+  Projection data in Interfile format can be read via
+  read_interfile_PDFS_positional_io(), or by appending \c ",pread" to the
+  filename passed to ProjData::read_from_file().
+
+  \warning This class is only available on systems with \c pread (\c HAVE_PREAD).
+*/
+class ProjDataPositionalIO : public ProjData
+{
+public:
+  typedef ProjDataFromStream::StorageOrder StorageOrder;
+
+  //! constructor opening an existing file
+  /*!
+    \param filename name of the file with the (binary) data
+    \param offset offset of the data in the file (in bytes)
+    \param segment_sequence_in_file has to be set according to the order
+       in which the segments occur in the file (see ProjDataFromStream)
+    \param open_mode std::ios::in for read-only access. If std::ios::out is
+       included, the file is opened read-write (and created if it does not exist).
+
+    Calls error() if the file cannot be opened, or if it is too small (when
+    opened read-only).
+  */
+  ProjDataPositionalIO(shared_ptr<ExamInfo> const& exam_info_sptr,
+                       shared_ptr<ProjDataInfo> const& proj_data_info_sptr,
+                       const std::string& filename,
+                       const std::streamoff offset,
+                       const std::vector<int>& segment_sequence_in_file,
+                       StorageOrder storage_order = ProjDataFromStream::Segment_View_AxialPos_TangPos,
+                       ByteOrder byte_order = ByteOrder::native,
+                       float scale_factor = 1,
+                       const std::ios::openmode open_mode = std::ios::in);
+
+  //! closes the file
+  virtual ~ProjDataPositionalIO();
+
+  //! Get & set viewgram
+  Viewgram<float> get_viewgram(const int view_num, const int segment_num,const bool make_num_tangential_poss_odd=false) const;
+  Succeeded set_viewgram(const Viewgram<float>& v);
+
+  //! Get & set sinogram
+  Sinogram<float> get_sinogram(const int ax_pos_num, const int segment_num,const bool make_num_tangential_poss_odd=false) const;
+  Succeeded set_sinogram(const Sinogram<float>& s);
+
+  //! Get the value of a bin (without reading any other data)
+  float get_bin_value(const Bin& bin) const;
+
+  //! Returns \c true, as \c pread and \c pwrite do not use a shared file position
+  bool supports_concurrent_access() const;
+
+  //! check if the data can be modified
+  bool is_writable() const;
+
+  //! Get the storage order
+  StorageOrder get_storage_order() const { return storage_order; }
+  //! Get the byte order in the file
+  ByteOrder get_byte_order_in_file() const { return on_disk_byte_order; }
+  //! Get the scale factor
+  float get_scale_factor() const { return scale_factor; }
+
+private:
+  std::string filename;
+  int file_descriptor;
+  std::streamoff offset;
+  bool writable;
+
+  StorageOrder storage_order;
+  ByteOrder on_disk_byte_order;
+  float scale_factor;
+
+  //! offsets (in number of elements) of the rows in the file
+  detail::ProjDataRowLayout layout;
+
+  //! read rows from the file, handling byte order and scale factor
+  /*! \a stride is the distance (in number of elements) in the file between the start of
+      consecutive rows. If the rows are contiguous, they are read with a single call. */
+  void read_rows(Array<2,float>& rows, const std::size_t first_offset, const std::size_t stride) const;
+  //! write rows to the file, handling byte order
+  Succeeded write_rows(const Array<2,float>& rows, const std::size_t first_offset, const std::size_t stride);
+};
+
+END_NAMESPACE_STIR
+
+#endif
@@ -0,0 +1,94 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup buildblock_detail
+  \brief Declaration of class stir::detail::ProjDataRowLayout
+*/
+#ifndef __stir_ProjDataRowLayout_H__
+#define __stir_ProjDataRowLayout_H__
+
+#include "stir/ProjDataFromStream.h"
+#include <string>
+#include <vector>
+
+START_NAMESPACE_STIR
+
+class ProjDataInfo;
+
+namespace detail
+{
+  /*!
+    \ingroup buildblock_detail
+    \brief Computes where the rows of projection data are in a raw data file
+
+    A row is the data for one segment, view and axial position (i.e. all tangential
+    positions), and is always contiguous. This class finds the offset of every row,
+    given the sequence of the segments in the file and the storage order (see
+    ProjDataFromStream). It is used by ProjDataMemoryMapped and ProjDataPositionalIO.
+
+    All offsets are in number of elements, relative to the start of the data.
+  */
+  class ProjDataRowLayout
+  {
+  public:
+    typedef ProjDataFromStream::StorageOrder StorageOrder;
+
+    //! constructor
+    /*! \a class_name is used in error messages.
+        Calls error() if the storage order is unsupported, or if the segment
+        sequence does not have the number of segments in \a proj_data_info.
+    */
+    ProjDataRowLayout(const ProjDataInfo& proj_data_info,
+                      const std::vector<int>& segment_sequence,
+                      const StorageOrder storage_order,
+                      const std::string& class_name);
+
+    //! total number of elements in the file
+    std::size_t get_total_num_elements() const { return total_num_elements; }
+
+    //! offset of the first element in a row
+    /*! Calls error() if the arguments are out of range. */
+    std::size_t get_row_offset(const int segment_num, const int view_num, const int axial_pos_num) const;
+
+    //! distance between the start of consecutive rows of a viewgram
+    std::size_t get_viewgram_row_stride(const int segment_num) const;
+    //! distance between the start of consecutive rows of a sinogram
+    std::size_t get_sinogram_row_stride(const int segment_num) const;
+
+  private:
+    std::vector<int> segment_sequence;
+    //! offset of each segment, indexed as segment_sequence
+    std::vector<std::size_t> segment_offsets;
+    //! min and number of axial positions of each segment, indexed as segment_sequence
+    std::vector<int> min_axial_pos_nums;
+    std::vector<int> num_axial_poss;
+    StorageOrder storage_order;
+    int min_view_num;
+    int num_views;
+    int num_tangential_poss;
+    std::size_t total_num_elements;
+    std::string class_name;
+
+    //! index in segment_sequence
+    std::size_t find_segment_index(const int segment_num) const;
+  };
+}
+
+END_NAMESPACE_STIR
+
+#endif
@@ -30,6 +30,7 @@
 */
 
 #include "stir/VectorWithOffset.h"
+#include "stir/Array.h"
 #include "stir/BasicCoordinate.h"
 #include "stir/IndexRange.h"
 #include "stir/stream.h"
@@ -243,6 +244,13 @@ public:
     }
     return true;
   }
+
+  //! evaluate the expression (e.g. <tt>a - b</tt> for Arrays) and use check_if_zero on the result
+  template <int num_dimensions, class elemT, class ExprT>
+    bool check_if_zero(const ArrayExpression<num_dimensions, elemT, ExprT>& t, const std::string& str = "")
+  {
+    return check_if_zero(Array<num_dimensions, elemT>(t), str);
+  }
   
   //! compare norm with tolerance
   template <int num_dimensions, class coordT> 
@@ -170,6 +170,12 @@ public:
   //! assignment operator with another vector
   inline VectorWithOffset & operator= (const VectorWithOffset &il) ;
 
+  //! swap content of 2 vectors (without copying any data)
+  /*! This swaps the pointers to the allocated memory, so if one of the vectors
+      uses existing memory (see owns_memory_for_data()), the other one will do so afterwards.
+  */
+  inline void swap(VectorWithOffset& other);
+
   //! \name index range operations
   //@{ 
   //! return number of elements in this vector
@@ -382,6 +388,18 @@ protected:
   //! Called internally to see if all variables are consistent
   inline void check_state() const;
 
+  //! (re)initialise the vector with the given range, using existing data
+  /*! If \a copy_data is \c false, the vector will use the memory starting at \a data_ptr
+      (and will therefore not own the memory, see owns_memory_for_data()). Any memory that
+      was allocated by the vector before is released.
+      Otherwise, the data is copied into memory allocated by the vector.
+
+      This is intended to be used by derived classes such as Array that allocate a
+      single block of memory for all their elements.
+  */
+  inline void init(const int min_index, const int max_index,
+                   T * const data_ptr, bool copy_data);
+
 private:
   //! length of vector
   unsigned int length;	
@@ -515,6 +515,51 @@ VectorWithOffset<T>::operator= (const VectorWithOffset &il)
 }
 
 
+template <class T>
+void
+VectorWithOffset<T>::swap(VectorWithOffset& other)
+{
+  this->check_state();
+  other.check_state();
+  std::swap(this->num, other.num);
+  std::swap(this->length, other.length);
+  std::swap(this->start, other.start);
+  std::swap(this->begin_allocated_memory, other.begin_allocated_memory);
+  std::swap(this->end_allocated_memory, other.end_allocated_memory);
+  std::swap(this->_owns_memory_for_data, other._owns_memory_for_data);
+}
+
+template <class T>
+void
+VectorWithOffset<T>::
+init(const int min_index, const int max_index,
+     T * const data_ptr, bool copy_data)
+{
+  this->check_state();
+  if (copy_data)
+    {
+      this->resize(min_index, max_index);
+      std::copy(data_ptr, data_ptr + this->length, this->begin());
+      return;
+    }
+  this->_destruct_and_deallocate();
+  this->_owns_memory_for_data = false;
+  if (min_index > max_index)
+    {
+      this->length = 0;
+      this->start = 0;
+    }
+  else
+    {
+      this->length = static_cast<unsigned>(max_index - min_index) + 1;
+      this->start = min_index;
+    }
+  this->begin_allocated_memory = data_ptr;
+  this->end_allocated_memory = data_ptr + this->length;
+  this->num = this->begin_allocated_memory - this->start;
+  this->check_state();
+}
+
 template <class T>
 VectorWithOffset<T>::VectorWithOffset(const VectorWithOffset &il) 
   : pointer_access(false),
@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup buildblock_detail
+  \brief Declaration of functions to store \c float data as blocks compressed with zlib
+
+  These functions implement the format used by ProjDataCompressed and by
+  compressed Interfile images (see InterfileCompressedOutputFileFormat).
+
+  \par Format
+  All numbers are stored in little endian byte order.
+  - the blocks. The uncompressed data of a block are \c float values, possibly byte-shuffled.
+  - the index: for every block the offset of the block (relative to the start of the data)
+    and its compressed size, both as 64-bit integers. A size of 0 means that the block
+    has not been written yet, and its data are all zeroes.
+  - flags as 64-bit integer (1 if bytes are shuffled)
+  - the number of blocks as 64-bit integer
+  - the 8 characters \c STIRPDZ1
+
+  \warning These functions are only available when STIR is compiled with zlib (\c HAVE_ZLIB).
+*/
+#ifndef __stir_deflate_float_blocks_H__
+#define __stir_deflate_float_blocks_H__
+
+#include "stir/common.h"
+#include <boost/cstdint.hpp>
+#include <iostream>
+#include <vector>
+
+START_NAMESPACE_STIR
+
+class Succeeded;
+
+namespace detail
+{
+  //! position (relative to the start of the data) and compressed size of a block
+  struct DeflateBlockInfo
+  {
+    DeflateBlockInfo() : offset(0), size(0) {}
+    boost::uint64_t offset;
+    boost::uint64_t size;
+  };
+
+  //! compress \a num_values floats
+  /*! The values are converted to little endian and, if \a byte_shuffle is \c true,
+      byte \c k of every value is stored contiguously (which often improves
+      compression considerably for smooth data).
+      This function can be called in parallel.
+  */
+  Succeeded
+    deflate_float_block(std::vector<unsigned char>& compressed,
+                        const float * const values, const std::size_t num_values,
+                        const int compression_level, const bool byte_shuffle);
+
+  //! decompress a block written by deflate_float_block()
+  /*! \a values has to point to \a num_values floats.
+      This function can be called in parallel.
+  */
+  Succeeded
+    inflate_float_block(float * const values, const std::size_t num_values,
+                        const std::vector<unsigned char>& compressed, const bool byte_shuffle);
+
+  //! write the index (and trailer) at the current "put" position of the stream
+  Succeeded
+    write_deflate_block_index(std::ostream& s,
+                              const std::vector<DeflateBlockInfo>& blocks,
+                              const bool byte_shuffle);
+
+  //! read the index (and trailer) from the end of the stream
+  /*! \param offset position of the start of the data in the stream
+      \param blocks has to have the expected number of blocks on input, and will be
+         filled with the index
+      \param byte_shuffle will be set from the flags in the stream
+      \param data_end will be set to the end of the last block (relative to \a offset)
+
+      Writes a warning and returns Succeeded::no if the stream does not contain a
+      valid index for the expected number of blocks.
+  */
+  Succeeded
+    read_deflate_block_index(std::istream& s, const std::streamoff offset,
+                             std::vector<DeflateBlockInfo>& blocks,
+                             bool& byte_shuffle,
+                             boost::uint64_t& data_end);
+}
+
+END_NAMESPACE_STIR
+
+#endif
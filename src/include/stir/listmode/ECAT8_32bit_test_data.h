@@ -0,0 +1,105 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup test
+  \brief Declaration of stir::ecat::write_ECAT8_32bit_test_data, used by the listmode tests
+*/
+
+#ifndef __stir_listmode_ECAT8_32bit_test_data_H__
+#define __stir_listmode_ECAT8_32bit_test_data_H__
+
+#include "stir/ByteOrder.h"
+#include "stir/error.h"
+#include "boost/cstdint.hpp"
+#include "boost/random/mersenne_twister.hpp"
+#include "boost/random/uniform_int.hpp"
+#include "boost/random/variate_generator.hpp"
+#include <fstream>
+#include <string>
+
+START_NAMESPACE_STIR
+namespace ecat {
+
+/*!
+  \ingroup test
+  \brief Writes a listmode file in the 32-bit PETLINK format with pseudo-random events
+
+  The Interfile header \a output_header_filename is a copy of \a template_header_filename
+  (e.g. examples/samples/mMR_listmode.l.hdr), with the <tt>name of data file</tt>
+  replaced by \a output_header_filename without its extension, followed by \c ".l".
+  Keys are expected to be written as in that file, i.e. without spaces around \c ":=".
+
+  The events are uniformly distributed over the bins with an offset (see CListEventECAT8_32bit)
+  smaller than \a max_offset, which can be used to only use the first segments. There is
+  a time tag every millisecond (starting from 0) followed by \a num_events_per_ms events.
+  Every 10th event is a delayed. The same arguments always give the same file.
+*/
+inline void
+write_ECAT8_32bit_test_data(const std::string& output_header_filename,
+                            const std::string& template_header_filename,
+                            const unsigned long max_offset,
+                            const unsigned long num_events,
+                            const unsigned long num_events_per_ms = 1000)
+{
+  const std::string data_filename =
+    output_header_filename.substr(0, output_header_filename.rfind('.')) + ".l";
+  {
+    std::ifstream template_header(template_header_filename.c_str());
+    std::ofstream header(output_header_filename.c_str());
+    if (!template_header || !header)
+      error("write_ECAT8_32bit_test_data: error opening header files '%s' or '%s'",
+            template_header_filename.c_str(), output_header_filename.c_str());
+    std::string line;
+    while (std::getline(template_header, line))
+      {
+        if (line.find("name of data file:=") == 0)
+          header << "name of data file:=" << data_filename.substr(data_filename.find_last_of("/\\")+1) << '\n';
+        else
+          header << line << '\n';
+      }
+  }
+
+  std::ofstream data(data_filename.c_str(), std::ios::out | std::ios::binary);
+  const ByteOrder byte_order(ByteOrder::little_endian);
+  boost::mt19937 generator(42);
+  boost::uniform_int<boost::uint32_t> offset_distribution(0, static_cast<boost::uint32_t>(max_offset-1));
+  boost::variate_generator<boost::mt19937&, boost::uniform_int<boost::uint32_t> >
+    random_offset(generator, offset_distribution);
+  for (unsigned long event_num=0; event_num<num_events; ++event_num)
+    {
+      if (event_num % num_events_per_ms == 0)
+        {
+          // time tag: type bit set, time in ms
+          boost::uint32_t word = (1U<<31) | static_cast<boost::uint32_t>(event_num / num_events_per_ms);
+          byte_order.swap_if_necessary(word);
+          data.write(reinterpret_cast<const char *>(&word), sizeof(word));
+        }
+      // event: type bit 0, "delayed" bit set for prompts, offset in the sinogram
+      const bool prompt = event_num % 10 != 9;
+      boost::uint32_t word = (prompt ? (1U<<30) : 0U) | random_offset();
+      byte_order.swap_if_necessary(word);
+      data.write(reinterpret_cast<const char *>(&word), sizeof(word));
+    }
+  if (!data)
+    error("write_ECAT8_32bit_test_data: error writing '%s'", data_filename.c_str());
+}
+
+} // namespace ecat
+END_NAMESPACE_STIR
+
+#endif
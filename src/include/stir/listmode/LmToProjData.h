@@ -108,6 +108,12 @@ class CListTime;
     ; if you're short of RAM (i.e. a single projdata does not fit into memory),
     ; you can use this to process the list mode data in multiple passes.
     num_segments_in_memory := -1
+    ; alternatively, read the list mode data only once per time frame, even when
+    ; num_segments_in_memory is smaller than the number of segments (see below)
+    single pass := 0
+    ; directory for the temporary files used in single pass mode
+    ; (default is to use the same directory as the output)
+    scratch directory :=
 
   End := 
   \endverbatim
@@ -143,6 +149,17 @@ class CListTime;
   </li>
   </ul>
 
+  \par Single pass mode
+
+  When \c num_segments_in_memory is smaller than the number of segments, the
+  default behaviour is to go through the list mode data once for every batch
+  of segments. With <tt>single pass := 1</tt>, the list mode data is read only once
+  per time frame. Events for segments that are not in memory are then
+  written to temporary files (one per segment, 8 bytes per event). Once the
+  first batch of segments has been written, the temporary files for the next
+  batches are read back (in parallel over the segments when using OpenMP),
+  added to the segments and deleted.
+
   \par Notes for developers
 
   The class provides several
@@ -206,6 +223,9 @@ protected:
   */
   void do_post_normalisation(Bin& bin) const;
 
+  //! Name of the temporary file used in single pass mode for the current frame and this segment
+  std::string get_spill_filename(const int segment_num) const;
+
   //! \name parsing functions
   //@{
   virtual void set_defaults();
@@ -225,6 +245,10 @@ protected:
   bool store_prompts;
   bool store_delayeds;
   int num_segments_in_memory;
+  //! if \c true, read the list mode data only once, using temporary files for the other segments
+  bool single_pass;
+  //! directory for the temporary files (if empty, the directory of the output is used)
+  std::string scratch_directory;
   long int num_events_to_store;
   int max_segment_num_to_process;
 
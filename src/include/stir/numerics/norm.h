@@ -40,6 +40,7 @@
 START_NAMESPACE_STIR
 
 template <int num_dimensions, class elemT> class Array;
+template <int num_dimensions, typename elemT, class ExprT> class ArrayExpression;
 
 /*!
  \ingroup numerics
@@ -128,6 +129,17 @@ template<class elemT>
 inline double 
 norm_squared (const Array<1,elemT> & v1);
 
+//! l2 norm of the result of an arithmetic operation on 1D arrays
+/*! This evaluates the expression into a temporary Array first. */
+template<class elemT, class ExprT>
+inline double
+norm (const ArrayExpression<1,elemT,ExprT> & v1);
+
+//! square of the l2 norm of the result of an arithmetic operation on 1D arrays
+template<class elemT, class ExprT>
+inline double
+norm_squared (const ArrayExpression<1,elemT,ExprT> & v1);
+
 //@}
 
 END_NAMESPACE_STIR
@@ -93,5 +93,19 @@ norm_squared(const Array<1,elemT> & v1)
   return norm_squared(v1.begin(), v1.end());
 }
 
+template<class elemT, class ExprT>
+inline double
+norm (const ArrayExpression<1,elemT,ExprT> & v1)
+{
+  return norm(Array<1,elemT>(v1));
+}
+
+template<class elemT, class ExprT>
+inline double
+norm_squared(const ArrayExpression<1,elemT,ExprT> & v1)
+{
+  return norm_squared(Array<1,elemT>(v1));
+}
+
 END_NAMESPACE_STIR
 
@@ -0,0 +1,132 @@
+//
+//
+/*!
+  \file
+  \ingroup projection
+
+  \brief Declaration of class stir::CompressedProjMatrixCache
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+#ifndef __stir_recon_buildblock_CompressedProjMatrixCache_H__
+#define __stir_recon_buildblock_CompressedProjMatrixCache_H__
+
+#include "stir/BasicCoordinate.h"
+#include <boost/cstdint.hpp>
+#include <vector>
+#include <cstddef>
+
+START_NAMESPACE_STIR
+
+class Succeeded;
+class ProjMatrixElemsForOneBin;
+
+/*!
+  \ingroup projection
+  \brief Compact storage of the rows of a projection matrix for a single
+  (view,segment) pair.
+
+  This class is used by ProjMatrixByBin when <tt>use compressed cache</tt> is set.
+  All rows are stored in one contiguous arena of 16-bit words. A row is stored
+  as its number of elements, followed by one entry per element. Voxel
+  coordinates are linearised using the bounding box of the image passed
+  to set_up(), and stored as a 16-bit difference with the previous element.
+  If the difference does not fit, or the voxel lies outside the bounding box,
+  the full coordinates are stored instead (using an escape word). The weight
+  is stored as a float, or optionally as a 16-bit (IEEE 754 half precision) float.
+
+  Rows are located via a dense table indexed by (axial_pos_num, tangential_pos_num),
+  such that finding a row is an index computation, not a hash lookup.
+
+  Rows are appended in the order in which they are stored, and are never modified
+  afterwards (aside from clear()).
+
+  \warning Elements are stored in the order in which they occur in the row. This
+  gives the best compression when rows are sorted (see ProjMatrixElemsForOneBin::push_back()).
+  \warning This class does not do any locking. Concurrent calls to store() and get()
+  need to be serialised by the caller.
+*/
+class CompressedProjMatrixCache
+{
+public:
+  CompressedProjMatrixCache();
+
+  //! Set ranges of bins that can be stored, and the bounding box used for linearisation
+  /*! Clears all stored rows. Memory for the row table is only allocated when the first
+      row is stored.
+  */
+  void set_up(const int min_axial_pos_num, const int max_axial_pos_num,
+              const int min_tangential_pos_num, const int max_tangential_pos_num,
+              const BasicCoordinate<3,int>& min_voxel_index,
+              const BasicCoordinate<3,int>& max_voxel_index,
+              const bool use_half_precision);
+
+  //! Store the row
+  /*! Bin coordinates are obtained via ProjMatrixElemsForOneBin::get_bin().
+      If the row is already stored, or the bin is out of range, nothing happens.
+  */
+  void store(const ProjMatrixElemsForOneBin&);
+
+  //! Get a row from the cache
+  /*! If the row is present, it overwrites the argument and returns Succeeded::yes,
+      otherwise it leaves the argument untouched and returns Succeeded::no.
+  */
+  Succeeded get(ProjMatrixElemsForOneBin&) const;
+
+  //! Checks if the row for a bin is present
+  bool is_stored(const int axial_pos_num, const int tangential_pos_num) const;
+
+  //! Remove all rows and deallocate memory
+  void clear();
+
+  //! Number of bytes currently allocated for the arena and the row table
+  std::size_t get_num_bytes_allocated() const;
+
+  //! Number of rows currently stored
+  std::size_t get_num_rows() const
+  { return num_rows; }
+
+  //! Conversion of a float to the nearest IEEE 754 half precision value
+  static boost::uint16_t float_to_half(const float);
+  //! Conversion of an IEEE 754 half precision value to a float
+  static float half_to_float(const boost::uint16_t);
+
+private:
+  typedef boost::uint16_t word_type;
+
+  int min_axial_pos_num;
+  int max_axial_pos_num;
+  int min_tangential_pos_num;
+  int max_tangential_pos_num;
+  BasicCoordinate<3,int> min_voxel_index;
+  BasicCoordinate<3,int> max_voxel_index;
+  //! number of voxels in a plane and a row of the bounding box
+  long plane_size, row_size;
+  bool use_half_precision;
+
+  std::vector<word_type> arena;
+  //! offset in the arena of the start of each row, plus 1 (0 means: not stored)
+  std::vector<std::size_t> row_offsets;
+  std::size_t num_rows;
+
+  //! returns -1 if out of range
+  long row_index(const int axial_pos_num, const int tangential_pos_num) const;
+};
+
+END_NAMESPACE_STIR
+
+#endif
@@ -0,0 +1,117 @@
+//
+//
+/*!
+  \file
+  \ingroup projection
+
+  \brief Declaration of class stir::ConcurrentProjMatrixCache
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+#ifndef __stir_recon_buildblock_ConcurrentProjMatrixCache_H__
+#define __stir_recon_buildblock_ConcurrentProjMatrixCache_H__
+
+#include "stir/common.h"
+#include <boost/config.hpp>
+#include <cstddef>
+
+#ifndef BOOST_NO_CXX11_HDR_ATOMIC
+#include <atomic>
+//! Preprocessor symbol that is defined when ConcurrentProjMatrixCache is available
+#define STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+#endif
+
+START_NAMESPACE_STIR
+
+class Succeeded;
+class ProjMatrixElemsForOneBin;
+
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+
+/*!
+  \ingroup projection
+  \brief Storage of the rows of a projection matrix for a single (view,segment)
+  pair that can be read and written concurrently without locks.
+
+  This class is used by ProjMatrixByBin when <tt>use lock-free cache</tt> is set.
+  Every row is stored as a separate ProjMatrixElemsForOneBin that is never
+  modified once it is published. A dense table of atomic pointers, indexed by
+  (axial_pos_num, tangential_pos_num), is used to find the row. Publishing is
+  done with a compare-and-swap, such that if 2 threads compute the same row
+  at the same time, only one of the results is kept. Readers therefore never
+  wait for another thread.
+
+  The table itself is allocated when the first row is stored (using the same
+  compare-and-swap mechanism), such that (view,segment) pairs that are never used
+  do not take any memory.
+
+  \warning clear() and set_up() are not thread-safe. They should not be called
+  while other threads access the object.
+
+  \warning This class needs C++-11 support for std::atomic.
+*/
+class ConcurrentProjMatrixCache
+{
+public:
+  ConcurrentProjMatrixCache();
+  ~ConcurrentProjMatrixCache();
+
+  //! Set ranges of bins that can be stored
+  /*! Clears all stored rows. */
+  void set_up(const int min_axial_pos_num, const int max_axial_pos_num,
+              const int min_tangential_pos_num, const int max_tangential_pos_num);
+
+  //! Store the row
+  /*! Bin coordinates are obtained via ProjMatrixElemsForOneBin::get_bin().
+      If the row is already stored, or the bin is out of range, nothing happens.
+  */
+  void store(const ProjMatrixElemsForOneBin&);
+
+  //! Get a row from the cache
+  /*! If the row is present, it overwrites the argument and returns Succeeded::yes,
+      otherwise it leaves the argument untouched and returns Succeeded::no.
+  */
+  Succeeded get(ProjMatrixElemsForOneBin&) const;
+
+  //! Remove all rows and deallocate memory
+  void clear();
+
+private:
+  typedef std::atomic<const ProjMatrixElemsForOneBin*> row_ptr_type;
+
+  int min_axial_pos_num;
+  int max_axial_pos_num;
+  int min_tangential_pos_num;
+  int max_tangential_pos_num;
+
+  //! table of pointers to rows (null if not allocated yet)
+  std::atomic<row_ptr_type*> rows;
+
+  std::size_t get_num_rows_in_table() const;
+  //! returns -1 if out of range
+  long row_index(const int axial_pos_num, const int tangential_pos_num) const;
+
+  // copying is not supported
+  ConcurrentProjMatrixCache(const ConcurrentProjMatrixCache&);
+  ConcurrentProjMatrixCache& operator=(const ConcurrentProjMatrixCache&);
+};
+
+#endif // STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+
+END_NAMESPACE_STIR
+
+#endif
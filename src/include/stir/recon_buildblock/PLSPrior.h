@@ -210,13 +210,23 @@ protected:
                                             const DiscretisedDensity<3,elemT> &image_grad_z,
                                             const DiscretisedDensity<3,elemT> &image_grad_y,
                                             const DiscretisedDensity<3,elemT> &image_grad_x);
-  //! Inner product in Eq. (9) of the paper but also the penalty function.
-  void compute_inner_product_and_penalty(DiscretisedDensity<3,elemT> &inner_product,
-                                           DiscretisedDensity<3,elemT> &penalty,
-                                         DiscretisedDensity<3,elemT> &pet_im_grad_z,
-                                         DiscretisedDensity<3,elemT> &pet_im_grad_y,
-                                         DiscretisedDensity<3,elemT> &pet_im_grad_x,
-                        const DiscretisedDensity<3,elemT> &pet_image);
+  //! Inner product in Eq. (9) of the paper but also the penalty function, for a single row of the image
+  /*! The forward differences of the image are returned as well. The arrays are resized if necessary. */
+  void compute_inner_product_and_penalty_for_row(Array<1,elemT> &inner_product,
+                                                 Array<1,elemT> &penalty,
+                                                 Array<1,elemT> &pet_im_grad_z,
+                                                 Array<1,elemT> &pet_im_grad_y,
+                                                 Array<1,elemT> &pet_im_grad_x,
+                                                 const DiscretisedDensity<3,elemT> &pet_image,
+                                                 const int z, const int y) const;
+
+  //! compute (pet_im_grad - inner_product*anatomical_im_grad/norm)/penalty for a single plane
+  /*! The arrays are resized if necessary.  normalised_grad_z is not used in the 2D case. */
+  void compute_normalised_gradient_for_plane(Array<2,elemT> &normalised_grad_z,
+                                             Array<2,elemT> &normalised_grad_y,
+                                             Array<2,elemT> &normalised_grad_x,
+                                             const DiscretisedDensity<3,elemT> &pet_image,
+                                             const int z) const;
 
   shared_ptr<DiscretisedDensity<3,elemT> > anatomical_grad_x_sptr;
   shared_ptr<DiscretisedDensity<3,elemT> > anatomical_grad_y_sptr;
@@ -37,8 +37,14 @@
 #include "stir/ProjDataInMemory.h"
 #include "stir/recon_buildblock/ProjectorByBinPairUsingProjMatrixByBin.h"
 #include "stir/ExamInfo.h"
+#include <boost/cstdint.hpp>
+#include <vector>
+#include <string>
+#include <iostream>
 START_NAMESPACE_STIR
 
+class CListRecord;
+
 
 /*!
   \ingroup GeneralisedObjectiveFunction
@@ -51,6 +57,30 @@ START_NAMESPACE_STIR
   If the list mode data is binned (with LmToProjData) without merging
   any bins, then the log likelihood computed from list mode data and
   projection data will be identical.
+
+  When compiled with OpenMP, the gradient computation is multi-threaded.
+  Events are read and decoded in batches by the master thread, while the other threads
+  compute the projection matrix rows and do the forward and back projection of
+  the previous batch into thread-local images. Every thread processes a fixed range of
+  events in the batch, and the images are added at the end in a fixed order, such that
+  the result is reproducible for a fixed number of threads.
+
+  \par Event cache
+
+  When setting <tt>use event cache := 1</tt>, the listmode file is read only once
+  (by set_up() or when the time frame changes), and the bins of the events (and the
+  value of the additive term) are stored per subset. Subsequent computations
+  iterate over this cache, which avoids reading and decoding the listmode data, and
+  finding the subset that every event belongs to. The cache is kept in memory,
+  unless an <tt>event cache directory</tt> is set, in which case it is written to one
+  binary file per subset in that directory (which should be on fast local storage).
+  Every event needs 8 bytes (plus 4 if there is an additive term). The names of these
+  files contain the process id and a counter, such that several objects (or processes)
+  can use the same directory. The files are removed by the destructor.
+  \verbatim
+  use event cache := 0
+  event cache directory :=
+  \endverbatim
 */
 
 template <typename TargetT>
@@ -74,6 +104,9 @@ public:
   
   PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>(); 
 
+  //! Removes the event cache files (if any)
+  virtual ~PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>();
+
   //! This should compute the gradient of the objective function at the  current_image_estimate
   virtual  
   void compute_sub_gradient_without_penalty_plus_sensitivity(TargetT& gradient,  
@@ -125,8 +158,74 @@ protected:
 
   virtual bool actual_subsets_are_approximately_balanced(std::string& warning_message) const;
 
+  //! if \c true, events are read from the listmode file only once
+  bool use_event_cache;
+  //! if non-empty, the event cache is written to disk in this directory
+  std::string event_cache_directory;
+
   void
     add_view_seg_to_sensitivity(TargetT& sensitivity, const ViewSegmentNumbers& view_seg_nums) const;
+
+private:
+  //! compact storage of the bin of an event in the event cache
+  struct CachedEvent
+  {
+    boost::int16_t segment_num;
+    boost::int16_t view_num;
+    boost::int16_t axial_pos_num;
+    boost::int16_t tangential_pos_num;
+  };
+  //! cached events per subset (only used when the cache is in memory)
+  std::vector<std::vector<CachedEvent> > cached_events;
+  //! values of the additive term for every cached event (only used when the cache is in memory)
+  std::vector<std::vector<float> > cached_additive_values;
+  //! number of cached events per subset
+  std::vector<std::size_t> num_cached_events;
+  //! time frame for which the cache was constructed (0 if none)
+  unsigned int event_cache_frame_num;
+  //! start of the names of the event cache files, unique for this object (empty if not set yet)
+  std::string event_cache_filename_prefix;
+  //! number of event cache files that were created
+  int num_event_cache_files;
+
+  //! number of events read in one go by compute_sub_gradient_without_penalty_plus_sensitivity
+  static const std::size_t num_events_per_batch = 100000;
+
+  //! Read the next batch of prompt events in the current subset and time frame
+  /*! \c bins will contain the measured bins, \c additive_values the corresponding
+      value of the additive term (if there is one).
+      \return \c false if there are no more events to read.
+  */
+  bool read_batch_of_events(std::vector<Bin>& bins, std::vector<float>& additive_values,
+                            CListRecord& record,
+                            long int& more_events, long& num_used_events,
+                            const double start_time, const double end_time,
+                            const int subset_num) const;
+
+  //! Same as read_batch_of_events(), but reads from the event cache
+  /*! \c position is the index of the next event to read in the subset. If the cache is
+      on disk, \c cache_stream_ptr has to point to the stream for the subset, otherwise it should be 0.
+  */
+  bool read_batch_of_events_from_cache(std::vector<Bin>& bins, std::vector<float>& additive_values,
+                                       std::size_t& position, std::istream * cache_stream_ptr,
+                                       long& num_used_events,
+                                       const int subset_num) const;
+
+  //! Read records until the next prompt event in the time frame that falls in the range of the projection data
+  /*! \return Succeeded::no at the end of the file or time frame */
+  Succeeded read_next_prompt_bin(Bin& measured_bin, CListRecord& record,
+                                 const double start_time, const double end_time) const;
+
+  //! Find the subset that an event in this bin belongs to
+  /*! \return -1 if the event is not used */
+  int find_subset_num(const Bin& measured_bin) const;
+
+  //! Read the listmode data for the current time frame and fill the event cache
+  void cache_listmode_events();
+
+  std::string get_event_cache_filename(const int subset_num) const;
+  //! Remove the event cache files that were created
+  void remove_event_cache_files();
 };
 
 END_NAMESPACE_STIR
@@ -124,6 +124,11 @@ class DistributedCachingInformation;
   ; see BinNormalisation hierarchy for possible values
   Bin Normalisation type :=
 
+  ; maximum memory (in MB) for the copies of the image used by the threads
+  ; (only used with OpenMP), 0 means no limit
+  ; see set_distributable_computation_memory_budget()
+  thread image memory budget (MB) := 0
+
   End PoissonLogLikelihoodWithLinearModelForMeanAndProjData Parameters :=
   \endverbatim
 */
@@ -196,6 +201,7 @@ public:
   const TimeFrameDefinitions& get_time_frame_definitions() const;
   const BinNormalisation& get_normalisation() const;
   const shared_ptr<BinNormalisation>& get_normalisation_sptr() const;
+  double get_thread_image_memory_budget_in_MB() const;
   //@}
   /*! \name Functions to set parameters
     This can be used as alternative to the parsing mechanism.
@@ -215,6 +221,11 @@ public:
   void set_frame_num(const int);
   void set_frame_definitions(const TimeFrameDefinitions&);
   virtual void set_normalisation_sptr(const shared_ptr<BinNormalisation>&);
+  //! set the memory budget for the images of the threads (0 means no limit)
+  /*! This is a global setting (see set_distributable_computation_memory_budget()),
+      which is applied by set_up().
+  */
+  void set_thread_image_memory_budget_in_MB(const double);
 
   virtual void set_input_data(const shared_ptr<ExamData> &);
   virtual const ProjData& get_input_data() const;
@@ -293,6 +304,9 @@ protected:
   //! signals whether to zero the data in the end planes of the projection data
   bool zero_seg0_end_planes;
 
+  //! maximum memory (in MB) for the images of the threads, 0 means no limit
+  double thread_image_memory_budget_in_MB;
+
   //! name of file in which additive projection data are stored
   std::string additive_projection_data_filename;
 
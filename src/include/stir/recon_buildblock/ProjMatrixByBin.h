@@ -35,6 +35,8 @@
 #include "stir/ParsingObject.h"
 #include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
 #include "stir/recon_buildblock/DataSymmetriesForBins.h"
+#include "stir/recon_buildblock/CompressedProjMatrixCache.h"
+#include "stir/recon_buildblock/ConcurrentProjMatrixCache.h"
 #include "stir/shared_ptr.h"
 #include "stir/VectorWithOffset.h"
 #include "stir/TimedObject.h"
@@ -80,10 +82,27 @@ class Bin;
   \verbatim
   disable caching := false
   store only basic bins in cache := true
+  use compressed cache := false
+  use half precision in compressed cache := false
+  use lock-free cache := false
   \endverbatim
   The 2nd option allows to cache the whole matrix. This results in the fastest
   behaviour IF your system does not start swapping. The default choice caches 
   only the 'basic' bins, and computes symmetry related bins from the 'basic' ones.
+
+  The compressed cache stores the rows for every (view,segment) in a contiguous
+  arena with delta-encoded voxel coordinates (see CompressedProjMatrixCache).
+  This typically needs 3 to 4 times less memory than the default cache, and finding
+  a row does not need a hash lookup. Weights can optionally be stored in half
+  precision, saving another third of the memory, at the expense of a relative
+  precision of about 1e-3.
+
+  The lock-free cache (see ConcurrentProjMatrixCache) is intended for multi-threaded
+  use (i.e. when STIR is compiled with OpenMP). Once a row is in the cache, threads
+  can read it without taking any lock. The default cache uses a lock per
+  (view,segment) pair, such that threads that access the same view serialise.
+  The lock-free cache cannot be combined with the compressed cache. It also needs
+  C++-11 support.
 */
 class ProjMatrixByBin :  
   public RegisteredObject<ProjMatrixByBin>,  
@@ -147,11 +166,22 @@ public:
   void enable_cache(const bool v = true);
   void store_only_basic_bins_in_cache(const bool v = true) ;
 
+  //! Use CompressedProjMatrixCache for caching
+  /*! \warning Has to be called before set_up() */
+  void use_compressed_cache(const bool v = true, const bool use_half_precision = false);
+
+  //! Use ConcurrentProjMatrixCache for caching
+  /*! \warning Has to be called before set_up() */
+  void use_lock_free_cache(const bool v = true);
+
   bool is_cache_enabled() const;
   bool does_cache_store_only_basic_bins() const;
+  bool does_cache_use_compression() const;
+  bool is_cache_lock_free() const;
 
   // void reserve_num_elements_in_cache(const std::size_t);
   //! Remove all elements from the cache
+  /*! \warning This should not be called while other threads are getting rows from the matrix. */
   void clear_cache() STIR_MUTABLE_CONST;
 
   
@@ -192,6 +222,9 @@ protected:
 
   bool cache_disabled;  
   bool cache_stores_only_basic_bins;
+  bool cache_is_compressed;
+  bool cache_uses_half_precision;
+  bool cache_is_lock_free;
 
   /*! \brief The method that tries to get data from the cache.
   
@@ -221,6 +254,16 @@ private:
   mutable
 #endif
     VectorWithOffset<VectorWithOffset<MapProjMatrixElemsForOneBin> > cache_collection;
+  //! alternative cache, used if cache_is_compressed
+#ifndef STIR_NO_MUTABLE
+  mutable
+#endif
+    VectorWithOffset<VectorWithOffset<CompressedProjMatrixCache> > compressed_cache_collection;
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+  //! alternative cache, used if cache_is_lock_free
+  /*! Note: the cache objects themselves are not copyable, so we store pointers. */
+  VectorWithOffset<VectorWithOffset<shared_ptr<ConcurrentProjMatrixCache> > > lock_free_cache_collection;
+#endif
 #ifdef STIR_OPENMP
 #ifndef STIR_NO_MUTABLE
   mutable
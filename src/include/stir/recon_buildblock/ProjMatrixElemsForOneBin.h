@@ -37,6 +37,7 @@
 
 
 #include "stir/recon_buildblock/ProjMatrixElemsForOneBinValue.h"
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBinAllocator.h"
 #include "stir/Bin.h"
 #include <vector>
 
@@ -67,6 +68,10 @@ template <int num_dimensions, typename elemT> class DiscretisedDensity;
   elements, efficient elements, etc. However, doing this
   will probably only be useful if all ProjMatrixByBin classes
   are then templated as well, which would be a pain.
+
+  The elements are stored using ProjMatrixElemsForOneBinAllocator, such
+  that creating, copying and destroying rows normally does not need
+  the system allocator (see ProjMatrixElemsForOneBinArena).
 */
 
 /* 
@@ -88,7 +93,7 @@ public:
   typedef ProjMatrixElemsForOneBinValue value_type;
 private:
   //! shorthand to keep typedefs below concise
-  typedef std::vector<value_type> Element_vector;
+  typedef std::vector<value_type, ProjMatrixElemsForOneBinAllocator<value_type> > Element_vector;
 
 public:  
   //! typedefs for iterator support
@@ -204,7 +209,7 @@ public:
 
   
 private:
-  std::vector<value_type> elements;    
+  Element_vector elements;    
   Bin bin;
 
 
@@ -0,0 +1,152 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projection
+
+  \brief Declaration of class stir::ProjMatrixElemsForOneBinArena and
+  stir::ProjMatrixElemsForOneBinAllocator
+*/
+#ifndef __stir_recon_buildblock_ProjMatrixElemsForOneBinAllocator_H__
+#define __stir_recon_buildblock_ProjMatrixElemsForOneBinAllocator_H__
+
+#include "stir/common.h"
+#include <boost/config.hpp>
+#include <cstddef>
+#include <new>
+
+#if !defined(BOOST_NO_CXX11_THREAD_LOCAL) && !defined(BOOST_NO_CXX11_HDR_ATOMIC) && !defined(BOOST_NO_CXX11_HDR_MUTEX)
+//! Preprocessor symbol that is defined when ProjMatrixElemsForOneBinArena reuses memory
+#define STIR_HAVE_PROJ_MATRIX_ELEMS_ARENA
+#endif
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup projection
+  \brief Per-thread pool of memory blocks for the rows of a projection matrix
+
+  Computing a row of a projection matrix, copying it in and out of the cache
+  and applying symmetries all create and destroy temporary vectors of
+  ProjMatrixElemsForOneBinValue. When many threads do this at the same time
+  (e.g. in list mode reconstructions), the calls to the system allocator
+  become a bottleneck.
+
+  This class keeps blocks of memory that are released in a free-list of the
+  thread that releases them, such that the next allocation of a similar size by
+  that thread does not need the system allocator. Block sizes are rounded
+  up to size classes with at most 12.5% overhead. No locks are used,
+  except when a thread uses the arena for the first time and when it exits.
+
+  Blocks larger than get_max_block_size() are always allocated on the heap.
+  The memory held in the free-lists of a single thread is limited to
+  get_max_num_cached_bytes_per_thread(). Memory is returned to the system
+  when the thread exits.
+
+  If the compiler does not support \c thread_local, \c std::atomic and \c std::mutex,
+  all allocations are forwarded to <tt>::operator new</tt> (and no counters are kept).
+  The preprocessor symbol \c STIR_HAVE_PROJ_MATRIX_ELEMS_ARENA is defined
+  otherwise.
+*/
+class ProjMatrixElemsForOneBinArena
+{
+ public:
+  //! Statistics on the usage of the arena, summed over all threads
+  struct Counters
+  {
+    //! total number of calls to allocate()
+    unsigned long long num_allocations;
+    //! number of allocations that reused a block from a free-list (i.e. heap allocations avoided)
+    unsigned long long num_reused_blocks;
+    //! number of blocks allocated on the heap
+    unsigned long long num_heap_allocations;
+  };
+
+  //! allocate memory for \a num_bytes
+  static void* allocate(const std::size_t num_bytes);
+  //! release memory that was allocated with allocate(num_bytes)
+  static void deallocate(void * ptr, const std::size_t num_bytes);
+
+  //! get the counters (summed over all threads, including the ones that exited)
+  static Counters get_counters();
+  //! set all counters to zero
+  static void reset_counters();
+
+  //! largest block size that is kept in the free-lists
+  static std::size_t get_max_block_size();
+  //! maximum number of bytes kept in the free-lists of a single thread
+  static std::size_t get_max_num_cached_bytes_per_thread();
+};
+
+/*!
+  \ingroup projection
+  \brief Allocator using ProjMatrixElemsForOneBinArena
+
+  This is a (stateless) standard conforming allocator, such that it can be
+  used for std::vector etc. All instances compare equal, as memory allocated
+  by one thread can be released by any other thread.
+*/
+template <class T>
+class ProjMatrixElemsForOneBinAllocator
+{
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+
+  template <class U>
+  struct rebind { typedef ProjMatrixElemsForOneBinAllocator<U> other; };
+
+  ProjMatrixElemsForOneBinAllocator() {}
+  template <class U>
+  ProjMatrixElemsForOneBinAllocator(const ProjMatrixElemsForOneBinAllocator<U>&) {}
+
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+
+  pointer allocate(size_type n, const void* = 0)
+  {
+    if (n > this->max_size())
+      throw std::bad_alloc();
+    return static_cast<pointer>(ProjMatrixElemsForOneBinArena::allocate(n*sizeof(T)));
+  }
+  void deallocate(pointer p, size_type n)
+  { ProjMatrixElemsForOneBinArena::deallocate(p, n*sizeof(T)); }
+
+  size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+
+  void construct(pointer p, const T& value) { new (static_cast<void*>(p)) T(value); }
+  void destroy(pointer p) { p->~T(); }
+};
+
+template <class T, class U>
+inline bool operator==(const ProjMatrixElemsForOneBinAllocator<T>&, const ProjMatrixElemsForOneBinAllocator<U>&)
+{ return true; }
+
+template <class T, class U>
+inline bool operator!=(const ProjMatrixElemsForOneBinAllocator<T>&, const ProjMatrixElemsForOneBinAllocator<U>&)
+{ return false; }
+
+END_NAMESPACE_STIR
+
+#endif
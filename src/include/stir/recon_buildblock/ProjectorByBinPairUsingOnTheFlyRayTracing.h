@@ -0,0 +1,123 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup projection
+
+  \brief Declares class stir::ProjectorByBinPairUsingOnTheFlyRayTracing
+
+*/
+#ifndef __stir_recon_buildblock_ProjectorByBinPairUsingOnTheFlyRayTracing_h_
+#define __stir_recon_buildblock_ProjectorByBinPairUsingOnTheFlyRayTracing_h_
+
+#include "stir/RegisteredParsingObject.h"
+#include "stir/recon_buildblock/ProjectorByBinPair.h"
+#include "stir/recon_buildblock/ProjMatrixByBinUsingRayTracing.h"
+
+START_NAMESPACE_STIR
+
+class Succeeded;
+/*!
+  \ingroup projection
+  \brief A matrix-free projector pair which computes ray tracing weights on the fly
+
+  This pair uses a ProjMatrixByBinUsingRayTracing (i.e. Siddon's algorithm)
+  with caching disabled. No projection matrix elements are stored, which makes this
+  pair suitable for large 3D PET data where the matrix does not fit in memory.
+
+  The forward and back projectors handle the symmetries (see
+  DataSymmetriesForBins_PET_CartesianGrid) explicitly, such that only the
+  rows of the basic bins are computed. When STIR is compiled with OpenMP,
+  these rows are computed in parallel within every RelatedViewgrams (unless
+  we are already in a parallel region, e.g. when the objective function
+  distributes the work over views).
+
+  \par Parsing parameters
+  \verbatim
+  Projector Pair Using On The Fly Ray Tracing Parameters:=
+  ; see ProjMatrixByBinUsingRayTracing for the meaning of these keywords
+  restrict to cylindrical FOV := 1
+  number of rays in tangential direction to trace for each bin := 1
+  use actual detector boundaries := 0
+  do_symmetry_90degrees_min_phi := 1
+  do_symmetry_180degrees_min_phi := 1
+  do_symmetry_swap_segment := 1
+  do_symmetry_swap_s := 1
+  do_symmetry_shift_z := 1
+  End Projector Pair Using On The Fly Ray Tracing Parameters:=
+  \endverbatim
+
+  Results are identical to the \c Matrix pair with the \c Ray \c Tracing matrix
+  (with the same parameters), but without the memory overhead of the cache.
+*/
+class ProjectorByBinPairUsingOnTheFlyRayTracing : 
+  public RegisteredParsingObject<ProjectorByBinPairUsingOnTheFlyRayTracing,
+                                 ProjectorByBinPair,
+                                 ProjectorByBinPair> 
+{ 
+ private:
+  typedef
+    RegisteredParsingObject<ProjectorByBinPairUsingOnTheFlyRayTracing,
+                            ProjectorByBinPair,
+                            ProjectorByBinPair> 
+    base_type;
+public:
+  //! Name which will be used when parsing a ProjectorByBinPair object
+  static const char * const registered_name; 
+
+  //! Default constructor (calls set_defaults())
+  ProjectorByBinPairUsingOnTheFlyRayTracing();
+
+  //! Stores all necessary geometric info
+  virtual Succeeded set_up(		 
+    const shared_ptr<ProjDataInfo>& proj_data_info_sptr,
+    const shared_ptr<DiscretisedDensity<3,float> >& density_info_sptr // TODO should be Info only
+    );
+
+  //! Get the matrix used to compute the weights
+  /*! Its parameters can be modified, but caching should not be enabled. */
+  shared_ptr<ProjMatrixByBinUsingRayTracing> get_proj_matrix_sptr() const;
+
+private:
+  shared_ptr<ProjMatrixByBinUsingRayTracing> proj_matrix_sptr;
+
+  //! \name parameters passed on to the matrix
+  //@{
+  bool restrict_to_cylindrical_FOV;
+  int num_tangential_LORs;
+  bool use_actual_detector_boundaries;
+  bool do_symmetry_90degrees_min_phi;
+  bool do_symmetry_180degrees_min_phi;
+  bool do_symmetry_swap_segment;
+  bool do_symmetry_swap_s;
+  bool do_symmetry_shift_z;
+  //@}
+
+  //! create the projectors using the current matrix
+  void create_projectors();
+
+  void set_defaults();
+  void initialise_keymap();
+  bool post_processing();
+};
+
+END_NAMESPACE_STIR
+
+
+#endif // __stir_recon_buildblock_ProjectorByBinPairUsingOnTheFlyRayTracing_h_
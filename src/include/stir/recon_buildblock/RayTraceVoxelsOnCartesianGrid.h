@@ -28,6 +28,8 @@
     See STIR/LICENSE.txt for details
 */
 #include "stir/common.h"
+#include <vector>
+#include <string>
 
 START_NAMESPACE_STIR
 
@@ -80,4 +82,36 @@ RayTraceVoxelsOnCartesianGrid(ProjMatrixElemsForOneBin& lor,
                               const CartesianCoordinate3D<float>& voxel_size,
                               const float normalisation_constant = 1.F);
 
+/*! \ingroup recon_buildblock
+  
+  \brief Ray traces a batch of LORs simultaneously.
+
+  This appends the same elements to \c lors[i] as
+  \code
+  RayTraceVoxelsOnCartesianGrid(lors[i], start_points[i], end_points[i], 
+                                voxel_size, normalisation_constant);
+  \endcode
+  would. All vectors have to have the same size.
+
+  Internally, 16 LORs are handled at the same time using a loop
+  without branches, such that the compiler can use SIMD instructions.
+  On x86 processors (and when compiling with gcc or clang), versions
+  for AVX2 and AVX-512 are compiled as well, and the one to use is
+  selected at run-time (see get_RayTraceVoxelsOnCartesianGrid_instruction_set()).
+
+  LORs with (nearly) identical start and end points, or in a plane between
+  voxels, are handled by the single LOR version.
+*/
+void 
+RayTraceVoxelsOnCartesianGrid(std::vector<ProjMatrixElemsForOneBin>& lors, 
+                              const std::vector<CartesianCoordinate3D<float> >& start_points, 
+                              const std::vector<CartesianCoordinate3D<float> >& end_points, 
+                              const CartesianCoordinate3D<float>& voxel_size,
+                              const float normalisation_constant = 1.F);
+
+//! \ingroup recon_buildblock
+//! Returns the name of the instruction set used by the batch version of RayTraceVoxelsOnCartesianGrid
+std::string
+get_RayTraceVoxelsOnCartesianGrid_instruction_set();
+
 END_NAMESPACE_STIR
@@ -33,6 +33,7 @@
   \author PARAPET project
 */
 #include "stir/shared_ptr.h"
+#include <cstddef>
 
 START_NAMESPACE_STIR
 
@@ -83,6 +84,24 @@ void setup_distributable_computation(
 */
 void end_distributable_computation();
 
+//! Set the maximum amount of memory used for thread-local copies of the output image
+/*! \ingroup distributable
+    When using OpenMP, every thread in distributable_computation() normally accumulates into its own
+    copy of the output image, which are added at the end. For large images and many threads, this
+    can use too much memory. This function limits the memory (in bytes) used for the copies.
+    If there is not enough memory for one copy per thread, threads will share images (and
+    therefore have to wait for each other).
+
+    A value of 0 (the default) means that there is no limit.
+*/
+void set_distributable_computation_memory_budget(const std::size_t num_bytes);
+
+//! Get the maximum amount of memory used for thread-local copies of the output image
+/*! \ingroup distributable
+    \see set_distributable_computation_memory_budget()
+*/
+std::size_t get_distributable_computation_memory_budget();
+
 //! typedef for callback functions for distributable_computation()
 /*! \ingroup distributable
     Pointers will be NULL when they are not to be used by the callback function.
@@ -113,6 +132,11 @@ typedef  void RPC_process_related_viewgrams_type (
 
   If STIR_MPI is defined, this function distributes the computation over the slaves.
 
+  If STIR_OPENMP is defined, the computation is distributed over the threads. When the
+  compiler supports OpenMP 3.1, reading of the data is pipelined with the computation:
+  one thread reads the viewgrams of the next (view,segment) groups (up to 2 per thread)
+  while the other threads process the groups that were read already.
+
   Subsets are currently defined on views. A particular \a subset_num contains all views  which are symmetry related to 
   \code 
   proj_data_ptr->min_view_num()+subset_num + n*num_subsets
@@ -0,0 +1,194 @@
+#ifndef __stir_scatter_ScatterEstimation_H__
+#define __stir_scatter_ScatterEstimation_H__
+
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup scatter
+  \brief Definition of class stir::ScatterEstimation.
+*/
+
+#include "stir/shared_ptr.h"
+#include "stir/DiscretisedDensity.h"
+#include "stir/ProjData.h"
+#include "stir/ParsingObject.h"
+#include "stir/scatter/ScatterEstimationByBin.h"
+#include "stir/recon_buildblock/Reconstruction.h"
+#include "stir/recon_buildblock/BinNormalisation.h"
+#include <string>
+
+START_NAMESPACE_STIR
+
+class Succeeded;
+
+/*!
+  \ingroup scatter
+  \brief Estimate scatter by alternating single scatter simulation and image reconstruction
+
+  This class implements the same procedure as the \c estimate_scatter.sh script, but
+  keeps all intermediate data in memory:
+  <ol>
+  <li> reconstruct an initial activity image (or read it from file)</li>
+  <li> simulate (single) scatter for the current activity image on the low resolution
+       template of the ScatterEstimationByBin object</li>
+  <li> interpolate the scatter estimate to the size of the emission data and fit it to
+       the tails of the emission data (see ScatterEstimationByBin::upsample_and_fit_scatter_estimate())</li>
+  <li> reconstruct a new activity image, taking the new scatter estimate into account</li>
+  <li> go back to step 2 (for the given number of scatter iterations)</li>
+  </ol>
+  The tails are found using CreateTailMaskFromACFs on the attenuation correction factors,
+  unless a mask is given.
+
+  As the same ScatterEstimationByBin object is used for every iteration, the
+  scatter points and the cached attenuation integrals are reused. Only the activity
+  integrals are recomputed for every new activity image.
+
+  If the reconstruction is an IterativeReconstruction, its objective function is set-up
+  with the emission data, the product of the attenuation correction factors and the
+  normalisation as multiplicative factors, and the background + scatter as additive term.
+  The reconstruction is set-up only once (such that e.g. the sensitivity is computed only once).
+  For the next scatter iterations, only the additive term of the objective function is replaced.
+  Every reconstruction uses the previous activity image as initial estimate.
+  For an AnalyticReconstruction, the input data is set to the emission data, corrected
+  for background, scatter, attenuation and normalisation. Note that the parameter file for
+  the analytic reconstruction still needs an <tt>input file</tt> (which will be ignored).
+
+  Negative values in the activity image are set to zero before the scatter simulation.
+
+  \par Parsing parameters
+  \verbatim
+  Iterative Scatter Estimation Parameters :=
+  ; emission data (prompts)
+  input file :=
+  ; background projection data (e.g. randoms), defaults to none
+  ;background projdata filename :=
+  ; attenuation correction factors (same size as the emission data)
+  attenuation correction factors filename :=
+  ; normalisation (without attenuation), defaults to none
+  ;Bin Normalisation type :=
+  ; parameter file for ScatterEstimationByBin
+  ; (activity image and output filename are not needed)
+  scatter simulation parameter filename :=
+  reconstruction method type :=
+  ; initial activity image. If not set, it is reconstructed without scatter correction
+  ;initial activity image filename :=
+  number of scatter iterations := 5
+  ; tail mask. If the filename is not set, it is computed from the ACFs
+  ;mask projdata filename :=
+  tail mask ACF threshold := 1.1
+  tail mask safety margin := 4
+  ; tail fitting
+  minimum scale factor := 1e-5
+  maximum scale factor := 1e5
+  half filter width := 1
+  remove interleaving := 1
+  ; output (optional)
+  output scatter estimate filename prefix :=
+  write scatter estimates for all iterations := 0
+  output activity image filename prefix :=
+  End Iterative Scatter Estimation Parameters :=
+  \endverbatim
+*/
+class ScatterEstimation : public ParsingObject
+{
+ public:
+  //! Default constructor (calls set_defaults())
+  ScatterEstimation();
+
+  //! \name functions to set data
+  //@{
+  void set_input_proj_data_sptr(const shared_ptr<ProjData>&);
+  void set_background_proj_data_sptr(const shared_ptr<ProjData>&);
+  void set_attenuation_correction_factors_sptr(const shared_ptr<ProjData>&);
+  void set_normalisation_sptr(const shared_ptr<BinNormalisation>&);
+  void set_mask_proj_data_sptr(const shared_ptr<ProjData>&);
+  void set_scatter_simulation_sptr(const shared_ptr<ScatterEstimationByBin>&);
+  void set_reconstruction_method_sptr(const shared_ptr<Reconstruction<DiscretisedDensity<3,float> > >&);
+  void set_initial_activity_image_sptr(const shared_ptr<DiscretisedDensity<3,float> >&);
+  void set_num_scatter_iterations(const int);
+  //@}
+
+  //! check consistency and prepare the data that does not change with the iterations
+  Succeeded set_up();
+
+  //! run all scatter iterations (calls set_up())
+  Succeeded process_data();
+
+  //! \name functions to get the results
+  //@{
+  //! scatter estimate of the last iteration (of the same size as the input data)
+  shared_ptr<ProjData> get_scatter_estimate_sptr() const;
+  //! last reconstructed activity image
+  shared_ptr<DiscretisedDensity<3,float> > get_activity_image_sptr() const;
+  //@}
+
+ protected:
+  void set_defaults();
+  void initialise_keymap();
+  bool post_processing();
+
+  //! reconstruct the activity image using the current scatter estimate
+  /*! Uses the current activity image (if any) as initial estimate for iterative reconstructions. */
+  Succeeded reconstruct_activity_image();
+  //! simulate scatter for the current activity image and fit it to the tails
+  Succeeded estimate_scatter();
+
+  //! \name parameters
+  //@{
+  std::string input_filename;
+  std::string background_filename;
+  std::string attenuation_correction_factors_filename;
+  std::string scatter_simulation_parameter_filename;
+  std::string initial_activity_image_filename;
+  std::string mask_filename;
+  std::string output_scatter_estimate_filename_prefix;
+  std::string output_activity_image_filename_prefix;
+  bool write_all_scatter_estimates;
+  int num_scatter_iterations;
+  float tail_mask_ACF_threshold;
+  int tail_mask_safety_margin;
+  float min_scale_factor;
+  float max_scale_factor;
+  int half_filter_width;
+  bool remove_interleaving;
+  //@}
+
+  shared_ptr<ProjData> input_proj_data_sptr;
+  shared_ptr<ProjData> background_proj_data_sptr;
+  shared_ptr<ProjData> attenuation_correction_factors_sptr;
+  shared_ptr<BinNormalisation> normalisation_sptr;
+  shared_ptr<ProjData> mask_proj_data_sptr;
+  shared_ptr<ScatterEstimationByBin> scatter_simulation_sptr;
+  shared_ptr<Reconstruction<DiscretisedDensity<3,float> > > reconstruction_method_sptr;
+
+ private:
+  //! input data minus background, used for tail fitting
+  shared_ptr<ProjData> data_to_fit_sptr;
+  //! normalisation combined with the attenuation correction factors
+  shared_ptr<BinNormalisation> multiplicative_normalisation_sptr;
+  //! scatter estimate on the low resolution template
+  shared_ptr<ProjData> low_resolution_scatter_sptr;
+  shared_ptr<ProjData> scatter_estimate_sptr;
+  shared_ptr<DiscretisedDensity<3,float> > activity_image_sptr;
+  //! true if the (iterative) reconstruction does not need to be set-up again
+  bool reconstruction_is_set_up;
+};
+
+END_NAMESPACE_STIR
+
+#endif
@@ -35,6 +35,7 @@
 #include "stir/numerics/BSplines.h"
 #include <vector>
 #include "stir/CartesianCoordinate3D.h"
+#include <boost/cstdint.hpp>
 
 START_NAMESPACE_STIR
 
@@ -145,8 +146,17 @@ class ScatterEstimationByBin : public ParsingObject
 
   void set_template_proj_data_info_sptr(const shared_ptr<ProjDataInfo>&);
   void set_template_proj_data_info(const std::string& filename);
+  //! get the projection data info used for the scatter simulation
+  shared_ptr<ProjDataInfo> get_template_proj_data_info_sptr() const;
 
-  //void set_output_proj_data_sptr(const shared_ptr<ProjData>& new_sptr);
+  //! set output projection data
+  /*! This has to be of the same size as the template_proj_data_info. Use this
+      (with for instance ProjDataInMemory) to avoid writing the estimate to file.
+      \warning No log file is written when no output filename is set.
+  */
+  void set_output_proj_data_sptr(const shared_ptr<ProjData>& new_sptr);
+  //! get output projection data
+  shared_ptr<ProjData> get_output_proj_data_sptr() const;
   //! create output projection data of same size as template_proj_data_info
   /*! \warning use set_template_proj_data_info() first. 
 
@@ -185,6 +195,15 @@ class ScatterEstimationByBin : public ParsingObject
       of memory, you can switch this off, but performance will suffer dramatically.
   */
   bool use_cache;
+  //! name of a file used to store the cached attenuation integrals
+  /*! If non-empty (and \c use_cache is on), the attenuation integrals are read from this file
+      when it was written for the same attenuation image, scatter points and detectors.
+      Otherwise, they are computed and written to this file. This avoids recomputing the
+      attenuation integrals when running the scatter simulation several times with the same
+      attenuation image (e.g. for different activity images). Note that this is only useful
+      if \c random is off, as the scatter points will otherwise be different for every run.
+  */
+  std::string attenuation_integrals_cache_filename;
 
   //! \name Parameters determining the energy detection efficiency of the scanner
   //@{
@@ -253,12 +272,16 @@ class ScatterEstimationByBin : public ParsingObject
     float 
     energy_lower_limit(const float low, const float approx, const float resolution_at_511keV);
 
+  //! find the indices of the detectors of a bin in \c detection_points_vector
+  /*! This does not need any locking, so can be called from multiple threads. */
   virtual 
     void
     find_detectors(unsigned& det_num_A, unsigned& det_num_B, const Bin& bin) const; 
 
-  unsigned 
-    find_in_detection_points_vector(const CartesianCoordinate3D<float>& coord) const;
+  //! Fill \c detection_points_vector with the coordinates of all detectors in the scanner
+  /*! Uses \c proj_data_info_ptr and \c shift_detector_coordinates_to_origin.*/
+  void
+    set_up_detection_points_vector();
   // private:
   const ProjDataInfoCylindricalNoArcCorr * proj_data_info_ptr;
   CartesianCoordinate3D<float>  shift_detector_coordinates_to_origin;
@@ -268,8 +291,8 @@ class ScatterEstimationByBin : public ParsingObject
     detection_efficiency_no_scatter(const unsigned det_num_A, 
 				    const unsigned det_num_B) const;
 
-  // next needs to be mutable because find_in_detection_points_vector is const
-  mutable std::vector<CartesianCoordinate3D<float> > detection_points_vector;
+  //! coordinates of all detectors, indexed as <tt>ring_num*num_detectors_per_ring + det_num</tt>
+  std::vector<CartesianCoordinate3D<float> > detection_points_vector;
  private:
   int total_detectors;
 
@@ -290,6 +313,18 @@ class ScatterEstimationByBin : public ParsingObject
 			      const CartesianCoordinate3D<float>& point1, 
 			      const CartesianCoordinate3D<float>& point2);
 
+  //! computes integrals from \a point1 to every point in \a points2
+  /*! Gives the same result as calling integral_between_2_points() for every point in \a points2,
+      but the rays are traced in batches (see the batch version of RayTraceVoxelsOnCartesianGrid()).
+      \a integrals is resized to the size of \a points2.
+  */
+  static
+    void
+    integrals_between_point_and_points(std::vector<float>& integrals,
+                                       const DiscretisedDensity<3,float>& density,
+                                       const CartesianCoordinate3D<float>& point1, 
+                                       const std::vector<CartesianCoordinate3D<float> >& points2);
+
   float 
     exp_integral_over_attenuation_image_between_scattpoint_det (const CartesianCoordinate3D<float>& scatter_point, 
 								const CartesianCoordinate3D<float>& detector_coord);
@@ -299,6 +334,18 @@ class ScatterEstimationByBin : public ParsingObject
   float 
     integral_over_activity_image_between_scattpoint_det (const CartesianCoordinate3D<float>& scatter_point,
 							 const CartesianCoordinate3D<float>& detector_coord);
+
+  //! computes exp_integral_over_attenuation_image_between_scattpoint_det() for many detectors
+  void
+    exp_integrals_over_attenuation_image_between_scattpoint_and_dets(std::vector<float>& values,
+                                                                     const CartesianCoordinate3D<float>& scatter_point,
+                                                                     const std::vector<CartesianCoordinate3D<float> >& detector_coords);
+
+  //! computes integral_over_activity_image_between_scattpoint_det() for many detectors
+  void
+    integrals_over_activity_image_between_scattpoint_and_dets(std::vector<float>& values,
+                                                              const CartesianCoordinate3D<float>& scatter_point,
+                                                              const std::vector<CartesianCoordinate3D<float> >& detector_coords);
   
  
     
@@ -389,6 +436,22 @@ class ScatterEstimationByBin : public ParsingObject
       call remove_cache_for_scattpoint_det_integrals_over_activity() first. 
   */
   void initialise_cache_for_scattpoint_det_integrals_over_activity();
+
+  //! fill the caches for all scatter points and detectors
+  /*! Only entries that have not been computed yet are filled. Computation is parallelised
+      over the scatter points (when using OpenMP).
+      If \c attenuation_integrals_cache_filename is set, the attenuation integrals are read
+      from file if possible, and written to it otherwise.
+
+      Does nothing if \c use_cache is false.
+  */
+  void precompute_cache_for_scattpoint_det_integrals();
+
+  //! checksum of the attenuation image, scatter points and detector coordinates
+  /*! Used to check that the attenuation integrals in \c attenuation_integrals_cache_filename are valid.*/
+  boost::uint32_t get_checksum_for_attenuation_integrals() const;
+  Succeeded read_cache_for_scattpoint_det_integrals_over_attenuation(const std::string& filename);
+  Succeeded write_cache_for_scattpoint_det_integrals_over_attenuation(const std::string& filename) const;
 };
 
 
@@ -39,7 +39,6 @@
 #include "stir/ThresholdMinToSmallPositiveValueDataProcessor.h"
 #include "stir/ChainedDataProcessor.h"
 #include "stir/Succeeded.h"
-#include "stir/numerics/divide.h"
 #include "stir/thresholding.h"
 #include "stir/is_null_ptr.h"
 #include "stir/NumericInfo.h"
@@ -48,6 +47,7 @@
 #include "stir/DataSymmetriesForViewSegmentNumbers.h"
 #include "stir/ViewSegmentNumbers.h"
 #include "stir/info.h"
+#include "stir/HighResWallClockTimer.h"
 
 #include "stir/modelling/ParametricDiscretisedDensity.h"
 #include "stir/modelling/KineticParameters.h"
@@ -62,6 +62,8 @@
 
 #include "stir/unique_ptr.h"
 #include <algorithm>
+#include <limits>
+#include <cmath>
 using std::min;
 using std::max;
 #ifndef STIR_NO_NAMESPACES
@@ -382,21 +384,279 @@ set_up(shared_ptr <TargetT > const& target_image_ptr)
         }
 
     }
+
+  // allocate the work images used by update_estimate()
+  this->multiplicative_update_image_sptr.reset(target_image_ptr->get_empty_copy());
+  if (this->objective_function_sptr->prior_is_zero())
+    this->denominator_sptr.reset();
+  else
+    this->denominator_sptr.reset(target_image_ptr->get_empty_copy());
+
   return Succeeded::yes;
 }
 
 
 
 
+namespace detail
+{
+  //! the different forms of the denominator of the OSL update
+  enum OSMAPOSLDenominatorType { OSMAPOSL_no_prior, OSMAPOSL_additive, OSMAPOSL_multiplicative };
+
+  //! statistics collected during the OSMAPOSL update, used for logging only
+  struct OSMAPOSLUpdateStatistics
+  {
+    OSMAPOSLUpdateStatistics()
+      : min_update(std::numeric_limits<float>::max()),
+        max_update(-std::numeric_limits<float>::max()),
+        num_cancelled_singularities(0)
+    {}
+    void add(const OSMAPOSLUpdateStatistics& other)
+    {
+      min_update = std::min(min_update, other.min_update);
+      max_update = std::max(max_update, other.max_update);
+      num_cancelled_singularities += other.num_cancelled_singularities;
+    }
+    float min_update;
+    float max_update;
+    long num_cancelled_singularities;
+  };
+
+  //! parameters of the multiplicative update
+  struct OSMAPOSLUpdateParameters
+  {
+    //! numerator and denominator smaller than this (in absolute value) give an update of 0 (see divide())
+    float small_value;
+    //! if true, the update is restricted to [min_relative_change, max_relative_change]
+    bool threshold_update;
+    float min_relative_change;
+    float max_relative_change;
+    //! if true, the image is multiplied with the update, otherwise the update is stored (without thresholding)
+    bool multiply_image;
+  };
+
+  //! computes the denominator from the prior gradient and returns the maximum of the numerator
+  /*! On input, the denominator range holds the gradient of the prior. */
+  template <class IterT, class ConstIterT>
+  static float
+  compute_OSMAPOSL_denominator_and_max(ConstIterT numerator_iter, const ConstIterT numerator_end,
+                                       IterT denominator_iter, ConstIterT sensitivity_iter,
+                                       const OSMAPOSLDenominatorType denominator_type,
+                                       const int num_subsets)
+  {
+    float max_numerator = -std::numeric_limits<float>::max();
+    for (; numerator_iter != numerator_end; ++numerator_iter, ++denominator_iter, ++sensitivity_iter)
+      {
+        max_numerator = std::max(max_numerator, static_cast<float>(*numerator_iter));
+        const float sensitivity = *sensitivity_iter;
+        if (denominator_type == OSMAPOSL_additive)
+          {
+            // p_v + beta*prior_gradient/num_subsets, restricted to [p_v/10, p_v*10]
+            const float denominator = *denominator_iter/num_subsets + sensitivity;
+            *denominator_iter = std::max(std::min(denominator, sensitivity*10), sensitivity/10);
+          }
+        else
+          {
+            // p_v*(1 + beta*prior_gradient), with the second factor restricted to [.1, 10]
+            const float denominator = *denominator_iter + 1;
+            *denominator_iter = std::max(std::min(denominator, 10.F), 1/10.F) * sensitivity;
+          }
+      }
+    return max_numerator;
+  }
+
+  //! divides numerator by denominator, thresholds and multiplies the image with the result
+  /*! The division follows divide(). If \a parameters.multiply_image is false, the (unthresholded)
+      update is stored in the numerator instead.
+  */
+  template <class IterT, class ConstIterT>
+  static void
+  apply_OSMAPOSL_update(IterT update_iter, const IterT update_end,
+                        ConstIterT denominator_iter, IterT image_iter,
+                        const OSMAPOSLUpdateParameters& parameters,
+                        OSMAPOSLUpdateStatistics& statistics)
+  {
+    for (; update_iter != update_end; ++update_iter, ++denominator_iter, ++image_iter)
+      {
+        const float numerator = *update_iter;
+        const float denominator = *denominator_iter;
+        float update;
+        if (std::fabs(denominator)<=parameters.small_value && std::fabs(numerator)<=parameters.small_value)
+          {
+            update = 0;
+            ++statistics.num_cancelled_singularities;
+          }
+        else
+          update = numerator/denominator;
+        statistics.min_update = std::min(statistics.min_update, update);
+        statistics.max_update = std::max(statistics.max_update, update);
+        if (!parameters.multiply_image)
+          {
+            *update_iter = update;
+            continue;
+          }
+        if (parameters.threshold_update)
+          update = std::min(std::max(update, parameters.min_relative_change), parameters.max_relative_change);
+        *image_iter *= update;
+      }
+  }
+
+  //! multiplies the image with the stored update after thresholding it
+  template <class IterT, class ConstIterT>
+  static void
+  multiply_with_OSMAPOSL_update(IterT image_iter, const IterT image_end,
+                                ConstIterT update_iter,
+                                const OSMAPOSLUpdateParameters& parameters)
+  {
+    for (; image_iter != image_end; ++image_iter, ++update_iter)
+      {
+        const float update = *update_iter;
+        *image_iter *=
+          parameters.threshold_update ?
+          std::min(std::max(update, parameters.min_relative_change), parameters.max_relative_change) :
+          update;
+      }
+  }
+
+  // generic versions, running over the full iterators
+
+  //! returns the maximum of the numerator, computing the denominator first when there is a prior
+  /*! \a denominator_ptr can be 0 when there is no prior. */
+  template <class TargetT>
+  static float
+  compute_OSMAPOSL_denominator_and_max(const TargetT& numerator, TargetT* denominator_ptr,
+                                       const TargetT& sensitivity,
+                                       const OSMAPOSLDenominatorType denominator_type,
+                                       const int num_subsets)
+  {
+    if (denominator_type == OSMAPOSL_no_prior)
+      return *std::max_element(numerator.begin_all_const(), numerator.end_all_const());
+    return
+      compute_OSMAPOSL_denominator_and_max(numerator.begin_all_const(), numerator.end_all_const(),
+                                           denominator_ptr->begin_all(), sensitivity.begin_all_const(),
+                                           denominator_type, num_subsets);
+  }
+
+  template <class TargetT>
+  static void
+  apply_OSMAPOSL_update(TargetT& update, const TargetT& denominator, TargetT& image,
+                        const OSMAPOSLUpdateParameters& parameters,
+                        OSMAPOSLUpdateStatistics& statistics)
+  {
+    apply_OSMAPOSL_update(update.begin_all(), update.end_all(),
+                          denominator.begin_all_const(), image.begin_all(),
+                          parameters, statistics);
+  }
+
+  template <class TargetT>
+  static void
+  multiply_with_OSMAPOSL_update(TargetT& image, const TargetT& update,
+                                const OSMAPOSLUpdateParameters& parameters)
+  {
+    multiply_with_OSMAPOSL_update(image.begin_all(), image.end_all(),
+                                  update.begin_all_const(), parameters);
+  }
+
+  // versions for images stored in a single block of memory, where we can split the
+  // work over threads
+
+  //! number of voxels handled by one thread at a time
+  static const std::size_t OSMAPOSL_chunk_size = 1<<16;
+
+  static float
+  compute_OSMAPOSL_denominator_and_max(const DiscretisedDensity<3,float>& numerator,
+                                       DiscretisedDensity<3,float>* denominator_ptr,
+                                       const DiscretisedDensity<3,float>& sensitivity,
+                                       const OSMAPOSLDenominatorType denominator_type,
+                                       const int num_subsets)
+  {
+    const bool use_denominator = denominator_type != OSMAPOSL_no_prior;
+    if (!numerator.is_contiguous() || !sensitivity.is_contiguous() ||
+        (use_denominator && !denominator_ptr->is_contiguous()))
+      return
+        compute_OSMAPOSL_denominator_and_max<DiscretisedDensity<3,float> >(numerator, denominator_ptr, sensitivity,
+                                                                           denominator_type, num_subsets);
+
+    const std::size_t num_elements = numerator.size_all();
+    const float * const numerator_data_ptr = numerator.get_const_full_data_ptr();
+    float * const denominator_data_ptr = use_denominator ? denominator_ptr->get_full_data_ptr() : 0;
+    const float * const sensitivity_data_ptr = sensitivity.get_const_full_data_ptr();
+    const int num_chunks = static_cast<int>((num_elements + OSMAPOSL_chunk_size - 1)/OSMAPOSL_chunk_size);
+    float max_numerator = -std::numeric_limits<float>::max();
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int chunk=0; chunk<num_chunks; ++chunk)
+      {
+        const std::size_t begin = chunk*OSMAPOSL_chunk_size;
+        const std::size_t end = std::min(begin + OSMAPOSL_chunk_size, num_elements);
+        const float chunk_max_numerator =
+          use_denominator ?
+          compute_OSMAPOSL_denominator_and_max(numerator_data_ptr + begin, numerator_data_ptr + end,
+                                               denominator_data_ptr + begin, sensitivity_data_ptr + begin,
+                                               denominator_type, num_subsets) :
+          *std::max_element(numerator_data_ptr + begin, numerator_data_ptr + end);
+#ifdef STIR_OPENMP
+#pragma omp critical(OSMAPOSL_NUMERATOR_MAX)
+#endif
+        max_numerator = std::max(max_numerator, chunk_max_numerator);
+      }
+    numerator.release_const_full_data_ptr();
+    if (use_denominator)
+      denominator_ptr->release_full_data_ptr();
+    sensitivity.release_const_full_data_ptr();
+    return max_numerator;
+  }
+
+  static void
+  apply_OSMAPOSL_update(DiscretisedDensity<3,float>& update,
+                        const DiscretisedDensity<3,float>& denominator,
+                        DiscretisedDensity<3,float>& image,
+                        const OSMAPOSLUpdateParameters& parameters,
+                        OSMAPOSLUpdateStatistics& statistics)
+  {
+    if (!update.is_contiguous() || !denominator.is_contiguous() || !image.is_contiguous())
+      {
+        apply_OSMAPOSL_update<DiscretisedDensity<3,float> >(update, denominator, image, parameters, statistics);
+        return;
+      }
+
+    const std::size_t num_elements = update.size_all();
+    float * const update_ptr = update.get_full_data_ptr();
+    const float * const denominator_ptr = denominator.get_const_full_data_ptr();
+    float * const image_ptr = image.get_full_data_ptr();
+    const int num_chunks = static_cast<int>((num_elements + OSMAPOSL_chunk_size - 1)/OSMAPOSL_chunk_size);
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int chunk=0; chunk<num_chunks; ++chunk)
+      {
+        const std::size_t begin = chunk*OSMAPOSL_chunk_size;
+        const std::size_t end = std::min(begin + OSMAPOSL_chunk_size, num_elements);
+        OSMAPOSLUpdateStatistics chunk_statistics;
+        apply_OSMAPOSL_update(update_ptr + begin, update_ptr + end,
+                              denominator_ptr + begin, image_ptr + begin,
+                              parameters, chunk_statistics);
+#ifdef STIR_OPENMP
+#pragma omp critical(OSMAPOSL_UPDATE_STATISTICS)
+#endif
+        statistics.add(chunk_statistics);
+      }
+    update.release_full_data_ptr();
+    denominator.release_const_full_data_ptr();
+    image.release_full_data_ptr();
+  }
+} // end of namespace detail
+
 template <typename TargetT>
-void 
+void
 OSMAPOSLReconstruction<TargetT>::
 update_estimate(TargetT &current_image_estimate)
 {
-  // TODO should use something like iterator_traits to figure out the 
+  // TODO should use something like iterator_traits to figure out the
   // type instead of hard-wiring float
   static const float small_num = 0.000001F;
-  
+
 #ifndef PARALLEL
   //CPUTimer subset_timer;
   //subset_timer.start();
@@ -404,159 +664,122 @@ update_estimate(TargetT &current_image_estimate)
   PTimer timerSubset;
   timerSubset.Start();
 #endif // PARALLEL
-  
-  // TODO make member parameter to avoid reallocation all the time
-  unique_ptr< TargetT > multiplicative_update_image_ptr
-    (current_image_estimate.get_empty_copy());
 
-  const int subset_num=this->get_subset_num();  
+  HighResWallClockTimer gradient_timer, prior_timer, update_timer;
+
+  TargetT& multiplicative_update_image = *this->multiplicative_update_image_sptr;
+
+  const int subset_num=this->get_subset_num();
   info(boost::format("Now processing subset #: %1%") % subset_num);
 
+  gradient_timer.start();
+  // the objective function might accumulate into its argument
+  std::fill(multiplicative_update_image.begin_all(), multiplicative_update_image.end_all(), 0.F);
   this->objective_function().
-    compute_sub_gradient_without_penalty_plus_sensitivity(*multiplicative_update_image_ptr,
+    compute_sub_gradient_without_penalty_plus_sensitivity(multiplicative_update_image,
                                                           current_image_estimate,
-                                                          subset_num); 
-  
-  // divide by subset sensitivity  
-  {
-    const TargetT& sensitivity =
-      this->objective_function().get_subset_sensitivity(subset_num);
+                                                          subset_num);
+  gradient_timer.stop();
 
+  const TargetT& sensitivity =
+    this->objective_function().get_subset_sensitivity(subset_num);
 
-    int count = 0;
-    
-    //std::cerr <<this->MAP_model << std::endl;
-    
-  if (this->objective_function_sptr->prior_is_zero())
-    {
-      divide(multiplicative_update_image_ptr->begin_all(),
-             multiplicative_update_image_ptr->end_all(), 
-             sensitivity.begin_all(),
-             small_num);
-        
-    }
-    else
+  detail::OSMAPOSLDenominatorType denominator_type = detail::OSMAPOSL_no_prior;
+  if (!this->objective_function_sptr->prior_is_zero())
     {
-      unique_ptr< TargetT > denominator_ptr
-        (current_image_estimate.get_empty_copy());
-      
-      
+      prior_timer.start();
+      if (is_null_ptr(this->denominator_sptr))
+        this->denominator_sptr.reset(current_image_estimate.get_empty_copy());
       this->objective_function_sptr->
-        get_prior_ptr()->compute_gradient(*denominator_ptr, current_image_estimate); 
-      
-      typename TargetT::full_iterator denominator_iter = denominator_ptr->begin_all();
-      const typename TargetT::full_iterator denominator_end = denominator_ptr->end_all();
-      typename TargetT::const_full_iterator sensitivity_iter = sensitivity.begin_all();
-
-      if(this->MAP_model =="additive" )
-      {
-        // lambda_new = lambda / (p_v + beta*prior_gradient/ num_subsets) *
-        //                   sum_subset backproj(measured/forwproj(lambda))
-        // with p_v = sum_{b in subset} p_bv
-        // actually, we restrict 1 + beta*prior_gradient/num_subsets/p_v between .1 and 10
-        while (denominator_iter != denominator_end)
-          {
-            *denominator_iter = *denominator_iter/this->get_num_subsets() + (*sensitivity_iter);
-            // bound denominator between (*sensitivity_iter)/10 and (*sensitivity_iter)*10
-            *denominator_iter =
-                std::max(std::min(*denominator_iter, (*sensitivity_iter)*10),(*sensitivity_iter)/10);
-            ++denominator_iter;
-            ++sensitivity_iter;
-          }
-      }
-      else
-      {
-        if(this->MAP_model =="multiplicative" )
-        {
-          // multiplicative form
-          // lambda_new = lambda / (p_v*(1 + beta*prior_gradient)) *
-          //                   sum_subset backproj(measured/forwproj(lambda))
-          // with p_v = sum_{b in subset} p_bv
-          // actually, we restrict 1 + beta*prior_gradient between .1 and 10
-        while (denominator_iter != denominator_end)
-          {
-            *denominator_iter += 1;
-            // bound denominator between 1/10 and 1*10
-            // TODO code will fail if *denominator_iter is not a float
-            *denominator_iter =
-                std::max(std::min(*denominator_iter, 10.F),1/10.F);
-            *denominator_iter *= (*sensitivity_iter);
-            ++denominator_iter;
-            ++sensitivity_iter;
-          }
-        }
-      }         
-      divide(multiplicative_update_image_ptr->begin_all(),
-             multiplicative_update_image_ptr->end_all(), 
-             denominator_ptr->begin_all(),
-             small_num);
+        get_prior_ptr()->compute_gradient(*this->denominator_sptr, current_image_estimate);
+      prior_timer.stop();
+      denominator_type =
+        this->MAP_model == "additive" ? detail::OSMAPOSL_additive : detail::OSMAPOSL_multiplicative;
     }
-    
-    info(boost::format("Number of (cancelled) singularities in Sensitivity division: %1%") % count);
-  }
-  
-    
-  if(this->inter_update_filter_interval>0 &&
-     !is_null_ptr(this->inter_update_filter_ptr) &&
-     !(this->subiteration_num%this->inter_update_filter_interval))
+
+  update_timer.start();
+  // The update is computed in (mostly) one pass over the voxels:
+  // - find the maximum of the numerator (needed for the division, see divide()), and
+  //   compute the denominator from the prior gradient
+  // - divide numerator by denominator, threshold and multiply the current image with the result.
+  // When the update image needs to be written or the inter-update filter needs to be applied,
+  // the last pass is split.
+  const float max_numerator =
+    detail::compute_OSMAPOSL_denominator_and_max(multiplicative_update_image,
+                                                 this->denominator_sptr.get(),
+                                                 sensitivity,
+                                                 denominator_type,
+                                                 this->get_num_subsets());
+  const TargetT& denominator =
+    denominator_type == detail::OSMAPOSL_no_prior ? sensitivity : *this->denominator_sptr;
+
+  const bool apply_inter_update_filter =
+    this->inter_update_filter_interval>0 &&
+    !is_null_ptr(this->inter_update_filter_ptr) &&
+    !(this->subiteration_num%this->inter_update_filter_interval);
+  const bool write_update = this->write_update_image && !this->_disable_output;
+
+  detail::OSMAPOSLUpdateParameters parameters;
+  parameters.small_value = std::max(max_numerator*small_num, 0.F);
+  // KT 17/08/2000 limit update
+  parameters.threshold_update = this->subiteration_num != 1;
+  parameters.min_relative_change = static_cast<float>(this->minimum_relative_change);
+  parameters.max_relative_change = static_cast<float>(this->maximum_relative_change);
+  parameters.multiply_image = !apply_inter_update_filter && !write_update;
+
+  detail::OSMAPOSLUpdateStatistics statistics;
+  detail::apply_OSMAPOSL_update(multiplicative_update_image, denominator, current_image_estimate,
+                                parameters, statistics);
+  update_timer.stop();
+
+  info(boost::format("Number of (cancelled) singularities in Sensitivity division: %1%") % statistics.num_cancelled_singularities);
+
+  if (apply_inter_update_filter)
   {
     info("Applying inter-update filter");
-    this->inter_update_filter_ptr->apply(current_image_estimate); 
+    this->inter_update_filter_ptr->apply(current_image_estimate);
   }
-  
-  // KT 17/08/2000 limit update
+
   // TODO move below thresholding?
-  if (this->write_update_image && !this->_disable_output)
+  if (write_update)
   {
     // allocate space for the filename assuming that
     // we never have more than 10^49 subiterations ...
     char * fname = new char[this->output_filename_prefix.size() + 60];
     sprintf(fname, "%s_update_%d", this->output_filename_prefix.c_str(), this->subiteration_num);
-    
+
     // Write it to file
     this->output_file_format_ptr->
-      write_to_file(fname, *multiplicative_update_image_ptr);
+      write_to_file(fname, multiplicative_update_image);
     delete[] fname;
   }
-  
-  if (this->subiteration_num != 1)
+
+  if (parameters.threshold_update)
     {
-      const float current_min =
-        *std::min_element(multiplicative_update_image_ptr->begin_all(),
-                          multiplicative_update_image_ptr->end_all()); 
-      const float current_max = 
-        *std::max_element(multiplicative_update_image_ptr->begin_all(),
-                          multiplicative_update_image_ptr->end_all()); 
-      const float new_min = 
-        static_cast<float>(this->minimum_relative_change);
-      const float new_max = 
-        static_cast<float>(this->maximum_relative_change);
+      const float current_min = statistics.min_update;
+      const float current_max = statistics.max_update;
+      const float new_min = parameters.min_relative_change;
+      const float new_max = parameters.max_relative_change;
       info(boost::format("Update image old min,max: %1%, %2%, new min,max %3%, %4%") % current_min % current_max % (min(current_min, new_min)) % (max(current_max, new_max)));
+    }
+
+  if (!parameters.multiply_image)
+    {
+      update_timer.start();
+      detail::multiply_with_OSMAPOSL_update(current_image_estimate, multiplicative_update_image, parameters);
+      update_timer.stop();
+    }
 
-      threshold_upper_lower(multiplicative_update_image_ptr->begin_all(),
-                            multiplicative_update_image_ptr->end_all(), 
-                            new_min, new_max);      
-    }  
+  info(boost::format("Subset timings (wall-clock): sub-gradient %1% s, prior gradient %2% s, update %3% s")
+       % gradient_timer.value() % prior_timer.value() % update_timer.value());
 
-  //current_image_estimate *= *multiplicative_update_image_ptr; 
-  {
-    typename TargetT::const_full_iterator multiplicative_update_image_iter = multiplicative_update_image_ptr->begin_all_const(); 
-    const typename TargetT::const_full_iterator end_multiplicative_update_image_iter = multiplicative_update_image_ptr->end_all_const(); 
-    typename TargetT::full_iterator current_image_estimate_iter = current_image_estimate.begin_all(); 
-    while (multiplicative_update_image_iter!=end_multiplicative_update_image_iter) 
-      { 
-        *current_image_estimate_iter *= (*multiplicative_update_image_iter); 
-        ++current_image_estimate_iter; ++multiplicative_update_image_iter; 
-      } 
-  }
-  
 #ifndef PARALLEL
   //cerr << "Subset : " << subset_timer.value() << "secs " <<endl;
 #else // PARALLEL
   timerSubset.Stop();
   info(boost::format("Subset: %1%secs") % timerSubset.GetTime());
 #endif
-  
+
 }
 
 template class OSMAPOSLReconstruction<DiscretisedDensity<3,float> >;
@@ -39,6 +39,20 @@
 #include "stir/utilities.h"
 #include "stir/IO/read_from_file.h"
 #include "stir/info.h"
+#include "stir/error.h"
+#include "stir/DiscretisedDensityOnCartesianGrid.h"
+#include "stir/stream.h"
+#include "stir/ProjData.h"
+#include "stir/RelatedViewgrams.h"
+#include "stir/ViewSegmentNumbers.h"
+#include "stir/DataSymmetriesForViewSegmentNumbers.h"
+#include "stir/recon_buildblock/PoissonLogLikelihoodWithLinearModelForMeanAndProjData.h"
+#include "stir/recon_buildblock/ProjectorByBinPair.h"
+#include "stir/recon_buildblock/BinNormalisation.h"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/cstdint.hpp>
 
 #include <iostream>
 #include <memory>
@@ -49,15 +63,17 @@
 #else
 #include <sstream>
 #endif
-#include <algorithm>
-#include "boost/lambda/lambda.hpp"
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <iterator>
 #include "stir/unique_ptr.h"
 
 #ifndef STIR_NO_NAMESPACES
 using std::cerr;
 using std::endl;
-using boost::lambda::_1;
-using boost::lambda::_2;
 #endif
 
 
@@ -80,6 +96,7 @@ set_defaults()
   upper_bound = NumericInfo<float>().max_value();
   write_update_image = 0;
   precomputed_denominator_filename = "";
+  precomputed_denominator_cache_directory = "";
 
   //MAP_model="additive"; 
   relaxation_parameter = 1;
@@ -105,6 +122,7 @@ initialise_keymap()
   this->parser.add_key("upper bound", &upper_bound);
   this->parser.add_key("write update image",&write_update_image);   
   this->parser.add_key("precomputed denominator", &precomputed_denominator_filename);
+  this->parser.add_key("precomputed denominator cache directory", &precomputed_denominator_cache_directory);
 
   this->parser.add_key("relaxation parameter", &relaxation_parameter);
   this->parser.add_key("relaxation gamma", &relaxation_gamma);
@@ -240,6 +258,7 @@ precompute_denominator_of_conditioner_without_penalty()
   info(boost::format("min and max in precomputed denominator %1%, %2%") % *std::min_element(precomputed_denominator_ptr->begin_all(), precomputed_denominator_ptr->end_all()) % *std::max_element(precomputed_denominator_ptr->begin_all(), precomputed_denominator_ptr->end_all()));  
 
   // Write it to file
+  if (!this->_disable_output)
   {
     std::string fname =  
       this->output_filename_prefix +
@@ -253,8 +272,539 @@ precompute_denominator_of_conditioner_without_penalty()
   return Succeeded::yes;
 }
 
+namespace detail
+{
+  //! keeps track of the minimum and maximum of a set of values
+  class OSSPSMinMax
+  {
+  public:
+    OSSPSMinMax()
+      : min_value(std::numeric_limits<float>::max()),
+        max_value(-std::numeric_limits<float>::max())
+    {}
+    void add(const float value)
+    {
+      if (value < min_value) min_value = value;
+      if (value > max_value) max_value = value;
+    }
+    void add(const OSSPSMinMax& other)
+    {
+      this->add(other.min_value);
+      this->add(other.max_value);
+    }
+    float min_value;
+    float max_value;
+  };
+
+  //! statistics collected during the OSSPS update, used for logging only
+  struct OSSPSUpdateStatistics
+  {
+    OSSPSMinMax scaled_gradient;
+    OSSPSMinMax denominator;
+    OSSPSMinMax update;
+    OSSPSMinMax image_before_thresholding;
+    void add(const OSSPSUpdateStatistics& other)
+    {
+      scaled_gradient.add(other.scaled_gradient);
+      denominator.add(other.denominator);
+      update.add(other.update);
+      image_before_thresholding.add(other.image_before_thresholding);
+    }
+  };
+
+  //! parameters of the OSSPS update
+  struct OSSPSUpdateParameters
+  {
+    //! factor for the subset gradient (i.e. the number of subsets)
+    float gradient_factor;
+    //! relaxation parameter times the step size
+    float step_size;
+    //! values of the denominator below this are set to it
+    float denominator_threshold;
+    float upper_bound;
+  };
+
+  //! denominator = 2*curvature + precomputed denominator, returning the smallest positive value
+  /*! If \a add_curvature is false, the denominator is just set to the precomputed denominator.
+      The \a denominator range can hold the curvature on input.
+      Returns std::numeric_limits<float>::max() if there are no positive values.
+  */
+  template <class IterT, class ConstIterT>
+  static float
+  compute_OSSPS_denominator(IterT denominator_iter, const IterT denominator_end,
+                            ConstIterT precomputed_denominator_iter,
+                            const bool add_curvature)
+  {
+    float min_positive = std::numeric_limits<float>::max();
+    for (; denominator_iter != denominator_end; ++denominator_iter, ++precomputed_denominator_iter)
+      {
+        const float value =
+          add_curvature ?
+          *denominator_iter * 2 + *precomputed_denominator_iter :
+          static_cast<float>(*precomputed_denominator_iter);
+        *denominator_iter = value;
+        if (value > 0 && value < min_positive)
+          min_positive = value;
+      }
+    return min_positive;
+  }
+
+  //! the OSSPS update for a range of voxels
+  /*! On input, \a update holds the subset gradient, on output, the additive update.
+      The thresholded denominator is stored back if \a store_denominator is true.
+  */
+  template <class IterT>
+  static void
+  apply_OSSPS_update(IterT image_iter, const IterT image_end,
+                     IterT update_iter, IterT denominator_iter,
+                     const bool store_denominator,
+                     const OSSPSUpdateParameters& parameters,
+                     OSSPSUpdateStatistics& statistics)
+  {
+    for (; image_iter != image_end; ++image_iter, ++update_iter, ++denominator_iter)
+      {
+        const float scaled_gradient = *update_iter * parameters.gradient_factor;
+        const float denominator = std::max(static_cast<float>(*denominator_iter), parameters.denominator_threshold);
+        if (store_denominator)
+          *denominator_iter = denominator;
+        const float update = scaled_gradient / denominator * parameters.step_size;
+        *update_iter = update;
+        const float new_value = *image_iter + update;
+        *image_iter = std::min(std::max(new_value, 0.F), parameters.upper_bound);
+
+        statistics.scaled_gradient.add(scaled_gradient);
+        statistics.denominator.add(denominator);
+        statistics.update.add(update);
+        statistics.image_before_thresholding.add(new_value);
+      }
+  }
+
+  // generic versions, running over the full iterators
+
+  template <class TargetT>
+  static float
+  compute_OSSPS_denominator(TargetT& denominator, const TargetT& precomputed_denominator,
+                            const bool add_curvature)
+  {
+    return
+      compute_OSSPS_denominator(denominator.begin_all(), denominator.end_all(),
+                                precomputed_denominator.begin_all_const(),
+                                add_curvature);
+  }
+
+  template <class TargetT>
+  static void
+  apply_OSSPS_update(TargetT& image, TargetT& update, TargetT& denominator,
+                     const bool store_denominator,
+                     const OSSPSUpdateParameters& parameters,
+                     OSSPSUpdateStatistics& statistics)
+  {
+    apply_OSSPS_update(image.begin_all(), image.end_all(),
+                       update.begin_all(), denominator.begin_all(),
+                       store_denominator, parameters, statistics);
+  }
+
+  // versions for images stored in a single block of memory, where we can split the
+  // work over threads
+
+  //! number of voxels handled by one thread at a time
+  static const std::size_t OSSPS_chunk_size = 1<<16;
+
+  static float
+  compute_OSSPS_denominator(DiscretisedDensity<3,float>& denominator,
+                            const DiscretisedDensity<3,float>& precomputed_denominator,
+                            const bool add_curvature)
+  {
+    if (!denominator.is_contiguous() || !precomputed_denominator.is_contiguous())
+      return compute_OSSPS_denominator<DiscretisedDensity<3,float> >(denominator, precomputed_denominator, add_curvature);
+
+    const std::size_t num_elements = denominator.size_all();
+    float * const denominator_ptr = denominator.get_full_data_ptr();
+    const float * const precomputed_denominator_ptr = precomputed_denominator.get_const_full_data_ptr();
+    const int num_chunks = static_cast<int>((num_elements + OSSPS_chunk_size - 1)/OSSPS_chunk_size);
+    float min_positive = std::numeric_limits<float>::max();
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int chunk=0; chunk<num_chunks; ++chunk)
+      {
+        const std::size_t begin = chunk*OSSPS_chunk_size;
+        const std::size_t end = std::min(begin + OSSPS_chunk_size, num_elements);
+        const float chunk_min_positive =
+          compute_OSSPS_denominator(denominator_ptr + begin, denominator_ptr + end,
+                                    precomputed_denominator_ptr + begin,
+                                    add_curvature);
+#ifdef STIR_OPENMP
+#pragma omp critical(OSSPS_DENOMINATOR_MIN)
+#endif
+        min_positive = std::min(min_positive, chunk_min_positive);
+      }
+    denominator.release_full_data_ptr();
+    precomputed_denominator.release_const_full_data_ptr();
+    return min_positive;
+  }
+
+  static void
+  apply_OSSPS_update(DiscretisedDensity<3,float>& image,
+                     DiscretisedDensity<3,float>& update,
+                     DiscretisedDensity<3,float>& denominator,
+                     const bool store_denominator,
+                     const OSSPSUpdateParameters& parameters,
+                     OSSPSUpdateStatistics& statistics)
+  {
+    if (!image.is_contiguous() || !update.is_contiguous() || !denominator.is_contiguous())
+      {
+        apply_OSSPS_update<DiscretisedDensity<3,float> >(image, update, denominator,
+                                                         store_denominator, parameters, statistics);
+        return;
+      }
+
+    const std::size_t num_elements = image.size_all();
+    float * const image_ptr = image.get_full_data_ptr();
+    float * const update_ptr = update.get_full_data_ptr();
+    float * const denominator_ptr = denominator.get_full_data_ptr();
+    const int num_chunks = static_cast<int>((num_elements + OSSPS_chunk_size - 1)/OSSPS_chunk_size);
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int chunk=0; chunk<num_chunks; ++chunk)
+      {
+        const std::size_t begin = chunk*OSSPS_chunk_size;
+        const std::size_t end = std::min(begin + OSSPS_chunk_size, num_elements);
+        OSSPSUpdateStatistics chunk_statistics;
+        apply_OSSPS_update(image_ptr + begin, image_ptr + end,
+                           update_ptr + begin, denominator_ptr + begin,
+                           store_denominator, parameters, chunk_statistics);
+#ifdef STIR_OPENMP
+#pragma omp critical(OSSPS_UPDATE_STATISTICS)
+#endif
+        statistics.add(chunk_statistics);
+      }
+    image.release_full_data_ptr();
+    update.release_full_data_ptr();
+    denominator.release_full_data_ptr();
+  }
+
+  //! describes the geometry of the image for the key of the denominator cache
+  /*! Returns an empty string when the image type is not supported. */
+  template <class TargetT>
+  static std::string
+  get_OSSPS_image_description(const TargetT&)
+  {
+    return std::string();
+  }
+
+  static std::string
+  get_OSSPS_image_description(const DiscretisedDensity<3,float>& image)
+  {
+    BasicCoordinate<3,int> min_indices, max_indices;
+    if (!image.get_regular_range(min_indices, max_indices))
+      return std::string();
+
+    std::ostringstream s;
+    s << "image min indices := " << min_indices << '\n'
+      << "image max indices := " << max_indices << '\n'
+      << "image origin := " << image.get_origin() << '\n';
+    const DiscretisedDensityOnCartesianGrid<3,float>* image_on_grid_ptr =
+      dynamic_cast<const DiscretisedDensityOnCartesianGrid<3,float>*>(&image);
+    if (image_on_grid_ptr != 0)
+      s << "image grid spacing := " << image_on_grid_ptr->get_grid_spacing() << '\n';
+    return s.str();
+  }
+
+  //! describes the data term of the objective function for the key of the denominator cache
+  /*! Returns an empty string when the objective function is not supported. */
+  template <class TargetT>
+  static std::string
+  get_OSSPS_objective_function_description(const GeneralisedObjectiveFunction<TargetT>&)
+  {
+    return std::string();
+  }
+
+  /*! The precomputed denominator depends on the projection data (geometry and content),
+      the normalisation (including attenuation), the projectors, the segments and the time frame.
+      It does not depend on the prior, which is therefore not included.
+
+      The normalisation is identified by its parameters and by a hash of its factors, such
+      that a change in the content of the files it reads is detected as well. Similarly, the
+      measured data are identified by a hash of their content. Computing these hashes needs
+      one pass over the data and normalisation factors, which is cheap compared to the forward
+      and back projection needed for the denominator itself.
+  */
+  static std::string
+  get_OSSPS_objective_function_description(const GeneralisedObjectiveFunction<DiscretisedDensity<3,float> >& objective_function)
+  {
+    typedef PoissonLogLikelihoodWithLinearModelForMeanAndProjData<DiscretisedDensity<3,float> > PLL_type;
+    const PLL_type * const PLL_ptr = dynamic_cast<const PLL_type *>(&objective_function);
+    if (PLL_ptr == 0)
+      return std::string();
+
+    const ProjData& proj_data = PLL_ptr->get_proj_data();
+    BinNormalisation& normalisation = *PLL_ptr->get_normalisation_sptr();
+    ProjectorByBinPair& projectors = *PLL_ptr->get_projector_pair_sptr();
+    const int max_segment_num = PLL_ptr->get_max_segment_num_to_process();
+    const double start_time =
+      PLL_ptr->get_time_frame_definitions().get_start_time(PLL_ptr->get_time_frame_num());
+    const double end_time =
+      PLL_ptr->get_time_frame_definitions().get_end_time(PLL_ptr->get_time_frame_num());
+
+    // hashes of the content of the data and of the normalisation factors
+    std::size_t data_hash = 0;
+    std::size_t normalisation_hash = 0;
+    {
+      shared_ptr<DataSymmetriesForViewSegmentNumbers>
+        symmetries_sptr(projectors.get_symmetries_used()->clone());
+      for (int segment_num = -max_segment_num; segment_num <= max_segment_num; ++segment_num)
+        for (int view_num = proj_data.get_min_view_num(); view_num <= proj_data.get_max_view_num(); ++view_num)
+          {
+            const ViewSegmentNumbers view_segment_num(view_num, segment_num);
+            if (!symmetries_sptr->is_basic(view_segment_num))
+              continue;
+            RelatedViewgrams<float> viewgrams =
+              proj_data.get_related_viewgrams(view_segment_num, symmetries_sptr);
+            for (RelatedViewgrams<float>::const_iterator iter = viewgrams.begin(); iter != viewgrams.end(); ++iter)
+              boost::hash_range(data_hash, iter->begin_all_const(), iter->end_all_const());
+            viewgrams.fill(1.F);
+            normalisation.undo(viewgrams, start_time, end_time);
+            for (RelatedViewgrams<float>::const_iterator iter = viewgrams.begin(); iter != viewgrams.end(); ++iter)
+              boost::hash_range(normalisation_hash, iter->begin_all_const(), iter->end_all_const());
+          }
+    }
+
+    std::ostringstream s;
+    s << "objective function type := " << PLL_type::registered_name << '\n'
+      << "projection data info :=\n" << proj_data.get_proj_data_info_ptr()->parameter_info() << '\n'
+      << "projection data content hash := " << boost::format("%1$016x") % data_hash << '\n'
+      << "maximum segment number := " << max_segment_num << '\n'
+      << "time frame := " << start_time << ", " << end_time << '\n'
+      << "normalisation type := " << normalisation.get_registered_name() << '\n'
+      << "normalisation parameters :=\n" << normalisation.parameter_info() << '\n'
+      << "normalisation factors hash := " << boost::format("%1$016x") % normalisation_hash << '\n'
+      << "projector pair parameters :=\n" << static_cast<ParsingObject&>(projectors).parameter_info() << '\n';
+    return s.str();
+  }
+
+  //! identifies a denominator cache file (and its version)
+  static const char OSSPS_denominator_cache_magic[8] = {'S','T','I','R','S','P','S','2'};
+  //! written in native byte order, such that files from a machine with different endianness are detected
+  static const boost::uint32_t OSSPS_denominator_cache_byte_order_marker = 0x01020304U;
+
+  //! copies the elements of a cache file into the denominator
+  /*! \a elements_ptr does not need to be aligned. */
+  template <class TargetT>
+  static void
+  copy_OSSPS_denominator_from_cache(TargetT& denominator, const char * elements_ptr)
+  {
+    for (typename TargetT::full_iterator iter = denominator.begin_all();
+         iter != denominator.end_all();
+         ++iter, elements_ptr += sizeof(float))
+      {
+        float value;
+        std::memcpy(&value, elements_ptr, sizeof(float));
+        *iter = value;
+      }
+  }
+
+  static void
+  copy_OSSPS_denominator_from_cache(DiscretisedDensity<3,float>& denominator, const char * elements_ptr)
+  {
+    if (!denominator.is_contiguous())
+      {
+        copy_OSSPS_denominator_from_cache<DiscretisedDensity<3,float> >(denominator, elements_ptr);
+        return;
+      }
+    std::memcpy(denominator.get_full_data_ptr(), elements_ptr, denominator.size_all()*sizeof(float));
+    denominator.release_full_data_ptr();
+  }
+
+  //! file name in the cache directory corresponding to a key
+  static std::string
+  get_OSSPS_denominator_cache_filename(const std::string& directory, const std::string& key)
+  {
+    const std::size_t hash = boost::hash<std::string>()(key);
+    return
+      (boost::format("%1%/OSSPS_precomputed_denominator_%2$016x.bin") % directory % hash).str();
+  }
+} // end of namespace detail
+
+template <class TargetT>
+std::string
+OSSPSReconstruction<TargetT>::
+get_precomputed_denominator_cache_key(const TargetT& target) const
+{
+  const std::string image_description = detail::get_OSSPS_image_description(target);
+  if (image_description.empty())
+    return std::string();
+  const std::string objective_function_description =
+    detail::get_OSSPS_objective_function_description(*this->objective_function_sptr);
+  if (objective_function_description.empty())
+    return std::string();
+  return image_description + objective_function_description;
+}
+
+/* The cache file consists of
+   - 8 bytes: OSSPS_denominator_cache_magic
+   - 32-bit unsigned integer: OSSPS_denominator_cache_byte_order_marker
+   - 64-bit unsigned integer: length of the key in bytes
+   - 64-bit unsigned integer: number of elements
+   - the key
+   - the elements as float
+   All numbers are in the byte order of the machine that wrote the file. Files with a
+   different byte order are ignored (and will be overwritten).
+
+   The file is mapped in memory, but the elements are copied into the denominator image
+   (with a single memcpy if the image is stored contiguously). The image owns its memory,
+   and the rest of OSSPS works on TargetT objects, so the mapping is not used in place.
+   This costs one pass over the image, which is negligible compared to computing it.
+*/
 template <class TargetT>
-Succeeded 
+Succeeded
+OSSPSReconstruction<TargetT>::
+read_precomputed_denominator_from_cache(TargetT& denominator) const
+{
+  const std::string key = this->get_precomputed_denominator_cache_key(denominator);
+  if (key.empty())
+    {
+      warning("OSSPS: caching the precomputed denominator is not supported for this type of image or objective function");
+      return Succeeded::no;
+    }
+  const std::string filename =
+    detail::get_OSSPS_denominator_cache_filename(this->precomputed_denominator_cache_directory, key);
+
+  using namespace boost::interprocess;
+  shared_ptr<mapped_region> region_sptr;
+  try
+    {
+      file_mapping mapping(filename.c_str(), read_only);
+      region_sptr.reset(new mapped_region(mapping, read_only));
+    }
+  catch (interprocess_exception&)
+    {
+      // no cache entry yet
+      return Succeeded::no;
+    }
+
+  const char * const data_ptr = static_cast<const char *>(region_sptr->get_address());
+  const std::size_t file_size = region_sptr->get_size();
+  const std::size_t magic_size = sizeof(detail::OSSPS_denominator_cache_magic);
+  const std::size_t header_size = magic_size + sizeof(boost::uint32_t) + 2*sizeof(boost::uint64_t);
+  boost::uint32_t byte_order_marker = 0;
+  boost::uint64_t key_length = 0;
+  boost::uint64_t num_elements = 0;
+  if (file_size >= header_size)
+    {
+      std::memcpy(&byte_order_marker, data_ptr + magic_size, sizeof(byte_order_marker));
+      std::memcpy(&key_length, data_ptr + magic_size + sizeof(byte_order_marker), sizeof(key_length));
+      std::memcpy(&num_elements, data_ptr + magic_size + sizeof(byte_order_marker) + sizeof(key_length), sizeof(num_elements));
+    }
+  if (file_size >= header_size &&
+      byte_order_marker != detail::OSSPS_denominator_cache_byte_order_marker)
+    {
+      warning(boost::format("OSSPS: ignoring precomputed denominator cache file %1% as it was written with a different byte order") % filename);
+      return Succeeded::no;
+    }
+  const std::size_t num_elements_in_image =
+    static_cast<std::size_t>(std::distance(denominator.begin_all_const(), denominator.end_all_const()));
+  if (file_size < header_size ||
+      std::memcmp(data_ptr, detail::OSSPS_denominator_cache_magic, magic_size) != 0 ||
+      key_length != key.size() ||
+      num_elements != num_elements_in_image ||
+      file_size != header_size + key_length + num_elements*sizeof(float) ||
+      key.compare(0, key.size(), data_ptr + header_size, key_length) != 0)
+    {
+      warning(boost::format("OSSPS: ignoring precomputed denominator cache file %1% as it does not match the current parameters") % filename);
+      return Succeeded::no;
+    }
+
+  detail::copy_OSSPS_denominator_from_cache(denominator, data_ptr + header_size + key_length);
+  info(boost::format("OSSPS: read precomputed denominator from cache file %1%") % filename);
+  return Succeeded::yes;
+}
+
+template <class TargetT>
+Succeeded
+OSSPSReconstruction<TargetT>::
+write_precomputed_denominator_to_cache(const TargetT& denominator) const
+{
+  const std::string key = this->get_precomputed_denominator_cache_key(denominator);
+  if (key.empty())
+    return Succeeded::no;
+  const std::string filename =
+    detail::get_OSSPS_denominator_cache_filename(this->precomputed_denominator_cache_directory, key);
+  // write to a temporary file first and rename it afterwards, such that other processes
+  // never see an incomplete file
+  const std::string tmp_filename =
+    (boost::format("%1%.%2%.%3%.tmp") % filename % std::time(0) % static_cast<const void *>(this)).str();
+  {
+    std::ofstream s(tmp_filename.c_str(), std::ios::out | std::ios::binary);
+    const boost::uint64_t key_length = key.size();
+    const boost::uint64_t num_elements =
+      static_cast<boost::uint64_t>(std::distance(denominator.begin_all_const(), denominator.end_all_const()));
+    s.write(detail::OSSPS_denominator_cache_magic, sizeof(detail::OSSPS_denominator_cache_magic));
+    s.write(reinterpret_cast<const char *>(&detail::OSSPS_denominator_cache_byte_order_marker),
+            sizeof(detail::OSSPS_denominator_cache_byte_order_marker));
+    s.write(reinterpret_cast<const char *>(&key_length), sizeof(key_length));
+    s.write(reinterpret_cast<const char *>(&num_elements), sizeof(num_elements));
+    s.write(key.data(), key.size());
+    for (typename TargetT::const_full_iterator iter = denominator.begin_all_const();
+         iter != denominator.end_all_const();
+         ++iter)
+      {
+        const float value = *iter;
+        s.write(reinterpret_cast<const char *>(&value), sizeof(value));
+      }
+    if (!s)
+      {
+        warning(boost::format("OSSPS: error writing precomputed denominator cache file %1%") % tmp_filename);
+        s.close();
+        std::remove(tmp_filename.c_str());
+        return Succeeded::no;
+      }
+  }
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    {
+      // on some systems rename fails when the file exists already (e.g. written by another process)
+      std::remove(tmp_filename.c_str());
+      return Succeeded::no;
+    }
+  info(boost::format("OSSPS: wrote precomputed denominator to cache file %1%") % filename);
+  return Succeeded::yes;
+}
+
+template <class TargetT>
+void
+OSSPSReconstruction<TargetT>::
+set_precomputed_denominator_cache_directory(const std::string& directory)
+{
+  this->precomputed_denominator_cache_directory = directory;
+}
+
+template <class TargetT>
+std::string
+OSSPSReconstruction<TargetT>::
+get_precomputed_denominator_cache_filename() const
+{
+  if (this->precomputed_denominator_cache_directory.empty() ||
+      is_null_ptr(this->precomputed_denominator_ptr))
+    return std::string();
+  const std::string key = this->get_precomputed_denominator_cache_key(*this->precomputed_denominator_ptr);
+  if (key.empty())
+    return std::string();
+  return detail::get_OSSPS_denominator_cache_filename(this->precomputed_denominator_cache_directory, key);
+}
+
+template <class TargetT>
+const TargetT&
+OSSPSReconstruction<TargetT>::
+get_precomputed_denominator() const
+{
+  if (is_null_ptr(this->precomputed_denominator_ptr))
+    error("OSSPS: get_precomputed_denominator() called before set_up()");
+  return *this->precomputed_denominator_ptr;
+}
+
+template <class TargetT>
+Succeeded
 OSSPSReconstruction<TargetT>::
 set_up(shared_ptr <TargetT > const& target_image_ptr)
 {
@@ -274,22 +824,28 @@ set_up(shared_ptr <TargetT > const& target_image_ptr)
       return Succeeded::no;
     }
 
-  if (!is_null_ptr(this->get_prior_ptr())&& 
+  if (!is_null_ptr(this->get_prior_ptr())&&
       dynamic_cast<PriorWithParabolicSurrogate<TargetT>*>(this->get_prior_ptr())==0)
   {
     warning("OSSPS: Prior must be of a type derived from PriorWithParabolicSurrogate\n");
     return Succeeded::no;
   }
 
-  if(enforce_initial_positivity) 
+  if(enforce_initial_positivity)
     threshold_min_to_small_positive_value(target_image_ptr->begin_all(),
 					  target_image_ptr->end_all(),
 					  10.E-6F);
-  
+
   if(this->precomputed_denominator_filename=="")
   {
     precomputed_denominator_ptr.reset(target_image_ptr->get_empty_copy());
-    precompute_denominator_of_conditioner_without_penalty();
+    if (this->precomputed_denominator_cache_directory.empty() ||
+        this->read_precomputed_denominator_from_cache(*precomputed_denominator_ptr) == Succeeded::no)
+      {
+        precompute_denominator_of_conditioner_without_penalty();
+        if (!this->precomputed_denominator_cache_directory.empty())
+          this->write_precomputed_denominator_to_cache(*precomputed_denominator_ptr);
+      }
   }
   else if(this->precomputed_denominator_filename=="1")
   {
@@ -297,9 +853,9 @@ set_up(shared_ptr <TargetT > const& target_image_ptr)
     std::fill(precomputed_denominator_ptr->begin_all(), precomputed_denominator_ptr->end_all(), 1.F);
   }
   else
-  {       
-    precomputed_denominator_ptr = 
-      read_from_file<TargetT>(this->precomputed_denominator_filename);   
+  {
+    precomputed_denominator_ptr =
+      read_from_file<TargetT>(this->precomputed_denominator_filename);
     {
       std::string explanation;
       if (!precomputed_denominator_ptr->has_same_characteristics(*target_image_ptr, explanation))
@@ -307,20 +863,26 @@ set_up(shared_ptr <TargetT > const& target_image_ptr)
 	  warning("OSSPS: precomputed_denominator should have same characteristics as target image: %s",
 		  explanation.c_str());
 	  return Succeeded::no;
-	}    
+	}
     }
-  }  
+  }
+
+  // allocate the work images used by update_estimate()
+  this->denominator_sptr.reset(target_image_ptr->get_empty_copy());
+  this->update_sptr.reset(target_image_ptr->get_empty_copy());
+
   return Succeeded::yes;
 }
 
 
 
 /*! \brief OSSPS additive update at every subiteration
-  \warning This modifies *precomputed_denominator_ptr. So, you <strong>have to</strong>
-  call set_up() before running a new reconstruction.
+
+  The update is computed in a single pass after computing the subset gradient (and the
+  curvature of the penalty if necessary).
   */
 template <class TargetT>
-void 
+void
 OSSPSReconstruction<TargetT>::
 update_estimate(TargetT &current_image_estimate)
 {
@@ -345,123 +907,80 @@ update_estimate(TargetT &current_image_estimate)
   PTimer timerSubset;
   timerSubset.Start();
 #endif // PARALLEL
-  
+
   const int subset_num=this->get_subset_num();
   info(boost::format("Now processing subset #: %1%") % subset_num);
-    
-  // TODO make member or static parameter to avoid reallocation all the time
-  unique_ptr< TargetT > numerator_ptr
-    (current_image_estimate.get_empty_copy());
 
-  this->objective_function_sptr->compute_sub_gradient(*numerator_ptr, current_image_estimate, subset_num);
-  //*numerator_ptr *= this->num_subsets;
-  std::transform(numerator_ptr->begin_all(), numerator_ptr->end_all(),
-		 numerator_ptr->begin_all(),
-		 _1 * this->num_subsets);
+  TargetT& update = *this->update_sptr;
+  TargetT& denominator = *this->denominator_sptr;
 
-  info(boost::format("num subsets %1%") % this->num_subsets);
-  info(boost::format("this->num_subsets*subgradient : max %1%, min %2%") % *std::max_element(numerator_ptr->begin_all(), numerator_ptr->end_all()) % *std::min_element(numerator_ptr->begin_all(), numerator_ptr->end_all()));
+  std::fill(update.begin_all(), update.end_all(), 0.F);
+  this->objective_function_sptr->compute_sub_gradient(update, current_image_estimate, subset_num);
 
-  // now divide by denominator
+  info(boost::format("num subsets %1%") % this->num_subsets);
 
-  if (recompute_penalty_term_in_denominator || 
-      (this->get_subiteration_num() == this->get_start_subiteration_num()))
-    {
-      unique_ptr< TargetT > work_image_ptr
-	(current_image_estimate.get_empty_copy());
-      
-      // avoid work (or crash) when penalty is 0
-      if (!this->objective_function_sptr->prior_is_zero())
-	{
-	  static_cast<PriorWithParabolicSurrogate<TargetT>&>(*get_prior_ptr()).
-	    parabolic_surrogate_curvature(*work_image_ptr, current_image_estimate);   
-	  //*work_image_ptr *= 2;
-	  //*work_image_ptr += *precomputed_denominator_ptr ;
-	  std::transform(work_image_ptr->begin_all(), work_image_ptr->end_all(),
-			 precomputed_denominator_ptr->begin_all(), 
-			 work_image_ptr->begin_all(),
-			 _1 * 2 + _2);
-	}
-      else
-	*work_image_ptr = *precomputed_denominator_ptr ;
-    
-      // KT 09/12/2002 new
-      // avoid division by 0 by thresholding the denominator to be strictly positive      
-      threshold_min_to_small_positive_value(work_image_ptr->begin_all(),
-					    work_image_ptr->end_all(),
-					    10.E-6F);
-      info(boost::format(" denominator max %1%, min %2%") % *std::max_element(work_image_ptr->begin_all(), work_image_ptr->end_all()) % *std::min_element(work_image_ptr->begin_all(), work_image_ptr->end_all()));
-
-      if (!recompute_penalty_term_in_denominator)
-	{
-	  // store for future use
-	  *precomputed_denominator_ptr = *work_image_ptr;
-	}
-    
-      //*numerator_ptr /= *work_image_ptr;
-      std::transform(numerator_ptr->begin_all(), numerator_ptr->end_all(),
-		     work_image_ptr->begin_all(),
-		     numerator_ptr->begin_all(), 
-		     _1 / _2);
+  //relaxation_parameter ~1/(1+n) where n is iteration number
+  const float relaxation_parameter = this->relaxation_parameter/
+    (1+this->relaxation_gamma*(this->subiteration_num/this->num_subsets));
 
-    }
-  else
-    {
-      // we have computed the denominator already 
-      //*numerator_ptr /= *precomputed_denominator_ptr;
-      std::transform(numerator_ptr->begin_all(), numerator_ptr->end_all(),
-		     precomputed_denominator_ptr->begin_all(),
-		     numerator_ptr->begin_all(), 
-		     _1 / _2);
+  info(boost::format("relaxation parameter = %1%") % relaxation_parameter);
 
-    }
+  const float alpha = 1.F;  //  line_search(current_image_estimate, update);
 
-  //relaxation_parameter ~1/(1+n) where n is iteration number 
-  const float relaxation_parameter = this->relaxation_parameter/
-    (1+this->relaxation_gamma*(this->subiteration_num/this->num_subsets));
+  detail::OSSPSUpdateParameters parameters;
+  parameters.gradient_factor = static_cast<float>(this->num_subsets);
+  parameters.step_size = relaxation_parameter * alpha;
+  parameters.upper_bound = static_cast<float>(upper_bound);
+  // the denominator is already thresholded when it was not recomputed
+  parameters.denominator_threshold = 0.F;
 
+  const bool compute_denominator =
+    recompute_penalty_term_in_denominator ||
+    (this->get_subiteration_num() == this->get_start_subiteration_num());
+  if (compute_denominator)
+    {
+      // avoid work (or crash) when penalty is 0
+      const bool add_curvature = !this->objective_function_sptr->prior_is_zero();
+      if (add_curvature)
+	static_cast<PriorWithParabolicSurrogate<TargetT>&>(*get_prior_ptr()).
+	  parabolic_surrogate_curvature(denominator, current_image_estimate);
+
+      // denominator = 2*curvature + precomputed_denominator
+      const float min_positive =
+        detail::compute_OSSPS_denominator(denominator, *this->precomputed_denominator_ptr, add_curvature);
+      // avoid division by 0 by thresholding the denominator to be strictly positive
+      // (as in threshold_min_to_small_positive_value())
+      const float small_number = 10.E-6F;
+      parameters.denominator_threshold =
+        min_positive == std::numeric_limits<float>::max() ?
+        small_number : min_positive * small_number;
+    }
 
-  info(boost::format("relaxation parameter = %1%") % relaxation_parameter);
+  detail::OSSPSUpdateStatistics statistics;
+  detail::apply_OSSPS_update(current_image_estimate, update, denominator,
+                             /* store_denominator = */ compute_denominator,
+                             parameters, statistics);
 
-  const float alpha = 1.F;  //  line_search(current_image_estimate, *numerator_ptr);
-  // *numerator_ptr *= relaxation_parameter * alpha;  
-  std::transform(numerator_ptr->begin_all(), numerator_ptr->end_all(),
-		 numerator_ptr->begin_all(),
-		 _1 * relaxation_parameter * alpha);
+  info(boost::format("this->num_subsets*subgradient : max %1%, min %2%") % statistics.scaled_gradient.max_value % statistics.scaled_gradient.min_value);
+  if (compute_denominator)
+    info(boost::format(" denominator max %1%, min %2%") % statistics.denominator.max_value % statistics.denominator.min_value);
+  info(boost::format("additive update image min,max: %1%, %2%") % statistics.update.min_value % statistics.update.max_value);
+  {
+    const float current_min = statistics.image_before_thresholding.min_value;
+    const float current_max = statistics.image_before_thresholding.max_value;
+    const float new_min = 0.F;
+    const float new_max = parameters.upper_bound;
+    info(boost::format("current image old min,max: %1%, %2%, new min,max %3%, %4%") % current_min % current_max % std::max(current_min, new_min) % std::min(current_max, new_max));
+  }
 
-  
   if (write_update_image)
     {
       // Write it to file
       const std::string fname =
 	this->make_filename_prefix_subiteration_num(this->output_filename_prefix + "_update");
       this->output_file_format_ptr->
-	write_to_file(fname, *numerator_ptr);
+	write_to_file(fname, update);
     }
-  
-  {
-    info(boost::format("additive update image min,max: %1%, %2%") % *std::min_element(numerator_ptr->begin_all(), numerator_ptr->end_all()) % *std::max_element(numerator_ptr->begin_all(), numerator_ptr->end_all()));
-
-  }  
-  current_image_estimate += *numerator_ptr; 
-
-  // now threshold image
-  {
-    const float current_min =
-      *std::min_element(current_image_estimate.begin_all(),
-			current_image_estimate.end_all()); 
-    const float current_max = 
-      *std::max_element(current_image_estimate.begin_all(),
-			current_image_estimate.end_all()); 
-    const float new_min = 0.F;
-    const float new_max = 
-      static_cast<float>(upper_bound);
-    info(boost::format("current image old min,max: %1%, %2%, new min,max %3%, %4%") % current_min % current_max % std::max(current_min, new_min) % std::min(current_max, new_max));
-    
-    threshold_upper_lower(current_image_estimate.begin_all(),
-			  current_image_estimate.end_all(), 
-			  new_min, new_max);      
-  }  
 
 #ifndef PARALLEL
   //cerr << "Subset : " << subset_timer.value() << "secs " <<endl;
@@ -470,7 +989,7 @@ update_estimate(TargetT &current_image_estimate)
   info(boost::format("Subset: %1%secs") % timerSubset.GetTime());
 
 #endif
-  
+
 }
 END_NAMESPACE_STIR
 
@@ -218,14 +218,17 @@ CListModeDataECAT<CListRecordT>::
 get_next_record(CListRecord& record_of_general_type) const
 {
   CListRecordT& record = static_cast<CListRecordT&>(record_of_general_type);
-  if (current_lm_data_ptr->get_next_record(record) == Succeeded::yes)
+  // get_next_records() decodes the record directly from the buffer of the stream, without
+  // virtual function calls (see CListModeDataECAT8_32bit::get_next_record())
+  if (current_lm_data_ptr->get_next_records(&record, 1) == 1)
     return Succeeded::yes;
   else
   {
     // warning: do not modify current_lm_file here. This is done by open_lm_file
     // open_lm_file uses current_lm_file as well
     if (open_lm_file(current_lm_file+1) == Succeeded::yes)
-      return current_lm_data_ptr->get_next_record(record);
+      return
+        current_lm_data_ptr->get_next_records(&record, 1) == 1 ? Succeeded::yes : Succeeded::no;
     else
       return Succeeded::no;
   }
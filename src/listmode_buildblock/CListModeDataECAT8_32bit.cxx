@@ -108,7 +108,12 @@ CListModeDataECAT8_32bit::
 get_next_record(CListRecord& record_of_general_type) const
 {
   CListRecordT& record = static_cast<CListRecordT&>(record_of_general_type);
-  return current_lm_data_ptr->get_next_record(record);
+  // get_next_records() decodes the record directly from the buffer of the stream, without
+  // virtual function calls. CListModeData hands out one record at a time, so we read
+  // batches of 1. (Decoding larger batches into a separate array and copying those
+  // records is slower, as records contain std::vectors and shared_ptrs.)
+  return
+    current_lm_data_ptr->get_next_records(&record, 1) == 1 ? Succeeded::yes : Succeeded::no;
  }
 
 
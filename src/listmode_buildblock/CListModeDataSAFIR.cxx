@@ -85,7 +85,10 @@ CListModeDataSAFIR<CListRecordT>::
 get_next_record(CListRecord& record_of_general_type) const
 {
 	CListRecordT& record = static_cast<CListRecordT&>(record_of_general_type);
-	Succeeded status = current_lm_data_ptr->get_next_record(record);
+	// get_next_records() decodes the record directly from the buffer of the stream, without
+	// virtual function calls (see CListModeDataECAT8_32bit::get_next_record())
+	Succeeded status =
+	  current_lm_data_ptr->get_next_records(&record, 1) == 1 ? Succeeded::yes : Succeeded::no;
 	if( status == Succeeded::yes ) record.event_SAFIR().set_map(map);
 	return status;
 	
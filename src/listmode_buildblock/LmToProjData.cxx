@@ -9,7 +9,7 @@
 */
 /*
     Copyright (C) 2000 - 2011-12-31, Hammersmith Imanet Ltd
-    Copyright (C) 2013, University College London
+    Copyright (C) 2013, 2018, University College London
     This file is part of STIR.
 
     This file is free software; you can redistribute it and/or modify
@@ -82,10 +82,14 @@ FRAME_BASED_DT_CORR:
 #include "stir/CPUTimer.h"
 #include "stir/recon_buildblock/TrivialBinNormalisation.h"
 #include "stir/is_null_ptr.h"
+#include "stir/Succeeded.h"
+#include <boost/cstdint.hpp>
+#include <boost/format.hpp>
 
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <cstdio>
 
 #ifndef STIR_NO_NAMESPACES
 using std::string;
@@ -140,6 +144,25 @@ construct_proj_data(shared_ptr<iostream>& output,
 		    const ExamInfo& exam_info,
                     const shared_ptr<ProjDataInfo>& proj_data_info_ptr);
 
+/* Functions used for the temporary files in single pass mode.
+   For every event, we store the index of its bin in the segment and the value to add.
+*/
+struct SpilledBinValue
+{
+  boost::uint32_t index;
+  float value;
+};
+
+static boost::uint32_t
+get_index_in_segment(const Bin& bin, const ProjDataInfo& proj_data_info);
+
+static Succeeded
+write_spilled_bin_values(const string& filename, vector<SpilledBinValue>& buffer);
+
+static Succeeded
+add_spilled_bin_values(segment_type& segment, const string& filename,
+                       const unsigned long num_spilled_bin_values);
+
 /**************************************************************
  The 3 parsing functions
 ***************************************************************/
@@ -152,6 +175,8 @@ set_defaults()
   store_delayeds = true;
   interactive=false;
   num_segments_in_memory = -1;
+  single_pass = false;
+  scratch_directory = "";
   normalisation_ptr.reset(new TrivialBinNormalisation);
   post_normalisation_ptr.reset(new TrivialBinNormalisation);
   do_pre_normalisation =0;
@@ -174,6 +199,8 @@ initialise_keymap()
   parser.add_key("maximum absolute segment number to process", &max_segment_num_to_process); 
   parser.add_key("do pre normalisation ", &do_pre_normalisation);
   parser.add_key("num_segments_in_memory", &num_segments_in_memory);
+  parser.add_key("single pass", &single_pass);
+  parser.add_key("scratch directory", &scratch_directory);
 
   //if (lm_data_ptr->has_delayeds()) TODO we haven't read the CListModeData yet, so cannot access has_delayeds() yet
   // one could add the next 2 keywords as part of a callback function for the 'input file' keyword.
@@ -496,6 +523,18 @@ get_compression_count(const Bin& bin) const
 
 }
 
+std::string
+LmToProjData::
+get_spill_filename(const int segment_num) const
+{
+  const string prefix =
+    scratch_directory.size()==0
+    ? output_filename_prefix
+    : scratch_directory + "/" + find_filename(output_filename_prefix.c_str());
+  return boost::str(boost::format("%1%_f%2%_seg%3%.spill")
+                    % prefix % current_frame_num % segment_num);
+}
+
 /**************************************************************
  Empty functions for new time events and new time frames.
 ***************************************************************/
@@ -514,7 +553,9 @@ start_new_time_frame(const unsigned int)
  Here follows the actual rebinning code (finally).
 
  It's essentially simple, but is in fact complicated because of the facility
- to store only part of the segments in memory.
+ to store only part of the segments in memory. In single pass mode, events
+ in segments that are not in memory are written to temporary files, which are
+ read back when we get to their segments.
 ***************************************************************/
 void
 LmToProjData::
@@ -576,6 +617,19 @@ process_data()
       const double start_time = frame_defs.get_start_time(current_frame_num);
       const double end_time = frame_defs.get_end_time(current_frame_num);
 
+      // in single pass mode, we write events for segments that are not in memory
+      // to a temporary file per segment. The buffers are used to avoid
+      // writing every single event.
+      const bool spill_events =
+        single_pass && !interactive &&
+        num_segments_in_memory < proj_data_ptr->get_num_segments();
+      const std::size_t spill_buffer_size = 65536;
+      VectorWithOffset<vector<SpilledBinValue> >
+        spill_buffers(proj_data_ptr->get_min_segment_num(), proj_data_ptr->get_max_segment_num());
+      VectorWithOffset<unsigned long>
+        num_spilled_bin_values(proj_data_ptr->get_min_segment_num(), proj_data_ptr->get_max_segment_num());
+      num_spilled_bin_values.fill(0UL);
+
       /*
 	 For each start_segment_index, we check which events occur in the
 	 segments between start_segment_index and 
@@ -592,6 +646,33 @@ process_data()
 	   if (!interactive)
 	     allocate_segments(segments, start_segment_index, end_segment_index, proj_data_ptr->get_proj_data_info_ptr());
 
+	   if (spill_events && start_segment_index != proj_data_ptr->get_min_segment_num())
+	     {
+	       // all events have been read already, so we just need to add the ones from the temporary files
+	       cerr << "\nAdding events for next batch of segments from temporary files\n";
+	       bool success = true;
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(&&:success)
+#endif
+	       for (int seg=start_segment_index; seg<=end_segment_index; ++seg)
+		 {
+		   if (num_spilled_bin_values[seg]==0)
+		     continue;
+		   const string filename = get_spill_filename(seg);
+		   if (add_spilled_bin_values(*segments[seg], filename, num_spilled_bin_values[seg])
+		       != Succeeded::yes)
+		     success = false;
+		   std::remove(filename.c_str());
+		 }
+	       if (!success)
+		 error("LmToProjData: error reading temporary files for segments %d to %d",
+		       start_segment_index, end_segment_index);
+	       save_and_delete_segments(output, segments, 
+					start_segment_index, end_segment_index, 
+					*proj_data_ptr);
+	       continue;
+	     }
+
 	   // the next variable is used to see if there are more events to store for the current segments
 	   // num_events_to_store-more_events will be the number of allowed coincidence events currently seen in the file
 	   // ('allowed' independent on the fact of we have its segment in memory or not)
@@ -625,6 +706,13 @@ process_data()
 	       // now save position such that we can go back
 	       frame_start_positions[current_frame_num] = 
 		 lm_data_ptr->save_get_position();
+
+	       if (spill_events)
+		 {
+		   // make sure we do not append to left-over files
+		   for (int seg=end_segment_index+1; seg<=proj_data_ptr->get_max_segment_num(); ++seg)
+		     std::remove(get_spill_filename(seg).c_str());
+		 }
 	     }
 	   {      
 	     // loop over all events in the listmode file
@@ -700,6 +788,31 @@ process_data()
 			       bin.get_bin_value() * 
 			       event_increment;
 			   }
+			 else if (spill_events)
+			   {
+			     do_post_normalisation(bin);
+
+			     num_stored_events += event_increment;
+			     if (record.event().is_prompt())
+			       ++num_prompts_in_frame;
+			     else
+			       ++num_delayeds_in_frame;
+
+			     if (num_stored_events%500000L==0) cout << "\r" << num_stored_events << " events stored" << flush;
+
+			     vector<SpilledBinValue>& buffer = spill_buffers[bin.segment_num()];
+			     SpilledBinValue spilled_bin_value;
+			     spilled_bin_value.index =
+			       get_index_in_segment(bin, *proj_data_ptr->get_proj_data_info_ptr());
+			     spilled_bin_value.value = bin.get_bin_value() * event_increment;
+			     buffer.push_back(spilled_bin_value);
+			     ++num_spilled_bin_values[bin.segment_num()];
+			     if (buffer.size() >= spill_buffer_size &&
+				 write_spilled_bin_values(get_spill_filename(bin.segment_num()), buffer)
+				 != Succeeded::yes)
+			       error("LmToProjData: error writing temporary file %s",
+				     get_spill_filename(bin.segment_num()).c_str());
+			   }
 		       }
 		     else 	// event is rejected for some reason
 		       {
@@ -714,6 +827,20 @@ process_data()
 	       max(time_of_last_stored_event,current_time); 
 	   } 
 
+	   if (spill_events)
+	     {
+	       // write remaining events to the temporary files
+	       for (int seg=end_segment_index+1; seg<=proj_data_ptr->get_max_segment_num(); ++seg)
+		 {
+		   if (write_spilled_bin_values(get_spill_filename(seg), spill_buffers[seg])
+		       != Succeeded::yes)
+		     error("LmToProjData: error writing temporary file %s",
+			   get_spill_filename(seg).c_str());
+		   // deallocate memory
+		   vector<SpilledBinValue>().swap(spill_buffers[seg]);
+		 }
+	     }
+
 	   if (!interactive)
 	   save_and_delete_segments(output, segments, 
 				    start_segment_index, end_segment_index, 
@@ -788,6 +915,71 @@ save_and_delete_segments(shared_ptr<iostream>& output,
 
 
 
+static boost::uint32_t
+get_index_in_segment(const Bin& bin, const ProjDataInfo& proj_data_info)
+{
+  const int num_axial_poss = proj_data_info.get_num_axial_poss(bin.segment_num());
+  const int num_tangential_poss = proj_data_info.get_num_tangential_poss();
+  return
+    (static_cast<boost::uint32_t>(bin.view_num() - proj_data_info.get_min_view_num()) * num_axial_poss +
+     static_cast<boost::uint32_t>(bin.axial_pos_num() - proj_data_info.get_min_axial_pos_num(bin.segment_num()))) *
+    num_tangential_poss +
+    static_cast<boost::uint32_t>(bin.tangential_pos_num() - proj_data_info.get_min_tangential_pos_num());
+}
+
+static Succeeded
+write_spilled_bin_values(const string& filename, vector<SpilledBinValue>& buffer)
+{
+  if (buffer.size()==0)
+    return Succeeded::yes;
+  ofstream spill_file(filename.c_str(), ios::out | ios::binary | ios::app);
+  if (!spill_file)
+    return Succeeded::no;
+  spill_file.write(reinterpret_cast<const char *>(&buffer[0]),
+                   buffer.size()*sizeof(SpilledBinValue));
+  if (!spill_file)
+    return Succeeded::no;
+  buffer.resize(0);
+  return Succeeded::yes;
+}
+
+static Succeeded
+add_spilled_bin_values(segment_type& segment, const string& filename,
+                       const unsigned long num_spilled_bin_values)
+{
+  ifstream spill_file(filename.c_str(), ios::in | ios::binary);
+  if (!spill_file)
+    return Succeeded::no;
+
+  const int min_view_num = segment.get_min_view_num();
+  const int min_axial_pos_num = segment.get_min_axial_pos_num();
+  const int min_tangential_pos_num = segment.get_min_tangential_pos_num();
+  const boost::uint32_t num_axial_poss = static_cast<boost::uint32_t>(segment.get_num_axial_poss());
+  const boost::uint32_t num_tangential_poss = static_cast<boost::uint32_t>(segment.get_num_tangential_poss());
+
+  vector<SpilledBinValue> buffer(65536);
+  unsigned long num_remaining = num_spilled_bin_values;
+  while (num_remaining > 0)
+    {
+      const std::size_t num_to_read =
+        static_cast<std::size_t>(min(num_remaining, static_cast<unsigned long>(buffer.size())));
+      spill_file.read(reinterpret_cast<char *>(&buffer[0]), num_to_read*sizeof(SpilledBinValue));
+      if (!spill_file)
+        return Succeeded::no;
+      for (std::size_t i=0; i<num_to_read; ++i)
+        {
+          const boost::uint32_t index = buffer[i].index;
+          const int tangential_pos_num = min_tangential_pos_num + static_cast<int>(index % num_tangential_poss);
+          const boost::uint32_t view_axial_index = index / num_tangential_poss;
+          const int axial_pos_num = min_axial_pos_num + static_cast<int>(view_axial_index % num_axial_poss);
+          const int view_num = min_view_num + static_cast<int>(view_axial_index / num_axial_poss);
+          segment[view_num][axial_pos_num][tangential_pos_num] += buffer[i].value;
+        }
+      num_remaining -= num_to_read;
+    }
+  return Succeeded::yes;
+}
+
 static
 shared_ptr<ProjData>
 construct_proj_data(shared_ptr<iostream>& output,
@@ -8,6 +8,14 @@
 
   \see class stir::LmToProjData for info on parameter file format
 
+  \par Usage
+  <pre>
+  lm_to_projdata [--ROOT-implicit-MT num_threads] [par_file]
+  </pre>
+  With <tt>--ROOT-implicit-MT</tt>, ROOT files are decompressed using ROOT's implicit
+  multi-threading (see InputStreamFromROOTFile::enable_implicit_multi_threading()).
+  \a num_threads equal to 0 lets ROOT choose the number of threads.
+
   \author Kris Thielemans
   \author Sanida Mustafovic
   
@@ -31,6 +39,11 @@
 
 #include "stir/listmode/LmToProjData.h"
 #include "stir/IO/InputFileFormatRegistry.h"
+#ifdef HAVE_CERN_ROOT
+#include "stir/IO/InputStreamFromROOTFile.h"
+#endif
+#include "stir/warning.h"
+#include <cstdlib>
 
 #ifndef STIR_NO_NAMESPACES
 using std::cerr;
@@ -47,7 +60,7 @@ int main(int argc, char * argv[])
     {
       if (strcmp(argv[1], "--help") == 0 ||
           strcmp(argv[1], "-?") == 0) {
-	cerr << "\nUsage: " << argv[0] << " [par_file]\n"
+	cerr << "\nUsage: " << argv[0] << " [--ROOT-implicit-MT num_threads] [par_file]\n"
 	     << "Run "<<argv[0]<<" --input-formats to list the supported input formats\n";
 	exit(EXIT_SUCCESS);
       }
@@ -60,6 +73,16 @@ int main(int argc, char * argv[])
 	    list_registered_names(cerr);
 	  exit(EXIT_SUCCESS);
 	}
+      // needs to be done before the input file is opened
+      if (argc>2 && strcmp(argv[1], "--ROOT-implicit-MT")==0)
+	{
+#ifdef HAVE_CERN_ROOT
+	  InputStreamFromROOTFile::enable_implicit_multi_threading(static_cast<unsigned int>(atoi(argv[2])));
+#else
+	  warning("lm_to_projdata: STIR was compiled without ROOT. Ignoring --ROOT-implicit-MT");
+#endif
+	  argc -= 2; argv += 2;
+	}
     }
   LmToProjData application(argc==2 ? argv[1] : 0);
   application.process_data();
@@ -43,6 +43,10 @@
 #include "stir/Viewgram.h"
 #include "stir/RelatedViewgrams.h"
 #include "stir/is_null_ptr.h"
+#include <algorithm>
+#ifdef STIR_OPENMP
+#include <omp.h>
+#endif
 
 using std::vector;
 
@@ -161,84 +165,128 @@ actual_back_project(DiscretisedDensity<3,float>& image,
     {
       // complicated version which handles the symmetries explicitly
       // faster when no caching is performed, about just as fast when there is caching
-      ProjMatrixElemsForOneBin proj_matrix_row;
       ProjMatrixElemsForOneBin proj_matrix_row_copy;
       const DataSymmetriesForBins* symmetries = proj_matrix_ptr->get_symmetries_ptr(); 
 
-      Array<2,int> 
-	already_processed(IndexRange2D(min_axial_pos_num, max_axial_pos_num,
-				       min_tangential_pos_num, max_tangential_pos_num));
+      // first find all basic bins
+      vector<Bin> basic_bins;
+      {
+        Array<2,int> 
+          already_processed(IndexRange2D(min_axial_pos_num, max_axial_pos_num,
+                                         min_tangential_pos_num, max_tangential_pos_num));
+
+        vector<AxTangPosNumbers> related_ax_tang_poss;
+        for ( int tang_pos = min_tangential_pos_num ;tang_pos  <= max_tangential_pos_num ;++tang_pos)  
+          for ( int ax_pos = min_axial_pos_num; ax_pos <= max_axial_pos_num ;++ax_pos)
+            {       
+              if (already_processed[ax_pos][tang_pos])
+                continue;          
+
+              Bin basic_bin(viewgrams.get_basic_segment_num(),
+                            viewgrams.get_basic_view_num(),
+                            ax_pos,
+                            tang_pos);
+              symmetries->find_basic_bin(basic_bin);
+              basic_bins.push_back(basic_bin);
+
+              related_ax_tang_poss.resize(0);
+              symmetries->get_related_bins_factorised(related_ax_tang_poss,basic_bin,
+                                                      min_axial_pos_num, max_axial_pos_num,
+                                                      min_tangential_pos_num, max_tangential_pos_num);
+              for (
+#ifndef STIR_NO_NAMESPACES
+                   std::
+#endif
+                     vector<AxTangPosNumbers>::const_iterator r_ax_tang_poss_iter = related_ax_tang_poss.begin();
+                   r_ax_tang_poss_iter != related_ax_tang_poss.end();
+                   ++r_ax_tang_poss_iter)
+                {
+                  const int axial_pos_tmp = (*r_ax_tang_poss_iter)[1];
+                  const int tang_pos_tmp = (*r_ax_tang_poss_iter)[2];
+                  if (min_axial_pos_num <= axial_pos_tmp && axial_pos_tmp <= max_axial_pos_num &&
+                      min_tangential_pos_num <=tang_pos_tmp  && tang_pos_tmp <= max_tangential_pos_num)
+                    already_processed[axial_pos_tmp][tang_pos_tmp] = 1;
+                }
+            }
+        assert(already_processed.sum() 
+               == (
+                   (max_axial_pos_num - min_axial_pos_num + 1) *
+                   (max_tangential_pos_num - min_tangential_pos_num + 1)));
+      }
 
+      /* Now handle the basic bins in blocks. For every block, we first compute
+         the rows (in parallel, unless we are called from a parallel region already),
+         and then back project them.
+         The latter cannot be done in parallel as different rows write to the same voxels.
+         The size of the block is a compromise between memory use and parallel efficiency.
+      */
+      const int num_basic_bins = static_cast<int>(basic_bins.size());
+      const int block_size = 256;
+      vector<ProjMatrixElemsForOneBin> proj_matrix_rows(std::min(block_size, num_basic_bins));
       vector<AxTangPosNumbers> related_ax_tang_poss;
-      for ( int tang_pos = min_tangential_pos_num ;tang_pos  <= max_tangential_pos_num ;++tang_pos)  
-	for ( int ax_pos = min_axial_pos_num; ax_pos <= max_axial_pos_num ;++ax_pos)
-	  {       
-	    if (already_processed[ax_pos][tang_pos])
-	      continue;          
-
-	    Bin basic_bin(viewgrams.get_basic_segment_num(),
-			  viewgrams.get_basic_view_num(),
-			  ax_pos,
-			  tang_pos);
-	    symmetries->find_basic_bin(basic_bin);
-    
-	    proj_matrix_ptr->get_proj_matrix_elems_for_one_bin(proj_matrix_row, basic_bin);
-      
-	    related_ax_tang_poss.resize(0);
-	    symmetries->get_related_bins_factorised(related_ax_tang_poss,basic_bin,
-						    min_axial_pos_num, max_axial_pos_num,
-						    min_tangential_pos_num, max_tangential_pos_num);
+      for (int block_start=0; block_start<num_basic_bins; block_start+=block_size)
+        {
+          const int block_end = std::min(block_start+block_size, num_basic_bins);
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic) if(!omp_in_parallel()) shared(basic_bins, proj_matrix_rows)
+#endif
+          for (int i=block_start; i<block_end; ++i)
+            proj_matrix_ptr->get_proj_matrix_elems_for_one_bin(proj_matrix_rows[i-block_start], basic_bins[i]);
+
+          for (int i=block_start; i<block_end; ++i)
+            {
+              const Bin& basic_bin = basic_bins[i];
+              const ProjMatrixElemsForOneBin& proj_matrix_row = proj_matrix_rows[i-block_start];
+
+              related_ax_tang_poss.resize(0);
+              symmetries->get_related_bins_factorised(related_ax_tang_poss,basic_bin,
+                                                      min_axial_pos_num, max_axial_pos_num,
+                                                      min_tangential_pos_num, max_tangential_pos_num);
     
-	    for (
+              for (
 #ifndef STIR_NO_NAMESPACES
-		 std::
+                   std::
 #endif
-		   vector<AxTangPosNumbers>::const_iterator r_ax_tang_poss_iter = related_ax_tang_poss.begin();
-		 r_ax_tang_poss_iter != related_ax_tang_poss.end();
-		 ++r_ax_tang_poss_iter)
-	      {
-		const int axial_pos_tmp = (*r_ax_tang_poss_iter)[1];
-		const int tang_pos_tmp = (*r_ax_tang_poss_iter)[2];
-	  
-		// symmetries might take the ranges out of what the user wants
-		if ( !(min_axial_pos_num <= axial_pos_tmp && axial_pos_tmp <= max_axial_pos_num &&
-		       min_tangential_pos_num <=tang_pos_tmp  && tang_pos_tmp <= max_tangential_pos_num))
-		  continue;
+                     vector<AxTangPosNumbers>::const_iterator r_ax_tang_poss_iter = related_ax_tang_poss.begin();
+                   r_ax_tang_poss_iter != related_ax_tang_poss.end();
+                   ++r_ax_tang_poss_iter)
+                {
+                  const int axial_pos_tmp = (*r_ax_tang_poss_iter)[1];
+                  const int tang_pos_tmp = (*r_ax_tang_poss_iter)[2];
 	  
-		already_processed[axial_pos_tmp][tang_pos_tmp] = 1;
-       
+                  // symmetries might take the ranges out of what the user wants
+                  if ( !(min_axial_pos_num <= axial_pos_tmp && axial_pos_tmp <= max_axial_pos_num &&
+                         min_tangential_pos_num <=tang_pos_tmp  && tang_pos_tmp <= max_tangential_pos_num))
+                    continue;
 	  
-		for (RelatedViewgrams<float>::const_iterator viewgram_iter = viewgrams.begin();
-		     viewgram_iter != viewgrams.end();
-		     ++viewgram_iter)
-		  {
-		    // KT 21/02/2002 added check on 0
-		    if ((*viewgram_iter)[axial_pos_tmp][tang_pos_tmp] == 0)
-		      continue;
-		    proj_matrix_row_copy = proj_matrix_row;
-		    Bin bin(viewgram_iter->get_segment_num(),
-			    viewgram_iter->get_view_num(),
-			    axial_pos_tmp,
-			    tang_pos_tmp,
-			    (*viewgram_iter)[axial_pos_tmp][tang_pos_tmp]);
+                  for (RelatedViewgrams<float>::const_iterator viewgram_iter = viewgrams.begin();
+                       viewgram_iter != viewgrams.end();
+                       ++viewgram_iter)
+                    {
+                      // KT 21/02/2002 added check on 0
+                      if ((*viewgram_iter)[axial_pos_tmp][tang_pos_tmp] == 0)
+                        continue;
+                      proj_matrix_row_copy = proj_matrix_row;
+                      Bin bin(viewgram_iter->get_segment_num(),
+                              viewgram_iter->get_view_num(),
+                              axial_pos_tmp,
+                              tang_pos_tmp,
+                              (*viewgram_iter)[axial_pos_tmp][tang_pos_tmp]);
 	      
-		    unique_ptr<SymmetryOperation> symm_op_ptr = 
-		      symmetries->find_symmetry_operation_from_basic_bin(bin);
-		    // TODO replace with Bin::compare_coordinates or so
-		    assert(bin.segment_num() == basic_bin.segment_num());
-		    assert(bin.view_num() == basic_bin.view_num());
-		    assert(bin.axial_pos_num() == basic_bin.axial_pos_num());
-		    assert(bin.tangential_pos_num() == basic_bin.tangential_pos_num());
+                      unique_ptr<SymmetryOperation> symm_op_ptr = 
+                        symmetries->find_symmetry_operation_from_basic_bin(bin);
+                      // TODO replace with Bin::compare_coordinates or so
+                      assert(bin.segment_num() == basic_bin.segment_num());
+                      assert(bin.view_num() == basic_bin.view_num());
+                      assert(bin.axial_pos_num() == basic_bin.axial_pos_num());
+                      assert(bin.tangential_pos_num() == basic_bin.tangential_pos_num());
 	      
-		    symm_op_ptr->transform_proj_matrix_elems_for_one_bin(proj_matrix_row_copy);
-		    proj_matrix_row_copy.back_project(image, bin);
-		  }
-	      }  
-	  }      
-      assert(already_processed.sum() 
-	     == (
-		 (max_axial_pos_num - min_axial_pos_num + 1) *
-		 (max_tangential_pos_num - min_tangential_pos_num + 1)));
+                      symm_op_ptr->transform_proj_matrix_elems_for_one_bin(proj_matrix_row_copy);
+                      proj_matrix_row_copy.back_project(image, bin);
+                    }
+                }  
+            }
+        }
     }  
 }
 
@@ -134,20 +134,30 @@ apply(ProjData& proj_data,const double start_time, const double end_time,
       const ViewSegmentNumbers vs=vs_nums_to_process[i];
       
       RelatedViewgrams<float> viewgrams;
-#ifdef STIR_OPENMP
       // reading/writing to streams is not safe in multi-threaded code
-      // so protect with a critical section
+      // so protect with a critical section (unless proj_data supports concurrent access)
       // note that the name of the section has to be same for the get/set
       // function as they're reading from/writing to the same stream
+      // Skipping the critical section relies on every thread handling different related
+      // viewgrams. This is the case here, as the basic view/segment numbers
+      // in vs_nums_to_process have disjoint related viewgrams
+      // (see ProjData::supports_concurrent_access()).
+      if (proj_data.supports_concurrent_access())
+        viewgrams = proj_data.get_related_viewgrams(vs, symmetries_sptr);
+      else
+#ifdef STIR_OPENMP
 #pragma omp critical (BINNORMALISATION_APPLY__VIEWGRAMS)
 #endif
       {
-        viewgrams = 
+        viewgrams =
           proj_data.get_related_viewgrams(vs, symmetries_sptr);
       }
 
       this->apply(viewgrams, start_time, end_time);
 
+      if (proj_data.supports_concurrent_access())
+        proj_data.set_related_viewgrams(viewgrams);
+      else
 #ifdef STIR_OPENMP
 #pragma omp critical (BINNORMALISATION_APPLY__VIEWGRAMS)
 #endif
@@ -180,16 +190,23 @@ undo(ProjData& proj_data,const double start_time, const double end_time,
       const ViewSegmentNumbers vs=vs_nums_to_process[i];
       
       RelatedViewgrams<float> viewgrams;
+      // see apply() for the critical sections
+      if (proj_data.supports_concurrent_access())
+        viewgrams = proj_data.get_related_viewgrams(vs, symmetries_sptr);
+      else
 #ifdef STIR_OPENMP
 #pragma omp critical (BINNORMALISATION_UNDO__VIEWGRAMS)
 #endif
       {
-        viewgrams = 
+        viewgrams =
           proj_data.get_related_viewgrams(vs, symmetries_sptr);
       }
 
       this->undo(viewgrams, start_time, end_time);
 
+      if (proj_data.supports_concurrent_access())
+        proj_data.set_related_viewgrams(viewgrams);
+      else
 #ifdef STIR_OPENMP
 #pragma omp critical (BINNORMALISATION_UNDO__VIEWGRAMS)
 #endif
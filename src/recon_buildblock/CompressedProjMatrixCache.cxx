@@ -0,0 +1,313 @@
+//
+//
+/*!
+  \file
+  \ingroup projection
+
+  \brief Implementation of class stir::CompressedProjMatrixCache
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+
+#include "stir/recon_buildblock/CompressedProjMatrixCache.h"
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
+#include "stir/Coordinate3D.h"
+#include "stir/Succeeded.h"
+#include <cstring>
+
+START_NAMESPACE_STIR
+
+// word used to indicate that full coordinates follow (instead of a difference)
+static const boost::uint16_t escape_word = 0x8000;
+
+CompressedProjMatrixCache::
+CompressedProjMatrixCache()
+  : min_axial_pos_num(0), max_axial_pos_num(-1),
+    min_tangential_pos_num(0), max_tangential_pos_num(-1),
+    plane_size(0), row_size(0),
+    use_half_precision(false),
+    num_rows(0)
+{}
+
+void
+CompressedProjMatrixCache::
+set_up(const int min_axial_pos_num_v, const int max_axial_pos_num_v,
+       const int min_tangential_pos_num_v, const int max_tangential_pos_num_v,
+       const BasicCoordinate<3,int>& min_voxel_index_v,
+       const BasicCoordinate<3,int>& max_voxel_index_v,
+       const bool use_half_precision_v)
+{
+  this->clear();
+  this->min_axial_pos_num = min_axial_pos_num_v;
+  this->max_axial_pos_num = max_axial_pos_num_v;
+  this->min_tangential_pos_num = min_tangential_pos_num_v;
+  this->max_tangential_pos_num = max_tangential_pos_num_v;
+  this->min_voxel_index = min_voxel_index_v;
+  this->max_voxel_index = max_voxel_index_v;
+  this->row_size = static_cast<long>(max_voxel_index[3] - min_voxel_index[3] + 1);
+  this->plane_size = this->row_size * (max_voxel_index[2] - min_voxel_index[2] + 1);
+  this->use_half_precision = use_half_precision_v;
+}
+
+void
+CompressedProjMatrixCache::
+clear()
+{
+  // use swap trick to make sure memory is deallocated
+  std::vector<word_type>().swap(this->arena);
+  std::vector<std::size_t>().swap(this->row_offsets);
+  this->num_rows = 0;
+}
+
+std::size_t
+CompressedProjMatrixCache::
+get_num_bytes_allocated() const
+{
+  return this->arena.capacity()*sizeof(word_type) +
+    this->row_offsets.capacity()*sizeof(std::size_t);
+}
+
+long
+CompressedProjMatrixCache::
+row_index(const int axial_pos_num, const int tangential_pos_num) const
+{
+  if (axial_pos_num < this->min_axial_pos_num || axial_pos_num > this->max_axial_pos_num ||
+      tangential_pos_num < this->min_tangential_pos_num || tangential_pos_num > this->max_tangential_pos_num)
+    return -1;
+  return
+    static_cast<long>(axial_pos_num - this->min_axial_pos_num) *
+      (this->max_tangential_pos_num - this->min_tangential_pos_num + 1) +
+    (tangential_pos_num - this->min_tangential_pos_num);
+}
+
+bool
+CompressedProjMatrixCache::
+is_stored(const int axial_pos_num, const int tangential_pos_num) const
+{
+  const long index = this->row_index(axial_pos_num, tangential_pos_num);
+  return
+    index >= 0 && !this->row_offsets.empty() && this->row_offsets[index] != 0;
+}
+
+void
+CompressedProjMatrixCache::
+store(const ProjMatrixElemsForOneBin& row)
+{
+  const Bin bin = row.get_bin();
+  const long index = this->row_index(bin.axial_pos_num(), bin.tangential_pos_num());
+  if (index < 0)
+    return;
+  if (this->row_offsets.empty())
+    this->row_offsets.resize(static_cast<std::size_t>(max_axial_pos_num - min_axial_pos_num + 1) *
+                             (max_tangential_pos_num - min_tangential_pos_num + 1),
+                             0);
+  if (this->row_offsets[index] != 0)
+    return;
+
+  const std::size_t start = this->arena.size();
+  const boost::uint32_t num_elements = static_cast<boost::uint32_t>(row.size());
+  this->arena.push_back(static_cast<word_type>(num_elements & 0xFFFF));
+  this->arena.push_back(static_cast<word_type>(num_elements >> 16));
+
+  bool previous_in_box = false;
+  long previous_linear_index = 0;
+  for (ProjMatrixElemsForOneBin::const_iterator element_ptr = row.begin();
+       element_ptr != row.end();
+       ++element_ptr)
+    {
+      const int c1 = element_ptr->coord1();
+      const int c2 = element_ptr->coord2();
+      const int c3 = element_ptr->coord3();
+      const bool in_box =
+        c1 >= min_voxel_index[1] && c1 <= max_voxel_index[1] &&
+        c2 >= min_voxel_index[2] && c2 <= max_voxel_index[2] &&
+        c3 >= min_voxel_index[3] && c3 <= max_voxel_index[3];
+      const long linear_index = in_box ?
+        (c1 - min_voxel_index[1])*plane_size + (c2 - min_voxel_index[2])*row_size + (c3 - min_voxel_index[3])
+        : 0L;
+      const long difference = linear_index - previous_linear_index;
+      if (in_box && previous_in_box && difference >= -32767 && difference <= 32767)
+        {
+          this->arena.push_back(static_cast<word_type>(static_cast<boost::int16_t>(difference)));
+        }
+      else
+        {
+          // coordinates are stored as shorts in ProjMatrixElemsForOneBinValue, so fit in 16 bits
+          this->arena.push_back(escape_word);
+          this->arena.push_back(static_cast<word_type>(static_cast<boost::int16_t>(c1)));
+          this->arena.push_back(static_cast<word_type>(static_cast<boost::int16_t>(c2)));
+          this->arena.push_back(static_cast<word_type>(static_cast<boost::int16_t>(c3)));
+        }
+      previous_linear_index = linear_index;
+      previous_in_box = in_box;
+
+      const float value = element_ptr->get_value();
+      if (this->use_half_precision)
+        {
+          this->arena.push_back(float_to_half(value));
+        }
+      else
+        {
+          boost::uint32_t bits;
+          std::memcpy(&bits, &value, sizeof(bits));
+          this->arena.push_back(static_cast<word_type>(bits & 0xFFFF));
+          this->arena.push_back(static_cast<word_type>(bits >> 16));
+        }
+    }
+  this->row_offsets[index] = start + 1;
+  ++this->num_rows;
+}
+
+Succeeded
+CompressedProjMatrixCache::
+get(ProjMatrixElemsForOneBin& row) const
+{
+  const Bin bin = row.get_bin();
+  const long index = this->row_index(bin.axial_pos_num(), bin.tangential_pos_num());
+  if (index < 0 || this->row_offsets.empty() || this->row_offsets[index] == 0)
+    return Succeeded::no;
+
+  const word_type * word_ptr = &this->arena[this->row_offsets[index] - 1];
+  const boost::uint32_t num_elements =
+    static_cast<boost::uint32_t>(word_ptr[0]) | (static_cast<boost::uint32_t>(word_ptr[1]) << 16);
+  word_ptr += 2;
+
+  row.erase();
+  row.reserve(num_elements);
+
+  Coordinate3D<int> coords(0,0,0);
+  long linear_index = 0;
+  for (boost::uint32_t i=0; i<num_elements; ++i)
+    {
+      if (*word_ptr == escape_word)
+        {
+          coords[1] = static_cast<boost::int16_t>(word_ptr[1]);
+          coords[2] = static_cast<boost::int16_t>(word_ptr[2]);
+          coords[3] = static_cast<boost::int16_t>(word_ptr[3]);
+          word_ptr += 4;
+          linear_index =
+            (coords[1] - min_voxel_index[1])*plane_size +
+            (coords[2] - min_voxel_index[2])*row_size +
+            (coords[3] - min_voxel_index[3]);
+        }
+      else
+        {
+          // the previous element was inside the bounding box, so linear_index is valid
+          linear_index += static_cast<boost::int16_t>(*word_ptr);
+          ++word_ptr;
+          const long remainder = linear_index % plane_size;
+          coords[1] = min_voxel_index[1] + static_cast<int>(linear_index / plane_size);
+          coords[2] = min_voxel_index[2] + static_cast<int>(remainder / row_size);
+          coords[3] = min_voxel_index[3] + static_cast<int>(remainder % row_size);
+        }
+
+      float value;
+      if (this->use_half_precision)
+        {
+          value = half_to_float(*word_ptr);
+          ++word_ptr;
+        }
+      else
+        {
+          const boost::uint32_t bits =
+            static_cast<boost::uint32_t>(word_ptr[0]) | (static_cast<boost::uint32_t>(word_ptr[1]) << 16);
+          std::memcpy(&value, &bits, sizeof(value));
+          word_ptr += 2;
+        }
+      row.push_back(ProjMatrixElemsForOneBin::value_type(coords, value));
+    }
+  return Succeeded::yes;
+}
+
+boost::uint16_t
+CompressedProjMatrixCache::
+float_to_half(const float f)
+{
+  boost::uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  const boost::uint16_t sign = static_cast<boost::uint16_t>((x >> 16) & 0x8000);
+  const int exponent = static_cast<int>((x >> 23) & 0xFF);
+  boost::uint32_t mantissa = x & 0x7FFFFF;
+
+  if (exponent == 0xFF) // Inf or NaN
+    return static_cast<boost::uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+
+  const int half_exponent = exponent - 127 + 15;
+  if (half_exponent >= 31) // overflow
+    return static_cast<boost::uint16_t>(sign | 0x7C00);
+
+  if (half_exponent <= 0)
+    {
+      // subnormal half (or zero)
+      if (half_exponent < -10)
+        return sign;
+      mantissa |= 0x800000;
+      const int shift = 14 - half_exponent;
+      boost::uint32_t half_mantissa = mantissa >> shift;
+      const boost::uint32_t remainder = mantissa & ((1U << shift) - 1);
+      const boost::uint32_t halfway = 1U << (shift - 1);
+      if (remainder > halfway || (remainder == halfway && (half_mantissa & 1)))
+        ++half_mantissa;
+      return static_cast<boost::uint16_t>(sign | half_mantissa);
+    }
+
+  boost::uint32_t half =
+    static_cast<boost::uint32_t>(half_exponent << 10) | (mantissa >> 13);
+  // round to nearest even. Note that a carry into the exponent is correct.
+  const boost::uint32_t remainder = mantissa & 0x1FFF;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+    ++half;
+  return static_cast<boost::uint16_t>(sign | half);
+}
+
+float
+CompressedProjMatrixCache::
+half_to_float(const boost::uint16_t h)
+{
+  const boost::uint32_t sign = static_cast<boost::uint32_t>(h & 0x8000) << 16;
+  int exponent = (h >> 10) & 0x1F;
+  boost::uint32_t mantissa = h & 0x3FF;
+  boost::uint32_t bits;
+
+  if (exponent == 0)
+    {
+      if (mantissa == 0)
+        bits = sign;
+      else
+        {
+          // subnormal half: normalise
+          exponent = 1;
+          while ((mantissa & 0x400) == 0)
+            {
+              mantissa <<= 1;
+              --exponent;
+            }
+          mantissa &= 0x3FF;
+          bits = sign | (static_cast<boost::uint32_t>(exponent - 15 + 127) << 23) | (mantissa << 13);
+        }
+    }
+  else if (exponent == 31)
+    bits = sign | 0x7F800000 | (mantissa << 13);
+  else
+    bits = sign | (static_cast<boost::uint32_t>(exponent - 15 + 127) << 23) | (mantissa << 13);
+
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+END_NAMESPACE_STIR
@@ -0,0 +1,156 @@
+//
+//
+/*!
+  \file
+  \ingroup projection
+
+  \brief Implementation of class stir::ConcurrentProjMatrixCache
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+
+#include "stir/recon_buildblock/ConcurrentProjMatrixCache.h"
+
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
+#include "stir/Succeeded.h"
+
+START_NAMESPACE_STIR
+
+ConcurrentProjMatrixCache::
+ConcurrentProjMatrixCache()
+  : min_axial_pos_num(0), max_axial_pos_num(-1),
+    min_tangential_pos_num(0), max_tangential_pos_num(-1),
+    rows(0)
+{}
+
+ConcurrentProjMatrixCache::
+~ConcurrentProjMatrixCache()
+{
+  this->clear();
+}
+
+std::size_t
+ConcurrentProjMatrixCache::
+get_num_rows_in_table() const
+{
+  if (this->max_axial_pos_num < this->min_axial_pos_num ||
+      this->max_tangential_pos_num < this->min_tangential_pos_num)
+    return 0;
+  return
+    static_cast<std::size_t>(this->max_axial_pos_num - this->min_axial_pos_num + 1) *
+    (this->max_tangential_pos_num - this->min_tangential_pos_num + 1);
+}
+
+void
+ConcurrentProjMatrixCache::
+set_up(const int min_axial_pos_num_v, const int max_axial_pos_num_v,
+       const int min_tangential_pos_num_v, const int max_tangential_pos_num_v)
+{
+  this->clear();
+  this->min_axial_pos_num = min_axial_pos_num_v;
+  this->max_axial_pos_num = max_axial_pos_num_v;
+  this->min_tangential_pos_num = min_tangential_pos_num_v;
+  this->max_tangential_pos_num = max_tangential_pos_num_v;
+}
+
+void
+ConcurrentProjMatrixCache::
+clear()
+{
+  row_ptr_type * table = this->rows.exchange(0);
+  if (table == 0)
+    return;
+  const std::size_t num_rows_in_table = this->get_num_rows_in_table();
+  for (std::size_t i=0; i<num_rows_in_table; ++i)
+    delete table[i].load(std::memory_order_relaxed);
+  delete[] table;
+}
+
+long
+ConcurrentProjMatrixCache::
+row_index(const int axial_pos_num, const int tangential_pos_num) const
+{
+  if (axial_pos_num < this->min_axial_pos_num || axial_pos_num > this->max_axial_pos_num ||
+      tangential_pos_num < this->min_tangential_pos_num || tangential_pos_num > this->max_tangential_pos_num)
+    return -1;
+  return
+    static_cast<long>(axial_pos_num - this->min_axial_pos_num) *
+      (this->max_tangential_pos_num - this->min_tangential_pos_num + 1) +
+    (tangential_pos_num - this->min_tangential_pos_num);
+}
+
+void
+ConcurrentProjMatrixCache::
+store(const ProjMatrixElemsForOneBin& row)
+{
+  const Bin bin = row.get_bin();
+  const long index = this->row_index(bin.axial_pos_num(), bin.tangential_pos_num());
+  if (index < 0)
+    return;
+
+  row_ptr_type * table = this->rows.load(std::memory_order_acquire);
+  if (table == 0)
+    {
+      const std::size_t num_rows_in_table = this->get_num_rows_in_table();
+      row_ptr_type * new_table = new row_ptr_type[num_rows_in_table];
+      for (std::size_t i=0; i<num_rows_in_table; ++i)
+        new_table[i].store(0, std::memory_order_relaxed);
+      if (this->rows.compare_exchange_strong(table, new_table,
+                                             std::memory_order_acq_rel, std::memory_order_acquire))
+        table = new_table;
+      else
+        {
+          // another thread was first. Note that table now points to its table.
+          delete[] new_table;
+        }
+    }
+
+  if (table[index].load(std::memory_order_acquire) != 0)
+    return;
+  const ProjMatrixElemsForOneBin * new_row_ptr = new ProjMatrixElemsForOneBin(row);
+  const ProjMatrixElemsForOneBin * expected = 0;
+  if (!table[index].compare_exchange_strong(expected, new_row_ptr,
+                                            std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+      // another thread stored this row already
+      delete new_row_ptr;
+    }
+}
+
+Succeeded
+ConcurrentProjMatrixCache::
+get(ProjMatrixElemsForOneBin& row) const
+{
+  const Bin bin = row.get_bin();
+  const long index = this->row_index(bin.axial_pos_num(), bin.tangential_pos_num());
+  if (index < 0)
+    return Succeeded::no;
+  const row_ptr_type * table = this->rows.load(std::memory_order_acquire);
+  if (table == 0)
+    return Succeeded::no;
+  const ProjMatrixElemsForOneBin * row_ptr = table[index].load(std::memory_order_acquire);
+  if (row_ptr == 0)
+    return Succeeded::no;
+  row = *row_ptr;
+  return Succeeded::yes;
+}
+
+END_NAMESPACE_STIR
+
+#endif // STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
@@ -122,6 +122,16 @@ ForwardProjectorByBin::forward_project(ProjData& proj_data,
       RelatedViewgrams<float> viewgrams = 
         proj_data.get_empty_related_viewgrams(vs, symmetries_sptr);
       forward_project(viewgrams, image);	  
+      // writing in parallel without a critical section relies on every thread writing
+      // different related viewgrams, which is the case as the basic view/segment numbers
+      // in vs_nums_to_process have disjoint related viewgrams
+      // (see ProjData::supports_concurrent_access())
+      if (proj_data.supports_concurrent_access())
+        {
+          if (!(proj_data.set_related_viewgrams(viewgrams) == Succeeded::yes))
+            error("Error set_related_viewgrams in forward projecting");
+        }
+      else
 #ifdef STIR_OPENMP
 #pragma omp critical (FORWARDPROJ_SETVIEWGRAMS)
 #endif
@@ -38,6 +38,9 @@
 #include <algorithm>
 #include <vector>
 #include <list>
+#ifdef STIR_OPENMP
+#include <omp.h>
+#endif
 
 #ifndef STIR_NO_NAMESPACE
 using std::find;
@@ -158,49 +161,82 @@ ForwardProjectorByBinUsingProjMatrixByBin::
     // Faster when no caching is performed, about just as fast when there is caching, 
     // but of only basic bins.
     
-    ProjMatrixElemsForOneBin proj_matrix_row;
-    ProjMatrixElemsForOneBin proj_matrix_row_copy;
     const DataSymmetriesForBins* symmetries = proj_matrix_ptr->get_symmetries_ptr(); 
     
-    Array<2,int> 
-      already_processed(IndexRange2D(min_axial_pos_num, max_axial_pos_num,
-                                     min_tangential_pos_num, max_tangential_pos_num));
+    // first find all basic bins and the bins related to them
+    vector<Bin> basic_bins;
+    vector<vector<AxTangPosNumbers> > related_ax_tang_poss;
+    {
+      Array<2,int> 
+        already_processed(IndexRange2D(min_axial_pos_num, max_axial_pos_num,
+                                       min_tangential_pos_num, max_tangential_pos_num));
     
-    for ( int tang_pos = min_tangential_pos_num ;tang_pos  <= max_tangential_pos_num ;++tang_pos)  
-      for ( int ax_pos = min_axial_pos_num; ax_pos <= max_axial_pos_num ;++ax_pos)
-      {       
-        if (already_processed[ax_pos][tang_pos])
-          continue;          
+      for ( int tang_pos = min_tangential_pos_num ;tang_pos  <= max_tangential_pos_num ;++tang_pos)  
+        for ( int ax_pos = min_axial_pos_num; ax_pos <= max_axial_pos_num ;++ax_pos)
+        {       
+          if (already_processed[ax_pos][tang_pos])
+            continue;          
         
-        Bin basic_bin(viewgrams.get_basic_segment_num(),viewgrams.get_basic_view_num(),ax_pos,tang_pos);
-        symmetries->find_basic_bin(basic_bin);
+          Bin basic_bin(viewgrams.get_basic_segment_num(),viewgrams.get_basic_view_num(),ax_pos,tang_pos);
+          symmetries->find_basic_bin(basic_bin);
         
-        proj_matrix_ptr->get_proj_matrix_elems_for_one_bin(proj_matrix_row, basic_bin);
+          vector<AxTangPosNumbers> r_ax_poss;
+          symmetries->get_related_bins_factorised(r_ax_poss,basic_bin,
+                                                  min_axial_pos_num, max_axial_pos_num,
+                                                  min_tangential_pos_num, max_tangential_pos_num);
         
-        vector<AxTangPosNumbers> r_ax_poss;
-        symmetries->get_related_bins_factorised(r_ax_poss,basic_bin,
-                                                min_axial_pos_num, max_axial_pos_num,
-                                                min_tangential_pos_num, max_tangential_pos_num);
+          basic_bins.push_back(basic_bin);
+          related_ax_tang_poss.push_back(vector<AxTangPosNumbers>());
+          for (
+#ifndef STIR_NO_NAMESPACES
+            std::
+#endif
+              vector<AxTangPosNumbers>::iterator r_ax_poss_iter = r_ax_poss.begin();
+            r_ax_poss_iter != r_ax_poss.end();
+            ++r_ax_poss_iter)
+          {
+            const int axial_pos_tmp = (*r_ax_poss_iter)[1];
+            const int tang_pos_tmp = (*r_ax_poss_iter)[2];
+          
+            // symmetries might take the ranges out of what the user wants
+            if ( !(min_axial_pos_num <= axial_pos_tmp && axial_pos_tmp <= max_axial_pos_num &&
+                   min_tangential_pos_num <=tang_pos_tmp  && tang_pos_tmp <= max_tangential_pos_num))
+              continue;
+          
+            already_processed[axial_pos_tmp][tang_pos_tmp] = 1;
+            related_ax_tang_poss.back().push_back(*r_ax_poss_iter);
+          }
+        }      
+      assert(already_processed.sum() == (
+                (max_axial_pos_num - min_axial_pos_num + 1) *
+                (max_tangential_pos_num - min_tangential_pos_num + 1)));      
+    }
+
+    // now compute the rows for the basic bins and forward project.
+    // Every basic bin writes to different elements of the viewgrams, so we can do
+    // this in parallel (unless we are called from a parallel region already).
+    const int num_basic_bins = static_cast<int>(basic_bins.size());
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic) if(!omp_in_parallel()) shared(viewgrams, image, symmetries, basic_bins, related_ax_tang_poss)
+#endif
+    for (int i=0; i<num_basic_bins; ++i)
+      {
+        ProjMatrixElemsForOneBin proj_matrix_row;
+        ProjMatrixElemsForOneBin proj_matrix_row_copy;
+        const Bin& basic_bin = basic_bins[i];
+        proj_matrix_ptr->get_proj_matrix_elems_for_one_bin(proj_matrix_row, basic_bin);
         
         for (
 #ifndef STIR_NO_NAMESPACES
           std::
 #endif
-            vector<AxTangPosNumbers>::iterator r_ax_poss_iter = r_ax_poss.begin();
-          r_ax_poss_iter != r_ax_poss.end();
+            vector<AxTangPosNumbers>::const_iterator r_ax_poss_iter = related_ax_tang_poss[i].begin();
+          r_ax_poss_iter != related_ax_tang_poss[i].end();
           ++r_ax_poss_iter)
         {
           const int axial_pos_tmp = (*r_ax_poss_iter)[1];
           const int tang_pos_tmp = (*r_ax_poss_iter)[2];
           
-          // symmetries might take the ranges out of what the user wants
-          if ( !(min_axial_pos_num <= axial_pos_tmp && axial_pos_tmp <= max_axial_pos_num &&
-                 min_tangential_pos_num <=tang_pos_tmp  && tang_pos_tmp <= max_tangential_pos_num))
-            continue;
-          
-          already_processed[axial_pos_tmp][tang_pos_tmp] = 1;
-          
-          
           for (RelatedViewgrams<float>::iterator viewgram_iter = viewgrams.begin();
                viewgram_iter != viewgrams.end();
                ++viewgram_iter)
@@ -223,9 +259,6 @@ ForwardProjectorByBinUsingProjMatrixByBin::
           }
         }  
       }      
-      assert(already_processed.sum() == (
-                (max_axial_pos_num - min_axial_pos_num + 1) *
-                (max_tangential_pos_num - min_tangential_pos_num + 1)));      
   }
 }
 
@@ -36,6 +36,7 @@
 #include "stir/is_null_ptr.h"
 #include "stir/info.h"
 #include <algorithm>
+#include <cmath>
 using std::min;
 using std::max;
 
@@ -92,7 +93,10 @@ PLSPrior<elemT>::set_up (shared_ptr<DiscretisedDensity<3,elemT> > const& target_
     this->set_anatomical_grad_sptr (anatomical_im_grad_y_sptr,1);
     this->set_anatomical_grad_sptr (anatomical_im_grad_x_sptr,2);
 
-    compute_normalisation_anatomical_gradient (*norm_sptr,*anatomical_im_grad_z_sptr,*anatomical_im_grad_y_sptr,*anatomical_im_grad_x_sptr );
+    // in 2D, the z-gradient is not used (and not allocated), so pass the y-gradient instead
+    compute_normalisation_anatomical_gradient (*norm_sptr,
+                                               only_2D ? *anatomical_im_grad_y_sptr : *anatomical_im_grad_z_sptr,
+                                               *anatomical_im_grad_y_sptr,*anatomical_im_grad_x_sptr );
 
     this->set_anatomical_grad_norm_sptr (shared_ptr<DiscretisedDensity<3,elemT> >(norm_sptr));
 
@@ -152,9 +156,9 @@ PLSPrior<elemT>::PLSPrior()
 
 template <typename elemT>
 PLSPrior<elemT>::PLSPrior(const bool only_2D_v, float penalisation_factor_v)
-  :  only_2D(only_2D_v)
 {
   set_defaults();
+  this->only_2D = only_2D_v;
   this->penalisation_factor = penalisation_factor_v;
 }
 
@@ -381,66 +385,140 @@ PLSPrior<elemT>::compute_normalisation_anatomical_gradient(DiscretisedDensity<3,
 template <typename elemT>
 void
 PLSPrior<elemT>::
-compute_inner_product_and_penalty(DiscretisedDensity<3,elemT> &inner_product,
-                                  DiscretisedDensity<3,elemT> &penalty,
-                                  DiscretisedDensity<3,elemT> &pet_im_grad_z,
-                                  DiscretisedDensity<3,elemT> &pet_im_grad_y,
-                                  DiscretisedDensity<3,elemT> &pet_im_grad_x,
-                      const DiscretisedDensity<3,elemT> &pet_image){
-
-
-
-    if(!only_2D)
-    compute_image_gradient_element (pet_im_grad_z,0,pet_image);
-
-    compute_image_gradient_element (pet_im_grad_y,1,pet_image);
-    compute_image_gradient_element (pet_im_grad_x,2,pet_image);
-
-
-    const int min_z = pet_image.get_min_index();
-    const int max_z = pet_image.get_max_index();
-
-
-        for (int z=min_z; z<=max_z; z++)
-          {
-
-            const int min_y = pet_image[z].get_min_index();
-            const int max_y = pet_image[z].get_max_index();
-
-
-
-              for (int y=min_y;y<= max_y;y++)
-                {
-
-                  const int min_x = pet_image[z][y].get_min_index();
-                  const int max_x = pet_image[z][y].get_max_index();
-
-
+compute_inner_product_and_penalty_for_row(Array<1,elemT> &inner_product,
+                                          Array<1,elemT> &penalty,
+                                          Array<1,elemT> &pet_im_grad_z,
+                                          Array<1,elemT> &pet_im_grad_y,
+                                          Array<1,elemT> &pet_im_grad_x,
+                                          const DiscretisedDensity<3,elemT> &pet_image,
+                                          const int z, const int y) const
+{
+  const Array<1,elemT>& row = pet_image[z][y];
+  const int min_x = row.get_min_index();
+  const int max_x = row.get_max_index();
+  const IndexRange<1> range = row.get_index_range();
+  if (!(inner_product.get_index_range() == range))
+    {
+      inner_product.resize(min_x, max_x);
+      penalty.resize(min_x, max_x);
+      pet_im_grad_z.resize(min_x, max_x);
+      pet_im_grad_y.resize(min_x, max_x);
+      pet_im_grad_x.resize(min_x, max_x);
+    }
 
-                    for (int x=min_x;x<= max_x;x++)
-                    {
-                        if(only_2D){
-                            inner_product[z][y][x]   = ((pet_im_grad_y[z][y][x]*(*anatomical_grad_y_sptr)[z][y][x]/(*get_norm_sptr())[z][y][x]) +
-                                                        (pet_im_grad_x[z][y][x]*(*anatomical_grad_x_sptr)[z][y][x]/(*get_norm_sptr())[z][y][x]));
+  // forward differences, which are set to 0 at the last voxel in every direction
+  // (as in compute_image_gradient_element())
+  pet_im_grad_x[max_x] = 0;
+  for (int x=min_x; x<max_x; ++x)
+    pet_im_grad_x[x] = row[x+1] - row[x];
+  if (y < pet_image[z].get_max_index())
+    {
+      const Array<1,elemT>& next_row = pet_image[z][y+1];
+      for (int x=min_x; x<=max_x; ++x)
+        pet_im_grad_y[x] = next_row[x] - row[x];
+    }
+  else
+    pet_im_grad_y.fill(0);
+  if (!only_2D && z < pet_image.get_max_index())
+    {
+      const Array<1,elemT>& next_row = pet_image[z+1][y];
+      for (int x=min_x; x<=max_x; ++x)
+        pet_im_grad_z[x] = next_row[x] - row[x];
+    }
+  else
+    pet_im_grad_z.fill(0);
 
-                            penalty[z][y][x]= sqrt (square(this->alpha) + square(pet_im_grad_y[z][y][x]) +
-                                                                              square(pet_im_grad_x[z][y][x]) -
-                                                                              square(inner_product[z][y][x]));
-                        }
-                        else{
-                     inner_product[z][y][x]   = (pet_im_grad_z[z][y][x]*(*anatomical_grad_z_sptr)[z][y][x] +
-                                                 pet_im_grad_y[z][y][x]*(*anatomical_grad_y_sptr)[z][y][x] +
-                                                 pet_im_grad_x[z][y][x]*(*anatomical_grad_x_sptr)[z][y][x])/(*get_norm_sptr())[z][y][x];
-
-                     penalty[z][y][x]= sqrt (square(this->alpha) + square(pet_im_grad_z[z][y][x]) +
-                                                                       square(pet_im_grad_y[z][y][x]) +
-                                                                       square(pet_im_grad_x[z][y][x]) -
-                                                                       square(inner_product[z][y][x]));
-                        }
-                    }
-                 }
-          }
+  /* The loops below use pointers to the start of the rows, and a local copy of alpha^2.
+     Every loop writes only 1 row. This keeps the number of run-time aliasing checks small
+     enough for the compiler to vectorise the loops.
+  */
+  const int num_x = max_x - min_x + 1;
+  const elemT alpha_squared = static_cast<elemT>(square(this->alpha));
+  const elemT * const grad_z = &pet_im_grad_z[min_x];
+  const elemT * const grad_y = &pet_im_grad_y[min_x];
+  const elemT * const grad_x = &pet_im_grad_x[min_x];
+  const elemT * const anatomical_grad_y = &(*anatomical_grad_y_sptr)[z][y][min_x];
+  const elemT * const anatomical_grad_x = &(*anatomical_grad_x_sptr)[z][y][min_x];
+  const elemT * const norm = &(*get_norm_sptr())[z][y][min_x];
+  elemT * const inner_product_row = &inner_product[min_x];
+  elemT * const penalty_row = &penalty[min_x];
+  if (only_2D)
+    {
+      for (int i=0; i<num_x; ++i)
+        inner_product_row[i] =
+          (grad_y[i]*anatomical_grad_y[i] + grad_x[i]*anatomical_grad_x[i])/norm[i];
+      for (int i=0; i<num_x; ++i)
+        penalty_row[i] = std::sqrt(alpha_squared + square(grad_y[i]) + square(grad_x[i]) -
+                                   square(inner_product_row[i]));
+    }
+  else
+    {
+      const elemT * const anatomical_grad_z = &(*anatomical_grad_z_sptr)[z][y][min_x];
+      for (int i=0; i<num_x; ++i)
+        inner_product_row[i] =
+          (grad_z[i]*anatomical_grad_z[i] + grad_y[i]*anatomical_grad_y[i] +
+           grad_x[i]*anatomical_grad_x[i])/norm[i];
+      for (int i=0; i<num_x; ++i)
+        penalty_row[i] = std::sqrt(alpha_squared + square(grad_z[i]) + square(grad_y[i]) +
+                                   square(grad_x[i]) - square(inner_product_row[i]));
+    }
+}
 
+template <typename elemT>
+void
+PLSPrior<elemT>::
+compute_normalised_gradient_for_plane(Array<2,elemT> &normalised_grad_z,
+                                      Array<2,elemT> &normalised_grad_y,
+                                      Array<2,elemT> &normalised_grad_x,
+                                      const DiscretisedDensity<3,elemT> &pet_image,
+                                      const int z) const
+{
+  const IndexRange<2> range = pet_image[z].get_index_range();
+  // avoid reallocation when the arrays already have the correct size
+  if (!only_2D && normalised_grad_z.get_index_range() != range)
+    normalised_grad_z.resize(range);
+  if (normalised_grad_y.get_index_range() != range)
+    normalised_grad_y.resize(range);
+  if (normalised_grad_x.get_index_range() != range)
+    normalised_grad_x.resize(range);
+
+  Array<1,elemT> inner_product, penalty, pet_im_grad_z, pet_im_grad_y, pet_im_grad_x;
+  for (int y=pet_image[z].get_min_index(); y<=pet_image[z].get_max_index(); ++y)
+    {
+      compute_inner_product_and_penalty_for_row(inner_product, penalty,
+                                                pet_im_grad_z, pet_im_grad_y, pet_im_grad_x,
+                                                pet_image, z, y);
+      const int min_x = pet_image[z][y].get_min_index();
+      const int num_x = pet_image[z][y].get_length();
+      if (num_x == 0)
+        continue;
+      // use pointers to the start of the rows, and write only 1 row per loop,
+      // such that the loops can be vectorised (see compute_inner_product_and_penalty_for_row())
+      const elemT * const anatomical_grad_y = &(*anatomical_grad_y_sptr)[z][y][min_x];
+      const elemT * const anatomical_grad_x = &(*anatomical_grad_x_sptr)[z][y][min_x];
+      const elemT * const norm = &(*get_norm_sptr())[z][y][min_x];
+      const elemT * const inner_product_row = &inner_product[min_x];
+      const elemT * const penalty_row = &penalty[min_x];
+      const elemT * const grad_y = &pet_im_grad_y[min_x];
+      const elemT * const grad_x = &pet_im_grad_x[min_x];
+      elemT * const normalised_grad_y_row = &normalised_grad_y[y][min_x];
+      elemT * const normalised_grad_x_row = &normalised_grad_x[y][min_x];
+      for (int i=0; i<num_x; ++i)
+        normalised_grad_y_row[i] =
+          (grad_y[i]-anatomical_grad_y[i]*inner_product_row[i]/norm[i])/penalty_row[i];
+      for (int i=0; i<num_x; ++i)
+        normalised_grad_x_row[i] =
+          (grad_x[i]-anatomical_grad_x[i]*inner_product_row[i]/norm[i])/penalty_row[i];
+      if (!only_2D)
+        {
+          const elemT * const anatomical_grad_z = &(*anatomical_grad_z_sptr)[z][y][min_x];
+          const elemT * const grad_z = &pet_im_grad_z[min_x];
+          elemT * const normalised_grad_z_row = &normalised_grad_z[y][min_x];
+          for (int i=0; i<num_x; ++i)
+            normalised_grad_z_row[i] =
+              (grad_z[i]-anatomical_grad_z[i]*inner_product_row[i]/norm[i])/penalty_row[i];
+        }
+    }
 }
 
 template <typename elemT>
@@ -455,63 +533,53 @@ compute_value(const DiscretisedDensity<3,elemT> &current_image_estimate)
 
   this->check(current_image_estimate);
 
-  shared_ptr<DiscretisedDensity<3,elemT> > pet_im_grad_z_sptr;
-  if(!only_2D)
-  pet_im_grad_z_sptr.reset(this->anatomical_sptr->get_empty_copy ());
-
-  shared_ptr<DiscretisedDensity<3,elemT> > pet_im_grad_y_sptr(this->anatomical_sptr->get_empty_copy ());
-  shared_ptr<DiscretisedDensity<3,elemT> > pet_im_grad_x_sptr(this->anatomical_sptr->get_empty_copy ());
-
-  shared_ptr<DiscretisedDensity<3,elemT> > inner_product_sptr(this->anatomical_sptr.get ()->get_empty_copy ());
-  shared_ptr<DiscretisedDensity<3,elemT> > penalty_sptr(this->anatomical_sptr.get ()->get_empty_copy ());
-
-  compute_inner_product_and_penalty (*inner_product_sptr,
-                                     *penalty_sptr,
-                                     *pet_im_grad_z_sptr,
-                                     *pet_im_grad_y_sptr,
-                                     *pet_im_grad_x_sptr,
-                                     current_image_estimate);
-
   const bool do_kappa = !is_null_ptr(kappa_ptr);
 
   if (do_kappa && !kappa_ptr->has_same_characteristics(current_image_estimate))
     error("PLSPrior: kappa image has not the same index range as the reconstructed image\n");
 
+  /* formula:
+     sum_x,y,z
+       (penalty[z][y][x]) * (*kappa_ptr)[z][y][x];
 
+     The penalty is computed row by row, such that no temporary images are needed.
+  */
   double result = 0.;
   const int min_z = current_image_estimate.get_min_index();
   const int max_z = current_image_estimate.get_max_index();
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:result)
+#endif
   for (int z=min_z; z<=max_z; z++)
     {
+      Array<1,elemT> inner_product, penalty, pet_im_grad_z, pet_im_grad_y, pet_im_grad_x;
 
       const int min_y = current_image_estimate[z].get_min_index();
       const int max_y = current_image_estimate[z].get_max_index();
 
-        for (int y=min_y;y<= max_y;y++)
-          {
-
-            const int min_x = current_image_estimate[z][y].get_min_index();
-            const int max_x = current_image_estimate[z][y].get_max_index();
-
-            for (int x=min_x;x<= max_x;x++)
-              {
-
-                /* formula:
-                  sum_x,y,z
-
-                   (penalty[z][y][x]) * (*kappa_ptr)[z][y][x];
-                */
-
-                        elemT current = (*penalty_sptr)[z][y][x];
-
-                        if (do_kappa)
-                          current *=
-                            (*kappa_ptr)[z][y][x] ;
+      for (int y=min_y;y<= max_y;y++)
+        {
+          compute_inner_product_and_penalty_for_row(inner_product, penalty,
+                                                    pet_im_grad_z, pet_im_grad_y, pet_im_grad_x,
+                                                    current_image_estimate, z, y);
 
-                        result += static_cast<double>(current);
+          const int min_x = current_image_estimate[z][y].get_min_index();
+          const int max_x = current_image_estimate[z][y].get_max_index();
 
-              }
-          }
+          double row_result = 0.;
+          if (do_kappa)
+            {
+              const Array<1,elemT>& kappa = (*kappa_ptr)[z][y];
+              for (int x=min_x;x<= max_x;x++)
+                row_result += static_cast<double>(penalty[x] * kappa[x]);
+            }
+          else
+            {
+              for (int x=min_x;x<= max_x;x++)
+                row_result += static_cast<double>(penalty[x]);
+            }
+          result += row_result;
+        }
     }
   return result * this->penalisation_factor;
 }
@@ -530,133 +598,108 @@ compute_gradient(DiscretisedDensity<3,elemT>& prior_gradient,
     return;
   }
 
-  shared_ptr<DiscretisedDensity<3,elemT> > pet_im_grad_z_sptr;
-  shared_ptr<DiscretisedDensity<3,elemT> > gradientz_sptr;
-
-  if(!only_2D){
-  pet_im_grad_z_sptr.reset(this->anatomical_sptr->get_empty_copy ());
-  gradientz_sptr.reset(this->anatomical_sptr->get_empty_copy ());
-  }
-
-  shared_ptr<DiscretisedDensity<3,elemT> > pet_im_grad_y_sptr(this->anatomical_sptr->get_empty_copy ());
-  shared_ptr<DiscretisedDensity<3,elemT> > pet_im_grad_x_sptr(this->anatomical_sptr->get_empty_copy ());
-
-  shared_ptr<DiscretisedDensity<3,elemT> > inner_product_sptr(this->anatomical_sptr->get_empty_copy ());
-  shared_ptr<DiscretisedDensity<3,elemT> > penalty_sptr(this->anatomical_sptr->get_empty_copy ());
-
-  shared_ptr<DiscretisedDensity<3,elemT> > gradienty_sptr(this->anatomical_sptr->get_empty_copy ());
-  shared_ptr<DiscretisedDensity<3,elemT> > gradientx_sptr(this->anatomical_sptr->get_empty_copy ());
-
-  compute_inner_product_and_penalty (*inner_product_sptr,
-                                     *penalty_sptr,
-                                     *pet_im_grad_z_sptr,
-                                     *pet_im_grad_y_sptr,
-                                     *pet_im_grad_x_sptr,
-                                     current_image_estimate);
-
-
   const bool do_kappa = !is_null_ptr(kappa_ptr);
   if (do_kappa && !kappa_ptr->has_same_characteristics(current_image_estimate))
     error("PLSPrior: kappa image has not the same index range as the reconstructed image\n");
- shared_ptr<DiscretisedDensity<3,elemT> > gradient_sptr(this->anatomical_sptr->get_empty_copy ());
-
-  const int min_z = current_image_estimate.get_min_index();
-  const int max_z = current_image_estimate.get_max_index();
-
-  for (int z=min_z; z<=max_z; z++)
-    {
 
-      const int min_y = current_image_estimate[z].get_min_index();
-      const int max_y = current_image_estimate[z].get_max_index();
-
-      for (int y=min_y;y<= max_y;y++)
-        {
+  /* formula:
+     - div (pet_im_grad-inner_product*anatomical_im_grad/norm)/penalty * (*kappa_ptr)
 
+     where the divergence is computed with backward differences. The argument of the
+     divergence ("normalised gradient") is computed plane by plane. We only need to keep
+     the z-component of the previous plane, such that no temporary images are needed.
+     Planes are processed in blocks (in parallel), where every block first computes the
+     normalised gradient of the plane before the block.
 
-          const int min_x = current_image_estimate[z][y].get_min_index();
-          const int max_x = current_image_estimate[z][y].get_max_index();
-
-          for (int x=min_x;x<= max_x;x++)
-            {
-
-              if(x+1>max_x || y+1>max_y ||(z+1>max_z && !only_2D))
-                  continue;
-
-                /* formula:
-                  sum_x,y,z
-                   div * (pet_im_grad[z][y][x]-inner_product[z][y][x]*anatomical_im_grad[z][y][x]/(*get_norm_sptr ())[z][y][x])*
-                   (*kappa_ptr)[z][y][x] /penalty[z][y][x];
-                */
-
-              if(only_2D){
-                  (*gradientx_sptr)[z][y][x+1] =
-                     (((*pet_im_grad_x_sptr)[z][y][x+1]-(*anatomical_grad_x_sptr)[z][y][x+1]*(*inner_product_sptr)[z][y][x+1]/
-                          (*get_norm_sptr ())[z][y][x+1])/(*penalty_sptr)[z][y][x+1] -
-                     (((*pet_im_grad_x_sptr)[z][y][x]-(*anatomical_grad_x_sptr)[z][y][x]*(*inner_product_sptr)[z][y][x]/(*get_norm_sptr ())[z][y][x])/
-                      (*penalty_sptr)[z][y][x]) );
-
-                  (*gradienty_sptr)[z][y+1][x] =
-                      (((*pet_im_grad_y_sptr)[z][y+1][x]-(*anatomical_grad_y_sptr)[z][y+1][x]*(*inner_product_sptr)[z][y+1][x]/
-                          (*get_norm_sptr ())[z][y+1][x])/(*penalty_sptr)[z][y+1][x] -
-                      (((*pet_im_grad_y_sptr)[z][y][x]-(*anatomical_grad_y_sptr)[z][y][x]*(*inner_product_sptr)[z][y][x]/(*get_norm_sptr ())[z][y][x])/
-                       (*penalty_sptr)[z][y][x]) );
-              }
-              else{
-
-                  (*gradientx_sptr)[z][y][x+1] =
-                          (((*pet_im_grad_x_sptr)[z][y][x+1]-(*anatomical_grad_x_sptr)[z][y][x+1]*(*inner_product_sptr)[z][y][x+1]/(*get_norm_sptr ())[z][y][x+1])/
-                          (*penalty_sptr)[z][y][x+1] -
-                          ((*pet_im_grad_x_sptr)[z][y][x]-(*anatomical_grad_x_sptr)[z][y][x]*(*inner_product_sptr)[z][y][x]/(*get_norm_sptr ())[z][y][x])/
-                          (*penalty_sptr)[z][y][x]);
-
-                  (*gradienty_sptr)[z][y+1][x] =
-                          (((*pet_im_grad_y_sptr)[z][y+1][x]-(*anatomical_grad_y_sptr)[z][y+1][x]*(*inner_product_sptr)[z][y+1][x]/
-                          (*get_norm_sptr ())[z][y+1][x])/(*penalty_sptr)[z][y+1][x] -
-                          (((*pet_im_grad_y_sptr)[z][y][x]-(*anatomical_grad_y_sptr)[z][y][x]*(*inner_product_sptr)[z][y][x]/
-                            (*get_norm_sptr ())[z][y][x])/(*penalty_sptr)[z][y][x]) );
-
-                  (*gradientz_sptr)[z+1][y][x] =
-                      (((*pet_im_grad_z_sptr)[z+1][y][x]-(*anatomical_grad_z_sptr)[z+1][y][x]*(*inner_product_sptr)[z+1][y][x]/
-                          (*get_norm_sptr ())[z+1][y][x])/(*penalty_sptr)[z+1][y][x] -
-                          (((*pet_im_grad_z_sptr)[z][y][x]-(*anatomical_grad_z_sptr)[z][y][x]*(*inner_product_sptr)[z][y][x]/
-                            (*get_norm_sptr ())[z][y][x])/(*penalty_sptr)[z][y][x]) );
-              }
-              }}}
+     Note that the normalised gradient is only used where the forward differences are
+     defined for all directions, and the divergence is set to 0 at the first voxel in every
+     direction.
+  */
+  const int min_z = current_image_estimate.get_min_index();
+  const int max_z = current_image_estimate.get_max_index();
+  const int num_planes_per_block = 8;
+  const int num_blocks = (max_z - min_z + num_planes_per_block)/num_planes_per_block;
 
-  for (int z=min_z; z<=max_z; z++)
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int block_num=0; block_num<num_blocks; ++block_num)
     {
+      const int start_z = min_z + block_num*num_planes_per_block;
+      const int end_z = min(max_z, start_z + num_planes_per_block - 1);
 
-      const int min_y = current_image_estimate[z].get_min_index();
-      const int max_y = current_image_estimate[z].get_max_index();
+      Array<2,elemT> normalised_grad_z, normalised_grad_y, normalised_grad_x;
+      Array<2,elemT> previous_normalised_grad_z;
+      if (!only_2D && start_z > min_z)
+        compute_normalised_gradient_for_plane(previous_normalised_grad_z,
+                                              normalised_grad_y, normalised_grad_x,
+                                              current_image_estimate, start_z-1);
 
-      for (int y=min_y;y<= max_y;y++)
+      for (int z=start_z; z<=end_z; z++)
         {
+          compute_normalised_gradient_for_plane(normalised_grad_z, normalised_grad_y, normalised_grad_x,
+                                                current_image_estimate, z);
+          const bool has_next_plane = only_2D || z < max_z;
+          const bool has_previous_plane = !only_2D && z > min_z;
 
+          const int min_y = current_image_estimate[z].get_min_index();
+          const int max_y = current_image_estimate[z].get_max_index();
 
-          const int min_x = current_image_estimate[z][y].get_min_index();
-          const int max_x = current_image_estimate[z][y].get_max_index();
-
-          for (int x=min_x;x<= max_x;x++)
+          for (int y=min_y;y<= max_y;y++)
             {
-              if(only_2D){
-
-              (*gradient_sptr)[z][y][x] = -((*gradienty_sptr)[z][y][x] + (*gradientx_sptr)[z][y][x]);
-
-              }
-              else{
-
-              (*gradient_sptr)[z][y][x] = -((*gradientz_sptr)[z][y][x] + (*gradienty_sptr)[z][y][x] + (*gradientx_sptr)[z][y][x]);
-
-              }
-
+              const int min_x = current_image_estimate[z][y].get_min_index();
+              const int max_x = current_image_estimate[z][y].get_max_index();
+              const int num_x = max_x - min_x + 1;
+              if (num_x <= 0)
+                continue;
+
+              /* The terms of the divergence are only added where they are defined (see above).
+                 We handle that with the loop bounds (and by setting the row to 0 first),
+                 such that the loops do not need any checks and can be vectorised.
+              */
+              elemT * const gradient_row = &prior_gradient[z][y][min_x];
+              std::fill(gradient_row, gradient_row + num_x, static_cast<elemT>(0));
+              if (y < max_y && has_next_plane)
+                {
+                  // x-term, for x > min_x
+                  const elemT * const grad_x = &normalised_grad_x[y][min_x];
+                  for (int i=1; i<num_x; ++i)
+                    gradient_row[i] -= grad_x[i] - grad_x[i-1];
+                }
+              if (y > min_y && has_next_plane)
+                {
+                  // y-term, for x < max_x
+                  const elemT * const grad_y = &normalised_grad_y[y][min_x];
+                  const elemT * const previous_grad_y = &normalised_grad_y[y-1][min_x];
+                  for (int i=0; i<num_x-1; ++i)
+                    gradient_row[i] -= grad_y[i] - previous_grad_y[i];
+                }
+              if (has_previous_plane && y < max_y)
+                {
+                  // z-term, for x < max_x
+                  const elemT * const grad_z = &normalised_grad_z[y][min_x];
+                  const elemT * const previous_grad_z = &previous_normalised_grad_z[y][min_x];
+                  for (int i=0; i<num_x-1; ++i)
+                    gradient_row[i] -= grad_z[i] - previous_grad_z[i];
+                }
+
+              const elemT penalisation_factor = static_cast<elemT>(this->penalisation_factor);
               if (do_kappa)
-                  (*gradient_sptr)[z][y][x] *=
-                  (*kappa_ptr)[z][y][x] ;
-
-
-
-                        prior_gradient[z][y][x]= (*gradient_sptr)[z][y][x] * this->penalisation_factor;
-            }}}
+                {
+                  const elemT * const kappa_row = &(*kappa_ptr)[z][y][min_x];
+                  for (int i=0; i<num_x; ++i)
+                    gradient_row[i] *= kappa_row[i] * penalisation_factor;
+                }
+              else
+                {
+                  for (int i=0; i<num_x; ++i)
+                    gradient_row[i] *= penalisation_factor;
+                }
+            }
+          if (!only_2D)
+            previous_normalised_grad_z.swap(normalised_grad_z);
+        }
+    }
 
   info(boost::format("Prior gradient max %1%, min %2%\n") % prior_gradient.find_max() % prior_gradient.find_min());
 
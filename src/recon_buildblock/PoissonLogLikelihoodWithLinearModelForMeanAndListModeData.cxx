@@ -144,13 +144,15 @@ Succeeded
 PoissonLogLikelihoodWithLinearModelForMeanAndListModeData<TargetT>::
 set_up(shared_ptr <TargetT > const& target_sptr)
 {
-  if ( base_type::set_up(target_sptr) != Succeeded::yes)
-    return Succeeded::no;
-
   // handle time frame definitions etc
+  // note: this has to be done before calling set_up of the base class, as derived classes
+  // might read the listmode data there
     if(this->num_events_to_use==0 && this->frame_defs_filename.size() == 0)
       do_time_frame = true;
  
+  if ( base_type::set_up(target_sptr) != Succeeded::yes)
+    return Succeeded::no;
+
     return Succeeded::yes;
 }
 
@@ -43,8 +43,15 @@
 #include "stir/recon_array_functions.h"
 
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <sstream>
+#include <cstdio>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 #include "stir/stream.h"
 
 #include "stir/recon_buildblock/ForwardProjectorByBinUsingProjMatrixByBin.h"
@@ -55,6 +62,9 @@
 #ifdef STIR_MPI
 #include "stir/recon_buildblock/distributed_functions.h"
 #endif
+#ifdef STIR_OPENMP
+#include <omp.h>
+#endif
 
 
 #include <vector>
@@ -65,6 +75,11 @@ const char * const
 PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>::
 registered_name = 
 "PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin";
+
+template<typename TargetT>
+const std::size_t
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>::
+num_events_per_batch;
  
 template <typename TargetT> 
 PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>:: 
@@ -86,6 +101,17 @@ set_defaults()
 
   this->normalisation_sptr.reset(new TrivialBinNormalisation);
   this->do_time_frame = false;
+  this->use_event_cache = false;
+  this->event_cache_directory = "";
+  this->event_cache_frame_num = 0;
+  this->num_event_cache_files = 0;
+} 
+
+template <typename TargetT> 
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>:: 
+~PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin() 
+{ 
+  this->remove_event_cache_files();
 } 
  
 template <typename TargetT> 
@@ -101,6 +127,8 @@ initialise_keymap()
   this->parser.add_key("additive sinogram",&this->additive_projection_data_filename); 
  
   this->parser.add_key("num_events_to_use",&this->num_events_to_use);
+  this->parser.add_key("use event cache", &this->use_event_cache);
+  this->parser.add_key("event cache directory", &this->event_cache_directory);
 } 
 template <typename TargetT> 
 int 
@@ -224,6 +252,10 @@ set_up_before_sensitivity(shared_ptr <TargetT > const& target_sptr)
             return Succeeded::no;
         }
 
+    this->event_cache_frame_num = 0;
+    if (this->use_event_cache)
+      this->cache_listmode_events();
+
     return Succeeded::yes;
 } 
  
@@ -402,6 +434,300 @@ construct_target_ptr() const
    this->target_parameter_parser.create(this->get_input_data());
 } 
  
+template <typename TargetT>
+Succeeded
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>::
+read_next_prompt_bin(Bin& measured_bin, CListRecord& record,
+                     const double start_time, const double end_time) const
+{
+  double current_time = 0.;
+
+  while (true)
+    {
+      if (this->list_mode_data_sptr->get_next_record(record) == Succeeded::no)
+        {
+          info("End of file!");
+          return Succeeded::no;
+        }
+
+      if(record.is_time() && end_time > 0.01)
+        {
+          current_time = record.time().get_time_in_secs();
+          if (this->do_time_frame && current_time >= end_time)
+            return Succeeded::no;
+          if (current_time < start_time)
+            continue;
+        }
+
+      if (record.is_event() && record.event().is_prompt())
+        {
+          measured_bin.set_bin_value(1.0f);
+          record.event().get_bin(measured_bin, *proj_data_info_sptr);
+
+          if (measured_bin.get_bin_value() != 1.0f
+              || measured_bin.segment_num() < proj_data_info_sptr->get_min_segment_num()
+              || measured_bin.segment_num()  > proj_data_info_sptr->get_max_segment_num()
+              || measured_bin.tangential_pos_num() < proj_data_info_sptr->get_min_tangential_pos_num()
+              || measured_bin.tangential_pos_num() > proj_data_info_sptr->get_max_tangential_pos_num()
+              || measured_bin.axial_pos_num() < proj_data_info_sptr->get_min_axial_pos_num(measured_bin.segment_num())
+              || measured_bin.axial_pos_num() > proj_data_info_sptr->get_max_axial_pos_num(measured_bin.segment_num()))
+            {
+              continue;
+            }
+
+          measured_bin.set_bin_value(1.0f);
+          return Succeeded::yes;
+        }
+    }
+}
+
+template <typename TargetT>
+int
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>::
+find_subset_num(const Bin& measured_bin) const
+{
+  if (this->num_subsets == 1)
+    return 0;
+  Bin basic_bin = measured_bin;
+  if (!this->PM_sptr->get_symmetries_ptr()->find_basic_bin(basic_bin))
+    return -1;
+  return static_cast<int>(basic_bin.view_num() % this->num_subsets);
+}
+
+template <typename TargetT>
+bool
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>::
+read_batch_of_events(std::vector<Bin>& bins, std::vector<float>& additive_values,
+                     CListRecord& record,
+                     long int& more_events, long& num_used_events,
+                     const double start_time, const double end_time,
+                     const int subset_num) const
+{
+  bins.clear();
+  additive_values.clear();
+
+  while (more_events && bins.size() < num_events_per_batch)
+    {
+      Bin measured_bin;
+      if (this->read_next_prompt_bin(measured_bin, record, start_time, end_time) == Succeeded::no)
+        return false;
+
+      // If more than 1 subsets, check if the current bin belongs to
+      // the current.
+      if (this->find_subset_num(measured_bin) != subset_num)
+        continue;
+
+      // additive sinogram
+      // Note: this is done here (and not in the threads doing the projections)
+      // as ProjDataInMemory::get_bin_value is not thread-safe
+      if (!is_null_ptr(this->additive_proj_data_sptr))
+        additive_values.push_back(this->additive_proj_data_sptr->get_bin_value(measured_bin));
+
+      bins.push_back(measured_bin);
+
+      if(!this->do_time_frame)
+        more_events -=1 ;
+
+      num_used_events += 1;
+
+      if (num_used_events%200000L==0)
+        info( boost::format("Stored Events: %1% ") % num_used_events);
+    }
+  return more_events != 0;
+}
+
+template <typename TargetT>
+std::string
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>::
+get_event_cache_filename(const int subset_num) const
+{
+  return
+    boost::str(boost::format("%1%/%2%_subset_%3%.bin")
+               % this->event_cache_directory % this->event_cache_filename_prefix % subset_num);
+}
+
+template <typename TargetT>
+void
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>::
+remove_event_cache_files()
+{
+  for (int subset_num=0; subset_num<this->num_event_cache_files; ++subset_num)
+    std::remove(this->get_event_cache_filename(subset_num).c_str());
+  this->num_event_cache_files = 0;
+}
+
+template <typename TargetT>
+void
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>::
+cache_listmode_events()
+{
+  const double start_time = this->frame_defs.get_start_time(this->current_frame_num);
+  const double end_time = this->frame_defs.get_end_time(this->current_frame_num);
+  const bool has_additive_term = !is_null_ptr(this->additive_proj_data_sptr);
+  const bool use_disk = !this->event_cache_directory.empty();
+
+  info(boost::format("Caching listmode events for frame %1% %2%")
+       % this->current_frame_num
+       % (use_disk ? "in directory " + this->event_cache_directory : std::string("in memory")));
+
+  this->cached_events.clear();
+  this->cached_events.resize(this->num_subsets);
+  this->cached_additive_values.clear();
+  this->cached_additive_values.resize(this->num_subsets);
+  this->num_cached_events.clear();
+  this->num_cached_events.resize(this->num_subsets, 0);
+
+  std::vector<shared_ptr<std::ofstream> > cache_streams;
+  this->remove_event_cache_files();
+  if (use_disk)
+    {
+      if (this->event_cache_filename_prefix.empty())
+        {
+          // make the names unique for this object
+          static int num_objects_using_event_cache_files = 0;
+#ifdef _WIN32
+          const int process_id = _getpid();
+#else
+          const int process_id = static_cast<int>(getpid());
+#endif
+          this->event_cache_filename_prefix =
+            boost::str(boost::format("listmode_event_cache_%1%_%2%")
+                       % process_id % num_objects_using_event_cache_files++);
+        }
+      this->num_event_cache_files = this->num_subsets;
+      cache_streams.resize(this->num_subsets);
+      for (int subset_num=0; subset_num<this->num_subsets; ++subset_num)
+        {
+          const std::string filename = this->get_event_cache_filename(subset_num);
+          cache_streams[subset_num].reset(new std::ofstream(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc));
+          if (!cache_streams[subset_num]->good())
+            error(boost::format("Error opening listmode event cache file '%1%' for writing") % filename);
+        }
+    }
+
+  this->list_mode_data_sptr->reset();
+  shared_ptr<CListRecord> record_sptr = this->list_mode_data_sptr->get_empty_record_sptr();
+  CListRecord& record = *record_sptr;
+
+  // when not using time frames, every subset will have (at most) num_events_to_use events
+  // (as is the case when reading from the listmode file)
+  int num_subsets_to_fill = this->num_subsets;
+  Bin measured_bin;
+  while (num_subsets_to_fill > 0 &&
+         this->read_next_prompt_bin(measured_bin, record, start_time, end_time) == Succeeded::yes)
+    {
+      const int subset_num = this->find_subset_num(measured_bin);
+      if (subset_num < 0)
+        continue;
+      if (!this->do_time_frame &&
+          this->num_cached_events[subset_num] >= static_cast<std::size_t>(this->num_events_to_use))
+        continue;
+
+      CachedEvent event;
+      event.segment_num = static_cast<boost::int16_t>(measured_bin.segment_num());
+      event.view_num = static_cast<boost::int16_t>(measured_bin.view_num());
+      event.axial_pos_num = static_cast<boost::int16_t>(measured_bin.axial_pos_num());
+      event.tangential_pos_num = static_cast<boost::int16_t>(measured_bin.tangential_pos_num());
+      const float additive_value =
+        has_additive_term ? this->additive_proj_data_sptr->get_bin_value(measured_bin) : 0.F;
+
+      if (use_disk)
+        {
+          std::ofstream& cache_stream = *cache_streams[subset_num];
+          cache_stream.write(reinterpret_cast<const char *>(&event), sizeof(event));
+          if (has_additive_term)
+            cache_stream.write(reinterpret_cast<const char *>(&additive_value), sizeof(additive_value));
+        }
+      else
+        {
+          this->cached_events[subset_num].push_back(event);
+          if (has_additive_term)
+            this->cached_additive_values[subset_num].push_back(additive_value);
+        }
+
+      ++this->num_cached_events[subset_num];
+      if (!this->do_time_frame &&
+          this->num_cached_events[subset_num] == static_cast<std::size_t>(this->num_events_to_use))
+        --num_subsets_to_fill;
+    }
+
+  for (int subset_num=0; subset_num<this->num_subsets; ++subset_num)
+    {
+      if (use_disk)
+        {
+          cache_streams[subset_num]->close();
+          if (!*cache_streams[subset_num])
+            error(boost::format("Error writing listmode event cache file '%1%'")
+                  % this->get_event_cache_filename(subset_num));
+        }
+      info(boost::format("Number of cached events in subset %1%: %2%")
+           % subset_num % this->num_cached_events[subset_num], 2);
+    }
+  this->event_cache_frame_num = this->current_frame_num;
+}
+
+template <typename TargetT>
+bool
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>::
+read_batch_of_events_from_cache(std::vector<Bin>& bins, std::vector<float>& additive_values,
+                                std::size_t& position, std::istream * cache_stream_ptr,
+                                long& num_used_events,
+                                const int subset_num) const
+{
+  const bool has_additive_term = !is_null_ptr(this->additive_proj_data_sptr);
+  const std::size_t num_events =
+    std::min(num_events_per_batch, this->num_cached_events[subset_num] - position);
+
+  bins.resize(num_events);
+  additive_values.resize(has_additive_term ? num_events : 0);
+
+  const CachedEvent * events_ptr = 0;
+  const float * additive_values_ptr = 0;
+  std::vector<CachedEvent> events_read;
+  std::vector<float> additive_values_read;
+  if (cache_stream_ptr == 0)
+    {
+      if (num_events>0)
+        {
+          events_ptr = &this->cached_events[subset_num][position];
+          if (has_additive_term)
+            additive_values_ptr = &this->cached_additive_values[subset_num][position];
+        }
+    }
+  else
+    {
+      events_read.resize(num_events);
+      additive_values_read.resize(has_additive_term ? num_events : 0);
+      for (std::size_t i=0; i<num_events; ++i)
+        {
+          cache_stream_ptr->read(reinterpret_cast<char *>(&events_read[i]), sizeof(CachedEvent));
+          if (has_additive_term)
+            cache_stream_ptr->read(reinterpret_cast<char *>(&additive_values_read[i]), sizeof(float));
+        }
+      if (!*cache_stream_ptr)
+        error("Error reading listmode event cache");
+      if (num_events>0)
+        {
+          events_ptr = &events_read[0];
+          if (has_additive_term)
+            additive_values_ptr = &additive_values_read[0];
+        }
+    }
+
+  for (std::size_t i=0; i<num_events; ++i)
+    {
+      bins[i] = Bin(events_ptr[i].segment_num, events_ptr[i].view_num,
+                    events_ptr[i].axial_pos_num, events_ptr[i].tangential_pos_num,
+                    1.F);
+      if (has_additive_term)
+        additive_values[i] = additive_values_ptr[i];
+    }
+
+  position += num_events;
+  num_used_events += static_cast<long>(num_events);
+  return position < this->num_cached_events[subset_num];
+}
+
 template <typename TargetT> 
 void 
 PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<TargetT>:: 
@@ -422,97 +748,132 @@ compute_sub_gradient_without_penalty_plus_sensitivity(TargetT& gradient,
     //go to the beginning of this frame
     //  list_mode_data_sptr->set_get_position(start_time);
     // TODO implement function that will do this for a random time
-    this->list_mode_data_sptr->reset();
-    double current_time = 0.;
-    ProjMatrixElemsForOneBin proj_matrix_row;
+    if (!this->use_event_cache)
+      this->list_mode_data_sptr->reset();
 
     shared_ptr<CListRecord> record_sptr = this->list_mode_data_sptr->get_empty_record_sptr();
     CListRecord& record = *record_sptr;
 
-    VectorWithOffset<CListModeData::SavedPosition>
-            frame_start_positions(1, static_cast<int>(this->frame_defs.get_num_frames()));
-
     long int more_events =
             this->do_time_frame? 1 : this->num_events_to_use;
 
-    while (more_events)//this->list_mode_data_sptr->get_next_record(record) == Succeeded::yes)
-    {
-
-        if (this->list_mode_data_sptr->get_next_record(record) == Succeeded::no)
-        {
-            info("End of file!");
-            break; //get out of while loop
-        }
-
-        if(record.is_time() && end_time > 0.01)
-        {
-            current_time = record.time().get_time_in_secs();
-            if (this->do_time_frame && current_time >= end_time)
-                break; // get out of while loop
-            if (current_time < start_time)
-                continue;
-        }
-
-        if (record.is_event() && record.event().is_prompt())
-        {
-            Bin measured_bin;
-            measured_bin.set_bin_value(1.0f);
-            record.event().get_bin(measured_bin, *proj_data_info_sptr);
-
-            if (measured_bin.get_bin_value() != 1.0f
-                    || measured_bin.segment_num() < proj_data_info_sptr->get_min_segment_num()
-                    || measured_bin.segment_num()  > proj_data_info_sptr->get_max_segment_num()
-                    || measured_bin.tangential_pos_num() < proj_data_info_sptr->get_min_tangential_pos_num()
-                    || measured_bin.tangential_pos_num() > proj_data_info_sptr->get_max_tangential_pos_num()
-                    || measured_bin.axial_pos_num() < proj_data_info_sptr->get_min_axial_pos_num(measured_bin.segment_num())
-                    || measured_bin.axial_pos_num() > proj_data_info_sptr->get_max_axial_pos_num(measured_bin.segment_num()))
-            {
-                continue;
-            }
-
-            measured_bin.set_bin_value(1.0f);
-            // If more than 1 subsets, check if the current bin belongs to
-            // the current.
-            if (this->num_subsets > 1)
-            {
-                Bin basic_bin = measured_bin;
-                if (!this->PM_sptr->get_symmetries_ptr()->find_basic_bin(basic_bin) ||
-                        subset_num != static_cast<int>(basic_bin.view_num() % this->num_subsets))
-                    continue;
-            }
-
-            this->PM_sptr->get_proj_matrix_elems_for_one_bin(proj_matrix_row, measured_bin);
-            //in_the_range++;
-            Bin fwd_bin;
-            fwd_bin.set_bin_value(0.0f);
-            proj_matrix_row.forward_project(fwd_bin,current_estimate);
-            // additive sinogram
-            if (!is_null_ptr(this->additive_proj_data_sptr))
-            {
-                float add_value = this->additive_proj_data_sptr->get_bin_value(measured_bin);
-                float value= fwd_bin.get_bin_value()+add_value;
-                fwd_bin.set_bin_value(value);
-            }
-            float  measured_div_fwd = 0.0f;
-
-            if(!this->do_time_frame)
-                more_events -=1 ;
+    // when using the event cache, we read bins from the cache (in memory or on disk)
+    // as opposed to the listmode file
+    if (this->use_event_cache && this->event_cache_frame_num != this->current_frame_num)
+      this->cache_listmode_events();
+    std::size_t cache_position = 0;
+    shared_ptr<std::ifstream> cache_stream_sptr;
+    if (this->use_event_cache && !this->event_cache_directory.empty())
+      {
+        const std::string filename = this->get_event_cache_filename(subset_num);
+        cache_stream_sptr.reset(new std::ifstream(filename.c_str(), std::ios::in | std::ios::binary));
+        if (!cache_stream_sptr->good())
+          error(boost::format("Error opening listmode event cache file '%1%'") % filename);
+      }
 
-            num_used_events += 1;
+    /* Events are processed in batches. While the other threads process the events in one batch,
+       the master thread reads the next batch (double buffering). The events in a batch are split
+       in fixed contiguous ranges, one per processing thread. Each of these threads back-projects
+       into its own image (the first one directly into the gradient), which are then added in
+       a fixed order. The result therefore only depends on the number of threads (and the batch size).
+       With only 1 thread, reading and processing alternate.
+    */
+    std::vector<Bin> bins[2];
+    std::vector<float> additive_values[2];
+    bool more_to_read =
+      this->use_event_cache ?
+      this->read_batch_of_events_from_cache(bins[0], additive_values[0],
+                                            cache_position, cache_stream_sptr.get(),
+                                            num_used_events, subset_num) :
+      this->read_batch_of_events(bins[0], additive_values[0], record,
+                                 more_events, num_used_events,
+                                 start_time, end_time, subset_num);
+    int current = 0;
+
+#ifdef STIR_OPENMP
+    std::vector< shared_ptr<TargetT> > local_gradient_sptrs(omp_get_max_threads());
+    std::vector<ProjMatrixElemsForOneBin> proj_matrix_rows(omp_get_max_threads());
+#else
+    std::vector< shared_ptr<TargetT> > local_gradient_sptrs(1);
+    std::vector<ProjMatrixElemsForOneBin> proj_matrix_rows(1);
+#endif
 
-            if (num_used_events%200000L==0)
-                info( boost::format("Stored Events: %1% ") % num_used_events);
+    while (!bins[current].empty())
+    {
+      const std::vector<Bin>& current_bins = bins[current];
+      const std::vector<float>& current_additive_values = additive_values[current];
+      const int next = 1 - current;
 
-            if ( measured_bin.get_bin_value() <= max_quotient *fwd_bin.get_bin_value())
-                measured_div_fwd = 1.0f /fwd_bin.get_bin_value();
+#ifdef STIR_OPENMP
+#pragma omp parallel shared(current_bins, current_additive_values, local_gradient_sptrs, proj_matrix_rows, gradient, current_estimate, more_to_read)
+#endif
+      {
+#ifdef STIR_OPENMP
+        const int thread_num = omp_get_thread_num();
+        const int num_threads = omp_get_num_threads();
+#else
+        const int thread_num = 0;
+        const int num_threads = 1;
+#endif
+        if (thread_num == 0)
+          {
+            if (more_to_read)
+              more_to_read =
+                this->use_event_cache ?
+                this->read_batch_of_events_from_cache(bins[next], additive_values[next],
+                                                      cache_position, cache_stream_sptr.get(),
+                                                      num_used_events, subset_num) :
+                this->read_batch_of_events(bins[next], additive_values[next], record,
+                                           more_events, num_used_events,
+                                           start_time, end_time, subset_num);
             else
-                continue;
-
-            measured_bin.set_bin_value(measured_div_fwd);
-            proj_matrix_row.back_project(gradient, measured_bin);
+              bins[next].clear();
+          }
 
-        }
+        // the master thread only processes events when it is on its own
+        const int num_processing_threads = num_threads>1 ? num_threads-1 : 1;
+        const int processing_thread_num = num_threads>1 ? thread_num-1 : 0;
+        if (processing_thread_num >= 0)
+          {
+            if (processing_thread_num>0 && is_null_ptr(local_gradient_sptrs[processing_thread_num]))
+              local_gradient_sptrs[processing_thread_num].reset(gradient.get_empty_copy());
+            TargetT& local_gradient =
+              processing_thread_num==0 ? gradient : *local_gradient_sptrs[processing_thread_num];
+            ProjMatrixElemsForOneBin& proj_matrix_row = proj_matrix_rows[processing_thread_num];
+
+            const std::size_t num_bins = current_bins.size();
+            const std::size_t begin = num_bins * processing_thread_num / num_processing_threads;
+            const std::size_t end = num_bins * (processing_thread_num+1) / num_processing_threads;
+            for (std::size_t i=begin; i<end; ++i)
+              {
+                Bin measured_bin = current_bins[i];
+                this->PM_sptr->get_proj_matrix_elems_for_one_bin(proj_matrix_row, measured_bin);
+                Bin fwd_bin;
+                fwd_bin.set_bin_value(0.0f);
+                proj_matrix_row.forward_project(fwd_bin,current_estimate);
+                // additive sinogram
+                if (!current_additive_values.empty())
+                  {
+                    float value= fwd_bin.get_bin_value()+current_additive_values[i];
+                    fwd_bin.set_bin_value(value);
+                  }
+
+                if ( measured_bin.get_bin_value() <= max_quotient *fwd_bin.get_bin_value())
+                  {
+                    measured_bin.set_bin_value(1.0f /fwd_bin.get_bin_value());
+                    proj_matrix_row.back_project(local_gradient, measured_bin);
+                  }
+              }
+          }
+      }
+      current = next;
     }
+
+    // "reduce" data constructed by threads
+    for (int i=1; i<static_cast<int>(local_gradient_sptrs.size()); ++i)
+      if(!is_null_ptr(local_gradient_sptrs[i])) // only accumulate if a thread filled something in
+        gradient += *(local_gradient_sptrs[i]);
+
     info(boost::format("Number of used events: %1%") % num_used_events);
 }
 
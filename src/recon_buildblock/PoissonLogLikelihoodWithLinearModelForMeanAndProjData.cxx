@@ -34,6 +34,7 @@
 #include "stir/RelatedViewgrams.h"
 #include "stir/stream.h"
 #include "stir/info.h"
+#include "stir/warning.h"
 
 #include "stir/recon_buildblock/ProjectorByBinPair.h"
 
@@ -102,6 +103,7 @@ set_defaults()
   //num_views_to_add=1;  
   this->proj_data_sptr.reset(); //MJ added
   this->zero_seg0_end_planes = 0;
+  this->thread_image_memory_budget_in_MB = 0.;
 
   this->additive_projection_data_filename = "0";
   this->additive_proj_data_sptr.reset();
@@ -163,6 +165,7 @@ initialise_keymap()
   this->parser.add_key("time frame definition filename", &this->frame_definition_filename); 
   this->parser.add_key("time frame number", &this->frame_num);
   this->parser.add_parsing_key("Bin Normalisation type", &this->normalisation_sptr);
+  this->parser.add_key("thread image memory budget (MB)", &this->thread_image_memory_budget_in_MB);
 
 #ifdef STIR_MPI
   //distributed stuff 
@@ -201,6 +204,12 @@ post_processing()
 
   target_parameter_parser.check_values();
 
+  if (this->thread_image_memory_budget_in_MB < 0)
+    {
+      warning("thread image memory budget (MB) should be non-negative");
+      return true;
+    }
+
   if (this->additive_projection_data_filename != "0")
   {
     info(boost::format("Reading additive projdata data %1%") % this->additive_projection_data_filename);
@@ -373,6 +382,12 @@ PoissonLogLikelihoodWithLinearModelForMeanAndProjData<TargetT>::
 get_normalisation_sptr() const
 { return this->normalisation_sptr; }
 
+template<typename TargetT>
+double
+PoissonLogLikelihoodWithLinearModelForMeanAndProjData<TargetT>::
+get_thread_image_memory_budget_in_MB() const
+{ return this->thread_image_memory_budget_in_MB; }
+
 
 /***************************************************************
   set_ functions
@@ -413,6 +428,14 @@ set_zero_seg0_end_planes(const bool arg)
   this->zero_seg0_end_planes = arg;
 }
 
+template<typename TargetT>
+void
+PoissonLogLikelihoodWithLinearModelForMeanAndProjData<TargetT>::
+set_thread_image_memory_budget_in_MB(const double arg)
+{
+  this->thread_image_memory_budget_in_MB = arg;
+}
+
 template<typename TargetT>
 void
 PoissonLogLikelihoodWithLinearModelForMeanAndProjData<TargetT>::
@@ -564,6 +587,13 @@ set_up_before_sensitivity(shared_ptr<TargetT > const& target_sptr)
                                   target_sptr,
                                   zero_seg0_end_planes,
                                   distributed_cache_enabled);
+  if (this->thread_image_memory_budget_in_MB < 0)
+    {
+      warning("thread image memory budget (MB) should be non-negative");
+      return Succeeded::no;
+    }
+  set_distributable_computation_memory_budget(
+    static_cast<std::size_t>(this->thread_image_memory_budget_in_MB*1024*1024));
         
 #ifdef STIR_MPI
   //set up distributed caching object
@@ -32,6 +32,13 @@
 
 #include "stir/recon_buildblock/ProjMatrixByBin.h"
 #include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
+#include "stir/DiscretisedDensity.h"
+#include "stir/is_null_ptr.h"
+#include "stir/info.h"
+#include "stir/error.h"
+#include "stir/warning.h"
+#include <boost/format.hpp>
+#include <algorithm>
 
 // define a local preprocessor symbol to keep code relatively clean
 #ifdef STIR_NO_MUTABLE
@@ -46,6 +53,9 @@ void ProjMatrixByBin::set_defaults()
 {
   cache_disabled=false;
   cache_stores_only_basic_bins=true;
+  cache_is_compressed=false;
+  cache_uses_half_precision=false;
+  cache_is_lock_free=false;
 }
 
 void 
@@ -53,11 +63,26 @@ ProjMatrixByBin::initialise_keymap()
 {
   parser.add_key("disable caching", &cache_disabled);
   parser.add_key("store_only_basic_bins_in_cache", &cache_stores_only_basic_bins);
+  parser.add_key("use compressed cache", &cache_is_compressed);
+  parser.add_key("use half precision in compressed cache", &cache_uses_half_precision);
+  parser.add_key("use lock-free cache", &cache_is_lock_free);
 }
 
 bool
 ProjMatrixByBin::post_processing()
 {
+  if (cache_is_compressed && cache_is_lock_free)
+    {
+      warning("ProjMatrixByBin: 'use compressed cache' and 'use lock-free cache' cannot both be set");
+      return true;
+    }
+#ifndef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+  if (cache_is_lock_free)
+    {
+      warning("ProjMatrixByBin: 'use lock-free cache' needs C++-11 support. Rebuild STIR with a more recent compiler.");
+      return true;
+    }
+#endif
   return false;
 }
 
@@ -76,6 +101,25 @@ ProjMatrixByBin::
 store_only_basic_bins_in_cache(const bool v) 
 { cache_stores_only_basic_bins=v;}
 
+void
+ProjMatrixByBin::
+use_compressed_cache(const bool v, const bool use_half_precision)
+{
+  cache_is_compressed = v;
+  cache_uses_half_precision = use_half_precision;
+}
+
+void
+ProjMatrixByBin::
+use_lock_free_cache(const bool v)
+{
+#ifndef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+  if (v)
+    error("ProjMatrixByBin: the lock-free cache needs C++-11 support");
+#endif
+  cache_is_lock_free = v;
+}
+
 bool 
 ProjMatrixByBin::
 is_cache_enabled() const
@@ -86,6 +130,16 @@ ProjMatrixByBin::
 does_cache_store_only_basic_bins() const
 { return cache_stores_only_basic_bins; }
 
+bool
+ProjMatrixByBin::
+does_cache_use_compression() const
+{ return cache_is_compressed; }
+
+bool
+ProjMatrixByBin::
+is_cache_lock_free() const
+{ return cache_is_lock_free; }
+
 void 
 ProjMatrixByBin::
 clear_cache() STIR_MUTABLE_CONST
@@ -104,6 +158,30 @@ clear_cache() STIR_MUTABLE_CONST
           this->cache_collection[i][j].clear();
         }
     }
+  for (int i=this->compressed_cache_collection.get_min_index();
+       i<=this->compressed_cache_collection.get_max_index();
+       ++i)
+    {
+      for (int j=this->compressed_cache_collection[i].get_min_index();
+           j<=this->compressed_cache_collection[i].get_max_index();
+           ++j)
+        {
+          this->compressed_cache_collection[i][j].clear();
+        }
+    }
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+  for (int i=this->lock_free_cache_collection.get_min_index();
+       i<=this->lock_free_cache_collection.get_max_index();
+       ++i)
+    {
+      for (int j=this->lock_free_cache_collection[i].get_min_index();
+           j<=this->lock_free_cache_collection[i].get_max_index();
+           ++j)
+        {
+          this->lock_free_cache_collection[i][j]->clear();
+        }
+    }
+#endif
 }
 
 /*
@@ -121,7 +199,7 @@ void
 ProjMatrixByBin::
 set_up(		 
     const shared_ptr<ProjDataInfo>& proj_data_info_sptr,
-    const shared_ptr<DiscretisedDensity<3,float> >& /*density_info_ptr*/ // TODO should be Info only
+    const shared_ptr<DiscretisedDensity<3,float> >& density_info_ptr // TODO should be Info only
     )
 {
   const int min_view_num = proj_data_info_sptr->get_min_view_num();
@@ -130,15 +208,86 @@ set_up(
   const int max_segment_num = proj_data_info_sptr->get_max_segment_num();
 
   this->cache_collection.recycle();
-  this->cache_collection.resize(min_view_num, max_view_num);
+  this->compressed_cache_collection.recycle();
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+  this->lock_free_cache_collection.recycle();
+#endif
+  if (this->cache_is_compressed && this->cache_is_lock_free)
+    error("ProjMatrixByBin: the compressed cache and the lock-free cache cannot be combined");
+  if (this->cache_is_compressed)
+    this->compressed_cache_collection.resize(min_view_num, max_view_num);
+  else if (this->cache_is_lock_free)
+    {
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+      this->lock_free_cache_collection.resize(min_view_num, max_view_num);
+#else
+      error("ProjMatrixByBin: the lock-free cache needs C++-11 support");
+#endif
+    }
+  else
+    this->cache_collection.resize(min_view_num, max_view_num);
 #ifdef STIR_OPENMP
   this->cache_locks.recycle();
   this->cache_locks.resize(min_view_num, max_view_num);
 #endif
 
+  // find bounding box of the image, used by the compressed cache for linearising voxel coordinates
+  BasicCoordinate<3,int> min_voxel_index, max_voxel_index;
+  if (this->cache_is_compressed)
+    {
+      if (is_null_ptr(density_info_ptr))
+        error("ProjMatrixByBin::set_up needs an image when using the compressed cache");
+      min_voxel_index[1] = density_info_ptr->get_min_index();
+      max_voxel_index[1] = density_info_ptr->get_max_index();
+      min_voxel_index[2] = (*density_info_ptr)[min_voxel_index[1]].get_min_index();
+      max_voxel_index[2] = (*density_info_ptr)[min_voxel_index[1]].get_max_index();
+      min_voxel_index[3] = (*density_info_ptr)[min_voxel_index[1]][min_voxel_index[2]].get_min_index();
+      max_voxel_index[3] = (*density_info_ptr)[min_voxel_index[1]][min_voxel_index[2]].get_max_index();
+      for (int z=density_info_ptr->get_min_index(); z<=density_info_ptr->get_max_index(); ++z)
+        {
+          min_voxel_index[2] = std::min(min_voxel_index[2], (*density_info_ptr)[z].get_min_index());
+          max_voxel_index[2] = std::max(max_voxel_index[2], (*density_info_ptr)[z].get_max_index());
+          for (int y=(*density_info_ptr)[z].get_min_index(); y<=(*density_info_ptr)[z].get_max_index(); ++y)
+            {
+              min_voxel_index[3] = std::min(min_voxel_index[3], (*density_info_ptr)[z][y].get_min_index());
+              max_voxel_index[3] = std::max(max_voxel_index[3], (*density_info_ptr)[z][y].get_max_index());
+            }
+        }
+      info(boost::format("ProjMatrixByBin: using compressed cache%1%")
+           % (this->cache_uses_half_precision ? " with half precision weights" : ""));
+    }
+
   for (int view_num=min_view_num; view_num<=max_view_num; ++view_num)
     {
-      this->cache_collection[view_num].resize(min_segment_num, max_segment_num);
+      if (this->cache_is_compressed)
+        {
+          this->compressed_cache_collection[view_num].resize(min_segment_num, max_segment_num);
+          for (int seg_num = min_segment_num; seg_num <=max_segment_num; ++seg_num)
+            this->compressed_cache_collection[view_num][seg_num].
+              set_up(proj_data_info_sptr->get_min_axial_pos_num(seg_num),
+                     proj_data_info_sptr->get_max_axial_pos_num(seg_num),
+                     proj_data_info_sptr->get_min_tangential_pos_num(),
+                     proj_data_info_sptr->get_max_tangential_pos_num(),
+                     min_voxel_index, max_voxel_index,
+                     this->cache_uses_half_precision);
+        }
+      else if (this->cache_is_lock_free)
+        {
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+          this->lock_free_cache_collection[view_num].resize(min_segment_num, max_segment_num);
+          for (int seg_num = min_segment_num; seg_num <=max_segment_num; ++seg_num)
+            {
+              this->lock_free_cache_collection[view_num][seg_num].reset(new ConcurrentProjMatrixCache);
+              this->lock_free_cache_collection[view_num][seg_num]->
+                set_up(proj_data_info_sptr->get_min_axial_pos_num(seg_num),
+                       proj_data_info_sptr->get_max_axial_pos_num(seg_num),
+                       proj_data_info_sptr->get_min_tangential_pos_num(),
+                       proj_data_info_sptr->get_max_tangential_pos_num());
+            }
+#endif
+        }
+      else
+        this->cache_collection[view_num].resize(min_segment_num, max_segment_num);
 #ifdef STIR_OPENMP
       this->cache_locks[view_num].resize(min_segment_num, max_segment_num);
       for (int seg_num = min_segment_num; seg_num <=max_segment_num; ++seg_num)
@@ -176,11 +325,22 @@ cache_proj_matrix_elems_for_one_bin(
   //std::cerr << "cached lor size " << probabilities.size() << " capacity " << probabilities.capacity() << std::endl;    
   // insert probabilities into the collection	
   const Bin bin = probabilities.get_bin();
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+  if (cache_is_lock_free)
+    {
+      // no locking needed
+      lock_free_cache_collection[bin.view_num()][bin.segment_num()]->store(probabilities);
+      return;
+    }
+#endif
 #ifdef STIR_OPENMP
   omp_set_lock(&this->cache_locks[bin.view_num()][bin.segment_num()]);
 #endif
-  cache_collection[bin.view_num()][bin.segment_num()].insert(MapProjMatrixElemsForOneBin::value_type( cache_key(bin), 
-                                                                                                      probabilities));  
+  if (cache_is_compressed)
+    compressed_cache_collection[bin.view_num()][bin.segment_num()].store(probabilities);
+  else
+    cache_collection[bin.view_num()][bin.segment_num()].insert(MapProjMatrixElemsForOneBin::value_type( cache_key(bin), 
+                                                                                                        probabilities));  
 #ifdef STIR_OPENMP
   omp_unset_lock(&this->cache_locks[bin.view_num()][bin.segment_num()]);
 #endif
@@ -205,12 +365,26 @@ get_cached_proj_matrix_elems_for_one_bin(
     assert ( symmetries_sptr->find_basic_bin(bin_copy) == 0);
   }
 #endif         
-  
+
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+  if (cache_is_lock_free)
+    {
+      // no locking needed
+      return lock_free_cache_collection[bin.view_num()][bin.segment_num()]->get(probabilities);
+    }
+#endif
+
   bool found=false;
 #ifdef STIR_OPENMP
   omp_set_lock(&this->cache_locks[bin.view_num()][bin.segment_num()]);
 #endif
 
+  if (cache_is_compressed)
+  {
+    found =
+      compressed_cache_collection[bin.view_num()][bin.segment_num()].get(probabilities) == Succeeded::yes;
+  }
+  else
   {
     const_MapProjMatrixElemsForOneBinIterator pos = 
       cache_collection[bin.view_num()][bin.segment_num()].find(cache_key( bin));
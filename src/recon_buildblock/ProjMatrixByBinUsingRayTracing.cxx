@@ -56,6 +56,7 @@
 #include "stir/modulo.h"
 #include "stir/stream.h"
 #include <algorithm>
+#include <vector>
 #include <math.h>
 #include <boost/format.hpp>
 
@@ -384,24 +385,22 @@ static inline int sign(const T& t)
   return t<0 ? -1 : 1;
 }
 
-// just do 1 LOR, returns true if lor is not empty
-static void
-ray_trace_one_lor(ProjMatrixElemsForOneBin& lor, 
-                  const float s_in_mm, const float t_in_mm, 
-                  const float cphi, const float sphi, 
-                  const float costheta, const float tantheta, 
-                  const float offset_in_z,
-                  const float fovrad_in_mm,
-                  const CartesianCoordinate3D<float>& voxel_size,
-                  const bool restrict_to_cylindrical_FOV,
-                  const int num_LORs)
+// find the end points of 1 LOR in the FOV (in voxel units), returns false if the LOR does not intersect the FOV
+/* The points are ordered such that ray tracing from start_point to stop_point gives a sorted lor.
+*/
+static bool
+find_end_points_of_one_lor(CartesianCoordinate3D<float>& start_point,
+                           CartesianCoordinate3D<float>& stop_point,
+                           const float s_in_mm, const float t_in_mm, 
+                           const float cphi, const float sphi, 
+                           const float costheta, const float tantheta, 
+                           const float offset_in_z,
+                           const float fovrad_in_mm,
+                           const CartesianCoordinate3D<float>& voxel_size,
+                           const bool restrict_to_cylindrical_FOV)
 {
-  assert(lor.size() == 0);
-
   /* Find Intersection points of LOR and image FOV (assuming infinitely long scanner)*/
   /* (in voxel units) */
-  CartesianCoordinate3D<float> start_point;  
-  CartesianCoordinate3D<float> stop_point;
   {
     /* parametrisation of LOR is
          X= s*cphi + a*sphi, 
@@ -415,9 +414,9 @@ ray_trace_one_lor(ProjMatrixElemsForOneBin& lor,
     if (restrict_to_cylindrical_FOV)
     {
 #ifdef STIR_PMRT_LARGER_FOV
-      if (fabs(s_in_mm) >= fovrad_in_mm) return;
+      if (fabs(s_in_mm) >= fovrad_in_mm) return false;
 #else
-      if (fabs(s_in_mm) > fovrad_in_mm) return;
+      if (fabs(s_in_mm) > fovrad_in_mm) return false;
 #endif
       // a has to be such that X^2+Y^2 == fovrad^2      
       if (fabs(s_in_mm) == fovrad_in_mm) 
@@ -442,7 +441,7 @@ ray_trace_one_lor(ProjMatrixElemsForOneBin& lor,
       if (fabs(cphi) < 1.E-3 || fabs(sphi) < 1.E-3) 
       {
         if (fovrad_in_mm < fabs(s_in_mm))
-          return;
+          return false;
         max_a = fovrad_in_mm;
         min_a = -fovrad_in_mm;
       }
@@ -453,7 +452,7 @@ ray_trace_one_lor(ProjMatrixElemsForOneBin& lor,
         min_a = max((-fovrad_in_mm*sign(sphi) - s_in_mm*cphi)/sphi,
                     (-fovrad_in_mm*sign(cphi) + s_in_mm*sphi)/cphi);
         if (min_a > max_a - 1.E-3*voxel_size.x())
-          return;
+          return false;
       }
       
     } //!restrict_to_cylindrical_FOV
@@ -498,33 +497,60 @@ ray_trace_one_lor(ProjMatrixElemsForOneBin& lor,
        (start_point.y() < stop_point.y() ||
         (start_point.y() == stop_point.y() &&
          (start_point.x() <= stop_point.x()))));
+    if (!from_start_to_stop)
+      std::swap(start_point, stop_point);
+    return true;
+  }
+}
 
-    // do actual ray tracing for this LOR
-    
-    RayTraceVoxelsOnCartesianGrid(lor, 
-                                  from_start_to_stop? start_point : stop_point,
-                                  !from_start_to_stop? start_point : stop_point,
-                                  voxel_size,
+// normalisation constant to use for ray tracing
+static inline float
+get_ray_tracing_normalisation_constant(const CartesianCoordinate3D<float>& voxel_size,
+                                       const int num_LORs)
+{
 #ifdef NEWSCALE
-                                  1.F/num_LORs // normalise to mm
+  return 1.F/num_LORs; // normalise to mm
 #else
-                                  1/voxel_size.x()/num_LORs // normalise to some kind of 'pixel units'
+  return 1/voxel_size.x()/num_LORs; // normalise to some kind of 'pixel units'
 #endif
-           );
+}
 
-#ifndef NDEBUG
-    {
-      // TODO output is still not sorted... why?
+// just do 1 LOR
+static void
+ray_trace_one_lor(ProjMatrixElemsForOneBin& lor, 
+                  const float s_in_mm, const float t_in_mm, 
+                  const float cphi, const float sphi, 
+                  const float costheta, const float tantheta, 
+                  const float offset_in_z,
+                  const float fovrad_in_mm,
+                  const CartesianCoordinate3D<float>& voxel_size,
+                  const bool restrict_to_cylindrical_FOV,
+                  const int num_LORs)
+{
+  assert(lor.size() == 0);
 
-      //ProjMatrixElemsForOneBin sorted_lor = lor;
-      //sorted_lor.sort();
-      //assert(lor == sorted_lor);
-      lor.check_state();
-    }
-#endif
+  CartesianCoordinate3D<float> start_point;  
+  CartesianCoordinate3D<float> stop_point;
+  if (!find_end_points_of_one_lor(start_point, stop_point,
+                                  s_in_mm, t_in_mm, cphi, sphi, costheta, tantheta,
+                                  offset_in_z, fovrad_in_mm, voxel_size,
+                                  restrict_to_cylindrical_FOV))
     return;
-  }
 
+  // do actual ray tracing for this LOR
+  RayTraceVoxelsOnCartesianGrid(lor, start_point, stop_point, voxel_size,
+                                get_ray_tracing_normalisation_constant(voxel_size, num_LORs));
+
+#ifndef NDEBUG
+  {
+    // TODO output is still not sorted... why?
+
+    //ProjMatrixElemsForOneBin sorted_lor = lor;
+    //sorted_lor.sort();
+    //assert(lor == sorted_lor);
+    lor.check_state();
+  }
+#endif
 }
 //////////////////////////////////////
 void 
@@ -687,8 +713,6 @@ calculate_proj_matrix_elems_for_one_bin(
   }
   else
   {
-    ProjMatrixElemsForOneBin ray_traced_lor;
-
     // get_sampling_in_s returns sampling in interleaved case
     // interleaved case has a sampling which is twice as high
     const float s_inc = 
@@ -696,18 +720,32 @@ calculate_proj_matrix_elems_for_one_bin(
         proj_data_info_ptr->get_sampling_in_s(bin)/num_tangential_LORs;
     float current_s_in_mm =
         s_in_mm - s_inc*(num_tangential_LORs-1)/2.F;
+    // find end points of all rays, and ray trace them simultaneously
+    std::vector<CartesianCoordinate3D<float> > start_points;
+    std::vector<CartesianCoordinate3D<float> > stop_points;
+    start_points.reserve(num_tangential_LORs);
+    stop_points.reserve(num_tangential_LORs);
     for (int s_LOR_num=1; s_LOR_num<=num_tangential_LORs; ++s_LOR_num, current_s_in_mm+=s_inc)
     {
-      ray_traced_lor.erase();
-      ray_trace_one_lor(ray_traced_lor, current_s_in_mm, t_in_mm, 
-                          cphi, sphi, costheta, tantheta, 
-                          offset_in_z, fovrad_in_mm, 
-                          voxel_size,
-                          restrict_to_cylindrical_FOV,
-                          num_lors_per_axial_pos*num_tangential_LORs);
-      //std::cerr << "ray traced size " << ray_traced_lor.size() << std::endl;
-      lor.merge(ray_traced_lor);
+      CartesianCoordinate3D<float> start_point;  
+      CartesianCoordinate3D<float> stop_point;
+      if (find_end_points_of_one_lor(start_point, stop_point,
+                                     current_s_in_mm, t_in_mm, 
+                                     cphi, sphi, costheta, tantheta, 
+                                     offset_in_z, fovrad_in_mm, 
+                                     voxel_size,
+                                     restrict_to_cylindrical_FOV))
+        {
+          start_points.push_back(start_point);
+          stop_points.push_back(stop_point);
+        }
     }
+    std::vector<ProjMatrixElemsForOneBin> ray_traced_lors(start_points.size());
+    RayTraceVoxelsOnCartesianGrid(ray_traced_lors, start_points, stop_points, voxel_size,
+                                  get_ray_tracing_normalisation_constant(voxel_size,
+                                                                         num_lors_per_axial_pos*num_tangential_LORs));
+    for (std::size_t i=0; i<ray_traced_lors.size(); ++i)
+      lor.merge(ray_traced_lors[i]);
   }
       
   // now add on other LORs in axial direction
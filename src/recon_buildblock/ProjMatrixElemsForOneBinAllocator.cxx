@@ -0,0 +1,318 @@
+//
+//
+/*!
+  \file
+  \ingroup projection
+
+  \brief Implementation of class stir::ProjMatrixElemsForOneBinArena
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBinAllocator.h"
+
+#ifdef STIR_HAVE_PROJ_MATRIX_ELEMS_ARENA
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#endif
+
+START_NAMESPACE_STIR
+
+// blocks up to 4 MB are kept in the free-lists
+static const std::size_t max_block_size = std::size_t(1) << 22;
+static const std::size_t max_num_cached_bytes_per_thread = std::size_t(1) << 26;
+
+std::size_t
+ProjMatrixElemsForOneBinArena::
+get_max_block_size()
+{
+  return max_block_size;
+}
+
+std::size_t
+ProjMatrixElemsForOneBinArena::
+get_max_num_cached_bytes_per_thread()
+{
+  return max_num_cached_bytes_per_thread;
+}
+
+#ifdef STIR_HAVE_PROJ_MATRIX_ELEMS_ARENA
+
+namespace {
+
+/* Size classes: multiples of 32 bytes up to 256 bytes, and then 8 classes
+   for every power of 2, i.e. 2^k < size <= 2^(k+1) is rounded up to a multiple
+   of 2^(k-3).
+*/
+const std::size_t num_small_classes = 8;
+const std::size_t small_class_size = 32;
+const std::size_t num_classes_per_power_of_2 = 8;
+// classes for 2^8 < size <= 2^22
+const std::size_t num_size_classes = num_small_classes + (22-8)*num_classes_per_power_of_2;
+
+//! find the size class and the rounded size (only valid for 0 < num_bytes <= max_block_size)
+inline std::size_t
+find_size_class(const std::size_t num_bytes, std::size_t& rounded_num_bytes)
+{
+  if (num_bytes <= num_small_classes*small_class_size)
+    {
+      const std::size_t m = (num_bytes + small_class_size - 1)/small_class_size;
+      rounded_num_bytes = std::max(m, std::size_t(1))*small_class_size;
+      return std::max(m, std::size_t(1)) - 1;
+    }
+  // find k such that 2^k < num_bytes <= 2^(k+1)
+  std::size_t k = 8;
+  while ((std::size_t(1) << (k+1)) < num_bytes)
+    ++k;
+  const std::size_t step = std::size_t(1) << (k-3);
+  const std::size_t m = (num_bytes + step - 1)/step; // between 9 and 16
+  rounded_num_bytes = m*step;
+  return num_small_classes + (k-8)*num_classes_per_power_of_2 + (m-9);
+}
+
+struct FreeBlock
+{
+  FreeBlock * next;
+};
+
+struct Pool
+{
+  Pool()
+    : num_cached_bytes(0), num_allocations(0), num_reused_blocks(0), num_heap_allocations(0)
+  {
+    std::fill(free_lists, free_lists + num_size_classes, static_cast<FreeBlock *>(0));
+  }
+  ~Pool()
+  {
+    for (std::size_t c=0; c<num_size_classes; ++c)
+      while (free_lists[c] != 0)
+        {
+          FreeBlock * block = free_lists[c];
+          free_lists[c] = block->next;
+          ::operator delete(block);
+        }
+  }
+
+  FreeBlock * free_lists[num_size_classes];
+  std::size_t num_cached_bytes;
+  // only modified by the owning thread, but read by get_counters()
+  std::atomic<unsigned long long> num_allocations;
+  std::atomic<unsigned long long> num_reused_blocks;
+  std::atomic<unsigned long long> num_heap_allocations;
+};
+
+//! keeps track of all pools such that we can sum their counters
+struct Registry
+{
+  Registry()
+    : retired_num_allocations(0), retired_num_reused_blocks(0), retired_num_heap_allocations(0)
+  {}
+  std::mutex mutex;
+  std::vector<Pool *> pools;
+  unsigned long long retired_num_allocations;
+  unsigned long long retired_num_reused_blocks;
+  unsigned long long retired_num_heap_allocations;
+};
+
+Registry&
+get_registry()
+{
+  static Registry registry;
+  return registry;
+}
+
+thread_local Pool * thread_pool_ptr = 0;
+// set when the thread exits, after which all allocations go to the heap
+thread_local bool thread_pool_destroyed = false;
+
+//! deletes the pool of the thread when it exits
+struct PoolOwner
+{
+  ~PoolOwner()
+  {
+    if (thread_pool_ptr != 0)
+      {
+        Registry& registry = get_registry();
+        {
+          std::lock_guard<std::mutex> lock(registry.mutex);
+          registry.retired_num_allocations += thread_pool_ptr->num_allocations.load();
+          registry.retired_num_reused_blocks += thread_pool_ptr->num_reused_blocks.load();
+          registry.retired_num_heap_allocations += thread_pool_ptr->num_heap_allocations.load();
+          registry.pools.erase(std::find(registry.pools.begin(), registry.pools.end(), thread_pool_ptr));
+        }
+        delete thread_pool_ptr;
+        thread_pool_ptr = 0;
+      }
+    thread_pool_destroyed = true;
+  }
+};
+
+Pool *
+get_thread_pool()
+{
+  if (thread_pool_ptr != 0)
+    return thread_pool_ptr;
+  if (thread_pool_destroyed)
+    return 0;
+  static thread_local PoolOwner owner;
+  Pool * pool_ptr = new Pool;
+  {
+    Registry& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.pools.push_back(pool_ptr);
+  }
+  thread_pool_ptr = pool_ptr;
+  return pool_ptr;
+}
+
+} // end of unnamed namespace
+
+void *
+ProjMatrixElemsForOneBinArena::
+allocate(const std::size_t num_bytes)
+{
+  if (num_bytes == 0 || num_bytes > max_block_size)
+    {
+      Pool * const pool_ptr = get_thread_pool();
+      if (pool_ptr != 0)
+        {
+          pool_ptr->num_allocations.fetch_add(1, std::memory_order_relaxed);
+          pool_ptr->num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+      return ::operator new(num_bytes);
+    }
+
+  std::size_t rounded_num_bytes;
+  const std::size_t size_class = find_size_class(num_bytes, rounded_num_bytes);
+  Pool * const pool_ptr = get_thread_pool();
+  // always allocate the rounded size, as the block might end up in the free-list of another thread
+  if (pool_ptr == 0)
+    return ::operator new(rounded_num_bytes);
+
+  pool_ptr->num_allocations.fetch_add(1, std::memory_order_relaxed);
+  FreeBlock * const block = pool_ptr->free_lists[size_class];
+  if (block != 0)
+    {
+      pool_ptr->free_lists[size_class] = block->next;
+      pool_ptr->num_cached_bytes -= rounded_num_bytes;
+      pool_ptr->num_reused_blocks.fetch_add(1, std::memory_order_relaxed);
+      return block;
+    }
+  pool_ptr->num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  return ::operator new(rounded_num_bytes);
+}
+
+void
+ProjMatrixElemsForOneBinArena::
+deallocate(void * ptr, const std::size_t num_bytes)
+{
+  if (ptr == 0)
+    return;
+  Pool * const pool_ptr = num_bytes == 0 || num_bytes > max_block_size ? 0 : get_thread_pool();
+  if (pool_ptr != 0)
+    {
+      std::size_t rounded_num_bytes;
+      const std::size_t size_class = find_size_class(num_bytes, rounded_num_bytes);
+      if (pool_ptr->num_cached_bytes + rounded_num_bytes <= max_num_cached_bytes_per_thread)
+        {
+          FreeBlock * const block = static_cast<FreeBlock *>(ptr);
+          block->next = pool_ptr->free_lists[size_class];
+          pool_ptr->free_lists[size_class] = block;
+          pool_ptr->num_cached_bytes += rounded_num_bytes;
+          return;
+        }
+    }
+  ::operator delete(ptr);
+}
+
+ProjMatrixElemsForOneBinArena::Counters
+ProjMatrixElemsForOneBinArena::
+get_counters()
+{
+  Registry& registry = get_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  Counters counters;
+  counters.num_allocations = registry.retired_num_allocations;
+  counters.num_reused_blocks = registry.retired_num_reused_blocks;
+  counters.num_heap_allocations = registry.retired_num_heap_allocations;
+  for (std::vector<Pool *>::const_iterator iter = registry.pools.begin();
+       iter != registry.pools.end();
+       ++iter)
+    {
+      counters.num_allocations += (*iter)->num_allocations.load(std::memory_order_relaxed);
+      counters.num_reused_blocks += (*iter)->num_reused_blocks.load(std::memory_order_relaxed);
+      counters.num_heap_allocations += (*iter)->num_heap_allocations.load(std::memory_order_relaxed);
+    }
+  return counters;
+}
+
+void
+ProjMatrixElemsForOneBinArena::
+reset_counters()
+{
+  Registry& registry = get_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.retired_num_allocations = 0;
+  registry.retired_num_reused_blocks = 0;
+  registry.retired_num_heap_allocations = 0;
+  for (std::vector<Pool *>::const_iterator iter = registry.pools.begin();
+       iter != registry.pools.end();
+       ++iter)
+    {
+      (*iter)->num_allocations.store(0, std::memory_order_relaxed);
+      (*iter)->num_reused_blocks.store(0, std::memory_order_relaxed);
+      (*iter)->num_heap_allocations.store(0, std::memory_order_relaxed);
+    }
+}
+
+#else // STIR_HAVE_PROJ_MATRIX_ELEMS_ARENA
+
+void *
+ProjMatrixElemsForOneBinArena::
+allocate(const std::size_t num_bytes)
+{
+  return ::operator new(num_bytes);
+}
+
+void
+ProjMatrixElemsForOneBinArena::
+deallocate(void * ptr, const std::size_t)
+{
+  ::operator delete(ptr);
+}
+
+ProjMatrixElemsForOneBinArena::Counters
+ProjMatrixElemsForOneBinArena::
+get_counters()
+{
+  Counters counters;
+  counters.num_allocations = 0;
+  counters.num_reused_blocks = 0;
+  counters.num_heap_allocations = 0;
+  return counters;
+}
+
+void
+ProjMatrixElemsForOneBinArena::
+reset_counters()
+{}
+
+#endif // STIR_HAVE_PROJ_MATRIX_ELEMS_ARENA
+
+END_NAMESPACE_STIR
@@ -0,0 +1,135 @@
+//
+//
+/*!
+  \file
+  \ingroup projection
+
+  \brief non-inline implementations for stir::ProjectorByBinPairUsingOnTheFlyRayTracing
+  
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+
+
+#include "stir/recon_buildblock/ProjectorByBinPairUsingOnTheFlyRayTracing.h"
+#include "stir/recon_buildblock/ForwardProjectorByBinUsingProjMatrixByBin.h"
+#include "stir/recon_buildblock/BackProjectorByBinUsingProjMatrixByBin.h"
+#include "stir/Succeeded.h"
+#include "stir/warning.h"
+#include "stir/error.h"
+
+START_NAMESPACE_STIR
+
+
+const char * const 
+ProjectorByBinPairUsingOnTheFlyRayTracing::registered_name =
+  "On The Fly Ray Tracing";
+
+
+void 
+ProjectorByBinPairUsingOnTheFlyRayTracing::initialise_keymap()
+{
+  base_type::initialise_keymap();
+  parser.add_start_key("Projector Pair Using On The Fly Ray Tracing Parameters");
+  parser.add_stop_key("End Projector Pair Using On The Fly Ray Tracing Parameters");
+  parser.add_key("restrict to cylindrical FOV", &restrict_to_cylindrical_FOV);
+  parser.add_key("number of rays in tangential direction to trace for each bin",
+                 &num_tangential_LORs);
+  parser.add_key("use actual detector boundaries", &use_actual_detector_boundaries);
+  parser.add_key("do_symmetry_90degrees_min_phi", &do_symmetry_90degrees_min_phi);
+  parser.add_key("do_symmetry_180degrees_min_phi", &do_symmetry_180degrees_min_phi);
+  parser.add_key("do_symmetry_swap_segment", &do_symmetry_swap_segment);
+  parser.add_key("do_symmetry_swap_s", &do_symmetry_swap_s);
+  parser.add_key("do_symmetry_shift_z", &do_symmetry_shift_z);
+}
+
+
+void
+ProjectorByBinPairUsingOnTheFlyRayTracing::set_defaults()
+{
+  base_type::set_defaults();
+  // use the defaults of the matrix
+  this->proj_matrix_sptr.reset(new ProjMatrixByBinUsingRayTracing);
+  this->restrict_to_cylindrical_FOV = proj_matrix_sptr->get_restrict_to_cylindrical_FOV();
+  this->num_tangential_LORs = proj_matrix_sptr->get_num_tangential_LORs();
+  this->use_actual_detector_boundaries = proj_matrix_sptr->get_use_actual_detector_boundaries();
+  this->do_symmetry_90degrees_min_phi = proj_matrix_sptr->get_do_symmetry_90degrees_min_phi();
+  this->do_symmetry_180degrees_min_phi = proj_matrix_sptr->get_do_symmetry_180degrees_min_phi();
+  this->do_symmetry_swap_segment = proj_matrix_sptr->get_do_symmetry_swap_segment();
+  this->do_symmetry_swap_s = proj_matrix_sptr->get_do_symmetry_swap_s();
+  this->do_symmetry_shift_z = proj_matrix_sptr->get_do_symmetry_shift_z();
+  this->create_projectors();
+}
+
+bool
+ProjectorByBinPairUsingOnTheFlyRayTracing::post_processing()
+{
+  if (base_type::post_processing())
+    return true;
+  if (this->num_tangential_LORs<1)
+    {
+      warning(boost::format("%s: number of rays in tangential direction should be at least 1, but is %d")
+              % registered_name % this->num_tangential_LORs);
+      return true;
+    }
+  this->proj_matrix_sptr->set_restrict_to_cylindrical_FOV(this->restrict_to_cylindrical_FOV);
+  this->proj_matrix_sptr->set_num_tangential_LORs(this->num_tangential_LORs);
+  this->proj_matrix_sptr->set_use_actual_detector_boundaries(this->use_actual_detector_boundaries);
+  this->proj_matrix_sptr->set_do_symmetry_90degrees_min_phi(this->do_symmetry_90degrees_min_phi);
+  this->proj_matrix_sptr->set_do_symmetry_180degrees_min_phi(this->do_symmetry_180degrees_min_phi);
+  this->proj_matrix_sptr->set_do_symmetry_swap_segment(this->do_symmetry_swap_segment);
+  this->proj_matrix_sptr->set_do_symmetry_swap_s(this->do_symmetry_swap_s);
+  this->proj_matrix_sptr->set_do_symmetry_shift_z(this->do_symmetry_shift_z);
+  return false;
+}
+
+void
+ProjectorByBinPairUsingOnTheFlyRayTracing::
+create_projectors()
+{
+  // no storage of matrix elements at all
+  this->proj_matrix_sptr->enable_cache(false);
+  this->forward_projector_sptr.reset(new ForwardProjectorByBinUsingProjMatrixByBin(this->proj_matrix_sptr));
+  this->back_projector_sptr.reset(new BackProjectorByBinUsingProjMatrixByBin(this->proj_matrix_sptr));
+}
+
+ProjectorByBinPairUsingOnTheFlyRayTracing::
+ProjectorByBinPairUsingOnTheFlyRayTracing()
+{
+  set_defaults();
+}
+
+Succeeded
+ProjectorByBinPairUsingOnTheFlyRayTracing::
+set_up(const shared_ptr<ProjDataInfo>& proj_data_info_sptr,
+       const shared_ptr<DiscretisedDensity<3,float> >& image_info_sptr)
+{    	 
+  if (this->proj_matrix_sptr->is_cache_enabled())
+    error("%s: caching should not be enabled for the projection matrix", registered_name);
+
+  // the matrix will be set_up by the forward and back projectors (called in the base class)
+  return base_type::set_up(proj_data_info_sptr, image_info_sptr);
+}
+
+shared_ptr<ProjMatrixByBinUsingRayTracing>
+ProjectorByBinPairUsingOnTheFlyRayTracing::
+get_proj_matrix_sptr() const
+{
+  return this->proj_matrix_sptr;
+}
+
+END_NAMESPACE_STIR
@@ -35,6 +35,7 @@
 #include "stir/is_null_ptr.h"
 #include "stir/info.h"
 #include <algorithm>
+#include <vector>
 using std::min;
 using std::max;
 
@@ -222,6 +223,16 @@ compute_weights(Array<3,float>& weights, const CartesianCoordinate3D<float>& gri
         }
 }
 
+/* The functions below loop over all voxels and their neighbourhood.
+   They are written such that the inner loop runs over a row of the image, while the outer
+   loops run over the neighbours. For every neighbour offset dx, the range of x is restricted
+   such that x+dx is in the image. The borders of the image are therefore handled by the
+   loop bounds, and the inner loops do not need any checks, such that the compiler can vectorise them.
+   The sum over the neighbourhood for a single voxel is still performed in the same order
+   as in a straightforward implementation.
+   We parallelise over planes.
+*/
+
 template <typename elemT>
 double
 QuadraticPrior<elemT>::
@@ -247,10 +258,15 @@ compute_value(const DiscretisedDensity<3,elemT> &current_image_estimate)
   if (do_kappa && !kappa_ptr->has_same_characteristics(current_image_estimate))
     error("QuadraticPrior: kappa image has not the same index range as the reconstructed image\n");
 
+  const int min_dx = weights[0][0].get_min_index();
+  const int max_dx = weights[0][0].get_max_index();
 
   double result = 0.;
   const int min_z = current_image_estimate.get_min_index(); 
   const int max_z = current_image_estimate.get_max_index(); 
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:result)
+#endif
   for (int z=min_z; z<=max_z; z++)
     {
       const int min_dz = max(weights.get_min_index(), min_z-z);
@@ -265,34 +281,53 @@ compute_value(const DiscretisedDensity<3,elemT> &current_image_estimate)
             const int max_dy = min(weights[0].get_max_index(), max_y-y);            
 
             const int min_x = current_image_estimate[z][y].get_min_index(); 
-            const int max_x = current_image_estimate[z][y].get_max_index(); 
-
-            for (int x=min_x;x<= max_x;x++)       
-              {
-                const int min_dx = max(weights[0][0].get_min_index(), min_x-x);
-                const int max_dx = min(weights[0][0].get_max_index(), max_x-x);
-                
-                /* formula:
-                  sum_dx,dy,dz
-                   1/4 weights[dz][dy][dx] *
-                   (current_image_estimate[z][y][x] - current_image_estimate[z+dz][y+dy][x+dx])^2 *
-                   (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
-                */
-                for (int dz=min_dz;dz<=max_dz;++dz)
-                  for (int dy=min_dy;dy<=max_dy;++dy)
-                    for (int dx=min_dx;dx<=max_dx;++dx)
-                      {
-                        elemT current =
-                          weights[dz][dy][dx] *
-                          square(current_image_estimate[z][y][x] - current_image_estimate[z+dz][y+dy][x+dx])/4;
-
-                        if (do_kappa)
-                          current *= 
-                            (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
-
-                        result += static_cast<double>(current);
-                      }
-              }              
+            const int num_x = current_image_estimate[z][y].get_length();
+            if (num_x == 0)
+              continue;
+            const elemT * const row = &current_image_estimate[z][y][min_x];
+            const elemT * const kappa_row = do_kappa ? &(*kappa_ptr)[z][y][min_x] : 0;
+
+            /* formula:
+               sum_dx,dy,dz
+                 1/4 weights[dz][dy][dx] *
+                 (current_image_estimate[z][y][x] - current_image_estimate[z+dz][y+dy][x+dx])^2 *
+                 (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
+            */
+            double row_result = 0.;
+            for (int dz=min_dz;dz<=max_dz;++dz)
+              for (int dy=min_dy;dy<=max_dy;++dy)
+                {
+                  const elemT * const neighbour_row = &current_image_estimate[z+dz][y+dy][min_x];
+                  const elemT * const kappa_neighbour_row = do_kappa ? &(*kappa_ptr)[z+dz][y+dy][min_x] : 0;
+                  for (int dx=min_dx;dx<=max_dx;++dx)
+                    {
+                      const float weight = weights[dz][dy][dx];
+                      if (weight == 0)
+                        continue;
+                      const int start_x = max(0, -dx);
+                      const int end_x = min(num_x, num_x-dx);
+                      if (do_kappa)
+                        {
+                          for (int x=start_x; x<end_x; ++x)
+                            {
+                              const elemT current =
+                                weight * square(row[x] - neighbour_row[x+dx])/4 *
+                                (kappa_row[x] * kappa_neighbour_row[x+dx]);
+                              row_result += static_cast<double>(current);
+                            }
+                        }
+                      else
+                        {
+                          for (int x=start_x; x<end_x; ++x)
+                            {
+                              const elemT current =
+                                weight * square(row[x] - neighbour_row[x+dx])/4;
+                              row_result += static_cast<double>(current);
+                            }
+                        }
+                    }
+                }
+            result += row_result;
           }
     }
   return result * this->penalisation_factor;
@@ -328,8 +363,14 @@ compute_gradient(DiscretisedDensity<3,elemT>& prior_gradient,
   if (do_kappa && !kappa_ptr->has_same_characteristics(current_image_estimate))
     error("QuadraticPrior: kappa image has not the same index range as the reconstructed image\n");
 
+  const int min_dx = weights[0][0].get_min_index();
+  const int max_dx = weights[0][0].get_max_index();
+
   const int min_z = current_image_estimate.get_min_index();  
   const int max_z = current_image_estimate.get_max_index();  
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
   for (int z=min_z; z<=max_z; z++) 
     { 
       const int min_dz = max(weights.get_min_index(), min_z-z); 
@@ -344,84 +385,49 @@ compute_gradient(DiscretisedDensity<3,elemT>& prior_gradient,
           const int max_dy = min(weights[0].get_max_index(), max_y-y);             
           
           const int min_x = current_image_estimate[z][y].get_min_index();
-          const int max_x = current_image_estimate[z][y].get_max_index();  
-          
-          for (int x=min_x;x<= max_x;x++)
-            {
-              const int min_dx = max(weights[0][0].get_min_index(), min_x-x);
-              const int max_dx = min(weights[0][0].get_max_index(), max_x-x);
-                
-                /* formula:
-                  sum_dx,dy,dz
-                   weights[dz][dy][dx] *
-                   (current_image_estimate[z][y][x] - current_image_estimate[z+dz][y+dy][x+dx]) *
-                   (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
-                */
-#if 1
-                elemT gradient = 0;
-                for (int dz=min_dz;dz<=max_dz;++dz)
-                  for (int dy=min_dy;dy<=max_dy;++dy)
-                    for (int dx=min_dx;dx<=max_dx;++dx)
+          const int num_x = current_image_estimate[z][y].get_length();
+          if (num_x == 0)
+            continue;
+          const elemT * const row = &current_image_estimate[z][y][min_x];
+          const elemT * const kappa_row = do_kappa ? &(*kappa_ptr)[z][y][min_x] : 0;
+          elemT * const gradient_row = &prior_gradient[z][y][min_x];
+          std::fill(gradient_row, gradient_row + num_x, static_cast<elemT>(0));
+
+          /* formula:
+             sum_dx,dy,dz
+               weights[dz][dy][dx] *
+               (current_image_estimate[z][y][x] - current_image_estimate[z+dz][y+dy][x+dx]) *
+               (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
+          */
+          for (int dz=min_dz;dz<=max_dz;++dz)
+            for (int dy=min_dy;dy<=max_dy;++dy)
+              {
+                const elemT * const neighbour_row = &current_image_estimate[z+dz][y+dy][min_x];
+                const elemT * const kappa_neighbour_row = do_kappa ? &(*kappa_ptr)[z+dz][y+dy][min_x] : 0;
+                for (int dx=min_dx;dx<=max_dx;++dx)
+                  {
+                    const float weight = weights[dz][dy][dx];
+                    if (weight == 0)
+                      continue;
+                    const int start_x = max(0, -dx);
+                    const int end_x = min(num_x, num_x-dx);
+                    if (do_kappa)
                       {
-                        elemT current =
-                          weights[dz][dy][dx] *
-                          (current_image_estimate[z][y][x] - current_image_estimate[z+dz][y+dy][x+dx]);
-
-                        if (do_kappa)
-                          current *= 
-                            (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
-
-                        gradient += current;
+                        for (int x=start_x; x<end_x; ++x)
+                          gradient_row[x] +=
+                            weight * (row[x] - neighbour_row[x+dx]) *
+                            (kappa_row[x] * kappa_neighbour_row[x+dx]);
                       }
-#else
-                // attempt to speed up by precomputing the sum of weights.
-                // The current code gives identical results but is actually slower
-                // than the above, at least when kappas are present.
-
-
-                // precompute sum of weights
-                // TODO without kappas, this is just weights.sum() most of the time, 
-                // but not near edges
-                float sum_of_weights = 0;
-                {
-                  if (do_kappa)
-                    {                
-                      for (int dz=min_dz;dz<=max_dz;++dz)
-                        for (int dy=min_dy;dy<=max_dy;++dy)
-                          for (int dx=min_dx;dx<=max_dx;++dx)
-                            sum_of_weights +=  weights[dz][dy][dx]*(*kappa_ptr)[z+dz][y+dy][x+dx];
-                    }
-                  else
-                    {
-                      for (int dz=min_dz;dz<=max_dz;++dz)
-                        for (int dy=min_dy;dy<=max_dy;++dy)
-                          for (int dx=min_dx;dx<=max_dx;++dx)
-                            sum_of_weights +=  weights[dz][dy][dx];
-                    }
-                }
-                // now compute contribution of central term
-                elemT gradient = sum_of_weights * current_image_estimate[z][y][x] ;
-
-                // subtract the rest
-                for (int dz=min_dz;dz<=max_dz;++dz)
-                  for (int dy=min_dy;dy<=max_dy;++dy)
-                    for (int dx=min_dx;dx<=max_dx;++dx)
+                    else
                       {
-                        elemT current =
-                          weights[dz][dy][dx] * current_image_estimate[z+dz][y+dy][x+dx];
-
-                        if (do_kappa)
-                          current *= (*kappa_ptr)[z+dz][y+dy][x+dx];
-
-                        gradient -= current;
+                        for (int x=start_x; x<end_x; ++x)
+                          gradient_row[x] += weight * (row[x] - neighbour_row[x+dx]);
                       }
-                // multiply with central kappa
-                if (do_kappa)
-                  gradient *= (*kappa_ptr)[z][y][x];
-#endif
-                prior_gradient[z][y][x]= gradient * this->penalisation_factor;
-              }              
-          }
+                  }
+              }
+          for (int x=0; x<num_x; ++x)
+            gradient_row[x] *= this->penalisation_factor;
+        }
     }
 
   info(boost::format("Prior gradient max %1%, min %2%\n") % prior_gradient.find_max() % prior_gradient.find_min());
@@ -530,8 +536,14 @@ QuadraticPrior<elemT>::parabolic_surrogate_curvature(DiscretisedDensity<3,elemT>
   if (do_kappa && !kappa_ptr->has_same_characteristics(current_image_estimate))
     error("QuadraticPrior: kappa image has not the same index range as the reconstructed image\n");
 
+  const int min_dx = weights[0][0].get_min_index();
+  const int max_dx = weights[0][0].get_max_index();
+
   const int min_z = current_image_estimate.get_min_index();   
   const int max_z = current_image_estimate.get_max_index();   
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
   for (int z=min_z; z<=max_z; z++)  
     {  
       const int min_dz = max(weights.get_min_index(), min_z-z);  
@@ -546,31 +558,40 @@ QuadraticPrior<elemT>::parabolic_surrogate_curvature(DiscretisedDensity<3,elemT>
           const int max_dy = min(weights[0].get_max_index(), max_y-y);              
            
           const int min_x = current_image_estimate[z][y].get_min_index(); 
-          const int max_x = current_image_estimate[z][y].get_max_index();   
-          for (int x=min_x;x<= max_x;x++) 
-            { 
-              const int min_dx = max(weights[0][0].get_min_index(), min_x-x); 
-              const int max_dx = min(weights[0][0].get_max_index(), max_x-x); 
-                
-                elemT gradient = 0;
-                for (int dz=min_dz;dz<=max_dz;++dz)
-                  for (int dy=min_dy;dy<=max_dy;++dy)
-                    for (int dx=min_dx;dx<=max_dx;++dx)
+          const int num_x = current_image_estimate[z][y].get_length();
+          if (num_x == 0)
+            continue;
+          const elemT * const kappa_row = do_kappa ? &(*kappa_ptr)[z][y][min_x] : 0;
+          elemT * const curvature_row = &parabolic_surrogate_curvature[z][y][min_x];
+          std::fill(curvature_row, curvature_row + num_x, static_cast<elemT>(0));
+
+          for (int dz=min_dz;dz<=max_dz;++dz)
+            for (int dy=min_dy;dy<=max_dy;++dy)
+              {
+                const elemT * const kappa_neighbour_row = do_kappa ? &(*kappa_ptr)[z+dz][y+dy][min_x] : 0;
+                for (int dx=min_dx;dx<=max_dx;++dx)
+                  {
+                    // 1 comes from omega = psi'(t)/t = 2*t/2t =1                  
+                    const float weight = weights[dz][dy][dx];
+                    if (weight == 0)
+                      continue;
+                    const int start_x = max(0, -dx);
+                    const int end_x = min(num_x, num_x-dx);
+                    if (do_kappa)
                       {
-                        // 1 comes from omega = psi'(t)/t = 2*t/2t =1                  
-                        elemT current =
-                          weights[dz][dy][dx] *1;
-
-                         if (do_kappa)
-                          current *= 
-                            (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
-
-                        gradient += current;
+                        for (int x=start_x; x<end_x; ++x)
+                          curvature_row[x] += weight * (kappa_row[x] * kappa_neighbour_row[x+dx]);
                       }
-                
-                parabolic_surrogate_curvature[z][y][x]= gradient * this->penalisation_factor;
-              }              
-          }
+                    else
+                      {
+                        for (int x=start_x; x<end_x; ++x)
+                          curvature_row[x] += weight;
+                      }
+                  }
+              }
+          for (int x=0; x<num_x; ++x)
+            curvature_row[x] *= this->penalisation_factor;
+        }
     }
 
   info(boost::format("parabolic_surrogate_curvature max %1%, min %2%\n") % parabolic_surrogate_curvature.find_max() % parabolic_surrogate_curvature.find_min());
@@ -613,8 +634,14 @@ add_multiplication_with_approximate_Hessian(DiscretisedDensity<3,elemT>& output,
   if (do_kappa && !kappa_ptr->has_same_characteristics(input))
     error("QuadraticPrior: kappa image has not the same index range as the reconstructed image\n");
 
+  const int min_dx = weights[0][0].get_min_index();
+  const int max_dx = weights[0][0].get_max_index();
+
   const int min_z = output.get_min_index();   
   const int max_z = output.get_max_index();   
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
   for (int z=min_z; z<=max_z; z++)  
     {  
       const int min_dz = max(weights.get_min_index(), min_z-z);  
@@ -623,35 +650,50 @@ add_multiplication_with_approximate_Hessian(DiscretisedDensity<3,elemT>& output,
       const int min_y = output[z].get_min_index();  
       const int max_y = output[z].get_max_index();  
        
+      // sum over the neighbourhood for every voxel in a row
+      std::vector<elemT> result(output[z][min_y].get_length());
       for (int y=min_y;y<= max_y;y++)  
         {  
           const int min_dy = max(weights[0].get_min_index(), min_y-y);  
           const int max_dy = min(weights[0].get_max_index(), max_y-y);              
            
           const int min_x = output[z][y].get_min_index(); 
-          const int max_x = output[z][y].get_max_index();   
-
-          for (int x=min_x;x<= max_x;x++) 
-            { 
-              const int min_dx = max(weights[0][0].get_min_index(), min_x-x); 
-              const int max_dx = min(weights[0][0].get_max_index(), max_x-x); 
-                
-                elemT result = 0;
-                for (int dz=min_dz;dz<=max_dz;++dz)
-                  for (int dy=min_dy;dy<=max_dy;++dy)
-                    for (int dx=min_dx;dx<=max_dx;++dx)
+          const int num_x = output[z][y].get_length();
+          if (num_x == 0)
+            continue;
+          const elemT * const kappa_row = do_kappa ? &(*kappa_ptr)[z][y][min_x] : 0;
+          result.assign(num_x, static_cast<elemT>(0));
+          elemT * const result_row = &result[0];
+
+          for (int dz=min_dz;dz<=max_dz;++dz)
+            for (int dy=min_dy;dy<=max_dy;++dy)
+              {
+                const elemT * const input_neighbour_row = &input[z+dz][y+dy][min_x];
+                const elemT * const kappa_neighbour_row = do_kappa ? &(*kappa_ptr)[z+dz][y+dy][min_x] : 0;
+                for (int dx=min_dx;dx<=max_dx;++dx)
+                  {
+                    const float weight = weights[dz][dy][dx];
+                    if (weight == 0)
+                      continue;
+                    const int start_x = max(0, -dx);
+                    const int end_x = min(num_x, num_x-dx);
+                    if (do_kappa)
                       {
-                        elemT current =
-                          weights[dz][dy][dx] * input[z+dz][y+dy][x+dx];
-
-                         if (do_kappa)
-                          current *= 
-                            (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
-                         result += current;
+                        for (int x=start_x; x<end_x; ++x)
+                          result_row[x] +=
+                            weight * input_neighbour_row[x+dx] *
+                            (kappa_row[x] * kappa_neighbour_row[x+dx]);
+                      }
+                    else
+                      {
+                        for (int x=start_x; x<end_x; ++x)
+                          result_row[x] += weight * input_neighbour_row[x+dx];
                       }
-                
-                output[z][y][x] += result * this->penalisation_factor;
-            }              
+                  }
+              }
+          elemT * const output_row = &output[z][y][min_x];
+          for (int x=0; x<num_x; ++x)
+            output_row[x] += result_row[x] * this->penalisation_factor;
         }
     }
   return Succeeded::yes;
@@ -35,14 +35,19 @@
    treatment of LORs parallel to planes is now scale independent (and checked with asserts)
    KT 18/05/2005
    handle LORs in a plane between voxels
+   2018
+   added version that traces a batch of LORs simultaneously
 */
 
 #include "stir/recon_buildblock/RayTraceVoxelsOnCartesianGrid.h"
 #include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
 #include "stir/CartesianCoordinate3D.h"
 #include "stir/round.h"
+#include "stir/warning.h"
 #include <math.h>
 #include <algorithm>
+#include <vector>
+#include <string>
 
 #ifndef STIR_NO_NAMESPACE
 using std::min;
@@ -58,30 +63,69 @@ is_half_integer(const float a)
     fabs(floor(a)+.5F - a)<.0001F;
 }
 
-void 
-RayTraceVoxelsOnCartesianGrid
-        (ProjMatrixElemsForOneBin& lor, 
-         const CartesianCoordinate3D<float>& start_point, 
-         const CartesianCoordinate3D<float>& stop_point, 
-         const CartesianCoordinate3D<float>& voxel_size,
-         const float normalisation_constant)
+namespace {
+//! state of the ray tracing for a single LOR
+struct RayTracingState
 {
+  float a, amax;
+  float ax, ay, az;
+  float inc_x, inc_y, inc_z;
+  int sign_x, sign_y, sign_z;
+  CartesianCoordinate3D<int> current_voxel;
+  unsigned int lor_size;
+};
+}
 
-  const CartesianCoordinate3D<float> difference = stop_point-start_point;
+static const float small_difference = 1.E-4F;
 
+//! check if we need to handle the LOR specially
+/*! returns \c true if the start and stop point are (nearly) identical, or if
+    the LOR is in one of the planes between voxels. In the latter case,
+    \a inc is set to the shift to the neighbouring voxel centres.
+*/
+static bool
+needs_special_treatment(CartesianCoordinate3D<float>& inc,
+                        const CartesianCoordinate3D<float>& start_point,
+                        const CartesianCoordinate3D<float>& difference)
+{
+  inc = CartesianCoordinate3D<float>(0,0,0);
   if (norm(difference)<=.00001F)
+    return true;
+
+  /* check if ray is in one of the planes between voxels.
+     If so, we will ray trace twice, i.e. to the 'left' and 'right', and store half 
+     the value for each voxel.
+  */
+  if (fabs(difference.z())<=small_difference && is_half_integer(start_point.z()))
     {
-      // TODO
-      // not sure how to handle this case as we're normally ray tracing from voxel edges
-      warning("ray tracing with equal start and end point. Returning zero");
-      return;
+      inc = CartesianCoordinate3D<float> (.5F,0,0);
+    }
+  else if (fabs(difference.y())<=small_difference && is_half_integer(start_point.y()))
+    {
+      inc = CartesianCoordinate3D<float> (0,.5F,0);
     }
+  else if (fabs(difference.x())<=small_difference && is_half_integer(start_point.x()))
+    {
+      inc = CartesianCoordinate3D<float> (0,0,.5F);
+    }
+  return norm(inc)>.1;
+}
+
+//! find starting values for the ray tracing of a LOR that does not need special treatment
+static void
+set_up_ray_tracing(RayTracingState& state,
+                   const CartesianCoordinate3D<float>& start_point, 
+                   const CartesianCoordinate3D<float>& stop_point, 
+                   const CartesianCoordinate3D<float>& voxel_size,
+                   const float normalisation_constant)
+{
+  const CartesianCoordinate3D<float> difference = stop_point-start_point;
 
   // Find number of contributing elements. This will be used to
   // make sure there's enough space in the LOR to avoid reallocation.
   // This will make it faster, but also avoid over-allocation
   // (as most STL implementations double the allocated size at over-run).
-  const int unsigned lor_size =
+  state.lor_size =
     static_cast<unsigned int>(ceil(fabs(difference.z())) +
 			      ceil(fabs(difference.y())) +
 			      ceil(fabs(difference.x()))) + 3;
@@ -95,6 +139,9 @@ RayTraceVoxelsOnCartesianGrid
   const int sign_x = difference.x()>=0 ? 1 : -1;
   const int sign_y = difference.y()>=0 ? 1 : -1;
   const int sign_z = difference.z()>=0 ? 1 : -1;
+  state.sign_x = sign_x;
+  state.sign_y = sign_y;
+  state.sign_z = sign_z;
 
   /* parametrise line in grid units as
      {z,y,x} = start_point + a difference/d12
@@ -106,62 +153,23 @@ RayTraceVoxelsOnCartesianGrid
 
     Special treatment is necessary when the line is parallel to one of the 
     coordinate planes. This is determined by comparing difference with the 
-    constant small_difference below. (Note that difference is in grid-units, so
+    constant small_difference. (Note that difference is in grid-units, so
     it has a natural scale of 1.)
   */
-  const float small_difference = 1.E-4F;
   const bool zero_diff_in_x = fabs(difference.x())<=small_difference;
   const bool zero_diff_in_y = fabs(difference.y())<=small_difference;
   const bool zero_diff_in_z = fabs(difference.z())<=small_difference;
 
-  /* check if ray is in one of the planes between voxels.
-     If so, we will ray trace twice, i.e. to the 'left' and 'right', and store half 
-     the value for each voxel.
-  */
-  {
-    CartesianCoordinate3D<float> inc(0,0,0);
-    // z
-    if (zero_diff_in_z && is_half_integer(start_point.z()))
-      {
-	inc = CartesianCoordinate3D<float> (.5F,0,0);
-      }
-    else if (zero_diff_in_y && is_half_integer(start_point.y()))
-      {
-	inc = CartesianCoordinate3D<float> (0,.5F,0);
-      }
-    else if (zero_diff_in_x && is_half_integer(start_point.x()))
-      {
-	inc = CartesianCoordinate3D<float> (0,0,.5F);
-      }
-    if (norm(inc)>.1)
-      {
-	lor.reserve(lor.size() + 2*lor_size);
-	RayTraceVoxelsOnCartesianGrid(lor, 
-				      start_point - inc,
-				      stop_point - inc, 
-				      voxel_size,
-				      normalisation_constant/2);
-	
-	RayTraceVoxelsOnCartesianGrid(lor, 
-				      start_point + inc,
-				      stop_point + inc, 
-				      voxel_size,
-				      normalisation_constant/2);
-	lor.sort();
-	return;
-      }
-  }
-
-  // now start the normal case
   assert(!(zero_diff_in_z && is_half_integer(start_point.z())));
   assert(!(zero_diff_in_y && is_half_integer(start_point.y())));
   assert(!(zero_diff_in_x && is_half_integer(start_point.x())));
 
-  lor.reserve(lor.size() + lor_size);
-
   const float inc_x = zero_diff_in_x ? d12*1000000.F : d12 / fabs(difference.x());
   const float inc_y = zero_diff_in_y ? d12*1000000.F : d12 / fabs(difference.y());
   const float inc_z = zero_diff_in_z ? d12*1000000.F : d12 / fabs(difference.z());
+  state.inc_x = inc_x;
+  state.inc_y = inc_y;
+  state.inc_z = inc_z;
   
   // intersection points with intra-voxel planes : 
   // find voxel which contains the end_point, and go to its 'right' edge
@@ -184,11 +192,12 @@ RayTraceVoxelsOnCartesianGrid
      a? might turn out be a tiny bit smaller then a?end_exact. So, we set aend a tiny bit 
      smaller than aend_exact.
   */
-const float axend = zero_diff_in_x ? d12*1000000.F : (xmax - start_point.x()) * inc_x * sign_x *.9999F;
+  const float axend = zero_diff_in_x ? d12*1000000.F : (xmax - start_point.x()) * inc_x * sign_x *.9999F;
   const float ayend = zero_diff_in_y ? d12*1000000.F : (ymax - start_point.y()) * inc_y * sign_y *.9999F;
   const float azend = zero_diff_in_z ? d12*1000000.F : (zmax - start_point.z()) * inc_z * sign_z *.9999F;
   
   const float amax = min(axend, min(ayend, azend));
+  state.amax = amax;
   
   // just to be sure, check that axend was set large enough when difference.x() was small.
   assert(fabs(difference.x())>small_difference || axend>amax);
@@ -196,7 +205,8 @@ const float axend = zero_diff_in_x ? d12*1000000.F : (xmax - start_point.x()) *
   assert(fabs(difference.z())>small_difference || azend>amax);
 
   // coordinates of the first Voxel:
-  CartesianCoordinate3D<int> current_voxel = round(start_point);
+  const CartesianCoordinate3D<int> current_voxel = round(start_point);
+  state.current_voxel = current_voxel;
   
   /* Find the a? values of the intersection points of the LOR with the planes between voxels
      at the 'left' side of the start_point..
@@ -235,7 +245,7 @@ const float axend = zero_diff_in_x ? d12*1000000.F : (xmax - start_point.x()) *
   // The biggest a?  value gives the start of the a-row 
   // Note that we should use a=0 if we want to start from start_point
   // (and not from the 'left' edge of the voxel containing start_point)
-  float a = max(ax, max(ay,az));      
+  state.a = max(ax, max(ay,az));      
 
   // now go the intersections with next plane
   if (zero_diff_in_x) ax = axend; else ax += inc_x;
@@ -246,6 +256,70 @@ const float axend = zero_diff_in_x ? d12*1000000.F : (xmax - start_point.x()) *
   assert(!zero_diff_in_x || ax>amax);
   assert(!zero_diff_in_y || ay>amax);
   assert(!zero_diff_in_z || az>amax);
+  state.ax = ax;
+  state.ay = ay;
+  state.az = az;
+}
+
+void 
+RayTraceVoxelsOnCartesianGrid
+        (ProjMatrixElemsForOneBin& lor, 
+         const CartesianCoordinate3D<float>& start_point, 
+         const CartesianCoordinate3D<float>& stop_point, 
+         const CartesianCoordinate3D<float>& voxel_size,
+         const float normalisation_constant)
+{
+
+  const CartesianCoordinate3D<float> difference = stop_point-start_point;
+
+  CartesianCoordinate3D<float> inc;
+  if (needs_special_treatment(inc, start_point, difference))
+    {
+      if (norm(inc)<=.1)
+        {
+          // TODO
+          // not sure how to handle this case as we're normally ray tracing from voxel edges
+          warning("ray tracing with equal start and end point. Returning zero");
+          return;
+        }
+      const int unsigned lor_size =
+        static_cast<unsigned int>(ceil(fabs(difference.z())) +
+                                  ceil(fabs(difference.y())) +
+                                  ceil(fabs(difference.x()))) + 3;
+      lor.reserve(lor.size() + 2*lor_size);
+      RayTraceVoxelsOnCartesianGrid(lor, 
+                                    start_point - inc,
+                                    stop_point - inc, 
+                                    voxel_size,
+                                    normalisation_constant/2);
+	
+      RayTraceVoxelsOnCartesianGrid(lor, 
+                                    start_point + inc,
+                                    stop_point + inc, 
+                                    voxel_size,
+                                    normalisation_constant/2);
+      lor.sort();
+      return;
+    }
+
+  // now start the normal case
+  RayTracingState state;
+  set_up_ray_tracing(state, start_point, stop_point, voxel_size, normalisation_constant);
+
+  lor.reserve(lor.size() + state.lor_size);
+
+  float a = state.a;
+  float ax = state.ax;
+  float ay = state.ay;
+  float az = state.az;
+  const float amax = state.amax;
+  const float inc_x = state.inc_x;
+  const float inc_y = state.inc_y;
+  const float inc_z = state.inc_z;
+  const int sign_x = state.sign_x;
+  const int sign_y = state.sign_y;
+  const int sign_z = state.sign_z;
+  CartesianCoordinate3D<int> current_voxel = state.current_voxel;
 
   {	  
     // go along the LOR 
@@ -275,4 +349,270 @@ const float axend = zero_diff_in_x ? d12*1000000.F : (xmax - start_point.x()) *
     }	// end of while (a<amax)           
   }
 }
+
+/************************ batched version *****************************/
+
+namespace {
+//! number of LORs that are traced simultaneously
+const int ray_tracing_batch_size = 16;
+//! number of steps that are computed before the results are copied to the LORs
+const int ray_tracing_num_steps_per_chunk = 32;
+
+/* State of a batch of LORs as a "structure of arrays", such that
+   operations on all LORs in the batch can be vectorised.
+   Lanes that are not used have a==amax, such that they are inactive.
+*/
+struct RayTracingBatch
+{
+  float a[ray_tracing_batch_size], amax[ray_tracing_batch_size];
+  float ax[ray_tracing_batch_size], ay[ray_tracing_batch_size], az[ray_tracing_batch_size];
+  float inc_x[ray_tracing_batch_size], inc_y[ray_tracing_batch_size], inc_z[ray_tracing_batch_size];
+  int sign_x[ray_tracing_batch_size], sign_y[ray_tracing_batch_size], sign_z[ray_tracing_batch_size];
+  int voxel_x[ray_tracing_batch_size], voxel_y[ray_tracing_batch_size], voxel_z[ray_tracing_batch_size];
+
+  // output for ray_tracing_num_steps_per_chunk steps
+  float length[ray_tracing_num_steps_per_chunk][ray_tracing_batch_size];
+  int out_x[ray_tracing_num_steps_per_chunk][ray_tracing_batch_size];
+  int out_y[ray_tracing_num_steps_per_chunk][ray_tracing_batch_size];
+  int out_z[ray_tracing_num_steps_per_chunk][ray_tracing_batch_size];
+  //! number of valid steps in the output for every lane
+  int num_steps[ray_tracing_batch_size];
+};
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+  (defined(__clang__) || (__GNUC__ >= 5))
+// we can compile versions for different instruction sets, and choose at run-time
+#define STIR_RAY_TRACING_RUNTIME_DISPATCH
+#endif
+
+/* gcc does not vectorise the loop below when floating point comparisons
+   could trap, so we tell it they won't (this is the default for clang).
+   Note that this has no effect on the results.
+*/
+#if defined(__GNUC__) && !defined(__clang__)
+#define STIR_RAY_TRACING_KERNEL_ATTRIBUTES __attribute__((optimize("no-trapping-math")))
+#else
+#define STIR_RAY_TRACING_KERNEL_ATTRIBUTES
+#endif
+#if defined(__GNUC__)
+#define STIR_RAY_TRACING_ALWAYS_INLINE inline __attribute__((always_inline)) STIR_RAY_TRACING_KERNEL_ATTRIBUTES
+#else
+#define STIR_RAY_TRACING_ALWAYS_INLINE inline
+#endif
+
+/* Does ray_tracing_num_steps_per_chunk steps for all LORs in the batch.
+   Returns the number of LORs that are still active.
+
+   This is the same algorithm as in the scalar version, but written without
+   branches, such that the compiler can vectorise the loop over the lanes.
+   The floating point operations are identical to the ones in the scalar version,
+   so results are identical as well.
+   Note that once a lane is inactive, it remains inactive, so the valid steps
+   for every lane are always the first ones.
+*/
+static STIR_RAY_TRACING_ALWAYS_INLINE int
+ray_trace_batch_chunk_kernel(RayTracingBatch& batch)
+{
+  // copy state to local variables, such that the compiler knows they
+  // do not overlap with the output (otherwise it does not vectorise the loop)
+  float a[ray_tracing_batch_size], ax[ray_tracing_batch_size], ay[ray_tracing_batch_size], az[ray_tracing_batch_size];
+  int voxel_x[ray_tracing_batch_size], voxel_y[ray_tracing_batch_size], voxel_z[ray_tracing_batch_size];
+  int num_steps[ray_tracing_batch_size];
+  for (int i=0; i<ray_tracing_batch_size; ++i)
+    {
+      a[i] = batch.a[i]; ax[i] = batch.ax[i]; ay[i] = batch.ay[i]; az[i] = batch.az[i];
+      voxel_x[i] = batch.voxel_x[i]; voxel_y[i] = batch.voxel_y[i]; voxel_z[i] = batch.voxel_z[i];
+      num_steps[i] = 0;
+    }
+
+  int num_active = 0;
+  for (int step=0; step<ray_tracing_num_steps_per_chunk; ++step)
+    {
+      num_active = 0;
+      for (int i=0; i<ray_tracing_batch_size; ++i)
+        {
+          // note: use of & and | instead of && and || avoids branches
+          const int active = a[i] < batch.amax[i];
+          // same choices as in the scalar version
+          const int ax_lt_ay = ax[i] < ay[i];
+          const int step_x = ax_lt_ay & (ax[i] < az[i]);
+          const int step_y = (1 - ax_lt_ay) & (ay[i] < az[i]);
+          const int step_z = 1 - (step_x | step_y);
+          const float next_a = step_x ? ax[i] : (step_y ? ay[i] : az[i]);
+          // compute all increments, such that there are no conditional loads
+          const float next_ax = ax[i] + batch.inc_x[i];
+          const float next_ay = ay[i] + batch.inc_y[i];
+          const float next_az = az[i] + batch.inc_z[i];
+
+          batch.length[step][i] = next_a - a[i];
+          batch.out_x[step][i] = voxel_x[i];
+          batch.out_y[step][i] = voxel_y[i];
+          batch.out_z[step][i] = voxel_z[i];
+
+          a[i] = active ? next_a : a[i];
+          ax[i] = (active & step_x) ? next_ax : ax[i];
+          ay[i] = (active & step_y) ? next_ay : ay[i];
+          az[i] = (active & step_z) ? next_az : az[i];
+          voxel_x[i] += (active & step_x) * batch.sign_x[i];
+          voxel_y[i] += (active & step_y) * batch.sign_y[i];
+          voxel_z[i] += (active & step_z) * batch.sign_z[i];
+          num_steps[i] += active;
+          num_active += active;
+        }
+      if (num_active == 0)
+        break;
+    }
+
+  for (int i=0; i<ray_tracing_batch_size; ++i)
+    {
+      batch.a[i] = a[i]; batch.ax[i] = ax[i]; batch.ay[i] = ay[i]; batch.az[i] = az[i];
+      batch.voxel_x[i] = voxel_x[i]; batch.voxel_y[i] = voxel_y[i]; batch.voxel_z[i] = voxel_z[i];
+      batch.num_steps[i] = num_steps[i];
+    }
+  return num_active;
+}
+
+STIR_RAY_TRACING_KERNEL_ATTRIBUTES static int
+ray_trace_batch_chunk_default(RayTracingBatch& batch)
+{
+  return ray_trace_batch_chunk_kernel(batch);
+}
+
+#ifdef STIR_RAY_TRACING_RUNTIME_DISPATCH
+__attribute__((target("avx2"))) STIR_RAY_TRACING_KERNEL_ATTRIBUTES static int
+ray_trace_batch_chunk_avx2(RayTracingBatch& batch)
+{
+  return ray_trace_batch_chunk_kernel(batch);
+}
+
+__attribute__((target("avx512f"))) STIR_RAY_TRACING_KERNEL_ATTRIBUTES static int
+ray_trace_batch_chunk_avx512(RayTracingBatch& batch)
+{
+  return ray_trace_batch_chunk_kernel(batch);
+}
+#endif
+
+typedef int (*ray_trace_batch_chunk_type)(RayTracingBatch&);
+
+static ray_trace_batch_chunk_type
+get_ray_trace_batch_chunk_function()
+{
+#ifdef STIR_RAY_TRACING_RUNTIME_DISPATCH
+  if (__builtin_cpu_supports("avx512f"))
+    return &ray_trace_batch_chunk_avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return &ray_trace_batch_chunk_avx2;
+#endif
+  return &ray_trace_batch_chunk_default;
+}
+
+std::string
+get_RayTraceVoxelsOnCartesianGrid_instruction_set()
+{
+  const ray_trace_batch_chunk_type function_ptr = get_ray_trace_batch_chunk_function();
+#ifdef STIR_RAY_TRACING_RUNTIME_DISPATCH
+  if (function_ptr == &ray_trace_batch_chunk_avx512)
+    return "AVX-512";
+  if (function_ptr == &ray_trace_batch_chunk_avx2)
+    return "AVX2";
+#endif
+  return "default";
+}
+
+void 
+RayTraceVoxelsOnCartesianGrid(std::vector<ProjMatrixElemsForOneBin>& lors,
+                              const std::vector<CartesianCoordinate3D<float> >& start_points, 
+                              const std::vector<CartesianCoordinate3D<float> >& stop_points, 
+                              const CartesianCoordinate3D<float>& voxel_size,
+                              const float normalisation_constant)
+{
+  assert(start_points.size() == stop_points.size());
+  assert(lors.size() == start_points.size());
+  // note: this is thread-safe as function-local statics are only initialised once
+  // (and the result is the same for all threads anyway)
+  static const ray_trace_batch_chunk_type ray_trace_batch_chunk =
+    get_ray_trace_batch_chunk_function();
+
+  RayTracingBatch batch;
+  ProjMatrixElemsForOneBin::value_type elements[ray_tracing_batch_size][ray_tracing_num_steps_per_chunk];
+  // LOR handled by every lane (or -1 if the lane is free)
+  int lor_nums[ray_tracing_batch_size];
+  // initialise all lanes as inactive
+  for (int i=0; i<ray_tracing_batch_size; ++i)
+    {
+      lor_nums[i] = -1;
+      batch.a[i] = batch.amax[i] = 0.F;
+      batch.ax[i] = batch.ay[i] = batch.az[i] = 0.F;
+      batch.inc_x[i] = batch.inc_y[i] = batch.inc_z[i] = 0.F;
+      batch.sign_x[i] = batch.sign_y[i] = batch.sign_z[i] = 0;
+      batch.voxel_x[i] = batch.voxel_y[i] = batch.voxel_z[i] = 0;
+    }
+
+  const int num_lors = static_cast<int>(lors.size());
+  int next_lor_num = 0;
+  while (true)
+    {
+      /* Put the next LORs in the lanes that are free.
+         This way, lanes do not stay idle when the LORs in a batch have different lengths.
+      */
+      int num_lanes_used = 0;
+      for (int i=0; i<ray_tracing_batch_size; ++i)
+        {
+          while (lor_nums[i]<0 && next_lor_num < num_lors)
+            {
+              const int lor_num = next_lor_num++;
+              CartesianCoordinate3D<float> inc;
+              if (needs_special_treatment(inc, start_points[lor_num], stop_points[lor_num]-start_points[lor_num]))
+                {
+                  RayTraceVoxelsOnCartesianGrid(lors[lor_num], start_points[lor_num], stop_points[lor_num],
+                                                voxel_size, normalisation_constant);
+                  continue;
+                }
+              RayTracingState state;
+              set_up_ray_tracing(state, start_points[lor_num], stop_points[lor_num], voxel_size, normalisation_constant);
+              lors[lor_num].reserve(lors[lor_num].size() + state.lor_size);
+              lor_nums[i] = lor_num;
+              batch.a[i] = state.a; batch.amax[i] = state.amax;
+              batch.ax[i] = state.ax; batch.ay[i] = state.ay; batch.az[i] = state.az;
+              batch.inc_x[i] = state.inc_x; batch.inc_y[i] = state.inc_y; batch.inc_z[i] = state.inc_z;
+              batch.sign_x[i] = state.sign_x; batch.sign_y[i] = state.sign_y; batch.sign_z[i] = state.sign_z;
+              batch.voxel_x[i] = state.current_voxel.x();
+              batch.voxel_y[i] = state.current_voxel.y();
+              batch.voxel_z[i] = state.current_voxel.z();
+            }
+          if (lor_nums[i]>=0)
+            ++num_lanes_used;
+        }
+      if (num_lanes_used == 0)
+        break;
+
+      // do the ray tracing for a number of steps, and copy the results
+      ray_trace_batch_chunk(batch);
+      /* We first construct all elements, and only then add them to the LORs.
+         Constructing an element and immediately copying it to the LOR turns out to be
+         very slow, as the copy reads the element before the stores of its (short) coordinates
+         have finished (at least on x86).
+      */
+      for (int i=0; i<ray_tracing_batch_size; ++i)
+        for (int step=0; step<batch.num_steps[i]; ++step)
+          elements[i][step] =
+            ProjMatrixElemsForOneBin::value_type
+            (CartesianCoordinate3D<int>(batch.out_z[step][i], batch.out_y[step][i], batch.out_x[step][i]),
+             batch.length[step][i]);
+      for (int i=0; i<ray_tracing_batch_size; ++i)
+        {
+          if (lor_nums[i]<0)
+            continue;
+          ProjMatrixElemsForOneBin& lor = lors[lor_nums[i]];
+          const int num_steps = batch.num_steps[i];
+          for (int step=0; step<num_steps; ++step)
+            lor.push_back(elements[i][step]);
+          // free the lane if the LOR is finished
+          if (!(batch.a[i] < batch.amax[i]))
+            lor_nums[i] = -1;
+        }
+    }
+}
+
 END_NAMESPACE_STIR
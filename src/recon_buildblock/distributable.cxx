@@ -58,6 +58,8 @@
 #include "stir/info.h"
 #include <boost/format.hpp>
 #include <algorithm>
+#include <numeric>
+#include <vector>
 
 #ifdef STIR_MPI
 #include "stir/recon_buildblock/distributableMPICacheEnabled.h"
@@ -70,6 +72,10 @@
 #    error Cannot use both OPENMP and MP
 #  endif
 #include <omp.h>
+#  if _OPENMP >= 201107
+// we need OpenMP 3.1 for tasks and atomic reads
+#    define STIR_DISTRIBUTABLE_PREFETCH_VIEWGRAMS
+#  endif
 #endif
 #include "stir/num_threads.h"
 
@@ -143,6 +149,114 @@ void end_distributable_computation()
 
 }
 
+static std::size_t distributable_computation_memory_budget = 0;
+
+void set_distributable_computation_memory_budget(const std::size_t num_bytes)
+{
+  distributable_computation_memory_budget = num_bytes;
+}
+
+std::size_t get_distributable_computation_memory_budget()
+{
+  return distributable_computation_memory_budget;
+}
+
+#ifdef STIR_OPENMP
+/* Helper class to handle the output images of the threads.
+
+   Every thread accumulates into its own image, such that threads do not need to
+   wait for each other. Thread 0 uses the output image itself. The number of images
+   is limited by the memory budget. If there are fewer images than threads,
+   a thread locks the image while it is using it.
+
+   reduce() adds all images to the output image. This is done in parallel
+   over slabs of planes, such that the reduction scales with the number of threads
+   as well.
+*/
+class LocalOutputImages
+{
+public:
+  LocalOutputImages(DiscretisedDensity<3,float>* output_image_ptr,
+                    const int num_threads,
+                    const std::size_t memory_budget)
+    : output_image_ptr(output_image_ptr)
+  {
+    int num_images = num_threads;
+    if (output_image_ptr != NULL && memory_budget > 0)
+      {
+        const std::size_t num_bytes_per_image =
+          static_cast<std::size_t>(output_image_ptr->size_all()) * sizeof(float);
+        // note: the output image itself is not counted
+        num_images =
+          std::max(1, std::min(num_threads, static_cast<int>(memory_budget/num_bytes_per_image) + 1));
+      }
+    this->image_sptrs.resize(num_images);
+    this->use_locks = num_images < num_threads;
+    if (this->use_locks)
+      {
+        this->locks.resize(num_images);
+        for (int i=0; i<num_images; ++i)
+          omp_init_lock(&this->locks[i]);
+      }
+  }
+
+  ~LocalOutputImages()
+  {
+    for (std::size_t i=0; i<this->locks.size(); ++i)
+      omp_destroy_lock(&this->locks[i]);
+  }
+
+  int get_num_images() const
+  { return static_cast<int>(this->image_sptrs.size()); }
+
+  //! get the image to use for this thread (returns 0 if there is no output image)
+  DiscretisedDensity<3,float>* acquire(const int thread_num)
+  {
+    if (this->output_image_ptr == NULL)
+      return NULL;
+    const int image_num = thread_num % this->get_num_images();
+    if (this->use_locks)
+      omp_set_lock(&this->locks[image_num]);
+    if (image_num == 0)
+      return this->output_image_ptr;
+    if (is_null_ptr(this->image_sptrs[image_num]))
+      this->image_sptrs[image_num].reset(this->output_image_ptr->get_empty_copy());
+    return this->image_sptrs[image_num].get();
+  }
+
+  //! has to be called when the thread is finished with the image returned by acquire()
+  void release(const int thread_num)
+  {
+    if (this->output_image_ptr != NULL && this->use_locks)
+      omp_unset_lock(&this->locks[thread_num % this->get_num_images()]);
+  }
+
+  //! add all images to the output image
+  void reduce()
+  {
+    if (this->output_image_ptr == NULL)
+      return;
+    const int min_z = this->output_image_ptr->get_min_index();
+    const int max_z = this->output_image_ptr->get_max_index();
+#pragma omp parallel for schedule(static)
+    for (int z=min_z; z<=max_z; ++z)
+      for (int i=1; i<this->get_num_images(); ++i)
+        if (!is_null_ptr(this->image_sptrs[i])) // only accumulate if a thread filled something in
+          (*this->output_image_ptr)[z] += (*this->image_sptrs[i])[z];
+  }
+
+private:
+  DiscretisedDensity<3,float>* output_image_ptr;
+  std::vector<shared_ptr<DiscretisedDensity<3,float> > > image_sptrs;
+  std::vector<omp_lock_t> locks;
+  bool use_locks;
+
+  // copying is not supported (because of the locks)
+  LocalOutputImages(const LocalOutputImages&);
+  LocalOutputImages& operator=(const LocalOutputImages&);
+};
+#endif
+
 template <class ViewgramsPtr>
 static void
 zero_end_sinograms(ViewgramsPtr viewgrams_ptr)
@@ -194,6 +308,14 @@ void get_viewgrams(shared_ptr<RelatedViewgrams<float> >& y,
                         
   if (read_from_proj_dat)
     {
+      // no need to serialise reading if the ProjData object supports it
+      if (proj_dat_ptr->supports_concurrent_access())
+        {
+          y.reset(new RelatedViewgrams<float>
+                  (proj_dat_ptr->get_related_viewgrams(view_segment_num, symmetries_ptr)));
+        }
+      else
+        {
 #ifdef STIR_OPENMP
 #pragma omp critical(VIEW)
 #endif
@@ -206,6 +328,7 @@ void get_viewgrams(shared_ptr<RelatedViewgrams<float> >& y,
                                   get_related_viewgrams(view_segment_num, symmetries_ptr));
       y.reset(new RelatedViewgrams<float>(tmp));
 #endif        
+        }
     }
   else
     {
@@ -408,10 +531,99 @@ void distributable_computation(
   //double total_seq_rpc_time=0.0; //sums up times used for RPC_process_related_viewgrams
 
 #ifdef STIR_OPENMP
-  std::vector< shared_ptr<DiscretisedDensity<3,float> > > local_output_image_sptrs;
-  std::vector<double> local_log_likelihoods;
-  std::vector<int> local_counts, local_count2s;
-#pragma omp parallel shared(local_output_image_sptrs, local_log_likelihoods, local_counts, local_count2s)
+  LocalOutputImages local_output_images(output_image_ptr, omp_get_max_threads(),
+                                        distributable_computation_memory_budget);
+  std::vector<double> local_log_likelihoods(omp_get_max_threads(), 0.);
+  std::vector<int> local_counts(omp_get_max_threads(), 0), local_count2s(omp_get_max_threads(), 0);
+  std::vector<double> local_read_times(omp_get_max_threads(), 0.), local_compute_times(omp_get_max_threads(), 0.);
+  if (output_image_ptr != NULL)
+    info(boost::format("Using %1% thread-local output image(s) for %2% threads")
+         % local_output_images.get_num_images() % omp_get_max_threads());
+#else
+  double read_time = 0., compute_time = 0.;
+#endif
+#ifdef STIR_DISTRIBUTABLE_PREFETCH_VIEWGRAMS
+  /* Pipeline reading of the data with the computation.
+     One thread reads the viewgrams of every (view,segment) group in the subset
+     and creates a task for the computation, which will be executed by one of the
+     other threads. The number of groups that have been read but are not processed
+     yet is limited, such that memory usage is bounded. If the limit is reached, the
+     reading thread will work on one of the tasks.
+     The threads doing the computation therefore never wait for I/O (unless the
+     reading thread cannot keep up).
+     If the team has only 1 thread (e.g. OMP_NUM_THREADS=1, or when called from
+     inside another parallel region), there is nobody else to execute the tasks.
+     They are then not deferred but executed immediately by the reading thread,
+     such that the queue never fills up.
+  */
+  int num_groups_in_queue = 0;
+#pragma omp parallel shared(local_output_images, local_log_likelihoods, local_counts, local_count2s, local_read_times, local_compute_times, num_groups_in_queue)
+  {
+#pragma omp single
+    {
+      std::cerr << "Starting loop with " << omp_get_num_threads() << " threads (with prefetching of viewgrams)\n";
+      const int max_num_groups_in_queue = 2*omp_get_num_threads();
+      const bool defer_tasks = omp_get_num_threads() > 1;
+
+      for (int i=0; i<static_cast<int>(vs_nums_to_process.size()); ++i)
+        {
+          // wait until there is space in the queue
+          while (true)
+            {
+              int current_num_groups_in_queue;
+#pragma omp atomic read
+              current_num_groups_in_queue = num_groups_in_queue;
+              if (current_num_groups_in_queue < max_num_groups_in_queue)
+                break;
+#pragma omp taskyield
+            }
+
+          const ViewSegmentNumbers view_segment_num=vs_nums_to_process[i];
+
+          shared_ptr<RelatedViewgrams<float> > y;
+          shared_ptr<RelatedViewgrams<float> > additive_binwise_correction_viewgrams;
+          shared_ptr<RelatedViewgrams<float> > mult_viewgrams_sptr;
+
+          HighResWallClockTimer read_timer;
+          read_timer.start();
+          get_viewgrams(y, additive_binwise_correction_viewgrams, mult_viewgrams_sptr,
+                        proj_dat_ptr, read_from_proj_dat,
+                        zero_seg0_end_planes,
+                        binwise_correction,
+                        normalisation_sptr, start_time_of_frame, end_time_of_frame,
+                        symmetries_ptr, view_segment_num);
+          read_timer.stop();
+          local_read_times[omp_get_thread_num()] += read_timer.value();
+#pragma omp atomic
+          ++num_groups_in_queue;
+
+#pragma omp task if(defer_tasks) firstprivate(view_segment_num, y, additive_binwise_correction_viewgrams, mult_viewgrams_sptr)
+          {
+            const int thread_num=omp_get_thread_num();
+            info(boost::format("Thread %d/%d calculating segment_num: %d, view_num: %d")
+                 % thread_num % omp_get_num_threads()
+                 % view_segment_num.segment_num() % view_segment_num.view_num());
+            HighResWallClockTimer compute_timer;
+            compute_timer.start();
+            RPC_process_related_viewgrams(forward_projector_ptr,
+                                          back_projector_ptr,
+                                          local_output_images.acquire(thread_num), input_image_ptr, y.get(),
+                                          local_counts[thread_num], local_count2s[thread_num],
+                                          is_null_ptr(log_likelihood_ptr)? NULL : &local_log_likelihoods[thread_num],
+                                          additive_binwise_correction_viewgrams.get(),
+                                          mult_viewgrams_sptr.get());
+            local_output_images.release(thread_num);
+            compute_timer.stop();
+            local_compute_times[thread_num] += compute_timer.value();
+#pragma omp atomic
+            --num_groups_in_queue;
+          } // end of task
+        } // end of for-loop
+    } // end of single (all tasks are finished at its implicit barrier)
+  } // end of parallel section of openmp
+#else // STIR_DISTRIBUTABLE_PREFETCH_VIEWGRAMS
+#ifdef STIR_OPENMP
+#pragma omp parallel shared(local_output_images, local_log_likelihoods, local_counts, local_count2s, local_read_times, local_compute_times)
 #endif
   // start of threaded section if openmp
   { 
@@ -419,10 +631,6 @@ void distributable_computation(
 #pragma omp single
     {
       std::cerr << "Starting loop with " << omp_get_num_threads() << " threads\n"; 
-      local_output_image_sptrs.resize(omp_get_max_threads(), shared_ptr<DiscretisedDensity<3,float> >());
-      local_log_likelihoods.resize(omp_get_max_threads(), 0.);
-      local_counts.resize(omp_get_max_threads(), 0);
-      local_count2s.resize(omp_get_max_threads(), 0);
     }
 #pragma omp for schedule(runtime)  
 #endif
@@ -435,12 +643,20 @@ void distributable_computation(
         shared_ptr<RelatedViewgrams<float> > additive_binwise_correction_viewgrams;
         shared_ptr<RelatedViewgrams<float> > mult_viewgrams_sptr;
 
+        HighResWallClockTimer read_timer;
+        read_timer.start();
         get_viewgrams(y, additive_binwise_correction_viewgrams, mult_viewgrams_sptr,
                       proj_dat_ptr, read_from_proj_dat,
                       zero_seg0_end_planes,
                       binwise_correction,
                       normalisation_sptr, start_time_of_frame, end_time_of_frame,
                       symmetries_ptr, view_segment_num);
+        read_timer.stop();
+#ifdef STIR_OPENMP
+        local_read_times[omp_get_thread_num()] += read_timer.value();
+#else
+        read_time += read_timer.value();
+#endif
 #ifdef STIR_MPI     
 
           //send viewgrams, the slave will immediatelly start calculation
@@ -475,41 +691,39 @@ void distributable_computation(
           info(boost::format("calculating segment_num: %d, view_num: %d")
                % view_segment_num.segment_num() % view_segment_num.view_num());
 #endif
+          HighResWallClockTimer compute_timer;
+          compute_timer.start();
 #ifdef STIR_OPENMP
-          if (output_image_ptr != NULL)
-            {
-              if(is_null_ptr(local_output_image_sptrs[thread_num]))
-                local_output_image_sptrs[thread_num].reset(output_image_ptr->get_empty_copy());
-            }
-            
           RPC_process_related_viewgrams(forward_projector_ptr,
                                         back_projector_ptr,
-                                        local_output_image_sptrs[thread_num].get(), input_image_ptr, y.get(), 
+                                        local_output_images.acquire(thread_num), input_image_ptr, y.get(), 
                                         local_counts[thread_num], local_count2s[thread_num], 
                                         is_null_ptr(log_likelihood_ptr)? NULL : &local_log_likelihoods[thread_num], 
                                         additive_binwise_correction_viewgrams.get(),
                                         mult_viewgrams_sptr.get());
-            
+          local_output_images.release(thread_num);
+          compute_timer.stop();
+          local_compute_times[thread_num] += compute_timer.value();
 #else
           RPC_process_related_viewgrams(forward_projector_ptr,
                                         back_projector_ptr,
                                         output_image_ptr, input_image_ptr, y.get(), count, count2, log_likelihood_ptr, 
                                         additive_binwise_correction_viewgrams.get(),
                                         mult_viewgrams_sptr.get());
+          compute_timer.stop();
+          compute_time += compute_timer.value();
 #endif // OPENMP                                    
 #endif // MPI
       } // end of for-loop 
   } // end of parallel section of openmp
+#endif // STIR_DISTRIBUTABLE_PREFETCH_VIEWGRAMS
   
 #ifdef STIR_OPENMP
   // "reduce" data constructed by threads
   {
-    if (output_image_ptr != NULL)
-      {
-        for (int i=0; i<static_cast<int>(local_output_image_sptrs.size()); ++i)
-	  if(!is_null_ptr(local_output_image_sptrs[i])) // only accumulate if a thread filled something in
-	    *output_image_ptr += *(local_output_image_sptrs[i]);
-      }
+    HighResWallClockTimer reduction_timer;
+    reduction_timer.start();
+    local_output_images.reduce();
     if (log_likelihood_ptr != NULL)
       {
         for (int i=0; i<static_cast<int>(local_log_likelihoods.size()); ++i)
@@ -517,7 +731,15 @@ void distributable_computation(
       }
     count += std::accumulate(local_counts.begin(), local_counts.end(), 0);
     count2 += std::accumulate(local_count2s.begin(), local_count2s.end(), 0);
+    reduction_timer.stop();
+    info(boost::format("Timings for distributable_computation (summed over threads): reading data %1%s, computation %2%s. Reduction: %3%s")
+         % std::accumulate(local_read_times.begin(), local_read_times.end(), 0.)
+         % std::accumulate(local_compute_times.begin(), local_compute_times.end(), 0.)
+         % reduction_timer.value());
   }
+#elif !defined(STIR_MPI)
+  info(boost::format("Timings for distributable_computation: reading data %1%s, computation %2%s")
+       % read_time % compute_time);
 #endif
 #ifdef STIR_MPI
   //end of iteration processing
@@ -46,6 +46,7 @@
 
 #include "stir/recon_buildblock/ProjectorByBinPairUsingProjMatrixByBin.h"
 #include "stir/recon_buildblock/ProjectorByBinPairUsingSeparateProjectors.h"
+#include "stir/recon_buildblock/ProjectorByBinPairUsingOnTheFlyRayTracing.h"
 
 #include "stir/recon_buildblock/TrivialBinNormalisation.h"
 #include "stir/recon_buildblock/ChainedBinNormalisation.h"
@@ -97,6 +98,7 @@ static PresmoothingForwardProjectorByBin::RegisterIt dummy53;
 
 static ProjectorByBinPairUsingProjMatrixByBin::RegisterIt dummy71;
 static ProjectorByBinPairUsingSeparateProjectors::RegisterIt dummy72;
+static ProjectorByBinPairUsingOnTheFlyRayTracing::RegisterIt dummy73;
 
 static TrivialBinNormalisation::RegisterIt dummy91;
 static ChainedBinNormalisation::RegisterIt dummy92;
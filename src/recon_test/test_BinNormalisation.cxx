@@ -0,0 +1,189 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup recon_test
+
+  \brief Test program for stir::BinNormalisation::apply and undo on ProjData
+
+  \par Usage
+
+  <pre>
+  test_BinNormalisation
+  </pre>
+*/
+
+#include "stir/recon_buildblock/BinNormalisationFromProjData.h"
+#include "stir/ProjDataPositionalIO.h"
+#include "stir/ProjDataInterfile.h"
+#include "stir/ProjDataInMemory.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/ExamInfo.h"
+#include "stir/Scanner.h"
+#include "stir/Viewgram.h"
+#include "stir/SegmentByView.h"
+#include "stir/RunTests.h"
+#include "stir/Succeeded.h"
+#include "stir/is_null_ptr.h"
+#include <iostream>
+#include <cstdio>
+#ifdef STIR_OPENMP
+#include <omp.h>
+#endif
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup test
+  \brief Test class for BinNormalisation::apply and undo on ProjData
+
+  Applies a normalisation to data on disk, read and written via positional I/O.
+  As ProjDataPositionalIO supports concurrent access, BinNormalisation then
+  reads and writes the related viewgrams from all threads without critical
+  sections. The result is compared with applying the same normalisation to the
+  data in memory. Undoing the normalisation has to give the original data again.
+
+  When OpenMP is enabled, the test uses 4 threads.
+*/
+class BinNormalisationTests : public RunTests
+{
+public:
+  void run_tests();
+private:
+  //! value used to fill the data. Different for every bin.
+  static float get_test_value(const int segment_num, const int view_num,
+                              const int axial_pos_num, const int tangential_pos_num)
+  {
+    return segment_num*1000.F + view_num*100.F + axial_pos_num + tangential_pos_num/100.F;
+  }
+
+  //! compare all segments of 2 ProjData
+  void check_if_equal_proj_data(const ProjData& proj_data, const ProjData& expected,
+                                const std::string& str);
+};
+
+void
+BinNormalisationTests::
+check_if_equal_proj_data(const ProjData& proj_data, const ProjData& expected,
+                         const std::string& str)
+{
+  for (int segment_num = expected.get_min_segment_num();
+       segment_num <= expected.get_max_segment_num();
+       ++segment_num)
+    {
+      const SegmentByView<float> segment = proj_data.get_segment_by_view(segment_num);
+      const SegmentByView<float> expected_segment = expected.get_segment_by_view(segment_num);
+      set_tolerance(expected_segment.find_max()*1.E-5);
+      check_if_equal(segment, expected_segment, str);
+    }
+}
+
+void
+BinNormalisationTests::
+run_tests()
+{
+  std::cerr << "Tests for BinNormalisation::apply and undo\n";
+
+#ifdef STIR_OPENMP
+  const int num_threads = omp_get_max_threads();
+  omp_set_num_threads(4);
+#endif
+
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  shared_ptr<ProjDataInfo>
+    proj_data_info_sptr(ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                                      /*span*/1, 2,/*views*/ 48, /*tang_pos*/64,
+                                                      /*arc_corrected*/ true));
+  shared_ptr<ExamInfo> exam_info_sptr(new ExamInfo);
+
+  // normalisation factors and data in memory, different for every bin
+  shared_ptr<ProjData> norm_proj_data_sptr(new ProjDataInMemory(exam_info_sptr, proj_data_info_sptr));
+  ProjDataInMemory original(exam_info_sptr, proj_data_info_sptr);
+  ProjDataInMemory expected(exam_info_sptr, proj_data_info_sptr);
+  for (int segment_num = expected.get_min_segment_num();
+       segment_num <= expected.get_max_segment_num();
+       ++segment_num)
+    for (int view_num = expected.get_min_view_num();
+         view_num <= expected.get_max_view_num();
+         ++view_num)
+      {
+        Viewgram<float> viewgram = expected.get_empty_viewgram(view_num, segment_num);
+        Viewgram<float> norm_viewgram = expected.get_empty_viewgram(view_num, segment_num);
+        for (int axial_pos_num = viewgram.get_min_axial_pos_num();
+             axial_pos_num <= viewgram.get_max_axial_pos_num();
+             ++axial_pos_num)
+          for (int tangential_pos_num = viewgram.get_min_tangential_pos_num();
+               tangential_pos_num <= viewgram.get_max_tangential_pos_num();
+               ++tangential_pos_num)
+            {
+              viewgram[axial_pos_num][tangential_pos_num] =
+                get_test_value(segment_num, view_num, axial_pos_num, tangential_pos_num);
+              norm_viewgram[axial_pos_num][tangential_pos_num] =
+                1.F + (view_num + axial_pos_num + tangential_pos_num + 200)/100.F;
+            }
+        original.set_viewgram(viewgram);
+        expected.set_viewgram(viewgram);
+        norm_proj_data_sptr->set_viewgram(norm_viewgram);
+      }
+
+  // write the data to disk
+  const std::string filename = "test_BinNormalisation.hs";
+  {
+    ProjDataInterfile proj_data(exam_info_sptr, proj_data_info_sptr, filename, std::ios::out);
+    proj_data.fill(original);
+  }
+
+  shared_ptr<BinNormalisation> normalisation_sptr(new BinNormalisationFromProjData(norm_proj_data_sptr));
+  if (!check(normalisation_sptr->set_up(proj_data_info_sptr) == Succeeded::yes, "set_up"))
+    return;
+  normalisation_sptr->apply(expected, 0., 1.);
+
+  {
+    shared_ptr<ProjData> proj_data_sptr =
+      ProjData::read_from_file(filename + ",pread", std::ios::in | std::ios::out);
+    if (check(!is_null_ptr(dynamic_cast<ProjDataPositionalIO *>(proj_data_sptr.get())),
+              "read_from_file with pread should return ProjDataPositionalIO"))
+      {
+        check(proj_data_sptr->supports_concurrent_access(), "supports_concurrent_access");
+
+        normalisation_sptr->apply(*proj_data_sptr, 0., 1.);
+        check_if_equal_proj_data(*proj_data_sptr, expected, "apply with positional I/O");
+
+        normalisation_sptr->undo(*proj_data_sptr, 0., 1.);
+        check_if_equal_proj_data(*proj_data_sptr, original, "undo with positional I/O");
+      }
+  }
+
+  std::remove(filename.c_str());
+  std::remove("test_BinNormalisation.s");
+
+#ifdef STIR_OPENMP
+  omp_set_num_threads(num_threads);
+#endif
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int main()
+{
+  BinNormalisationTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
@@ -0,0 +1,224 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup test
+
+  \brief Test program for stir::CompressedProjMatrixCache and stir::ConcurrentProjMatrixCache
+
+  Compares rows obtained from a stir::ProjMatrixByBinUsingRayTracing using the
+  default cache with rows obtained when using the compressed or lock-free cache.
+*/
+
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/Scanner.h"
+#include "stir/recon_buildblock/ProjMatrixByBinUsingRayTracing.h"
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
+#include "stir/recon_buildblock/CompressedProjMatrixCache.h"
+#include "stir/RunTests.h"
+#include <iostream>
+#include <sstream>
+#include <math.h>
+
+#ifndef STIR_NO_NAMESPACES
+using std::stringstream;
+using std::cerr;
+#endif
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup test
+  \brief Test class for CompressedProjMatrixCache and ConcurrentProjMatrixCache
+
+  Checks conversion to and from half precision floats, and checks that
+  ProjMatrixByBin returns the same rows with and without the compressed
+  (or lock-free) cache.
+*/
+class CompressedProjMatrixCacheTests : public RunTests
+{
+public:
+  void run_tests();
+private:
+  void run_tests_half_precision();
+  void run_tests_for_1_matrix(const shared_ptr<ProjDataInfo>& proj_data_info_sptr,
+                              const shared_ptr<DiscretisedDensity<3,float> >& density_sptr,
+                              const bool store_only_basic_bins,
+                              const bool use_half_precision,
+                              const bool use_lock_free_cache = false);
+  void set_up_matrix(ProjMatrixByBinUsingRayTracing& proj_matrix,
+                     const shared_ptr<ProjDataInfo>& proj_data_info_sptr,
+                     const shared_ptr<DiscretisedDensity<3,float> >& density_sptr,
+                     const bool store_only_basic_bins,
+                     const bool use_compressed_cache,
+                     const bool use_half_precision,
+                     const bool use_lock_free_cache);
+};
+
+void
+CompressedProjMatrixCacheTests::
+run_tests_half_precision()
+{
+  cerr << "\tTesting half precision conversion\n";
+  const float values[] = { 0.F, 1.F, -2.F, 0.5F, 65504.F, 0.000061035156F /* smallest normal */ };
+  for (unsigned i=0; i<sizeof(values)/sizeof(values[0]); ++i)
+    check_if_equal(CompressedProjMatrixCache::half_to_float(CompressedProjMatrixCache::float_to_half(values[i])),
+                   values[i], "half precision conversion of exactly representable value");
+  // subnormal
+  check_if_equal(CompressedProjMatrixCache::half_to_float(1),
+                 static_cast<float>(pow(2., -24.)), "smallest subnormal half");
+  // relative precision
+  for (float value=1.E-3F; value<1000.F; value*=1.37F)
+    {
+      const float converted =
+        CompressedProjMatrixCache::half_to_float(CompressedProjMatrixCache::float_to_half(value));
+      check(fabs(converted-value) <= value/2048.F*1.0001F,
+            "relative accuracy of half precision conversion");
+    }
+}
+
+void
+CompressedProjMatrixCacheTests::
+set_up_matrix(ProjMatrixByBinUsingRayTracing& proj_matrix,
+              const shared_ptr<ProjDataInfo>& proj_data_info_sptr,
+              const shared_ptr<DiscretisedDensity<3,float> >& density_sptr,
+              const bool store_only_basic_bins,
+              const bool use_compressed_cache,
+              const bool use_half_precision,
+              const bool use_lock_free_cache)
+{
+  stringstream str;
+  str <<
+    "Ray Tracing Matrix Parameters :=\n"
+    "restrict to cylindrical FOV := 1\n"
+    "number of rays in tangential direction to trace for each bin := 1\n"
+    "use actual detector boundaries := 0\n"
+    "store_only_basic_bins_in_cache := " << store_only_basic_bins << "\n"
+    "use compressed cache := " << use_compressed_cache << "\n"
+    "use half precision in compressed cache := " << use_half_precision << "\n"
+    "use lock-free cache := " << use_lock_free_cache << "\n"
+    "End Ray Tracing Matrix Parameters :=\n";
+  if (!check(proj_matrix.parse(str), "parsing projection matrix parameters"))
+    return;
+  check_if_equal(proj_matrix.does_cache_use_compression(), use_compressed_cache,
+                 "parsing of compressed cache parameter");
+  proj_matrix.set_up(proj_data_info_sptr, density_sptr);
+}
+
+void
+CompressedProjMatrixCacheTests::
+run_tests_for_1_matrix(const shared_ptr<ProjDataInfo>& proj_data_info_sptr,
+                       const shared_ptr<DiscretisedDensity<3,float> >& density_sptr,
+                       const bool store_only_basic_bins,
+                       const bool use_half_precision,
+                       const bool use_lock_free_cache)
+{
+  ProjMatrixByBinUsingRayTracing proj_matrix;
+  set_up_matrix(proj_matrix, proj_data_info_sptr, density_sptr,
+                store_only_basic_bins, false, false, false);
+  ProjMatrixByBinUsingRayTracing proj_matrix_compressed;
+  set_up_matrix(proj_matrix_compressed, proj_data_info_sptr, density_sptr,
+                store_only_basic_bins, !use_lock_free_cache, use_half_precision, use_lock_free_cache);
+
+  ProjMatrixElemsForOneBin elems;
+  ProjMatrixElemsForOneBin elems_compressed;
+  // 2 passes: first pass fills the cache, 2nd pass reads from the cache
+  for (int pass=0; pass<2; ++pass)
+    for (int segment_num = proj_data_info_sptr->get_min_segment_num();
+         segment_num <= proj_data_info_sptr->get_max_segment_num();
+         ++segment_num)
+      for (int view_num = proj_data_info_sptr->get_min_view_num();
+           view_num <= proj_data_info_sptr->get_max_view_num();
+           ++view_num)
+        for (int axial_pos_num = proj_data_info_sptr->get_min_axial_pos_num(segment_num);
+             axial_pos_num <= proj_data_info_sptr->get_max_axial_pos_num(segment_num);
+             ++axial_pos_num)
+          for (int tangential_pos_num = proj_data_info_sptr->get_min_tangential_pos_num();
+               tangential_pos_num <= proj_data_info_sptr->get_max_tangential_pos_num();
+               ++tangential_pos_num)
+            {
+              const Bin bin(segment_num, view_num, axial_pos_num, tangential_pos_num);
+              proj_matrix.get_proj_matrix_elems_for_one_bin(elems, bin);
+              proj_matrix_compressed.get_proj_matrix_elems_for_one_bin(elems_compressed, bin);
+              if (!check_if_equal(elems.size(), elems_compressed.size(), "number of elements in row"))
+                return;
+              ProjMatrixElemsForOneBin::const_iterator iter = elems.begin();
+              ProjMatrixElemsForOneBin::const_iterator iter_compressed = elems_compressed.begin();
+              for (; iter != elems.end(); ++iter, ++iter_compressed)
+                {
+                  if (!check_if_equal(iter->get_coords(), iter_compressed->get_coords(), "coordinates of element") ||
+                      !check(fabs(iter->get_value() - iter_compressed->get_value()) <=
+                             (use_half_precision ? iter->get_value()/2000.F : 0.F),
+                             "value of element"))
+                    {
+                      cerr << "Problem at segment " << segment_num << ", view " << view_num
+                           << ", axial position " << axial_pos_num
+                           << ", tangential position " << tangential_pos_num << '\n';
+                      return;
+                    }
+                }
+            }
+}
+
+void
+CompressedProjMatrixCacheTests::run_tests()
+{
+  cerr << "Tests for CompressedProjMatrixCache and ConcurrentProjMatrixCache\n";
+  run_tests_half_precision();
+
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  shared_ptr<ProjDataInfo> proj_data_info_sptr(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                  /*span=*/3,
+                                  /*max_delta=*/12,
+                                  /*num_views=*/8,
+                                  /*num_tang_poss=*/16));
+  const CartesianCoordinate3D<float> origin (0,0,0);
+  const float zoom=1.F;
+  shared_ptr<DiscretisedDensity<3,float> >
+    density_sptr(new VoxelsOnCartesianGrid<float>(*proj_data_info_sptr,zoom,origin));
+
+  cerr << "\tTesting compressed cache with only basic bins\n";
+  run_tests_for_1_matrix(proj_data_info_sptr, density_sptr, true, false);
+  cerr << "\tTesting compressed cache with all bins\n";
+  run_tests_for_1_matrix(proj_data_info_sptr, density_sptr, false, false);
+  cerr << "\tTesting compressed cache with half precision\n";
+  run_tests_for_1_matrix(proj_data_info_sptr, density_sptr, true, true);
+#ifdef STIR_HAVE_CONCURRENT_PROJ_MATRIX_CACHE
+  cerr << "\tTesting lock-free cache with only basic bins\n";
+  run_tests_for_1_matrix(proj_data_info_sptr, density_sptr, true, false, true);
+  cerr << "\tTesting lock-free cache with all bins\n";
+  run_tests_for_1_matrix(proj_data_info_sptr, density_sptr, false, false, true);
+#endif
+}
+
+END_NAMESPACE_STIR
+
+
+USING_NAMESPACE_STIR
+
+
+int main()
+{
+  CompressedProjMatrixCacheTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
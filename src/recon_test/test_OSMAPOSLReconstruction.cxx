@@ -0,0 +1,283 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup recon_test
+  \ingroup OSMAPOSL
+
+  \brief Test program for the update in stir::OSMAPOSLReconstruction
+
+  \par Usage
+
+  <pre>
+  test_OSMAPOSLReconstruction
+  </pre>
+*/
+
+#include "stir/OSMAPOSL/OSMAPOSLReconstruction.h"
+#include "stir/recon_buildblock/PoissonLogLikelihoodWithLinearModelForMeanAndProjData.h"
+#include "stir/recon_buildblock/ProjMatrixByBinUsingRayTracing.h"
+#include "stir/recon_buildblock/ProjectorByBinPairUsingProjMatrixByBin.h"
+#include "stir/recon_buildblock/BinNormalisationFromProjData.h"
+#include "stir/recon_buildblock/QuadraticPrior.h"
+#include "stir/MedianImageFilter3D.h"
+#include "stir/ThresholdMinToSmallPositiveValueDataProcessor.h"
+#include "stir/ChainedDataProcessor.h"
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/CartesianCoordinate3D.h"
+#include "stir/ProjDataInMemory.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/ExamInfo.h"
+#include "stir/Scanner.h"
+#include "stir/SegmentByView.h"
+#include "stir/numerics/divide.h"
+#include "stir/RunTests.h"
+#include "stir/Succeeded.h"
+#include <boost/format.hpp>
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup test
+  \brief Test class for the update in OSMAPOSLReconstruction
+
+  OSMAPOSLReconstruction::update_estimate() computes the denominator, the division,
+  the thresholding of the update and the multiplication in (mostly) a single pass over
+  the image. This test compares a few subiterations with a straightforward implementation
+  of the OSL update, using the objective function, the prior and divide(). This is done
+  without a prior, with the additive and multiplicative forms of the OSL update, and with
+  an inter-update filter (when the multiplication is a separate pass). The update is
+  restricted by the minimum and maximum relative change, and the test checks that this
+  thresholding is active.
+*/
+class OSMAPOSLReconstructionTests : public RunTests
+{
+public:
+  void run_tests();
+private:
+  typedef DiscretisedDensity<3,float> target_type;
+  typedef PoissonLogLikelihoodWithLinearModelForMeanAndProjData<target_type> objective_function_type;
+
+  //! run OSMAPOSL and the reference implementation, and compare the images
+  void run_tests_for_MAP_model(const std::string& MAP_model, const bool use_prior,
+                               const bool use_inter_update_filter);
+
+  //! one subiteration of the reference implementation
+  /*! \return the number of voxels where the update was thresholded */
+  int reference_update(target_type& image, objective_function_type& objective_function,
+                       const std::string& MAP_model, const int subset_num, const int subiteration_num,
+                       DataProcessor<target_type> * const inter_update_filter_ptr);
+
+  shared_ptr<objective_function_type> objective_function_sptr;
+  shared_ptr<target_type> initial_image_sptr;
+
+  static const int num_subsets = 2;
+  static const int num_subiterations = 4;
+  static const float minimum_relative_change;
+  static const float maximum_relative_change;
+};
+
+const float OSMAPOSLReconstructionTests::minimum_relative_change = .8F;
+const float OSMAPOSLReconstructionTests::maximum_relative_change = 1.2F;
+
+int
+OSMAPOSLReconstructionTests::
+reference_update(target_type& image, objective_function_type& objective_function,
+                 const std::string& MAP_model, const int subset_num, const int subiteration_num,
+                 DataProcessor<target_type> * const inter_update_filter_ptr)
+{
+  static const float small_num = 0.000001F;
+  shared_ptr<target_type> update_sptr(image.get_empty_copy());
+  objective_function.
+    compute_sub_gradient_without_penalty_plus_sensitivity(*update_sptr, image, subset_num);
+  const target_type& sensitivity = objective_function.get_subset_sensitivity(subset_num);
+  if (objective_function.prior_is_zero())
+    divide(update_sptr->begin_all(), update_sptr->end_all(), sensitivity.begin_all_const(), small_num);
+  else
+    {
+      shared_ptr<target_type> denominator_sptr(image.get_empty_copy());
+      objective_function.get_prior_ptr()->compute_gradient(*denominator_sptr, image);
+      target_type::full_iterator denominator_iter = denominator_sptr->begin_all();
+      target_type::const_full_iterator sensitivity_iter = sensitivity.begin_all_const();
+      for (; denominator_iter != denominator_sptr->end_all(); ++denominator_iter, ++sensitivity_iter)
+        {
+          if (MAP_model == "additive")
+            {
+              *denominator_iter = *denominator_iter/num_subsets + *sensitivity_iter;
+              *denominator_iter = std::max(std::min(*denominator_iter, *sensitivity_iter*10), *sensitivity_iter/10);
+            }
+          else
+            {
+              *denominator_iter += 1;
+              *denominator_iter = std::max(std::min(*denominator_iter, 10.F), 1/10.F);
+              *denominator_iter *= *sensitivity_iter;
+            }
+        }
+      divide(update_sptr->begin_all(), update_sptr->end_all(), denominator_sptr->begin_all_const(), small_num);
+    }
+
+  if (inter_update_filter_ptr != 0)
+    inter_update_filter_ptr->apply(image);
+
+  int num_thresholded = 0;
+  target_type::full_iterator image_iter = image.begin_all();
+  for (target_type::full_iterator update_iter = update_sptr->begin_all();
+       update_iter != update_sptr->end_all();
+       ++update_iter, ++image_iter)
+    {
+      float update = *update_iter;
+      if (subiteration_num != 1)
+        {
+          if (update < minimum_relative_change || update > maximum_relative_change)
+            ++num_thresholded;
+          update = std::min(std::max(update, minimum_relative_change), maximum_relative_change);
+        }
+      *image_iter *= update;
+    }
+  return num_thresholded;
+}
+
+void
+OSMAPOSLReconstructionTests::
+run_tests_for_MAP_model(const std::string& MAP_model, const bool use_prior,
+                        const bool use_inter_update_filter)
+{
+  const std::string description =
+    boost::str(boost::format("%1% model, %2%prior, %3%inter-update filter")
+               % MAP_model % (use_prior ? "" : "no ") % (use_inter_update_filter ? "" : "no "));
+  std::cerr << "\tTesting " << description << '\n';
+
+  if (use_prior)
+    objective_function_sptr->set_prior_sptr(
+      shared_ptr<GeneralisedPrior<target_type> >(new QuadraticPrior<float>(false, .5F)));
+  else
+    objective_function_sptr->set_prior_sptr(shared_ptr<GeneralisedPrior<target_type> >());
+
+  const CartesianCoordinate3D<int> mask_radius(0,1,1);
+  OSMAPOSLReconstruction<target_type> reconstruction;
+  reconstruction.set_objective_function_sptr(objective_function_sptr);
+  reconstruction.set_num_subsets(num_subsets);
+  reconstruction.set_num_subiterations(num_subiterations);
+  reconstruction.set_disable_output(true);
+  reconstruction.set_MAP_model(MAP_model);
+  reconstruction.set_minimum_relative_change(minimum_relative_change);
+  reconstruction.set_maximum_relative_change(maximum_relative_change);
+  if (use_inter_update_filter)
+    {
+      reconstruction.set_inter_update_filter_interval(1);
+      reconstruction.set_inter_update_filter_ptr(
+        shared_ptr<DataProcessor<target_type> >(new MedianImageFilter3D<float>(mask_radius)));
+    }
+  shared_ptr<target_type> image_sptr(initial_image_sptr->clone());
+  if (!check(reconstruction.set_up(image_sptr) == Succeeded::yes, "OSMAPOSL set_up " + description))
+    return;
+  if (!check(reconstruction.reconstruct(image_sptr) == Succeeded::yes, "OSMAPOSL reconstruct " + description))
+    return;
+
+  // the objective function has been set-up by the reconstruction
+  shared_ptr<target_type> reference_image_sptr(initial_image_sptr->clone());
+  // OSMAPOSL makes sure that the filtered image is positive
+  ChainedDataProcessor<target_type>
+    inter_update_filter(shared_ptr<DataProcessor<target_type> >(new MedianImageFilter3D<float>(mask_radius)),
+                        shared_ptr<DataProcessor<target_type> >(new ThresholdMinToSmallPositiveValueDataProcessor<target_type>));
+  inter_update_filter.set_up(*reference_image_sptr);
+  int num_thresholded = 0;
+  for (int subiteration_num = 1; subiteration_num <= num_subiterations; ++subiteration_num)
+    num_thresholded +=
+      reference_update(*reference_image_sptr, *objective_function_sptr, MAP_model,
+                       (subiteration_num - 1) % num_subsets, subiteration_num,
+                       use_inter_update_filter ? &inter_update_filter : 0);
+  check(num_thresholded > 0, "the update should be thresholded in some voxels for " + description);
+
+  // the sub-gradient might be computed in a different order with several threads
+  set_tolerance(reference_image_sptr->find_max()*1.E-4);
+  check_if_equal(*image_sptr, *reference_image_sptr, "OSMAPOSL image for " + description);
+}
+
+void
+OSMAPOSLReconstructionTests::
+run_tests()
+{
+  std::cerr << "Tests for the update in OSMAPOSLReconstruction\n";
+
+  // construct a small scanner
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  scanner_sptr->set_num_rings(3);
+  shared_ptr<ProjDataInfo> proj_data_info_sptr(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                  /*span=*/1,
+                                  /*max_delta=*/1,
+                                  /*num_views=*/16,
+                                  /*num_tang_poss=*/32,
+                                  /*arc_corrected=*/false));
+  shared_ptr<ExamInfo> exam_info_sptr(new ExamInfo);
+  exam_info_sptr->imaging_modality = ImagingModality::PT;
+
+  // a non-uniform initial image
+  VoxelsOnCartesianGrid<float> * image_ptr =
+    new VoxelsOnCartesianGrid<float>(exam_info_sptr, *proj_data_info_sptr, .25F);
+  initial_image_sptr.reset(image_ptr);
+  for (int z=image_ptr->get_min_z(); z<=image_ptr->get_max_z(); ++z)
+    for (int y=image_ptr->get_min_y(); y<=image_ptr->get_max_y(); ++y)
+      for (int x=image_ptr->get_min_x(); x<=image_ptr->get_max_x(); ++x)
+        (*image_ptr)[z][y][x] = 1.F + ((x+2*y+z+1000) % 5)/4.F;
+
+  // measured data with some structure, and normalisation factors
+  shared_ptr<ProjData> proj_data_sptr(new ProjDataInMemory(exam_info_sptr, proj_data_info_sptr));
+  for (int seg_num=proj_data_sptr->get_min_segment_num(); seg_num<=proj_data_sptr->get_max_segment_num(); ++seg_num)
+    {
+      SegmentByView<float> segment = proj_data_sptr->get_empty_segment_by_view(seg_num);
+      for (int view_num=segment.get_min_view_num(); view_num<=segment.get_max_view_num(); ++view_num)
+        for (int ax_pos_num=segment.get_min_axial_pos_num(); ax_pos_num<=segment.get_max_axial_pos_num(); ++ax_pos_num)
+          for (int tang_pos_num=segment.get_min_tangential_pos_num(); tang_pos_num<=segment.get_max_tangential_pos_num(); ++tang_pos_num)
+            segment[view_num][ax_pos_num][tang_pos_num] =
+              1.F + static_cast<float>((view_num + 3*ax_pos_num + 7*tang_pos_num + 100) % 5);
+      proj_data_sptr->set_segment(segment);
+    }
+  shared_ptr<ProjData> norm_proj_data_sptr(new ProjDataInMemory(exam_info_sptr, proj_data_info_sptr));
+  norm_proj_data_sptr->fill(2.F);
+
+  objective_function_sptr.reset(new objective_function_type);
+  {
+    shared_ptr<ProjMatrixByBin> proj_matrix_sptr(new ProjMatrixByBinUsingRayTracing());
+    shared_ptr<ProjectorByBinPair> proj_pair_sptr(new ProjectorByBinPairUsingProjMatrixByBin(proj_matrix_sptr));
+    objective_function_sptr->set_projector_pair_sptr(proj_pair_sptr);
+    objective_function_sptr->set_proj_data_sptr(proj_data_sptr);
+    objective_function_sptr->set_normalisation_sptr(
+      shared_ptr<BinNormalisation>(new BinNormalisationFromProjData(norm_proj_data_sptr)));
+  }
+
+  run_tests_for_MAP_model("multiplicative", false, false);
+  run_tests_for_MAP_model("additive", true, false);
+  run_tests_for_MAP_model("multiplicative", true, false);
+  run_tests_for_MAP_model("multiplicative", true, true);
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int main()
+{
+  OSMAPOSLReconstructionTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
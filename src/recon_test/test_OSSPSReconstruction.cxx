@@ -0,0 +1,277 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup recon_test
+  \ingroup OSSPS
+
+  \brief Test program for the cache of the precomputed denominator in stir::OSSPSReconstruction
+
+  \par Usage
+
+  <pre>
+  test_OSSPSReconstruction
+  </pre>
+  The cache files are written in a new sub-directory of the current directory,
+  which is removed at the end.
+*/
+
+#include "stir/OSSPS/OSSPSReconstruction.h"
+#include "stir/recon_buildblock/PoissonLogLikelihoodWithLinearModelForMeanAndProjData.h"
+#include "stir/recon_buildblock/ProjMatrixByBinUsingRayTracing.h"
+#include "stir/recon_buildblock/ProjectorByBinPairUsingProjMatrixByBin.h"
+#include "stir/recon_buildblock/BinNormalisationFromProjData.h"
+#include "stir/recon_buildblock/QuadraticPrior.h"
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/ProjDataInMemory.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/ExamInfo.h"
+#include "stir/Scanner.h"
+#include "stir/SegmentByView.h"
+#include "stir/FilePath.h"
+#include "stir/RunTests.h"
+#include "stir/Succeeded.h"
+#include <boost/format.hpp>
+#include <boost/cstdint.hpp>
+#include <iostream>
+#include <fstream>
+#include <set>
+#include <cstdio>
+#include <ctime>
+
+START_NAMESPACE_STIR
+
+namespace detail
+{
+  //! objective function which counts how often the approximate Hessian is computed
+  class PLLCountingHessians
+    : public PoissonLogLikelihoodWithLinearModelForMeanAndProjData<DiscretisedDensity<3,float> >
+  {
+  public:
+    PLLCountingHessians()
+      : num_Hessians(0)
+    {}
+    mutable int num_Hessians;
+  protected:
+    virtual Succeeded
+      actual_add_multiplication_with_approximate_sub_Hessian_without_penalty(DiscretisedDensity<3,float>& output,
+                                                                             const DiscretisedDensity<3,float>& input,
+                                                                             const int subset_num) const
+    {
+      ++this->num_Hessians;
+      return PoissonLogLikelihoodWithLinearModelForMeanAndProjData<DiscretisedDensity<3,float> >::
+        actual_add_multiplication_with_approximate_sub_Hessian_without_penalty(output, input, subset_num);
+    }
+  };
+}
+
+/*!
+  \ingroup test
+  \brief Test class for the cache of the precomputed denominator in OSSPSReconstruction
+
+  Checks that a cached denominator is identical to the computed one, that the cache is
+  reused when only the prior changes, and that it is not used when the content of the data
+  or normalisation changes, or when the file has a different byte order.
+*/
+class OSSPSReconstructionTests : public RunTests
+{
+public:
+  void run_tests();
+private:
+  typedef DiscretisedDensity<3,float> target_type;
+  //! sets-up a new OSSPS object, and returns the file name of its cache entry
+  std::string set_up_OSSPS(shared_ptr<target_type>& denominator_sptr,
+                           const shared_ptr<detail::PLLCountingHessians>& objective_function_sptr,
+                           const shared_ptr<target_type>& image_sptr,
+                           const std::string& cache_directory);
+  //! fills the data with values depending on the bin and on \a offset
+  static void fill_proj_data(ProjData& proj_data, const float offset);
+};
+
+void
+OSSPSReconstructionTests::
+fill_proj_data(ProjData& proj_data, const float offset)
+{
+  for (int seg_num=proj_data.get_min_segment_num(); seg_num<=proj_data.get_max_segment_num(); ++seg_num)
+    {
+      SegmentByView<float> segment = proj_data.get_empty_segment_by_view(seg_num);
+      for (int view_num=segment.get_min_view_num(); view_num<=segment.get_max_view_num(); ++view_num)
+        for (int ax_pos_num=segment.get_min_axial_pos_num(); ax_pos_num<=segment.get_max_axial_pos_num(); ++ax_pos_num)
+          for (int tang_pos_num=segment.get_min_tangential_pos_num(); tang_pos_num<=segment.get_max_tangential_pos_num(); ++tang_pos_num)
+            segment[view_num][ax_pos_num][tang_pos_num] =
+              offset + 1.F + static_cast<float>((view_num + 3*ax_pos_num + 7*tang_pos_num + 100) % 5);
+      proj_data.set_segment(segment);
+    }
+}
+
+std::string
+OSSPSReconstructionTests::
+set_up_OSSPS(shared_ptr<target_type>& denominator_sptr,
+             const shared_ptr<detail::PLLCountingHessians>& objective_function_sptr,
+             const shared_ptr<target_type>& image_sptr,
+             const std::string& cache_directory)
+{
+  OSSPSReconstruction<target_type> reconstruction;
+  reconstruction.set_objective_function_sptr(objective_function_sptr);
+  reconstruction.set_num_subsets(1);
+  reconstruction.set_num_subiterations(1);
+  reconstruction.set_disable_output(true);
+  reconstruction.set_precomputed_denominator_cache_directory(cache_directory);
+  shared_ptr<target_type> target_sptr(image_sptr->clone());
+  if (!check(reconstruction.set_up(target_sptr) == Succeeded::yes, "OSSPS set_up"))
+    return std::string();
+  denominator_sptr.reset(reconstruction.get_precomputed_denominator().clone());
+  return reconstruction.get_precomputed_denominator_cache_filename();
+}
+
+void
+OSSPSReconstructionTests::
+run_tests()
+{
+  std::cerr << "Tests for the OSSPS precomputed denominator cache\n";
+
+  // construct a small scanner
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  scanner_sptr->set_num_rings(3);
+  shared_ptr<ProjDataInfo> proj_data_info_sptr(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                  /*span=*/1,
+                                  /*max_delta=*/0,
+                                  /*num_views=*/16,
+                                  /*num_tang_poss=*/32,
+                                  /*arc_corrected=*/false));
+  shared_ptr<ExamInfo> exam_info_sptr(new ExamInfo);
+  exam_info_sptr->imaging_modality = ImagingModality::PT;
+
+  shared_ptr<target_type>
+    image_sptr(new VoxelsOnCartesianGrid<float>(exam_info_sptr, *proj_data_info_sptr, .25F));
+  image_sptr->fill(1.F);
+
+  shared_ptr<ProjData> proj_data_sptr(new ProjDataInMemory(exam_info_sptr, proj_data_info_sptr));
+  fill_proj_data(*proj_data_sptr, 0.F);
+  shared_ptr<ProjData> norm_proj_data_sptr(new ProjDataInMemory(exam_info_sptr, proj_data_info_sptr));
+  norm_proj_data_sptr->fill(2.F);
+
+  shared_ptr<detail::PLLCountingHessians> objective_function_sptr(new detail::PLLCountingHessians);
+  {
+    shared_ptr<ProjMatrixByBin> proj_matrix_sptr(new ProjMatrixByBinUsingRayTracing());
+    shared_ptr<ProjectorByBinPair> proj_pair_sptr(new ProjectorByBinPairUsingProjMatrixByBin(proj_matrix_sptr));
+    objective_function_sptr->set_projector_pair_sptr(proj_pair_sptr);
+    objective_function_sptr->set_proj_data_sptr(proj_data_sptr);
+    objective_function_sptr->set_normalisation_sptr(
+      shared_ptr<BinNormalisation>(new BinNormalisationFromProjData(norm_proj_data_sptr)));
+  }
+
+  // a new directory, such that there are no cache files from previous runs
+  const std::string cache_directory =
+    FilePath(FilePath::get_current_working_directory())
+      .append(boost::str(boost::format("test_OSSPS_cache_%1%") % std::time(0)))
+      .get_as_string();
+  std::set<std::string> cache_filenames;
+
+  // reference without the cache
+  shared_ptr<target_type> reference_denominator_sptr;
+  set_up_OSSPS(reference_denominator_sptr, objective_function_sptr, image_sptr, "");
+  check_if_equal(objective_function_sptr->num_Hessians, 1, "denominator should be computed without cache");
+
+  // write and read the cache
+  std::string filename;
+  {
+    shared_ptr<target_type> denominator_sptr;
+    filename = set_up_OSSPS(denominator_sptr, objective_function_sptr, image_sptr, cache_directory);
+    cache_filenames.insert(filename);
+    check_if_equal(objective_function_sptr->num_Hessians, 2, "denominator should be computed for an empty cache");
+    check(FilePath::exists(filename), "cache file should be written");
+
+    const std::string filename_read =
+      set_up_OSSPS(denominator_sptr, objective_function_sptr, image_sptr, cache_directory);
+    check_if_equal(objective_function_sptr->num_Hessians, 2, "denominator should be read from the cache");
+    check(filename_read == filename, "cache file name should not change");
+    check(denominator_sptr->has_same_characteristics(*reference_denominator_sptr),
+          "characteristics of the denominator read from the cache");
+    check_if_equal(*denominator_sptr, *reference_denominator_sptr, "denominator read from the cache");
+  }
+
+  // the prior is not part of the key
+  {
+    objective_function_sptr->set_prior_sptr(
+      shared_ptr<GeneralisedPrior<target_type> >(new QuadraticPrior<float>(false, 1.F)));
+    shared_ptr<target_type> denominator_sptr;
+    check(set_up_OSSPS(denominator_sptr, objective_function_sptr, image_sptr, cache_directory) == filename,
+          "cache file name should not depend on the prior");
+    check_if_equal(objective_function_sptr->num_Hessians, 2, "cache should be used for a different prior");
+  }
+
+  // a different content of the measured data
+  {
+    fill_proj_data(*proj_data_sptr, 1.F);
+    shared_ptr<target_type> denominator_sptr;
+    const std::string new_filename =
+      set_up_OSSPS(denominator_sptr, objective_function_sptr, image_sptr, cache_directory);
+    cache_filenames.insert(new_filename);
+    check(new_filename != filename, "cache file name should depend on the content of the data");
+    check_if_equal(objective_function_sptr->num_Hessians, 3, "cache should not be used for different data");
+    fill_proj_data(*proj_data_sptr, 0.F);
+  }
+
+  // a different content of the normalisation factors
+  {
+    norm_proj_data_sptr->fill(3.F);
+    shared_ptr<target_type> denominator_sptr;
+    const std::string new_filename =
+      set_up_OSSPS(denominator_sptr, objective_function_sptr, image_sptr, cache_directory);
+    cache_filenames.insert(new_filename);
+    check(new_filename != filename, "cache file name should depend on the normalisation factors");
+    check_if_equal(objective_function_sptr->num_Hessians, 4, "cache should not be used for a different normalisation");
+    norm_proj_data_sptr->fill(2.F);
+  }
+
+  // a file with a different byte order is ignored (and rewritten)
+  {
+    {
+      // the byte order marker follows the 8 byte magic string
+      std::fstream s(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+      const boost::uint32_t swapped_byte_order_marker = 0x04030201U;
+      s.seekp(8);
+      s.write(reinterpret_cast<const char *>(&swapped_byte_order_marker), sizeof(swapped_byte_order_marker));
+      check(!s.fail(), "writing to the cache file");
+    }
+    shared_ptr<target_type> denominator_sptr;
+    check(set_up_OSSPS(denominator_sptr, objective_function_sptr, image_sptr, cache_directory) == filename,
+          "cache file name with the original set-up");
+    check_if_equal(objective_function_sptr->num_Hessians, 5, "cache should not be used for a different byte order");
+    check_if_equal(*denominator_sptr, *reference_denominator_sptr, "denominator after ignoring the cache");
+    set_up_OSSPS(denominator_sptr, objective_function_sptr, image_sptr, cache_directory);
+    check_if_equal(objective_function_sptr->num_Hessians, 5, "cache should be rewritten after a different byte order");
+  }
+
+  for (std::set<std::string>::const_iterator iter = cache_filenames.begin(); iter != cache_filenames.end(); ++iter)
+    std::remove(iter->c_str());
+  std::remove(cache_directory.c_str());
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int main()
+{
+  OSSPSReconstructionTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
@@ -0,0 +1,268 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup recon_test
+
+  \brief Test program for the gradient of
+  stir::PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin
+
+  \par Usage
+
+  <pre>
+  test_PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin mMR_listmode.l.hdr
+  </pre>
+  The header is used as a template for a listmode file with pseudo-random events,
+  which is written in the current directory and removed at the end. The event cache
+  files are written in the current directory as well.
+*/
+
+#include "stir/recon_buildblock/PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin.h"
+#include "stir/listmode/CListModeData.h"
+#include "stir/listmode/ECAT8_32bit_test_data.h"
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/IO/read_from_file.h"
+#include "stir/RunTests.h"
+#include "stir/Succeeded.h"
+#include <boost/format.hpp>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef STIR_OPENMP
+#include <omp.h>
+#endif
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup test
+  \brief Test class for the gradient of
+  PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin
+
+  The gradient is computed for a listmode file with pseudo-random events in the first 3
+  segments of the mMR, such that several batches of events are read.
+
+  When OpenMP is enabled, the gradient computed with 4 threads (where 1 thread reads
+  events while the others process them) is compared with the gradient computed with
+  1 thread. Computing it twice with 4 threads has to give identical results.
+
+  The gradient for a subset also has to be identical when using the event cache in
+  memory and on disk. Two objects can use the same directory for the cache at the same
+  time, and the cache files have to be removed by the destructor.
+*/
+class PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBinTests
+  : public RunTests
+{
+public:
+  PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBinTests(const std::string& template_header_filename)
+    : template_header_filename(template_header_filename)
+  {}
+  void run_tests();
+private:
+  typedef DiscretisedDensity<3,float> target_type;
+  typedef PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin<target_type>
+    objective_function_type;
+
+  //! parse the parameters (using \a extra_parameters in the parameter file) and call set_up
+  bool set_up(objective_function_type& objective_function,
+              const std::string& extra_parameters, const int num_subsets = 1);
+  //! compute the gradient for 1 subset
+  shared_ptr<target_type>
+    compute_gradient(objective_function_type& objective_function, const int subset_num = 0);
+  //! set up a new objective function and compute the gradient for 1 subset
+  shared_ptr<target_type>
+    compute_gradient(const std::string& extra_parameters, const int num_subsets = 1, const int subset_num = 0);
+
+  //! compare the gradients with and without the event cache
+  void run_tests_for_event_cache();
+
+  std::string template_header_filename;
+  std::string listmode_filename;
+  shared_ptr<target_type> estimate_sptr;
+};
+
+bool
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBinTests::
+set_up(objective_function_type& objective_function,
+       const std::string& extra_parameters, const int num_subsets)
+{
+  std::istringstream parameters(boost::str(boost::format(
+    "PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin Parameters:=\n"
+    "list mode filename := %1%\n"
+    "max ring difference num to process := 1\n"
+    "sensitivity filename := 1\n"
+    "use_subset_sensitivities := 0\n"
+    "Matrix type := Ray Tracing\n"
+    "  Ray Tracing Matrix Parameters:=\n"
+    "  disable caching := 1\n"
+    "  End Ray Tracing Matrix Parameters:=\n"
+    "%2%"
+    "End PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin Parameters:=\n")
+                                           % listmode_filename % extra_parameters));
+  if (!check(objective_function.parse(parameters), "parsing objective function parameters"))
+    return false;
+  objective_function.set_num_subsets(num_subsets);
+  return check(objective_function.set_up(estimate_sptr) == Succeeded::yes, "set_up");
+}
+
+shared_ptr<DiscretisedDensity<3,float> >
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBinTests::
+compute_gradient(objective_function_type& objective_function, const int subset_num)
+{
+  shared_ptr<target_type> gradient_sptr(estimate_sptr->get_empty_copy());
+  objective_function.compute_sub_gradient_without_penalty_plus_sensitivity(*gradient_sptr, *estimate_sptr, subset_num);
+  return gradient_sptr;
+}
+
+shared_ptr<DiscretisedDensity<3,float> >
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBinTests::
+compute_gradient(const std::string& extra_parameters, const int num_subsets, const int subset_num)
+{
+  objective_function_type objective_function;
+  if (!set_up(objective_function, extra_parameters, num_subsets))
+    return shared_ptr<target_type>(estimate_sptr->get_empty_copy());
+  return compute_gradient(objective_function, subset_num);
+}
+
+//! name of an event cache file in the current directory
+/*! \a object_num counts the objects that used an event cache on disk in this process. */
+static std::string
+get_event_cache_filename(const int object_num, const int subset_num)
+{
+#ifdef _WIN32
+  const int process_id = _getpid();
+#else
+  const int process_id = static_cast<int>(getpid());
+#endif
+  return boost::str(boost::format("./listmode_event_cache_%1%_%2%_subset_%3%.bin")
+                    % process_id % object_num % subset_num);
+}
+
+void
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBinTests::
+run_tests_for_event_cache()
+{
+  std::cerr << "\tTesting the event cache\n";
+  const int num_subsets = 3;
+  // events are read in the same order and batches with and without the cache
+  set_tolerance(0.);
+  for (int subset_num=0; subset_num<num_subsets; subset_num+=2)
+    {
+      const shared_ptr<target_type> gradient_sptr = compute_gradient("", num_subsets, subset_num);
+      check(gradient_sptr->find_max() > 0.F, "gradient should be non-zero");
+      check_if_equal(*compute_gradient("use event cache := 1\n", num_subsets, subset_num), *gradient_sptr,
+                     boost::str(boost::format("gradient with event cache in memory (subset %1%)") % subset_num));
+
+      // 2 objects using an event cache in the same directory
+      {
+        const std::string extra_parameters = "use event cache := 1\nevent cache directory := .\n";
+        objective_function_type objective_function1, objective_function2;
+        if (!set_up(objective_function1, extra_parameters, num_subsets) ||
+            !set_up(objective_function2, extra_parameters, num_subsets))
+          return;
+        const int object_num = subset_num; // 2 objects per subset
+        check(std::ifstream(get_event_cache_filename(object_num, subset_num).c_str()).good() &&
+              std::ifstream(get_event_cache_filename(object_num+1, subset_num).c_str()).good(),
+              "every object should have its own event cache files");
+        check_if_equal(*compute_gradient(objective_function1, subset_num), *gradient_sptr,
+                       boost::str(boost::format("gradient with event cache on disk (subset %1%)") % subset_num));
+        check_if_equal(*compute_gradient(objective_function2, subset_num), *gradient_sptr,
+                       boost::str(boost::format("gradient with event cache on disk for second object (subset %1%)") % subset_num));
+      }
+      for (int object_num=subset_num; object_num<subset_num+2; ++object_num)
+        for (int i=0; i<num_subsets; ++i)
+          check(!std::ifstream(get_event_cache_filename(object_num, i).c_str()).good(),
+                "event cache files should be removed by the destructor");
+    }
+}
+
+void
+PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBinTests::
+run_tests()
+{
+  std::cerr << "Tests for the gradient of PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBin\n";
+
+  // 250000 events (of which 225000 prompts) in segments 0, -1 and 1 of the mMR
+  listmode_filename = "test_PLL_listmode.hdr";
+  const unsigned long max_offset = 344UL*252*(64+63+63);
+  ecat::write_ECAT8_32bit_test_data(listmode_filename, template_header_filename,
+                                    max_offset, 250000);
+
+  {
+    shared_ptr<CListModeData> lm_data_sptr = read_from_file<CListModeData>(listmode_filename);
+    // use large voxels to keep the test fast
+    VoxelsOnCartesianGrid<float> * image_ptr =
+      new VoxelsOnCartesianGrid<float>(*lm_data_sptr->get_proj_data_info_sptr(), .25F,
+                                       CartesianCoordinate3D<float>(0.F,0.F,0.F));
+    estimate_sptr.reset(image_ptr);
+    // a non-uniform estimate
+    for (int z=image_ptr->get_min_z(); z<=image_ptr->get_max_z(); ++z)
+      for (int y=image_ptr->get_min_y(); y<=image_ptr->get_max_y(); ++y)
+        for (int x=image_ptr->get_min_x(); x<=image_ptr->get_max_x(); ++x)
+          (*image_ptr)[z][y][x] = 1.F + ((x+2*y+z+1000) % 5)/4.F;
+  }
+
+#ifdef STIR_OPENMP
+  const int num_threads = omp_get_max_threads();
+  omp_set_num_threads(1);
+#endif
+  const shared_ptr<target_type> serial_gradient_sptr = compute_gradient("");
+  check(serial_gradient_sptr->find_max() > 0.F, "gradient should be non-zero");
+#ifdef STIR_OPENMP
+  {
+    omp_set_num_threads(4);
+    const shared_ptr<target_type> threaded_gradient_sptr = compute_gradient("");
+    set_tolerance(serial_gradient_sptr->find_max()*1.E-5);
+    check_if_equal(*threaded_gradient_sptr, *serial_gradient_sptr,
+                   "gradient with 4 threads should be equal to the serial gradient");
+    set_tolerance(0.);
+    check_if_equal(*compute_gradient(""), *threaded_gradient_sptr,
+                   "gradient with 4 threads should be reproducible");
+  }
+  omp_set_num_threads(num_threads);
+#endif
+
+  run_tests_for_event_cache();
+
+  std::remove(listmode_filename.c_str());
+  std::remove("test_PLL_listmode.l");
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+    {
+      std::cerr << "Usage : " << argv[0] << " mMR_listmode.l.hdr\n";
+      return EXIT_FAILURE;
+    }
+  PoissonLogLikelihoodWithLinearModelForMeanAndListModeDataWithProjMatrixByBinTests tests(argv[1]);
+  tests.run_tests();
+  return tests.main_return_value();
+}
@@ -112,6 +112,20 @@ protected:
   /*! Note that this function is not specific to PoissonLogLikelihoodWithLinearModelForMeanAndProjData */
   void run_tests_for_objective_function(GeneralisedObjectiveFunction<target_type>& objective_function,
                                         target_type& target);
+
+  //! check that the gradient is the same when computed from inside a parallel region
+  /*! In that case, the OpenMP team used by the objective function only has 1 thread.
+      This is a regression test for the viewgram prefetching in distributable_computation.
+  */
+  void run_tests_for_1_thread(GeneralisedObjectiveFunction<target_type>& objective_function,
+                              const target_type& target);
+
+  //! check that the gradient is the same when the threads have to share images
+  /*! This uses a memory budget that is too small for a single thread-local image,
+      such that all threads accumulate into the output image (using a lock).
+  */
+  void run_tests_for_memory_budget(PoissonLogLikelihoodWithLinearModelForMeanAndProjData<target_type>& objective_function,
+                                   const shared_ptr<target_type>& target_sptr);
 };
 
 PoissonLogLikelihoodWithLinearModelForMeanAndProjDataTests::
@@ -165,6 +179,60 @@ run_tests_for_objective_function(GeneralisedObjectiveFunction<PoissonLogLikeliho
 
 }
 
+void
+PoissonLogLikelihoodWithLinearModelForMeanAndProjDataTests::
+run_tests_for_1_thread(GeneralisedObjectiveFunction<PoissonLogLikelihoodWithLinearModelForMeanAndProjDataTests::target_type>& objective_function,
+                       const PoissonLogLikelihoodWithLinearModelForMeanAndProjDataTests::target_type& target)
+{
+#ifdef STIR_OPENMP
+  shared_ptr<target_type> gradient_sptr(target.get_empty_copy());
+  shared_ptr<target_type> gradient_1_thread_sptr(target.get_empty_copy());
+  const int subset_num = 0;
+  info("Computing gradient");
+  objective_function.compute_sub_gradient(*gradient_sptr, target, subset_num);
+  info("Computing gradient from inside a parallel region");
+#pragma omp parallel num_threads(2)
+  {
+#pragma omp master
+    {
+      objective_function.compute_sub_gradient(*gradient_1_thread_sptr, target, subset_num);
+    }
+  }
+  this->set_tolerance(std::max(fabs(double(gradient_sptr->find_min())), double(gradient_sptr->find_max()))/1000);
+  this->check_if_equal(*gradient_sptr, *gradient_1_thread_sptr, "gradient computed with 1 thread");
+#endif
+}
+
+void
+PoissonLogLikelihoodWithLinearModelForMeanAndProjDataTests::
+run_tests_for_memory_budget(PoissonLogLikelihoodWithLinearModelForMeanAndProjData<PoissonLogLikelihoodWithLinearModelForMeanAndProjDataTests::target_type>& objective_function,
+                            const shared_ptr<PoissonLogLikelihoodWithLinearModelForMeanAndProjDataTests::target_type>& target_sptr)
+{
+  // make sure that there are several threads (if OpenMP is enabled)
+  const int num_threads = get_max_num_threads();
+  set_num_threads(4);
+  shared_ptr<target_type> gradient_sptr(target_sptr->get_empty_copy());
+  shared_ptr<target_type> gradient_small_budget_sptr(target_sptr->get_empty_copy());
+  const int subset_num = 0;
+  info("Computing gradient without memory budget");
+  objective_function.set_thread_image_memory_budget_in_MB(0.);
+  if (!check(objective_function.set_up(target_sptr)==Succeeded::yes, "set-up of objective function without memory budget"))
+    return;
+  objective_function.compute_sub_gradient(*gradient_sptr, *target_sptr, subset_num);
+  info("Computing gradient with a small memory budget");
+  objective_function.set_thread_image_memory_budget_in_MB(1.E-3);
+  if (!check(objective_function.set_up(target_sptr)==Succeeded::yes, "set-up of objective function with memory budget"))
+    return;
+  objective_function.compute_sub_gradient(*gradient_small_budget_sptr, *target_sptr, subset_num);
+  // restore the defaults
+  set_num_threads(num_threads);
+  objective_function.set_thread_image_memory_budget_in_MB(0.);
+  check(objective_function.set_up(target_sptr)==Succeeded::yes, "set-up of objective function after memory budget");
+
+  this->set_tolerance(std::max(fabs(double(gradient_sptr->find_min())), double(gradient_sptr->find_max()))/10000);
+  this->check_if_equal(*gradient_sptr, *gradient_small_budget_sptr, "gradient computed with a small memory budget");
+}
+
 void
 PoissonLogLikelihoodWithLinearModelForMeanAndProjDataTests::
 construct_input_data(shared_ptr<target_type>& density_sptr)
@@ -321,6 +389,9 @@ run_tests()
   shared_ptr<target_type> density_sptr;
   construct_input_data(density_sptr);
   this->run_tests_for_objective_function(*this->objective_function_sptr, *density_sptr);
+  this->run_tests_for_1_thread(*this->objective_function_sptr, *density_sptr);
+  this->run_tests_for_memory_budget(dynamic_cast<PoissonLogLikelihoodWithLinearModelForMeanAndProjData<target_type>& >(*this->objective_function_sptr),
+                                    density_sptr);
 #else
   // alternative that gets the objective function from an OSMAPOSL .par file
   // currently disabled
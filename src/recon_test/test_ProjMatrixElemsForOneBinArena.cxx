@@ -0,0 +1,204 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup test
+
+  \brief Test program for stir::ProjMatrixElemsForOneBinArena
+
+  Checks that memory blocks are reused, and that rows of stir::ProjMatrixElemsForOneBin
+  (which use the arena for their elements) behave as before.
+*/
+
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBinAllocator.h"
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
+#include "stir/RunTests.h"
+#include <iostream>
+#include <vector>
+#include <cstring>
+#ifdef STIR_OPENMP
+#include <omp.h>
+#endif
+
+#ifndef STIR_NO_NAMESPACES
+using std::cerr;
+#endif
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup test
+  \brief Test class for ProjMatrixElemsForOneBinArena
+*/
+class ProjMatrixElemsForOneBinArenaTests : public RunTests
+{
+public:
+  void run_tests();
+private:
+  void run_tests_arena();
+  void run_tests_rows();
+  //! fill a row with \a num_elems elements
+  static void fill_row(ProjMatrixElemsForOneBin& row, const int num_elems, const float value);
+};
+
+void
+ProjMatrixElemsForOneBinArenaTests::
+fill_row(ProjMatrixElemsForOneBin& row, const int num_elems, const float value)
+{
+  row.erase();
+  for (int i=0; i<num_elems; ++i)
+    row.push_back(ProjMatrixElemsForOneBin::value_type(Coordinate3D<int>(i/100, (i/10)%10, i%10), value));
+}
+
+void
+ProjMatrixElemsForOneBinArenaTests::
+run_tests_arena()
+{
+  cerr << "\tTesting allocation and reuse of blocks\n";
+  const std::size_t sizes[] =
+    { 1, 31, 32, 33, 256, 257, 1000, 4096, 12345, 100000,
+      ProjMatrixElemsForOneBinArena::get_max_block_size(),
+      ProjMatrixElemsForOneBinArena::get_max_block_size()+1 };
+  const unsigned num_sizes = sizeof(sizes)/sizeof(sizes[0]);
+  for (unsigned i=0; i<num_sizes; ++i)
+    {
+      char * const ptr = static_cast<char *>(ProjMatrixElemsForOneBinArena::allocate(sizes[i]));
+      // check that we can write the whole block
+      std::memset(ptr, 1, sizes[i]);
+      check_if_equal(static_cast<int>(ptr[sizes[i]-1]), 1, "test writing to last byte");
+      ProjMatrixElemsForOneBinArena::deallocate(ptr, sizes[i]);
+    }
+
+#ifdef STIR_HAVE_PROJ_MATRIX_ELEMS_ARENA
+  {
+    void * const ptr = ProjMatrixElemsForOneBinArena::allocate(1000);
+    ProjMatrixElemsForOneBinArena::deallocate(ptr, 1000);
+    // sizes in the same size class should reuse the block
+    ProjMatrixElemsForOneBinArena::reset_counters();
+    void * const ptr2 = ProjMatrixElemsForOneBinArena::allocate(1010);
+    check(ptr == ptr2, "test reuse of block in the same size class");
+    ProjMatrixElemsForOneBinArena::deallocate(ptr2, 1010);
+  }
+  {
+    const ProjMatrixElemsForOneBinArena::Counters counters =
+      ProjMatrixElemsForOneBinArena::get_counters();
+    check_if_equal(counters.num_allocations, 1ULL, "test number of allocations");
+    check_if_equal(counters.num_reused_blocks, 1ULL, "test number of reused blocks");
+    check_if_equal(counters.num_heap_allocations, 0ULL, "test number of heap allocations");
+  }
+  {
+    // blocks that are too large are never reused
+    ProjMatrixElemsForOneBinArena::reset_counters();
+    const std::size_t size = ProjMatrixElemsForOneBinArena::get_max_block_size()+1;
+    ProjMatrixElemsForOneBinArena::deallocate(ProjMatrixElemsForOneBinArena::allocate(size), size);
+    ProjMatrixElemsForOneBinArena::deallocate(ProjMatrixElemsForOneBinArena::allocate(size), size);
+    const ProjMatrixElemsForOneBinArena::Counters counters =
+      ProjMatrixElemsForOneBinArena::get_counters();
+    check_if_equal(counters.num_heap_allocations, 2ULL, "test number of heap allocations for large blocks");
+  }
+#endif
+}
+
+void
+ProjMatrixElemsForOneBinArenaTests::
+run_tests_rows()
+{
+  cerr << "\tTesting rows using the arena\n";
+  {
+    ProjMatrixElemsForOneBin row;
+    fill_row(row, 1000, 2.F);
+    ProjMatrixElemsForOneBin row_copy(row);
+    check(row_copy == row, "test copy of row");
+    row_copy *= 2.F;
+    ProjMatrixElemsForOneBin row2;
+    fill_row(row2, 1000, 2.F);
+    row.merge(row2);
+    check_if_equal(row.size(), std::size_t(1000), "test size after merge");
+    check(row == row_copy, "test values after merge");
+  }
+#ifdef STIR_HAVE_PROJ_MATRIX_ELEMS_ARENA
+  {
+    // growing and copying the same rows many times should be served from the arena
+    ProjMatrixElemsForOneBinArena::reset_counters();
+    for (int i=0; i<100; ++i)
+      {
+        ProjMatrixElemsForOneBin row;
+        fill_row(row, 777, 1.F);
+        ProjMatrixElemsForOneBin row_copy(row);
+      }
+    const ProjMatrixElemsForOneBinArena::Counters counters =
+      ProjMatrixElemsForOneBinArena::get_counters();
+    check(counters.num_reused_blocks > 0, "test reuse of blocks by rows");
+    check(counters.num_heap_allocations*10 < counters.num_allocations,
+          "test most allocations by rows are served from the arena");
+    check_if_equal(counters.num_allocations,
+                   counters.num_reused_blocks + counters.num_heap_allocations,
+                   "test consistency of counters");
+  }
+#endif
+#ifdef STIR_OPENMP
+  {
+    cerr << "\tTesting rows using the arena in multiple threads\n";
+    const int num_rows = 200;
+    std::vector<ProjMatrixElemsForOneBin> rows(num_rows);
+#pragma omp parallel for schedule(dynamic)
+    for (int i=0; i<num_rows; ++i)
+      {
+        ProjMatrixElemsForOneBin tmp;
+        fill_row(tmp, 10*i+1, static_cast<float>(i));
+        rows[i] = tmp;
+      }
+    // now check the rows (probably in a different thread)
+#pragma omp parallel for schedule(dynamic)
+    for (int i=num_rows-1; i>=0; --i)
+      {
+        ProjMatrixElemsForOneBin tmp;
+        fill_row(tmp, 10*i+1, static_cast<float>(i));
+        if (rows[i] != tmp)
+          {
+#pragma omp critical(TESTPROJMATRIXELEMSARENA)
+            check(false, "test rows computed in multiple threads");
+          }
+      }
+  }
+#endif
+}
+
+void
+ProjMatrixElemsForOneBinArenaTests::
+run_tests()
+{
+  cerr << "Tests for ProjMatrixElemsForOneBinArena\n";
+  run_tests_arena();
+  run_tests_rows();
+}
+
+END_NAMESPACE_STIR
+
+
+USING_NAMESPACE_STIR
+
+
+int main()
+{
+  ProjMatrixElemsForOneBinArenaTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
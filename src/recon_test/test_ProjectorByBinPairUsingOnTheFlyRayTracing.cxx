@@ -0,0 +1,168 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup test
+
+  \brief Test program for stir::ProjectorByBinPairUsingOnTheFlyRayTracing
+
+  Compares forward and back projections with the matrix-free pair with those
+  obtained with stir::ProjectorByBinPairUsingProjMatrixByBin using a cached
+  stir::ProjMatrixByBinUsingRayTracing.
+*/
+
+#include "stir/recon_buildblock/ProjectorByBinPairUsingOnTheFlyRayTracing.h"
+#include "stir/recon_buildblock/ProjectorByBinPairUsingProjMatrixByBin.h"
+#include "stir/recon_buildblock/ProjMatrixByBinUsingRayTracing.h"
+#include "stir/recon_buildblock/ForwardProjectorByBin.h"
+#include "stir/recon_buildblock/BackProjectorByBin.h"
+#include "stir/DataSymmetriesForViewSegmentNumbers.h"
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/ExamInfo.h"
+#include "stir/ProjDataInMemory.h"
+#include "stir/RelatedViewgrams.h"
+#include "stir/ViewSegmentNumbers.h"
+#include "stir/Scanner.h"
+#include "stir/Succeeded.h"
+#include "stir/RunTests.h"
+#include <iostream>
+#include <sstream>
+
+#ifndef STIR_NO_NAMESPACES
+using std::stringstream;
+using std::cerr;
+#endif
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup test
+  \brief Test class for ProjectorByBinPairUsingOnTheFlyRayTracing
+*/
+class ProjectorByBinPairUsingOnTheFlyRayTracingTests : public RunTests
+{
+public:
+  void run_tests();
+};
+
+void
+ProjectorByBinPairUsingOnTheFlyRayTracingTests::run_tests()
+{
+  cerr << "Tests for ProjectorByBinPairUsingOnTheFlyRayTracing\n";
+
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  shared_ptr<ProjDataInfo> proj_data_info_sptr(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                  /*span=*/3,
+                                  /*max_delta=*/12,
+                                  /*num_views=*/16,
+                                  /*num_tang_poss=*/32));
+  const CartesianCoordinate3D<float> origin (0,0,0);
+  const float zoom=1.F;
+  shared_ptr<VoxelsOnCartesianGrid<float> >
+    image_sptr(new VoxelsOnCartesianGrid<float>(*proj_data_info_sptr,zoom,origin));
+  // fill with something non-uniform
+  for (int z=image_sptr->get_min_z(); z<=image_sptr->get_max_z(); ++z)
+    for (int y=image_sptr->get_min_y(); y<=image_sptr->get_max_y(); ++y)
+      for (int x=image_sptr->get_min_x(); x<=image_sptr->get_max_x(); ++x)
+        (*image_sptr)[z][y][x] = 1.F + z + (y+x)/10.F;
+
+  // set up the matrix-free pair via the parser
+  ProjectorByBinPairUsingOnTheFlyRayTracing on_the_fly_pair;
+  {
+    stringstream str;
+    str <<
+      "Projector Pair Using On The Fly Ray Tracing Parameters :=\n"
+      "restrict to cylindrical FOV := 1\n"
+      "number of rays in tangential direction to trace for each bin := 2\n"
+      "End Projector Pair Using On The Fly Ray Tracing Parameters :=\n";
+    if (!check(on_the_fly_pair.parse(str), "parsing projector pair parameters"))
+      return;
+    check(!on_the_fly_pair.get_proj_matrix_sptr()->is_cache_enabled(),
+          "cache should be disabled");
+    check_if_equal(on_the_fly_pair.get_proj_matrix_sptr()->get_num_tangential_LORs(), 2,
+                   "parsing of number of rays");
+  }
+  // reference pair using a cached matrix
+  shared_ptr<ProjMatrixByBinUsingRayTracing> proj_matrix_sptr(new ProjMatrixByBinUsingRayTracing);
+  proj_matrix_sptr->set_num_tangential_LORs(2);
+  ProjectorByBinPairUsingProjMatrixByBin matrix_pair(proj_matrix_sptr);
+
+  if (!check(on_the_fly_pair.set_up(proj_data_info_sptr, image_sptr) == Succeeded::yes,
+             "set_up of on-the-fly pair") ||
+      !check(matrix_pair.set_up(proj_data_info_sptr, image_sptr) == Succeeded::yes,
+             "set_up of matrix pair"))
+    return;
+
+  shared_ptr<DataSymmetriesForViewSegmentNumbers>
+    symmetries_sptr(on_the_fly_pair.get_symmetries_used()->clone());
+  shared_ptr<ExamInfo> exam_info_sptr(new ExamInfo);
+  ProjDataInMemory proj_data(exam_info_sptr, proj_data_info_sptr);
+
+  for (int segment_num = proj_data.get_min_segment_num();
+       segment_num <= proj_data.get_max_segment_num();
+       ++segment_num)
+    for (int view_num = proj_data.get_min_view_num();
+         view_num <= proj_data.get_max_view_num();
+         ++view_num)
+      {
+        const ViewSegmentNumbers vs(view_num, segment_num);
+        if (!symmetries_sptr->is_basic(vs))
+          continue;
+        RelatedViewgrams<float> viewgrams =
+          proj_data.get_empty_related_viewgrams(vs, symmetries_sptr);
+        RelatedViewgrams<float> ref_viewgrams = viewgrams;
+        on_the_fly_pair.get_forward_projector_sptr()->forward_project(viewgrams, *image_sptr);
+        matrix_pair.get_forward_projector_sptr()->forward_project(ref_viewgrams, *image_sptr);
+        RelatedViewgrams<float>::const_iterator iter = viewgrams.begin();
+        RelatedViewgrams<float>::const_iterator ref_iter = ref_viewgrams.begin();
+        for (; iter != viewgrams.end(); ++iter, ++ref_iter)
+          if (!check_if_equal(*iter, *ref_iter, "forward projection"))
+            {
+              cerr << "Problem at segment " << iter->get_segment_num()
+                   << ", view " << iter->get_view_num() << '\n';
+              return;
+            }
+
+        shared_ptr<DiscretisedDensity<3,float> > back_image_sptr(image_sptr->get_empty_copy());
+        shared_ptr<DiscretisedDensity<3,float> > ref_back_image_sptr(image_sptr->get_empty_copy());
+        on_the_fly_pair.get_back_projector_sptr()->back_project(*back_image_sptr, viewgrams);
+        matrix_pair.get_back_projector_sptr()->back_project(*ref_back_image_sptr, ref_viewgrams);
+        if (!check_if_equal(*back_image_sptr, *ref_back_image_sptr, "back projection"))
+          {
+            cerr << "Problem at segment " << segment_num << ", view " << view_num << '\n';
+            return;
+          }
+      }
+}
+
+END_NAMESPACE_STIR
+
+
+USING_NAMESPACE_STIR
+
+
+int main()
+{
+  ProjectorByBinPairUsingOnTheFlyRayTracingTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
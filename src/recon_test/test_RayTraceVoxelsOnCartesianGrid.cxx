@@ -0,0 +1,161 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup test
+
+  \brief Test program for the batch version of stir::RayTraceVoxelsOnCartesianGrid
+
+  Compares the result of ray tracing a batch of LORs with the result of
+  ray tracing every LOR separately.
+*/
+
+#include "stir/recon_buildblock/RayTraceVoxelsOnCartesianGrid.h"
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
+#include "stir/CartesianCoordinate3D.h"
+#include "stir/RunTests.h"
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <iostream>
+#include <vector>
+#include <math.h>
+
+#ifndef STIR_NO_NAMESPACES
+using std::cerr;
+using std::vector;
+#endif
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup test
+  \brief Test class for the batch version of RayTraceVoxelsOnCartesianGrid
+
+  Uses random LORs in all directions, LORs parallel to a coordinate plane,
+  and LORs in the plane between voxels.
+*/
+class RayTraceVoxelsOnCartesianGridTests : public RunTests
+{
+public:
+  void run_tests();
+private:
+  void run_tests_for_LORs(const vector<CartesianCoordinate3D<float> >& start_points,
+                          const vector<CartesianCoordinate3D<float> >& stop_points,
+                          const char * const description);
+};
+
+void
+RayTraceVoxelsOnCartesianGridTests::
+run_tests_for_LORs(const vector<CartesianCoordinate3D<float> >& start_points,
+                   const vector<CartesianCoordinate3D<float> >& stop_points,
+                   const char * const description)
+{
+  cerr << "\tTesting " << description << '\n';
+  const CartesianCoordinate3D<float> voxel_size(2.425F, 2.2F, 2.2F);
+  const float normalisation_constant = 1/voxel_size.x();
+
+  vector<ProjMatrixElemsForOneBin> lors(start_points.size());
+  RayTraceVoxelsOnCartesianGrid(lors, start_points, stop_points, voxel_size, normalisation_constant);
+
+  for (std::size_t i=0; i<start_points.size(); ++i)
+    {
+      ProjMatrixElemsForOneBin lor;
+      RayTraceVoxelsOnCartesianGrid(lor, start_points[i], stop_points[i], voxel_size, normalisation_constant);
+      bool equal = check_if_equal(lor.size(), lors[i].size(), "number of elements in LOR");
+      ProjMatrixElemsForOneBin::const_iterator iter = lor.begin();
+      ProjMatrixElemsForOneBin::const_iterator iter_batch = lors[i].begin();
+      for (; equal && iter != lor.end(); ++iter, ++iter_batch)
+        {
+          equal =
+            check_if_equal(iter->get_coords(), iter_batch->get_coords(), "coordinates of element") &&
+            check_if_equal(iter->get_value(), iter_batch->get_value(), "value of element");
+        }
+      if (!equal)
+        {
+          cerr << "Problem with LOR from " << start_points[i] << " to " << stop_points[i] << '\n';
+          return;
+        }
+    }
+}
+
+void
+RayTraceVoxelsOnCartesianGridTests::run_tests()
+{
+  cerr << "Tests for RayTraceVoxelsOnCartesianGrid (batch version using "
+       << get_RayTraceVoxelsOnCartesianGrid_instruction_set() << ")\n";
+
+  boost::mt19937 generator(42);
+  boost::variate_generator<boost::mt19937&, boost::uniform_real<float> >
+    random_coordinate(generator, boost::uniform_real<float>(-30.F, 30.F));
+
+  // use a number of LORs which is not a multiple of the batch size
+  const int num_LORs = 1001;
+  {
+    vector<CartesianCoordinate3D<float> > start_points, stop_points;
+    for (int i=0; i<num_LORs; ++i)
+      {
+        start_points.push_back(CartesianCoordinate3D<float>(random_coordinate(), random_coordinate(), random_coordinate()));
+        stop_points.push_back(CartesianCoordinate3D<float>(random_coordinate(), random_coordinate(), random_coordinate()));
+      }
+    run_tests_for_LORs(start_points, stop_points, "LORs in random directions");
+  }
+  {
+    vector<CartesianCoordinate3D<float> > start_points, stop_points;
+    for (int i=0; i<num_LORs; ++i)
+      {
+        const float z = random_coordinate();
+        start_points.push_back(CartesianCoordinate3D<float>(z, random_coordinate(), random_coordinate()));
+        stop_points.push_back(CartesianCoordinate3D<float>(z, random_coordinate(), random_coordinate()));
+        // also an LOR parallel to the y-axis
+        const float x = random_coordinate();
+        start_points.push_back(CartesianCoordinate3D<float>(random_coordinate(), random_coordinate(), x));
+        stop_points.push_back(CartesianCoordinate3D<float>(random_coordinate(), random_coordinate(), x));
+      }
+    run_tests_for_LORs(start_points, stop_points, "LORs parallel to a coordinate plane");
+  }
+  {
+    // mix LORs in a plane between voxels with other LORs, such that both
+    // the batch and the single LOR version are used
+    vector<CartesianCoordinate3D<float> > start_points, stop_points;
+    for (int i=0; i<num_LORs; ++i)
+      {
+        const float z = floor(random_coordinate()) + .5F;
+        start_points.push_back(CartesianCoordinate3D<float>(z, random_coordinate(), random_coordinate()));
+        stop_points.push_back(CartesianCoordinate3D<float>(z, random_coordinate(), random_coordinate()));
+        start_points.push_back(CartesianCoordinate3D<float>(random_coordinate(), random_coordinate(), random_coordinate()));
+        stop_points.push_back(CartesianCoordinate3D<float>(random_coordinate(), random_coordinate(), random_coordinate()));
+      }
+    run_tests_for_LORs(start_points, stop_points, "LORs in a plane between voxels");
+  }
+}
+
+END_NAMESPACE_STIR
+
+
+USING_NAMESPACE_STIR
+
+
+int main()
+{
+  RayTraceVoxelsOnCartesianGridTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
@@ -0,0 +1,220 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup recon_test
+  \ingroup scatter
+
+  \brief Test program for stir::ScatterEstimation
+
+  \par Usage
+
+  <pre>
+  test_ScatterEstimation
+  </pre>
+*/
+
+#include "stir/scatter/ScatterEstimation.h"
+#include "stir/scatter/ScatterEstimationByBin.h"
+#include "stir/OSMAPOSL/OSMAPOSLReconstruction.h"
+#include "stir/recon_buildblock/PoissonLogLikelihoodWithLinearModelForMeanAndProjData.h"
+#include "stir/recon_buildblock/ProjMatrixByBinUsingRayTracing.h"
+#include "stir/recon_buildblock/ProjectorByBinPairUsingProjMatrixByBin.h"
+#include "stir/recon_buildblock/BinNormalisationFromProjData.h"
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/ProjDataInMemory.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/ExamInfo.h"
+#include "stir/TimeFrameDefinitions.h"
+#include "stir/Scanner.h"
+#include "stir/SegmentByView.h"
+#include "stir/RunTests.h"
+#include "stir/Succeeded.h"
+#include "stir/is_null_ptr.h"
+#include <iostream>
+
+START_NAMESPACE_STIR
+
+namespace detail
+{
+  //! OSMAPOSL which counts how often it is set-up
+  class OSMAPOSLCountingSetUps : public OSMAPOSLReconstruction<DiscretisedDensity<3,float> >
+  {
+  public:
+    OSMAPOSLCountingSetUps()
+      : num_set_ups(0)
+    {}
+    virtual Succeeded set_up(shared_ptr<DiscretisedDensity<3,float> > const& target_sptr)
+    {
+      ++this->num_set_ups;
+      return OSMAPOSLReconstruction<DiscretisedDensity<3,float> >::set_up(target_sptr);
+    }
+    int num_set_ups;
+  };
+}
+
+/*!
+  \ingroup test
+  \brief Test class for ScatterEstimation
+
+  Runs a few scatter iterations on a small scanner, with all data in memory.
+  Checks that the reconstruction is set-up only once, and that the additive term
+  of the objective function corresponds to the final scatter estimate.
+*/
+class ScatterEstimationTests : public RunTests
+{
+public:
+  void run_tests();
+};
+
+void
+ScatterEstimationTests::
+run_tests()
+{
+  std::cerr << "Tests for ScatterEstimation\n";
+
+  // construct a small scanner
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  scanner_sptr->set_num_rings(3);
+  shared_ptr<ProjDataInfo> proj_data_info_sptr(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                  /*span=*/1,
+                                  /*max_delta=*/0,
+                                  /*num_views=*/16,
+                                  /*num_tang_poss=*/32,
+                                  /*arc_corrected=*/false));
+  shared_ptr<ProjDataInfo> template_proj_data_info_sptr(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                  /*span=*/1,
+                                  /*max_delta=*/0,
+                                  /*num_views=*/4,
+                                  /*num_tang_poss=*/8,
+                                  /*arc_corrected=*/false));
+  shared_ptr<ExamInfo> exam_info_sptr(new ExamInfo);
+  exam_info_sptr->imaging_modality = ImagingModality::PT;
+  {
+    std::vector<std::pair<double, double> > frame_times(1, std::make_pair(0., 100.));
+    exam_info_sptr->set_time_frame_definitions(TimeFrameDefinitions(frame_times));
+  }
+
+  // images: a centred cylinder
+  shared_ptr<VoxelsOnCartesianGrid<float> >
+    activity_image_sptr(new VoxelsOnCartesianGrid<float>(exam_info_sptr, *proj_data_info_sptr, .25F));
+  shared_ptr<VoxelsOnCartesianGrid<float> > density_image_sptr(activity_image_sptr->get_empty_copy());
+  {
+    const float radius = 70.F; // mm
+    const CartesianCoordinate3D<float> voxel_size = activity_image_sptr->get_voxel_size();
+    for (int z=activity_image_sptr->get_min_z(); z<=activity_image_sptr->get_max_z(); ++z)
+      for (int y=activity_image_sptr->get_min_y(); y<=activity_image_sptr->get_max_y(); ++y)
+        for (int x=activity_image_sptr->get_min_x(); x<=activity_image_sptr->get_max_x(); ++x)
+          if (square(x*voxel_size.x()) + square(y*voxel_size.y()) < square(radius))
+            {
+              (*activity_image_sptr)[z][y][x] = 1.F;
+              (*density_image_sptr)[z][y][x] = .096F; // water, in cm^-1
+            }
+  }
+
+  // emission data and attenuation correction factors
+  // (with ACFs larger than 1 in the centre, such that we have tails)
+  shared_ptr<ProjData> input_proj_data_sptr(new ProjDataInMemory(exam_info_sptr, proj_data_info_sptr));
+  shared_ptr<ProjData> acf_proj_data_sptr(new ProjDataInMemory(exam_info_sptr, proj_data_info_sptr));
+  for (int seg_num=proj_data_info_sptr->get_min_segment_num(); seg_num<=proj_data_info_sptr->get_max_segment_num(); ++seg_num)
+    {
+      SegmentByView<float> segment = input_proj_data_sptr->get_empty_segment_by_view(seg_num);
+      SegmentByView<float> acf_segment = acf_proj_data_sptr->get_empty_segment_by_view(seg_num);
+      for (int view_num=segment.get_min_view_num(); view_num<=segment.get_max_view_num(); ++view_num)
+        for (int ax_pos_num=segment.get_min_axial_pos_num(); ax_pos_num<=segment.get_max_axial_pos_num(); ++ax_pos_num)
+          for (int tang_pos_num=segment.get_min_tangential_pos_num(); tang_pos_num<=segment.get_max_tangential_pos_num(); ++tang_pos_num)
+            {
+              const bool in_object = std::abs(tang_pos_num) < 10;
+              segment[view_num][ax_pos_num][tang_pos_num] = in_object ? 10.F : 1.F;
+              acf_segment[view_num][ax_pos_num][tang_pos_num] = in_object ? 4.F : 1.F;
+            }
+      input_proj_data_sptr->set_segment(segment);
+      acf_proj_data_sptr->set_segment(acf_segment);
+    }
+
+  shared_ptr<ScatterEstimationByBin> scatter_simulation_sptr(new ScatterEstimationByBin);
+  scatter_simulation_sptr->set_density_image_sptr(density_image_sptr);
+  scatter_simulation_sptr->set_density_image_for_scatter_points_sptr(density_image_sptr);
+  scatter_simulation_sptr->set_template_proj_data_info_sptr(template_proj_data_info_sptr);
+
+  shared_ptr<PoissonLogLikelihoodWithLinearModelForMeanAndProjData<DiscretisedDensity<3,float> > >
+    objective_function_sptr(new PoissonLogLikelihoodWithLinearModelForMeanAndProjData<DiscretisedDensity<3,float> >);
+  shared_ptr<ProjMatrixByBin> proj_matrix_sptr(new ProjMatrixByBinUsingRayTracing());
+  shared_ptr<ProjectorByBinPair> proj_pair_sptr(new ProjectorByBinPairUsingProjMatrixByBin(proj_matrix_sptr));
+  objective_function_sptr->set_projector_pair_sptr(proj_pair_sptr);
+  shared_ptr<detail::OSMAPOSLCountingSetUps> reconstruction_sptr(new detail::OSMAPOSLCountingSetUps);
+  reconstruction_sptr->set_objective_function_sptr(objective_function_sptr);
+  reconstruction_sptr->set_num_subsets(1);
+  reconstruction_sptr->set_num_subiterations(1);
+  reconstruction_sptr->set_disable_output(true);
+
+  ScatterEstimation scatter_estimation;
+  scatter_estimation.set_input_proj_data_sptr(input_proj_data_sptr);
+  scatter_estimation.set_attenuation_correction_factors_sptr(acf_proj_data_sptr);
+  scatter_estimation.set_scatter_simulation_sptr(scatter_simulation_sptr);
+  scatter_estimation.set_reconstruction_method_sptr(reconstruction_sptr);
+  scatter_estimation.set_initial_activity_image_sptr(activity_image_sptr);
+  scatter_estimation.set_num_scatter_iterations(3);
+
+  if (!check(scatter_estimation.process_data() == Succeeded::yes, "process_data"))
+    return;
+
+  check_if_equal(reconstruction_sptr->num_set_ups, 1, "number of times the reconstruction is set-up");
+  check(activity_image_sptr->has_same_characteristics(*scatter_estimation.get_activity_image_sptr()),
+        "characteristics of the reconstructed image");
+  check(scatter_estimation.get_activity_image_sptr()->find_max() > 0, "reconstructed image should be positive");
+
+  shared_ptr<ProjData> scatter_estimate_sptr = scatter_estimation.get_scatter_estimate_sptr();
+  const SegmentBySinogram<float> scatter_segment = scatter_estimate_sptr->get_segment_by_sinogram(0);
+  check(scatter_segment.find_min() >= 0, "scatter estimate should be non-negative");
+  check(scatter_segment.find_max() > 0, "scatter estimate should not be zero");
+
+  // the additive term used by the last reconstruction is the attenuated scatter estimate
+  {
+    ProjDataInMemory expected_additive_proj_data(*scatter_estimate_sptr);
+    shared_ptr<BinNormalisation> attenuation_sptr(new BinNormalisationFromProjData(acf_proj_data_sptr));
+    attenuation_sptr->set_up(proj_data_info_sptr);
+    attenuation_sptr->apply(expected_additive_proj_data, 0., 100.);
+    shared_ptr<ProjData> additive_proj_data_sptr = objective_function_sptr->get_additive_proj_data_sptr();
+    if (check(!is_null_ptr(additive_proj_data_sptr), "additive term should be set"))
+      {
+        set_tolerance(scatter_segment.find_max()*1.E-4);
+        check_if_equal(additive_proj_data_sptr->get_segment_by_sinogram(0),
+                       expected_additive_proj_data.get_segment_by_sinogram(0),
+                       "additive term should be the last scatter estimate");
+      }
+  }
+
+  // a new process_data() sets-up the reconstruction again
+  scatter_estimation.set_num_scatter_iterations(1);
+  if (check(scatter_estimation.process_data() == Succeeded::yes, "second process_data"))
+    check_if_equal(reconstruction_sptr->num_set_ups, 2, "number of set-ups after second process_data");
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int main()
+{
+  ScatterEstimationTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
@@ -0,0 +1,246 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup recon_test
+  \ingroup scatter
+
+  \brief Test program for the cached integrals in stir::ScatterEstimationByBin
+
+  \par Usage
+
+  <pre>
+  test_ScatterEstimationByBin
+  </pre>
+  The file with the cached attenuation integrals is written in the current directory,
+  and removed at the end.
+*/
+
+#include "stir/scatter/ScatterEstimationByBin.h"
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/ProjDataInMemory.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/ExamInfo.h"
+#include "stir/Scanner.h"
+#include "stir/RunTests.h"
+#include "stir/Succeeded.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdio>
+
+START_NAMESPACE_STIR
+
+namespace detail
+{
+  //! ScatterEstimationByBin which gives access to the cached attenuation integrals
+  /*! The scatter points are not moved randomly, such that they are the same for every object. */
+  class ScatterEstimationByBinWithCacheAccess : public ScatterEstimationByBin
+  {
+  public:
+    ScatterEstimationByBinWithCacheAccess(const std::string& cache_filename)
+    {
+      this->random = false;
+      this->use_cache = true;
+      this->attenuation_integrals_cache_filename = cache_filename;
+    }
+    int get_num_scatter_points() const
+    { return static_cast<int>(this->scatt_points_vector.size()); }
+    int get_num_detectors() const
+    { return static_cast<int>(this->detection_points_vector.size()); }
+    //! value in the cache (computed with the batched ray tracing)
+    float get_cached_value(const int scatter_point_num, const int det_num)
+    { return this->cached_exp_integral_over_attenuation_image_between_scattpoint_det(scatter_point_num, det_num); }
+    //! value computed for a single ray
+    float get_value(const int scatter_point_num, const int det_num)
+    {
+      return this->exp_integral_over_attenuation_image_between_scattpoint_det(this->scatt_points_vector[scatter_point_num].coord,
+                                                                             this->detection_points_vector[det_num]);
+    }
+  };
+}
+
+/*!
+  \ingroup test
+  \brief Test class for the cached integrals in ScatterEstimationByBin
+
+  Runs the scatter simulation for a small scanner and checks that the precomputed
+  attenuation integrals are equal to the integrals computed for every ray separately.
+
+  The attenuation integrals are written to a file. This file is modified, and a second
+  simulation with the same attenuation image has to use the modified values. A simulation
+  with a different attenuation image has to recompute them.
+*/
+class ScatterEstimationByBinTests : public RunTests
+{
+public:
+  void run_tests();
+private:
+  //! run the scatter simulation
+  bool process_data(detail::ScatterEstimationByBinWithCacheAccess& scatter_simulation,
+                    const shared_ptr<DiscretisedDensity<3,float> >& density_image_sptr);
+  //! check that all cached values are equal to \a value (or computed for every ray if \a value is negative)
+  void check_cached_values(detail::ScatterEstimationByBinWithCacheAccess& scatter_simulation,
+                           const float value, const std::string& str);
+
+  shared_ptr<ProjDataInfo> template_proj_data_info_sptr;
+  shared_ptr<ExamInfo> exam_info_sptr;
+  shared_ptr<DiscretisedDensity<3,float> > activity_image_sptr;
+  shared_ptr<DiscretisedDensity<3,float> > density_image_for_scatter_points_sptr;
+};
+
+bool
+ScatterEstimationByBinTests::
+process_data(detail::ScatterEstimationByBinWithCacheAccess& scatter_simulation,
+             const shared_ptr<DiscretisedDensity<3,float> >& density_image_sptr)
+{
+  scatter_simulation.set_density_image_sptr(density_image_sptr);
+  scatter_simulation.set_density_image_for_scatter_points_sptr(density_image_for_scatter_points_sptr);
+  scatter_simulation.set_template_proj_data_info_sptr(template_proj_data_info_sptr);
+  scatter_simulation.set_activity_image_sptr(activity_image_sptr);
+  scatter_simulation.set_output_proj_data_sptr(
+    shared_ptr<ProjData>(new ProjDataInMemory(exam_info_sptr, template_proj_data_info_sptr)));
+  return
+    check(scatter_simulation.process_data() == Succeeded::yes, "scatter simulation") &&
+    check(scatter_simulation.get_num_scatter_points() > 0, "there should be scatter points");
+}
+
+void
+ScatterEstimationByBinTests::
+check_cached_values(detail::ScatterEstimationByBinWithCacheAccess& scatter_simulation,
+                    const float value, const std::string& str)
+{
+  // check only some detectors, as computing every ray separately is slow
+  for (int scatter_point_num=0; scatter_point_num<scatter_simulation.get_num_scatter_points(); ++scatter_point_num)
+    for (int det_num=scatter_point_num%7; det_num<scatter_simulation.get_num_detectors(); det_num+=7)
+      if (!check_if_equal(scatter_simulation.get_cached_value(scatter_point_num, det_num),
+                          value < 0 ? scatter_simulation.get_value(scatter_point_num, det_num) : value,
+                          str))
+        return;
+}
+
+void
+ScatterEstimationByBinTests::
+run_tests()
+{
+  std::cerr << "Tests for the cached integrals in ScatterEstimationByBin\n";
+
+  // construct a small scanner
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  scanner_sptr->set_num_rings(3);
+  shared_ptr<ProjDataInfo> proj_data_info_sptr(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                  /*span=*/1,
+                                  /*max_delta=*/0,
+                                  /*num_views=*/16,
+                                  /*num_tang_poss=*/32,
+                                  /*arc_corrected=*/false));
+  template_proj_data_info_sptr.reset(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                  /*span=*/1,
+                                  /*max_delta=*/0,
+                                  /*num_views=*/4,
+                                  /*num_tang_poss=*/8,
+                                  /*arc_corrected=*/false));
+  exam_info_sptr.reset(new ExamInfo);
+  exam_info_sptr->imaging_modality = ImagingModality::PT;
+
+  // images: a centred cylinder, with a non-uniform attenuation
+  shared_ptr<VoxelsOnCartesianGrid<float> >
+    activity_image_ptr(new VoxelsOnCartesianGrid<float>(exam_info_sptr, *proj_data_info_sptr, .25F));
+  shared_ptr<VoxelsOnCartesianGrid<float> > density_image_ptr(activity_image_ptr->get_empty_copy());
+  {
+    const float radius = 70.F; // mm
+    const CartesianCoordinate3D<float> voxel_size = activity_image_ptr->get_voxel_size();
+    for (int z=activity_image_ptr->get_min_z(); z<=activity_image_ptr->get_max_z(); ++z)
+      for (int y=activity_image_ptr->get_min_y(); y<=activity_image_ptr->get_max_y(); ++y)
+        for (int x=activity_image_ptr->get_min_x(); x<=activity_image_ptr->get_max_x(); ++x)
+          if (square(x*voxel_size.x()) + square(y*voxel_size.y()) < square(radius))
+            {
+              (*activity_image_ptr)[z][y][x] = 1.F;
+              (*density_image_ptr)[z][y][x] = x > 0 ? .096F : .15F; // in cm^-1
+            }
+  }
+  activity_image_sptr = activity_image_ptr;
+  density_image_for_scatter_points_sptr = density_image_ptr;
+
+  const std::string cache_filename = "test_ScatterEstimationByBin_attenuation_integrals.cache";
+  std::remove(cache_filename.c_str());
+  // exp(-integral) is at most 1
+  set_tolerance(1.E-5);
+
+  std::cerr << "\tComputing the attenuation integrals\n";
+  {
+    detail::ScatterEstimationByBinWithCacheAccess scatter_simulation(cache_filename);
+    if (!process_data(scatter_simulation, density_image_for_scatter_points_sptr))
+      return;
+    check_cached_values(scatter_simulation, -1.F, "precomputed attenuation integrals");
+  }
+
+  // replace all values in the file by a value that cannot be an attenuation integral
+  const float modified_value = 2.F;
+  {
+    std::fstream s(cache_filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if (!check(s.good(), "attenuation integrals should be written to file"))
+      return;
+    // 2 lines of text, followed by the values in little endian order
+    std::string line;
+    std::getline(s, line);
+    std::getline(s, line);
+    const std::streampos data_start = s.tellg();
+    s.seekg(0, std::ios::end);
+    const std::size_t num_values = static_cast<std::size_t>(s.tellg() - data_start)/sizeof(float);
+    // 2.F in little endian
+    const char modified_value_bytes[4] = { 0, 0, 0, 0x40 };
+    s.seekp(data_start);
+    for (std::size_t i=0; i<num_values; ++i)
+      s.write(modified_value_bytes, sizeof(modified_value_bytes));
+    check(!s.fail(), "modifying the attenuation integrals in the file");
+  }
+
+  std::cerr << "\tReading the attenuation integrals from file\n";
+  {
+    detail::ScatterEstimationByBinWithCacheAccess scatter_simulation(cache_filename);
+    if (!process_data(scatter_simulation, density_image_for_scatter_points_sptr))
+      return;
+    check_cached_values(scatter_simulation, modified_value, "attenuation integrals read from file");
+  }
+
+  std::cerr << "\tUsing a different attenuation image\n";
+  {
+    shared_ptr<DiscretisedDensity<3,float> > new_density_image_sptr(density_image_for_scatter_points_sptr->clone());
+    *new_density_image_sptr *= 1.1F;
+    detail::ScatterEstimationByBinWithCacheAccess scatter_simulation(cache_filename);
+    if (!process_data(scatter_simulation, new_density_image_sptr))
+      return;
+    check_cached_values(scatter_simulation, -1.F, "attenuation integrals for a different attenuation image");
+  }
+
+  std::remove(cache_filename.c_str());
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int main()
+{
+  ScatterEstimationByBinTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
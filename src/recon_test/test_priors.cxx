@@ -0,0 +1,354 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup recon_test
+
+  \brief Test program for the value and gradient of stir::QuadraticPrior and stir::PLSPrior
+
+  The results of the prior classes are compared with a straightforward implementation
+  that loops over all voxels and checks the boundaries of the neighbourhood for every voxel
+  (which is how the priors used to be implemented).
+
+  \par Usage
+  \verbatim
+  test_priors
+  \endverbatim
+*/
+
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/IndexRange3D.h"
+#include "stir/recon_buildblock/QuadraticPrior.h"
+#include "stir/recon_buildblock/PLSPrior.h"
+#include "stir/RunTests.h"
+#include "stir/is_null_ptr.h"
+#include "stir/Succeeded.h"
+#include <boost/format.hpp>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup test
+  \brief Test class for QuadraticPrior and PLSPrior
+*/
+class PriorTests : public RunTests
+{
+public:
+  void run_tests();
+
+private:
+  typedef DiscretisedDensity<3,float> image_type;
+
+  void run_tests_for_quadratic_prior(const shared_ptr<image_type>& image_sptr,
+                                     const shared_ptr<image_type>& kappa_sptr);
+  void run_tests_for_PLS_prior(const shared_ptr<image_type>& image_sptr,
+                               const shared_ptr<image_type>& anatomical_sptr,
+                               const shared_ptr<image_type>& kappa_sptr,
+                               const bool only_2D);
+
+  static double reference_quadratic_value(const QuadraticPrior<float>& prior, const image_type& image);
+  static void reference_quadratic_gradient(image_type& gradient,
+                                           const QuadraticPrior<float>& prior, const image_type& image);
+  static void reference_PLS_terms(image_type& penalty, shared_ptr<image_type> normalised_grad[3],
+                                  const PLSPrior<float>& prior, const image_type& image,
+                                  const bool only_2D);
+  static double reference_PLS_value(const PLSPrior<float>& prior, const image_type& image,
+                                    const bool only_2D);
+  static void reference_PLS_gradient(image_type& gradient,
+                                     const PLSPrior<float>& prior, const image_type& image,
+                                     const bool only_2D);
+  //! check value and gradient, using a tolerance relative to the maximum of the reference
+  void check_results(const double value, const double reference_value,
+                     const image_type& gradient, const image_type& reference_gradient,
+                     const std::string& str);
+};
+
+//! straightforward implementation of QuadraticPrior::compute_value()
+double
+PriorTests::
+reference_quadratic_value(const QuadraticPrior<float>& prior, const image_type& image)
+{
+  const Array<3,float> weights = prior.get_weights();
+  const shared_ptr<image_type> kappa_ptr = prior.get_kappa_sptr();
+  const bool do_kappa = !is_null_ptr(kappa_ptr);
+  double result = 0.;
+  for (int z=image.get_min_index(); z<=image.get_max_index(); z++)
+    for (int y=image[z].get_min_index(); y<=image[z].get_max_index(); y++)
+      for (int x=image[z][y].get_min_index(); x<=image[z][y].get_max_index(); x++)
+        for (int dz=weights.get_min_index(); dz<=weights.get_max_index(); ++dz)
+          for (int dy=weights[dz].get_min_index(); dy<=weights[dz].get_max_index(); ++dy)
+            for (int dx=weights[dz][dy].get_min_index(); dx<=weights[dz][dy].get_max_index(); ++dx)
+              {
+                if (z+dz<image.get_min_index() || z+dz>image.get_max_index() ||
+                    y+dy<image[z].get_min_index() || y+dy>image[z].get_max_index() ||
+                    x+dx<image[z][y].get_min_index() || x+dx>image[z][y].get_max_index())
+                  continue;
+                double current =
+                  weights[dz][dy][dx] * square(image[z][y][x] - image[z+dz][y+dy][x+dx])/4;
+                if (do_kappa)
+                  current *= (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
+                result += current;
+              }
+  return result * prior.get_penalisation_factor();
+}
+
+//! straightforward implementation of QuadraticPrior::compute_gradient()
+void
+PriorTests::
+reference_quadratic_gradient(image_type& gradient, const QuadraticPrior<float>& prior, const image_type& image)
+{
+  const Array<3,float> weights = prior.get_weights();
+  const shared_ptr<image_type> kappa_ptr = prior.get_kappa_sptr();
+  const bool do_kappa = !is_null_ptr(kappa_ptr);
+  for (int z=image.get_min_index(); z<=image.get_max_index(); z++)
+    for (int y=image[z].get_min_index(); y<=image[z].get_max_index(); y++)
+      for (int x=image[z][y].get_min_index(); x<=image[z][y].get_max_index(); x++)
+        {
+          double sum = 0;
+          for (int dz=weights.get_min_index(); dz<=weights.get_max_index(); ++dz)
+            for (int dy=weights[dz].get_min_index(); dy<=weights[dz].get_max_index(); ++dy)
+              for (int dx=weights[dz][dy].get_min_index(); dx<=weights[dz][dy].get_max_index(); ++dx)
+                {
+                  if (z+dz<image.get_min_index() || z+dz>image.get_max_index() ||
+                      y+dy<image[z].get_min_index() || y+dy>image[z].get_max_index() ||
+                      x+dx<image[z][y].get_min_index() || x+dx>image[z][y].get_max_index())
+                    continue;
+                  double current = weights[dz][dy][dx] * (image[z][y][x] - image[z+dz][y+dy][x+dx]);
+                  if (do_kappa)
+                    current *= (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
+                  sum += current;
+                }
+          gradient[z][y][x] = static_cast<float>(sum * prior.get_penalisation_factor());
+        }
+}
+
+//! computes the penalty and the normalised gradient for PLSPrior using full images
+/*! The image gradient uses forward differences, set to 0 at the last voxel in every direction. */
+void
+PriorTests::
+reference_PLS_terms(image_type& penalty, shared_ptr<image_type> normalised_grad[3],
+                    const PLSPrior<float>& prior, const image_type& image,
+                    const bool only_2D)
+{
+  const double alpha = prior.get_alpha();
+  const image_type& norm = *prior.get_norm_sptr();
+  const int min_d = only_2D ? 1 : 0;
+  for (int z=image.get_min_index(); z<=image.get_max_index(); ++z)
+    for (int y=image[z].get_min_index(); y<=image[z].get_max_index(); ++y)
+      for (int x=image[z][y].get_min_index(); x<=image[z][y].get_max_index(); ++x)
+        {
+          double pet_grad[3] = {0, 0, 0};
+          if (!only_2D && z<image.get_max_index())
+            pet_grad[0] = image[z+1][y][x] - image[z][y][x];
+          if (y<image[z].get_max_index())
+            pet_grad[1] = image[z][y+1][x] - image[z][y][x];
+          if (x<image[z][y].get_max_index())
+            pet_grad[2] = image[z][y][x+1] - image[z][y][x];
+
+          double inner_product = 0;
+          for (int d=min_d; d<3; ++d)
+            inner_product += pet_grad[d] * (*prior.get_anatomical_grad_sptr(d))[z][y][x];
+          inner_product /= norm[z][y][x];
+          double sum_of_squares = square(alpha);
+          for (int d=min_d; d<3; ++d)
+            sum_of_squares += square(pet_grad[d]);
+          const double current_penalty = std::sqrt(sum_of_squares - square(inner_product));
+          penalty[z][y][x] = static_cast<float>(current_penalty);
+          for (int d=min_d; d<3; ++d)
+            (*normalised_grad[d])[z][y][x] = static_cast<float>(
+              (pet_grad[d] - (*prior.get_anatomical_grad_sptr(d))[z][y][x]*inner_product/norm[z][y][x]) /
+              current_penalty);
+        }
+}
+
+//! straightforward implementation of PLSPrior::compute_value()
+double
+PriorTests::
+reference_PLS_value(const PLSPrior<float>& prior, const image_type& image, const bool only_2D)
+{
+  shared_ptr<image_type> penalty_sptr(image.get_empty_copy());
+  shared_ptr<image_type> normalised_grad[3];
+  for (int d=0; d<3; ++d)
+    normalised_grad[d].reset(image.get_empty_copy());
+  reference_PLS_terms(*penalty_sptr, normalised_grad, prior, image, only_2D);
+  const shared_ptr<image_type> kappa_ptr = prior.get_kappa_sptr();
+  double result = 0.;
+  for (int z=image.get_min_index(); z<=image.get_max_index(); ++z)
+    for (int y=image[z].get_min_index(); y<=image[z].get_max_index(); ++y)
+      for (int x=image[z][y].get_min_index(); x<=image[z][y].get_max_index(); ++x)
+        result += (*penalty_sptr)[z][y][x] * (is_null_ptr(kappa_ptr) ? 1.F : (*kappa_ptr)[z][y][x]);
+  return result * prior.get_penalisation_factor();
+}
+
+//! straightforward implementation of PLSPrior::compute_gradient()
+/*! The divergence uses backward differences. Terms are only added where the forward differences
+    of the image gradient are defined in all directions.
+*/
+void
+PriorTests::
+reference_PLS_gradient(image_type& gradient, const PLSPrior<float>& prior, const image_type& image,
+                       const bool only_2D)
+{
+  shared_ptr<image_type> penalty_sptr(image.get_empty_copy());
+  shared_ptr<image_type> normalised_grad[3];
+  for (int d=0; d<3; ++d)
+    normalised_grad[d].reset(image.get_empty_copy());
+  reference_PLS_terms(*penalty_sptr, normalised_grad, prior, image, only_2D);
+  const shared_ptr<image_type> kappa_ptr = prior.get_kappa_sptr();
+  const int min_z = image.get_min_index();
+  const int max_z = image.get_max_index();
+  for (int z=min_z; z<=max_z; ++z)
+    {
+      const int min_y = image[z].get_min_index();
+      const int max_y = image[z].get_max_index();
+      // in 2D, there is always a "next plane"
+      const bool has_next_plane = only_2D || z<max_z;
+      for (int y=min_y; y<=max_y; ++y)
+        {
+          const int min_x = image[z][y].get_min_index();
+          const int max_x = image[z][y].get_max_index();
+          for (int x=min_x; x<=max_x; ++x)
+            {
+              double divergence = 0;
+              if (!only_2D && z>min_z && y<max_y && x<max_x)
+                divergence += (*normalised_grad[0])[z][y][x] - (*normalised_grad[0])[z-1][y][x];
+              if (y>min_y && has_next_plane && x<max_x)
+                divergence += (*normalised_grad[1])[z][y][x] - (*normalised_grad[1])[z][y-1][x];
+              if (x>min_x && has_next_plane && y<max_y)
+                divergence += (*normalised_grad[2])[z][y][x] - (*normalised_grad[2])[z][y][x-1];
+              if (!is_null_ptr(kappa_ptr))
+                divergence *= (*kappa_ptr)[z][y][x];
+              gradient[z][y][x] = static_cast<float>(-divergence * prior.get_penalisation_factor());
+            }
+        }
+    }
+}
+
+void
+PriorTests::
+check_results(const double value, const double reference_value,
+              const image_type& gradient, const image_type& reference_gradient,
+              const std::string& str)
+{
+  set_tolerance(1.E-4);
+  check_if_equal(value/reference_value, 1., str + ": value");
+  set_tolerance(std::max(reference_gradient.find_max(), -reference_gradient.find_min())*1.E-4);
+  check(gradient.has_same_characteristics(reference_gradient), str + ": characteristics of gradient");
+  check_if_equal(gradient, reference_gradient, str + ": gradient");
+}
+
+void
+PriorTests::
+run_tests_for_quadratic_prior(const shared_ptr<image_type>& image_sptr,
+                              const shared_ptr<image_type>& kappa_sptr)
+{
+  const std::string name = is_null_ptr(kappa_sptr) ? "QuadraticPrior" : "QuadraticPrior with kappa";
+  std::cerr << "Tests for " << name << '\n';
+  QuadraticPrior<float> prior(false, 1.3F);
+  prior.set_kappa_sptr(kappa_sptr);
+  if (!check(prior.set_up(image_sptr) == Succeeded::yes, name + ": set_up"))
+    return;
+  // the weights are computed by the first call
+  const double value = prior.compute_value(*image_sptr);
+  const double reference_value = reference_quadratic_value(prior, *image_sptr);
+  shared_ptr<image_type> gradient_sptr(image_sptr->get_empty_copy());
+  shared_ptr<image_type> reference_gradient_sptr(image_sptr->get_empty_copy());
+  prior.compute_gradient(*gradient_sptr, *image_sptr);
+  reference_quadratic_gradient(*reference_gradient_sptr, prior, *image_sptr);
+  check_results(value, reference_value, *gradient_sptr, *reference_gradient_sptr, name);
+}
+
+void
+PriorTests::
+run_tests_for_PLS_prior(const shared_ptr<image_type>& image_sptr,
+                        const shared_ptr<image_type>& anatomical_sptr,
+                        const shared_ptr<image_type>& kappa_sptr,
+                        const bool only_2D)
+{
+  const std::string name =
+    boost::str(boost::format("PLSPrior (%1%%2%)")
+               % (only_2D ? "2D" : "3D") % (is_null_ptr(kappa_sptr) ? "" : " with kappa"));
+  std::cerr << "Tests for " << name << '\n';
+  PLSPrior<float> prior(only_2D, 1.3F);
+  prior.set_anatomical_image_sptr(anatomical_sptr);
+  prior.set_kappa_sptr(kappa_sptr);
+  prior.set_eta(.1);
+  prior.set_alpha(.01);
+  if (!check(prior.set_up(image_sptr) == Succeeded::yes, name + ": set_up"))
+    return;
+  const double value = prior.compute_value(*image_sptr);
+  const double reference_value = reference_PLS_value(prior, *image_sptr, only_2D);
+  shared_ptr<image_type> gradient_sptr(image_sptr->get_empty_copy());
+  shared_ptr<image_type> reference_gradient_sptr(image_sptr->get_empty_copy());
+  prior.compute_gradient(*gradient_sptr, *image_sptr);
+  reference_PLS_gradient(*reference_gradient_sptr, prior, *image_sptr, only_2D);
+  check_results(value, reference_value, *gradient_sptr, *reference_gradient_sptr, name);
+}
+
+void
+PriorTests::
+run_tests()
+{
+  // a small image with an asymmetric index range, such that all borders are tested
+  // (more than 8 planes, as the PLS gradient is computed in blocks of planes)
+  const IndexRange3D range(0, 10, -5, 6, -7, 4);
+  shared_ptr<VoxelsOnCartesianGrid<float> >
+    image_sptr(new VoxelsOnCartesianGrid<float>(range,
+                                                CartesianCoordinate3D<float>(0,0,0),
+                                                CartesianCoordinate3D<float>(2.425F,2.F,2.F)));
+  shared_ptr<VoxelsOnCartesianGrid<float> > anatomical_sptr(image_sptr->get_empty_voxels_on_cartesian_grid());
+  shared_ptr<VoxelsOnCartesianGrid<float> > kappa_sptr(image_sptr->get_empty_voxels_on_cartesian_grid());
+  {
+    // a blob in a noisy background, and an anatomical image with an edge
+    srand(1);
+    for (int z=range.get_min_index(); z<=range.get_max_index(); ++z)
+      for (int y=range[z].get_min_index(); y<=range[z].get_max_index(); ++y)
+        for (int x=range[z][y].get_min_index(); x<=range[z][y].get_max_index(); ++x)
+          {
+            const float r2 = static_cast<float>(square(x) + square(y) + square(z-5))/25;
+            (*image_sptr)[z][y][x] =
+              static_cast<float>(std::exp(-r2)) + 0.1F*static_cast<float>(rand())/RAND_MAX;
+            (*anatomical_sptr)[z][y][x] = r2 < 1 ? 2.F : 1.F;
+            (*kappa_sptr)[z][y][x] = 1 + static_cast<float>(rand())/RAND_MAX;
+          }
+  }
+
+  run_tests_for_quadratic_prior(image_sptr, shared_ptr<image_type>());
+  run_tests_for_quadratic_prior(image_sptr, kappa_sptr);
+  for (int only_2D=0; only_2D<=1; ++only_2D)
+    {
+      run_tests_for_PLS_prior(image_sptr, anatomical_sptr, shared_ptr<image_type>(), only_2D!=0);
+      run_tests_for_PLS_prior(image_sptr, anatomical_sptr, kappa_sptr, only_2D!=0);
+    }
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int main()
+{
+  PriorTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
@@ -0,0 +1,196 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup test
+
+  \brief Benchmark for the caches of stir::ProjMatrixByBin
+
+  Measures how many rows per second can be fetched from a fully filled cache
+  of a stir::ProjMatrixByBinUsingRayTracing, as a function of the number of threads
+  (when compiled with OpenMP), for the default, compressed and lock-free caches.
+
+  \par Usage
+  \verbatim
+  timings_ProjMatrixByBin_cache [max_num_threads [num_passes]]
+  \endverbatim
+  Defaults are the maximum number of OpenMP threads and 3 passes.
+  Bins are processed in order of view, such that threads usually access the same view.
+
+  This program is not run as part of the tests.
+*/
+
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/Scanner.h"
+#include "stir/recon_buildblock/ProjMatrixByBinUsingRayTracing.h"
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBinAllocator.h"
+#include "stir/HighResWallClockTimer.h"
+#include "stir/error.h"
+#include <boost/format.hpp>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <stdlib.h>
+#ifdef STIR_OPENMP
+#include <omp.h>
+#endif
+
+#ifndef STIR_NO_NAMESPACES
+using std::cout;
+using std::cerr;
+using std::vector;
+using std::string;
+#endif
+
+USING_NAMESPACE_STIR
+
+static void
+set_up_matrix(ProjMatrixByBinUsingRayTracing& proj_matrix,
+              const string& cache_parameters,
+              const shared_ptr<ProjDataInfo>& proj_data_info_sptr,
+              const shared_ptr<DiscretisedDensity<3,float> >& density_sptr)
+{
+  std::stringstream str;
+  str <<
+    "Ray Tracing Matrix Parameters :=\n"
+    "restrict to cylindrical FOV := 1\n"
+    "number of rays in tangential direction to trace for each bin := 1\n"
+    << cache_parameters <<
+    "End Ray Tracing Matrix Parameters :=\n";
+  if (!proj_matrix.parse(str))
+    error("Error parsing matrix parameters");
+  proj_matrix.set_up(proj_data_info_sptr, density_sptr);
+}
+
+//! fetch all rows num_passes times, returns wall-clock time in seconds
+static double
+fetch_all_rows(const ProjMatrixByBin& proj_matrix, const vector<Bin>& bins,
+               const int num_threads, const int num_passes)
+{
+#ifdef STIR_OPENMP
+  omp_set_num_threads(num_threads);
+#endif
+  HighResWallClockTimer timer;
+  timer.start();
+  for (int pass=0; pass<num_passes; ++pass)
+    {
+      const int num_bins = static_cast<int>(bins.size());
+#ifdef STIR_OPENMP
+#pragma omp parallel
+#endif
+      {
+        ProjMatrixElemsForOneBin row;
+#ifdef STIR_OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (int i=0; i<num_bins; ++i)
+          proj_matrix.get_proj_matrix_elems_for_one_bin(row, bins[i]);
+      }
+    }
+  timer.stop();
+  return timer.value();
+}
+
+int
+main(int argc, char **argv)
+{
+  int max_num_threads = 1;
+#ifdef STIR_OPENMP
+  max_num_threads = omp_get_max_threads();
+#endif
+  int num_passes = 3;
+  if (argc>1)
+    max_num_threads = atoi(argv[1]);
+  if (argc>2)
+    num_passes = atoi(argv[2]);
+  if (argc>3 || max_num_threads<1 || num_passes<1)
+    {
+      cerr << "Usage: " << argv[0] << " [max_num_threads [num_passes]]\n";
+      return EXIT_FAILURE;
+    }
+#ifndef STIR_OPENMP
+  if (max_num_threads>1)
+    {
+      cerr << "Compiled without OpenMP, so only timing a single thread\n";
+      max_num_threads = 1;
+    }
+#endif
+
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  shared_ptr<ProjDataInfo> proj_data_info_sptr(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                  /*span=*/3,
+                                  /*max_delta=*/12,
+                                  /*num_views=*/scanner_sptr->get_num_detectors_per_ring()/2,
+                                  /*num_tang_poss=*/scanner_sptr->get_max_num_non_arccorrected_bins()));
+  const CartesianCoordinate3D<float> origin (0,0,0);
+  shared_ptr<DiscretisedDensity<3,float> >
+    density_sptr(new VoxelsOnCartesianGrid<float>(*proj_data_info_sptr,1.F,origin));
+
+  vector<Bin> bins;
+  for (int view_num = proj_data_info_sptr->get_min_view_num();
+       view_num <= proj_data_info_sptr->get_max_view_num();
+       ++view_num)
+    for (int segment_num = proj_data_info_sptr->get_min_segment_num();
+         segment_num <= proj_data_info_sptr->get_max_segment_num();
+         ++segment_num)
+      for (int axial_pos_num = proj_data_info_sptr->get_min_axial_pos_num(segment_num);
+           axial_pos_num <= proj_data_info_sptr->get_max_axial_pos_num(segment_num);
+           ++axial_pos_num)
+        for (int tangential_pos_num = proj_data_info_sptr->get_min_tangential_pos_num();
+             tangential_pos_num <= proj_data_info_sptr->get_max_tangential_pos_num();
+             ++tangential_pos_num)
+          bins.push_back(Bin(segment_num, view_num, axial_pos_num, tangential_pos_num));
+
+  const char * const cache_names[] = { "default", "compressed", "lock-free" };
+  const char * const cache_parameters[] =
+    {
+      "",
+      "use compressed cache := 1\n",
+      "use lock-free cache := 1\n"
+    };
+
+  cout << boost::format("%1% rows, %2% passes\n") % bins.size() % num_passes;
+  cout << boost::format("%|12| %|10| %|16| %|16|\n") % "cache" % "threads" % "rows/s" % "reused blocks";
+  for (unsigned c=0; c<sizeof(cache_names)/sizeof(cache_names[0]); ++c)
+    {
+      ProjMatrixByBinUsingRayTracing proj_matrix;
+      set_up_matrix(proj_matrix, cache_parameters[c], proj_data_info_sptr, density_sptr);
+      // fill the cache
+      fetch_all_rows(proj_matrix, bins, max_num_threads, 1);
+
+      for (int num_threads=1; num_threads<=max_num_threads; num_threads*=2)
+        {
+          ProjMatrixElemsForOneBinArena::reset_counters();
+          const double time = fetch_all_rows(proj_matrix, bins, num_threads, num_passes);
+          const ProjMatrixElemsForOneBinArena::Counters counters =
+            ProjMatrixElemsForOneBinArena::get_counters();
+          const double fraction_reused =
+            counters.num_allocations == 0 ? 0. :
+            static_cast<double>(counters.num_reused_blocks)/counters.num_allocations;
+          cout << boost::format("%|12| %|10| %|16.0f| %|15.1f|%%\n")
+            % cache_names[c] % num_threads % (bins.size()*num_passes/time) % (100*fraction_reused);
+        }
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+
+  \file
+  \ingroup test
+
+  \brief Benchmark for stir::RayTraceVoxelsOnCartesianGrid
+
+  Compares how many LORs per second can be ray traced by the single LOR
+  and the batch version of stir::RayTraceVoxelsOnCartesianGrid.
+  LORs are randomly oriented through an image of 128x128x64 voxels.
+
+  \par Usage
+  \verbatim
+  timings_RayTraceVoxelsOnCartesianGrid [num_LORs [batch_size]]
+  \endverbatim
+  Defaults are 100000 LORs and batches of 64 LORs.
+
+  This program is not run as part of the tests.
+*/
+
+#include "stir/recon_buildblock/RayTraceVoxelsOnCartesianGrid.h"
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
+#include "stir/CartesianCoordinate3D.h"
+#include "stir/HighResWallClockTimer.h"
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <boost/format.hpp>
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+
+#ifndef STIR_NO_NAMESPACES
+using std::cout;
+using std::cerr;
+using std::vector;
+#endif
+
+USING_NAMESPACE_STIR
+
+int
+main(int argc, char **argv)
+{
+  int num_LORs = 100000;
+  int batch_size = 64;
+  if (argc>1)
+    num_LORs = atoi(argv[1]);
+  if (argc>2)
+    batch_size = atoi(argv[2]);
+  if (argc>3 || num_LORs<1 || batch_size<1)
+    {
+      cerr << "Usage: " << argv[0] << " [num_LORs [batch_size]]\n";
+      return EXIT_FAILURE;
+    }
+
+  // generate LORs between 2 random points on a cylinder around the image
+  boost::mt19937 generator(42);
+  boost::variate_generator<boost::mt19937&, boost::uniform_real<float> >
+    random_uniform(generator, boost::uniform_real<float>(0.F, 1.F));
+  const float radius = 63.F;
+  const float half_length = 31.F;
+  vector<CartesianCoordinate3D<float> > start_points, stop_points;
+  for (int i=0; i<num_LORs; ++i)
+    {
+      const float phi1 = static_cast<float>(2*_PI*random_uniform());
+      const float phi2 = static_cast<float>(2*_PI*random_uniform());
+      start_points.push_back(CartesianCoordinate3D<float>((2*random_uniform()-1)*half_length,
+                                                          radius*sin(phi1), radius*cos(phi1)));
+      stop_points.push_back(CartesianCoordinate3D<float>((2*random_uniform()-1)*half_length,
+                                                         radius*sin(phi2), radius*cos(phi2)));
+    }
+  const CartesianCoordinate3D<float> voxel_size(2.425F, 2.2F, 2.2F);
+
+  std::size_t num_elements_single = 0;
+  HighResWallClockTimer timer;
+  timer.start();
+  {
+    ProjMatrixElemsForOneBin lor;
+    for (int i=0; i<num_LORs; ++i)
+      {
+        lor.erase();
+        RayTraceVoxelsOnCartesianGrid(lor, start_points[i], stop_points[i], voxel_size);
+        num_elements_single += lor.size();
+      }
+  }
+  timer.stop();
+  const double time_single = timer.value();
+
+  std::size_t num_elements_batch = 0;
+  timer.reset();
+  timer.start();
+  {
+    vector<ProjMatrixElemsForOneBin> lors(batch_size);
+    vector<CartesianCoordinate3D<float> > batch_start_points, batch_stop_points;
+    for (int first=0; first<num_LORs; first+=batch_size)
+      {
+        const int last = std::min(first+batch_size, num_LORs);
+        batch_start_points.assign(start_points.begin()+first, start_points.begin()+last);
+        batch_stop_points.assign(stop_points.begin()+first, stop_points.begin()+last);
+        lors.resize(last-first);
+        for (std::size_t i=0; i<lors.size(); ++i)
+          lors[i].erase();
+        RayTraceVoxelsOnCartesianGrid(lors, batch_start_points, batch_stop_points, voxel_size);
+        for (std::size_t i=0; i<lors.size(); ++i)
+          num_elements_batch += lors[i].size();
+      }
+  }
+  timer.stop();
+  const double time_batch = timer.value();
+
+  if (num_elements_single != num_elements_batch)
+    {
+      cerr << "Error: different number of elements for single LOR and batch version\n";
+      return EXIT_FAILURE;
+    }
+
+  cout << boost::format("%1% LORs, %2% elements, batch version uses %3%\n")
+    % num_LORs % num_elements_single % get_RayTraceVoxelsOnCartesianGrid_instruction_set();
+  cout << boost::format("%|12| %|16|\n") % "version" % "rows/s";
+  cout << boost::format("%|12| %|16.0f|\n") % "single" % (num_LORs/time_single);
+  cout << boost::format("%|12| %|16.0f|\n") % "batch" % (num_LORs/time_batch);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,401 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup test
+
+  \brief Benchmark for the value and gradient of stir::QuadraticPrior and stir::PLSPrior
+
+  Compares the implementation in the prior classes with a straightforward
+  implementation that loops over all voxels and checks the boundaries of the
+  neighbourhood for every voxel (which is how the priors used to be implemented).
+  Both the timings and the maximum difference between the results are reported.
+
+  \par Usage
+  \verbatim
+  timings_priors [num_planes [num_voxels_in_plane [num_repetitions]]]
+  \endverbatim
+  Defaults are 109 planes of 256x256 voxels (a typical 3D PET image size),
+  and 3 repetitions.
+
+  This program is not run as part of the tests.
+*/
+
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/IndexRange3D.h"
+#include "stir/recon_buildblock/QuadraticPrior.h"
+#include "stir/recon_buildblock/PLSPrior.h"
+#include "stir/HighResWallClockTimer.h"
+#include "stir/is_null_ptr.h"
+#include "stir/Succeeded.h"
+#include "stir/error.h"
+#include <boost/format.hpp>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+
+#ifndef STIR_NO_NAMESPACES
+using std::cout;
+using std::cerr;
+using std::min;
+using std::max;
+#endif
+
+USING_NAMESPACE_STIR
+
+typedef DiscretisedDensity<3,float> image_type;
+
+//! straightforward implementation of QuadraticPrior::compute_value()
+static double
+reference_quadratic_value(const QuadraticPrior<float>& prior, const image_type& image)
+{
+  const Array<3,float> weights = prior.get_weights();
+  const shared_ptr<image_type> kappa_ptr = prior.get_kappa_sptr();
+  const bool do_kappa = !is_null_ptr(kappa_ptr);
+  double result = 0.;
+  const int min_z = image.get_min_index();
+  const int max_z = image.get_max_index();
+  for (int z=min_z; z<=max_z; z++)
+    {
+      const int min_dz = max(weights.get_min_index(), min_z-z);
+      const int max_dz = min(weights.get_max_index(), max_z-z);
+      const int min_y = image[z].get_min_index();
+      const int max_y = image[z].get_max_index();
+      for (int y=min_y;y<= max_y;y++)
+        {
+          const int min_dy = max(weights[0].get_min_index(), min_y-y);
+          const int max_dy = min(weights[0].get_max_index(), max_y-y);
+          const int min_x = image[z][y].get_min_index();
+          const int max_x = image[z][y].get_max_index();
+          for (int x=min_x;x<= max_x;x++)
+            {
+              const int min_dx = max(weights[0][0].get_min_index(), min_x-x);
+              const int max_dx = min(weights[0][0].get_max_index(), max_x-x);
+              for (int dz=min_dz;dz<=max_dz;++dz)
+                for (int dy=min_dy;dy<=max_dy;++dy)
+                  for (int dx=min_dx;dx<=max_dx;++dx)
+                    {
+                      float current =
+                        weights[dz][dy][dx] *
+                        square(image[z][y][x] - image[z+dz][y+dy][x+dx])/4;
+                      if (do_kappa)
+                        current *= (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
+                      result += static_cast<double>(current);
+                    }
+            }
+        }
+    }
+  return result * prior.get_penalisation_factor();
+}
+
+//! straightforward implementation of QuadraticPrior::compute_gradient()
+static void
+reference_quadratic_gradient(image_type& gradient, const QuadraticPrior<float>& prior, const image_type& image)
+{
+  const Array<3,float> weights = prior.get_weights();
+  const shared_ptr<image_type> kappa_ptr = prior.get_kappa_sptr();
+  const bool do_kappa = !is_null_ptr(kappa_ptr);
+  const int min_z = image.get_min_index();
+  const int max_z = image.get_max_index();
+  for (int z=min_z; z<=max_z; z++)
+    {
+      const int min_dz = max(weights.get_min_index(), min_z-z);
+      const int max_dz = min(weights.get_max_index(), max_z-z);
+      const int min_y = image[z].get_min_index();
+      const int max_y = image[z].get_max_index();
+      for (int y=min_y;y<= max_y;y++)
+        {
+          const int min_dy = max(weights[0].get_min_index(), min_y-y);
+          const int max_dy = min(weights[0].get_max_index(), max_y-y);
+          const int min_x = image[z][y].get_min_index();
+          const int max_x = image[z][y].get_max_index();
+          for (int x=min_x;x<= max_x;x++)
+            {
+              const int min_dx = max(weights[0][0].get_min_index(), min_x-x);
+              const int max_dx = min(weights[0][0].get_max_index(), max_x-x);
+              float sum = 0;
+              for (int dz=min_dz;dz<=max_dz;++dz)
+                for (int dy=min_dy;dy<=max_dy;++dy)
+                  for (int dx=min_dx;dx<=max_dx;++dx)
+                    {
+                      float current =
+                        weights[dz][dy][dx] * (image[z][y][x] - image[z+dz][y+dy][x+dx]);
+                      if (do_kappa)
+                        current *= (*kappa_ptr)[z][y][x] * (*kappa_ptr)[z+dz][y+dy][x+dx];
+                      sum += current;
+                    }
+              gradient[z][y][x] = sum * prior.get_penalisation_factor();
+            }
+        }
+    }
+}
+
+//! forward difference in direction 0 (z), 1 (y) or 2 (x), set to 0 at the last voxel
+static void
+reference_forward_difference(image_type& result, const image_type& image, const int direction)
+{
+  result.fill(0);
+  for (int z=image.get_min_index(); z<=image.get_max_index(); ++z)
+    for (int y=image[z].get_min_index(); y<=image[z].get_max_index(); ++y)
+      for (int x=image[z][y].get_min_index(); x<=image[z][y].get_max_index(); ++x)
+        {
+          if (direction==0 && z<image.get_max_index())
+            result[z][y][x] = image[z+1][y][x] - image[z][y][x];
+          if (direction==1 && y<image[z].get_max_index())
+            result[z][y][x] = image[z][y+1][x] - image[z][y][x];
+          if (direction==2 && x<image[z][y].get_max_index())
+            result[z][y][x] = image[z][y][x+1] - image[z][y][x];
+        }
+}
+
+//! computes the penalty and the normalised gradient for PLSPrior (3D only) using full images
+static void
+reference_PLS_terms(image_type& penalty,
+                    image_type * normalised_grad[3],
+                    const PLSPrior<float>& prior, const image_type& image)
+{
+  const float alpha = static_cast<float>(prior.get_alpha());
+  const image_type& norm = *prior.get_norm_sptr();
+  shared_ptr<image_type> pet_grad[3];
+  for (int d=0; d<3; ++d)
+    {
+      pet_grad[d].reset(image.get_empty_copy());
+      reference_forward_difference(*pet_grad[d], image, d);
+    }
+  shared_ptr<image_type> inner_product_sptr(image.get_empty_copy());
+  image_type& inner_product = *inner_product_sptr;
+  for (int z=image.get_min_index(); z<=image.get_max_index(); ++z)
+    for (int y=image[z].get_min_index(); y<=image[z].get_max_index(); ++y)
+      for (int x=image[z][y].get_min_index(); x<=image[z][y].get_max_index(); ++x)
+        {
+          float sum = 0;
+          for (int d=0; d<3; ++d)
+            sum += (*pet_grad[d])[z][y][x] * (*prior.get_anatomical_grad_sptr(d))[z][y][x];
+          inner_product[z][y][x] = sum/norm[z][y][x];
+          float sum_of_squares = square(alpha);
+          for (int d=0; d<3; ++d)
+            sum_of_squares += square((*pet_grad[d])[z][y][x]);
+          penalty[z][y][x] = std::sqrt(sum_of_squares - square(inner_product[z][y][x]));
+          for (int d=0; d<3; ++d)
+            (*normalised_grad[d])[z][y][x] =
+              ((*pet_grad[d])[z][y][x] -
+               (*prior.get_anatomical_grad_sptr(d))[z][y][x]*inner_product[z][y][x]/norm[z][y][x])/
+              penalty[z][y][x];
+        }
+}
+
+//! straightforward implementation of PLSPrior::compute_value() (3D, no kappa)
+static double
+reference_PLS_value(const PLSPrior<float>& prior, const image_type& image)
+{
+  shared_ptr<image_type> penalty_sptr(image.get_empty_copy());
+  shared_ptr<image_type> normalised_grad_sptr[3];
+  image_type * normalised_grad[3];
+  for (int d=0; d<3; ++d)
+    {
+      normalised_grad_sptr[d].reset(image.get_empty_copy());
+      normalised_grad[d] = normalised_grad_sptr[d].get();
+    }
+  reference_PLS_terms(*penalty_sptr, normalised_grad, prior, image);
+  double result = 0.;
+  for (image_type::const_full_iterator iter = penalty_sptr->begin_all_const();
+       iter != penalty_sptr->end_all_const();
+       ++iter)
+    result += *iter;
+  return result * prior.get_penalisation_factor();
+}
+
+//! straightforward implementation of PLSPrior::compute_gradient() (3D, no kappa)
+static void
+reference_PLS_gradient(image_type& gradient, const PLSPrior<float>& prior, const image_type& image)
+{
+  shared_ptr<image_type> penalty_sptr(image.get_empty_copy());
+  shared_ptr<image_type> normalised_grad_sptr[3];
+  image_type * normalised_grad[3];
+  for (int d=0; d<3; ++d)
+    {
+      normalised_grad_sptr[d].reset(image.get_empty_copy());
+      normalised_grad[d] = normalised_grad_sptr[d].get();
+    }
+  reference_PLS_terms(*penalty_sptr, normalised_grad, prior, image);
+  const int min_z = image.get_min_index();
+  const int max_z = image.get_max_index();
+  for (int z=min_z; z<=max_z; ++z)
+    for (int y=image[z].get_min_index(); y<=image[z].get_max_index(); ++y)
+      for (int x=image[z][y].get_min_index(); x<=image[z][y].get_max_index(); ++x)
+        {
+          const int min_y = image[z].get_min_index();
+          const int max_y = image[z].get_max_index();
+          const int min_x = image[z][y].get_min_index();
+          const int max_x = image[z][y].get_max_index();
+          float divergence = 0;
+          if (z>min_z && y<max_y && x<max_x)
+            divergence += (*normalised_grad[0])[z][y][x] - (*normalised_grad[0])[z-1][y][x];
+          if (y>min_y && z<max_z && x<max_x)
+            divergence += (*normalised_grad[1])[z][y][x] - (*normalised_grad[1])[z][y-1][x];
+          if (x>min_x && z<max_z && y<max_y)
+            divergence += (*normalised_grad[2])[z][y][x] - (*normalised_grad[2])[z][y][x-1];
+          gradient[z][y][x] = -divergence * prior.get_penalisation_factor();
+        }
+}
+
+//! maximum absolute difference between 2 images, relative to the maximum of the first
+static float
+relative_difference(const image_type& image1, const image_type& image2)
+{
+  float max_diff = 0;
+  image_type::const_full_iterator iter2 = image2.begin_all_const();
+  for (image_type::const_full_iterator iter1 = image1.begin_all_const();
+       iter1 != image1.end_all_const();
+       ++iter1, ++iter2)
+    max_diff = max(max_diff, std::fabs(*iter1 - *iter2));
+  const float max_value = max(image1.find_max(), -image1.find_min());
+  return max_value==0 ? max_diff : max_diff/max_value;
+}
+
+static void
+report(const char * const name, const double reference_time, const double time, const double difference)
+{
+  cout << boost::format("%|-24| %|12.3f| %|12.3f| %|10.1f| %|14.3g|\n")
+    % name % reference_time % time % (reference_time/time) % difference;
+}
+
+int
+main(int argc, char **argv)
+{
+  int num_planes = 109;
+  int num_voxels_in_plane = 256;
+  int num_repetitions = 3;
+  if (argc>1)
+    num_planes = atoi(argv[1]);
+  if (argc>2)
+    num_voxels_in_plane = atoi(argv[2]);
+  if (argc>3)
+    num_repetitions = atoi(argv[3]);
+  if (argc>4 || num_planes<1 || num_voxels_in_plane<1 || num_repetitions<1)
+    {
+      cerr << "Usage: " << argv[0] << " [num_planes [num_voxels_in_plane [num_repetitions]]]\n";
+      return EXIT_FAILURE;
+    }
+
+  const int half_size = num_voxels_in_plane/2;
+  const IndexRange3D range(0, num_planes-1,
+                           -half_size, num_voxels_in_plane-half_size-1,
+                           -half_size, num_voxels_in_plane-half_size-1);
+  shared_ptr<VoxelsOnCartesianGrid<float> >
+    image_sptr(new VoxelsOnCartesianGrid<float>(range,
+                                                CartesianCoordinate3D<float>(0,0,0),
+                                                CartesianCoordinate3D<float>(2.425F,2.F,2.F)));
+  shared_ptr<VoxelsOnCartesianGrid<float> > anatomical_sptr(image_sptr->get_empty_voxels_on_cartesian_grid());
+  {
+    // a blob in a noisy background, and an anatomical image with a sharper edge
+    srand(1);
+    for (int z=range.get_min_index(); z<=range.get_max_index(); ++z)
+      for (int y=-half_size; y<num_voxels_in_plane-half_size; ++y)
+        for (int x=-half_size; x<num_voxels_in_plane-half_size; ++x)
+          {
+            const float r2 = static_cast<float>(square(x) + square(y))/square(half_size);
+            (*image_sptr)[z][y][x] =
+              static_cast<float>(std::exp(-2*r2)) + 0.1F*static_cast<float>(rand())/RAND_MAX;
+            (*anatomical_sptr)[z][y][x] = r2 < .5F ? 2.F : 1.F;
+          }
+  }
+  shared_ptr<image_type> gradient_sptr(image_sptr->get_empty_copy());
+  shared_ptr<image_type> reference_gradient_sptr(image_sptr->get_empty_copy());
+
+  cout << boost::format("Image of %1% planes of %2%x%2% voxels, %3% repetitions\n")
+    % num_planes % num_voxels_in_plane % num_repetitions;
+  cout << boost::format("%|-24| %|12| %|12| %|10| %|14|\n")
+    % "kernel" % "old (s)" % "new (s)" % "speed-up" % "rel. diff.";
+
+  HighResWallClockTimer reference_timer, timer;
+
+  {
+    QuadraticPrior<float> prior(false, 1.F);
+    if (prior.set_up(image_sptr) != Succeeded::yes)
+      error("Error setting up QuadraticPrior");
+    // compute the weights
+    prior.compute_value(*image_sptr);
+
+    double reference_value = 0., value = 0.;
+    reference_timer.reset(); timer.reset();
+    for (int i=0; i<num_repetitions; ++i)
+      {
+        reference_timer.start();
+        reference_value = reference_quadratic_value(prior, *image_sptr);
+        reference_timer.stop();
+        timer.start();
+        value = prior.compute_value(*image_sptr);
+        timer.stop();
+      }
+    report("Quadratic value", reference_timer.value(), timer.value(),
+           std::fabs(value-reference_value)/std::fabs(reference_value));
+
+    reference_timer.reset(); timer.reset();
+    for (int i=0; i<num_repetitions; ++i)
+      {
+        reference_timer.start();
+        reference_quadratic_gradient(*reference_gradient_sptr, prior, *image_sptr);
+        reference_timer.stop();
+        timer.start();
+        prior.compute_gradient(*gradient_sptr, *image_sptr);
+        timer.stop();
+      }
+    report("Quadratic gradient", reference_timer.value(), timer.value(),
+           relative_difference(*reference_gradient_sptr, *gradient_sptr));
+  }
+
+  {
+    PLSPrior<float> prior(false, 1.F);
+    prior.set_anatomical_image_sptr(anatomical_sptr);
+    prior.set_eta(.1);
+    prior.set_alpha(.01);
+    if (prior.set_up(image_sptr) != Succeeded::yes)
+      error("Error setting up PLSPrior");
+
+    double reference_value = 0., value = 0.;
+    reference_timer.reset(); timer.reset();
+    for (int i=0; i<num_repetitions; ++i)
+      {
+        reference_timer.start();
+        reference_value = reference_PLS_value(prior, *image_sptr);
+        reference_timer.stop();
+        timer.start();
+        value = prior.compute_value(*image_sptr);
+        timer.stop();
+      }
+    report("PLS value", reference_timer.value(), timer.value(),
+           std::fabs(value-reference_value)/std::fabs(reference_value));
+
+    reference_timer.reset(); timer.reset();
+    for (int i=0; i<num_repetitions; ++i)
+      {
+        reference_timer.start();
+        reference_PLS_gradient(*reference_gradient_sptr, prior, *image_sptr);
+        reference_timer.stop();
+        timer.start();
+        prior.compute_gradient(*gradient_sptr, *image_sptr);
+        timer.stop();
+      }
+    report("PLS gradient", reference_timer.value(), timer.value(),
+           relative_difference(*reference_gradient_sptr, *gradient_sptr));
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,463 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup scatter
+  \brief Implementation of class stir::ScatterEstimation
+*/
+
+#include "stir/scatter/ScatterEstimation.h"
+#include "stir/scatter/CreateTailMaskFromACFs.h"
+#include "stir/recon_buildblock/IterativeReconstruction.h"
+#include "stir/recon_buildblock/AnalyticReconstruction.h"
+#include "stir/recon_buildblock/GeneralisedObjectiveFunction.h"
+#include "stir/recon_buildblock/BinNormalisationFromProjData.h"
+#include "stir/recon_buildblock/ChainedBinNormalisation.h"
+#include "stir/recon_buildblock/TrivialBinNormalisation.h"
+#include "stir/ProjDataInMemory.h"
+#include "stir/ProjDataInterfile.h"
+#include "stir/ExamInfo.h"
+#include "stir/IO/OutputFileFormat.h"
+#include "stir/IO/read_from_file.h"
+#include "stir/thresholding.h"
+#include "stir/is_null_ptr.h"
+#include "stir/Succeeded.h"
+#include "stir/info.h"
+#include "stir/warning.h"
+#include "stir/error.h"
+#include <boost/format.hpp>
+
+START_NAMESPACE_STIR
+
+//! adds \a factor times \a in to \a out (which have to have the same sizes)
+static void
+add_proj_data(ProjData& out, const ProjData& in, const float factor)
+{
+  for (int segment_num=out.get_min_segment_num(); segment_num<=out.get_max_segment_num(); ++segment_num)
+    {
+      SegmentBySinogram<float> segment = out.get_segment_by_sinogram(segment_num);
+      SegmentBySinogram<float> segment_to_add = in.get_segment_by_sinogram(segment_num);
+      segment_to_add *= factor;
+      segment += segment_to_add;
+      if (out.set_segment(segment) == Succeeded::no)
+        error("ScatterEstimation: error setting segment");
+    }
+}
+
+static void
+write_proj_data(const std::string& filename, const ProjData& proj_data)
+{
+  ProjDataInterfile output(proj_data.get_exam_info_sptr(),
+                           proj_data.get_proj_data_info_ptr()->create_shared_clone(),
+                           filename);
+  output.fill(proj_data);
+}
+
+void
+ScatterEstimation::
+set_defaults()
+{
+  this->input_filename = "";
+  this->background_filename = "";
+  this->attenuation_correction_factors_filename = "";
+  this->scatter_simulation_parameter_filename = "";
+  this->initial_activity_image_filename = "";
+  this->mask_filename = "";
+  this->output_scatter_estimate_filename_prefix = "";
+  this->output_activity_image_filename_prefix = "";
+  this->write_all_scatter_estimates = false;
+  this->num_scatter_iterations = 5;
+  this->tail_mask_ACF_threshold = 1.1F;
+  this->tail_mask_safety_margin = 4;
+  this->min_scale_factor = 1.E-5F;
+  this->max_scale_factor = 1.E5F;
+  this->half_filter_width = 1;
+  this->remove_interleaving = true;
+
+  this->input_proj_data_sptr.reset();
+  this->background_proj_data_sptr.reset();
+  this->attenuation_correction_factors_sptr.reset();
+  this->normalisation_sptr.reset();
+  this->mask_proj_data_sptr.reset();
+  this->scatter_simulation_sptr.reset();
+  this->reconstruction_method_sptr.reset();
+  this->activity_image_sptr.reset();
+  this->reconstruction_is_set_up = false;
+}
+
+void
+ScatterEstimation::
+initialise_keymap()
+{
+  this->parser.add_start_key("Iterative Scatter Estimation Parameters");
+  this->parser.add_stop_key("End Iterative Scatter Estimation Parameters");
+  this->parser.add_key("input file", &this->input_filename);
+  this->parser.add_key("background projdata filename", &this->background_filename);
+  this->parser.add_key("attenuation correction factors filename", &this->attenuation_correction_factors_filename);
+  this->parser.add_parsing_key("Bin Normalisation type", &this->normalisation_sptr);
+  this->parser.add_key("scatter simulation parameter filename", &this->scatter_simulation_parameter_filename);
+  this->parser.add_parsing_key("reconstruction method type", &this->reconstruction_method_sptr);
+  this->parser.add_key("initial activity image filename", &this->initial_activity_image_filename);
+  this->parser.add_key("number of scatter iterations", &this->num_scatter_iterations);
+  this->parser.add_key("mask projdata filename", &this->mask_filename);
+  this->parser.add_key("tail mask ACF threshold", &this->tail_mask_ACF_threshold);
+  this->parser.add_key("tail mask safety margin", &this->tail_mask_safety_margin);
+  this->parser.add_key("minimum scale factor", &this->min_scale_factor);
+  this->parser.add_key("maximum scale factor", &this->max_scale_factor);
+  this->parser.add_key("half filter width", &this->half_filter_width);
+  this->parser.add_key("remove interleaving", &this->remove_interleaving);
+  this->parser.add_key("output scatter estimate filename prefix", &this->output_scatter_estimate_filename_prefix);
+  this->parser.add_key("write scatter estimates for all iterations", &this->write_all_scatter_estimates);
+  this->parser.add_key("output activity image filename prefix", &this->output_activity_image_filename_prefix);
+}
+
+bool
+ScatterEstimation::
+post_processing()
+{
+  if (this->input_filename.size() == 0)
+    { warning("ScatterEstimation: you need to specify an input file"); return true; }
+  this->input_proj_data_sptr = ProjData::read_from_file(this->input_filename);
+
+  if (this->background_filename.size() > 0)
+    this->background_proj_data_sptr = ProjData::read_from_file(this->background_filename);
+
+  if (this->attenuation_correction_factors_filename.size() == 0)
+    { warning("ScatterEstimation: you need to specify the attenuation correction factors"); return true; }
+  this->attenuation_correction_factors_sptr =
+    ProjData::read_from_file(this->attenuation_correction_factors_filename);
+
+  if (this->mask_filename.size() > 0)
+    this->mask_proj_data_sptr = ProjData::read_from_file(this->mask_filename);
+
+  if (this->scatter_simulation_parameter_filename.size() == 0)
+    { warning("ScatterEstimation: you need to specify the scatter simulation parameter file"); return true; }
+  this->scatter_simulation_sptr.reset(new ScatterEstimationByBin);
+  if (!this->scatter_simulation_sptr->parse(this->scatter_simulation_parameter_filename.c_str()))
+    { warning("ScatterEstimation: error parsing the scatter simulation parameter file"); return true; }
+
+  if (is_null_ptr(this->reconstruction_method_sptr))
+    { warning("ScatterEstimation: you need to specify the reconstruction method"); return true; }
+
+  if (this->initial_activity_image_filename.size() > 0)
+    this->activity_image_sptr =
+      read_from_file<DiscretisedDensity<3,float> >(this->initial_activity_image_filename);
+
+  if (this->num_scatter_iterations < 1)
+    { warning("ScatterEstimation: number of scatter iterations should be at least 1"); return true; }
+  if (this->half_filter_width < 0)
+    { warning("ScatterEstimation: half filter width should be non-negative"); return true; }
+
+  return false;
+}
+
+ScatterEstimation::
+ScatterEstimation()
+{
+  this->set_defaults();
+}
+
+/****************** functions to set data **********************/
+
+void
+ScatterEstimation::
+set_input_proj_data_sptr(const shared_ptr<ProjData>& arg)
+{
+  this->input_proj_data_sptr = arg;
+}
+
+void
+ScatterEstimation::
+set_background_proj_data_sptr(const shared_ptr<ProjData>& arg)
+{
+  this->background_proj_data_sptr = arg;
+}
+
+void
+ScatterEstimation::
+set_attenuation_correction_factors_sptr(const shared_ptr<ProjData>& arg)
+{
+  this->attenuation_correction_factors_sptr = arg;
+}
+
+void
+ScatterEstimation::
+set_normalisation_sptr(const shared_ptr<BinNormalisation>& arg)
+{
+  this->normalisation_sptr = arg;
+}
+
+void
+ScatterEstimation::
+set_mask_proj_data_sptr(const shared_ptr<ProjData>& arg)
+{
+  this->mask_proj_data_sptr = arg;
+}
+
+void
+ScatterEstimation::
+set_scatter_simulation_sptr(const shared_ptr<ScatterEstimationByBin>& arg)
+{
+  this->scatter_simulation_sptr = arg;
+}
+
+void
+ScatterEstimation::
+set_reconstruction_method_sptr(const shared_ptr<Reconstruction<DiscretisedDensity<3,float> > >& arg)
+{
+  this->reconstruction_method_sptr = arg;
+}
+
+void
+ScatterEstimation::
+set_initial_activity_image_sptr(const shared_ptr<DiscretisedDensity<3,float> >& arg)
+{
+  this->activity_image_sptr = arg;
+}
+
+void
+ScatterEstimation::
+set_num_scatter_iterations(const int arg)
+{
+  this->num_scatter_iterations = arg;
+}
+
+shared_ptr<ProjData>
+ScatterEstimation::
+get_scatter_estimate_sptr() const
+{
+  return this->scatter_estimate_sptr;
+}
+
+shared_ptr<DiscretisedDensity<3,float> >
+ScatterEstimation::
+get_activity_image_sptr() const
+{
+  return this->activity_image_sptr;
+}
+
+/****************** functions that do the work **********************/
+
+Succeeded
+ScatterEstimation::
+set_up()
+{
+  if (is_null_ptr(this->input_proj_data_sptr))
+    { warning("ScatterEstimation: input data not set"); return Succeeded::no; }
+  if (is_null_ptr(this->attenuation_correction_factors_sptr))
+    { warning("ScatterEstimation: attenuation correction factors not set"); return Succeeded::no; }
+  if (is_null_ptr(this->scatter_simulation_sptr))
+    { warning("ScatterEstimation: scatter simulation not set"); return Succeeded::no; }
+  if (is_null_ptr(this->reconstruction_method_sptr))
+    { warning("ScatterEstimation: reconstruction method not set"); return Succeeded::no; }
+
+  shared_ptr<ExamInfo> exam_info_sptr(this->input_proj_data_sptr->get_exam_info_sptr()->create_shared_clone());
+  shared_ptr<ProjDataInfo> proj_data_info_sptr =
+    this->input_proj_data_sptr->get_proj_data_info_ptr()->create_shared_clone();
+
+  if (is_null_ptr(this->normalisation_sptr))
+    this->normalisation_sptr.reset(new TrivialBinNormalisation);
+  if (this->normalisation_sptr->set_up(proj_data_info_sptr) == Succeeded::no)
+    { warning("ScatterEstimation: error setting-up normalisation"); return Succeeded::no; }
+
+  // attenuation and normalisation, used for the reconstructions
+  shared_ptr<BinNormalisation>
+    attenuation_sptr(new BinNormalisationFromProjData(this->attenuation_correction_factors_sptr));
+  this->multiplicative_normalisation_sptr.reset(new ChainedBinNormalisation(attenuation_sptr, this->normalisation_sptr));
+  if (this->multiplicative_normalisation_sptr->set_up(proj_data_info_sptr) == Succeeded::no)
+    { warning("ScatterEstimation: error setting-up attenuation correction factors"); return Succeeded::no; }
+
+  // the scatter estimate is fitted to the emission data minus the background
+  if (is_null_ptr(this->background_proj_data_sptr))
+    this->data_to_fit_sptr = this->input_proj_data_sptr;
+  else
+    {
+      this->data_to_fit_sptr.reset(new ProjDataInMemory(*this->input_proj_data_sptr));
+      add_proj_data(*this->data_to_fit_sptr, *this->background_proj_data_sptr, -1.F);
+    }
+
+  if (is_null_ptr(this->mask_proj_data_sptr))
+    {
+      info("ScatterEstimation: computing tail mask from attenuation correction factors");
+      CreateTailMaskFromACFs create_tail_mask;
+      create_tail_mask.ACF_threshold = this->tail_mask_ACF_threshold;
+      create_tail_mask.safety_margin = this->tail_mask_safety_margin;
+      create_tail_mask.set_input_projdata_sptr(this->attenuation_correction_factors_sptr);
+      this->mask_proj_data_sptr.reset(new ProjDataInMemory(exam_info_sptr, proj_data_info_sptr));
+      create_tail_mask.set_output_projdata_sptr(this->mask_proj_data_sptr);
+      if (create_tail_mask.process_data() == Succeeded::no)
+        { warning("ScatterEstimation: error computing tail mask"); return Succeeded::no; }
+    }
+
+  // keep the low resolution scatter estimate in memory
+  this->low_resolution_scatter_sptr.reset(new ProjDataInMemory(exam_info_sptr,
+                                                               this->scatter_simulation_sptr->get_template_proj_data_info_sptr()));
+  this->scatter_simulation_sptr->set_output_proj_data_sptr(this->low_resolution_scatter_sptr);
+
+  this->scatter_estimate_sptr.reset(new ProjDataInMemory(exam_info_sptr, proj_data_info_sptr));
+
+  this->reconstruction_is_set_up = false;
+  return Succeeded::yes;
+}
+
+Succeeded
+ScatterEstimation::
+reconstruct_activity_image()
+{
+  const TimeFrameDefinitions& time_frame_defs =
+    this->input_proj_data_sptr->get_exam_info_sptr()->get_time_frame_definitions();
+
+  IterativeReconstruction<DiscretisedDensity<3,float> > * const iterative_reconstruction_ptr =
+    dynamic_cast<IterativeReconstruction<DiscretisedDensity<3,float> > *>(this->reconstruction_method_sptr.get());
+  AnalyticReconstruction * const analytic_reconstruction_ptr =
+    dynamic_cast<AnalyticReconstruction *>(this->reconstruction_method_sptr.get());
+
+  shared_ptr<DiscretisedDensity<3,float> > target_sptr;
+  if (!is_null_ptr(iterative_reconstruction_ptr))
+    {
+      // additive term is scatter+background, with the same multiplicative factors as the data
+      shared_ptr<ProjData> additive_proj_data_sptr(new ProjDataInMemory(*this->scatter_estimate_sptr));
+      if (!is_null_ptr(this->background_proj_data_sptr))
+        add_proj_data(*additive_proj_data_sptr, *this->background_proj_data_sptr, 1.F);
+      this->multiplicative_normalisation_sptr->apply(*additive_proj_data_sptr,
+                                                     time_frame_defs.get_start_time(), time_frame_defs.get_end_time());
+
+      GeneralisedObjectiveFunction<DiscretisedDensity<3,float> >& objective_function =
+        *iterative_reconstruction_ptr->get_objective_function_sptr();
+      if (!this->reconstruction_is_set_up)
+        {
+          iterative_reconstruction_ptr->set_input_data(this->input_proj_data_sptr);
+          objective_function.set_normalisation_sptr(this->multiplicative_normalisation_sptr);
+        }
+      // only the additive term changes between scatter iterations, so there is no need
+      // to set-up the reconstruction (and recompute the sensitivity) again
+      objective_function.set_additive_proj_data_sptr(additive_proj_data_sptr);
+
+      // continue from the previous activity image
+      if (is_null_ptr(this->activity_image_sptr))
+        target_sptr.reset(iterative_reconstruction_ptr->get_initial_data_ptr());
+      else
+        target_sptr.reset(this->activity_image_sptr->clone());
+    }
+  else if (!is_null_ptr(analytic_reconstruction_ptr))
+    {
+      // reconstruct corrected data
+      shared_ptr<ProjData> corrected_proj_data_sptr(new ProjDataInMemory(*this->input_proj_data_sptr));
+      add_proj_data(*corrected_proj_data_sptr, *this->scatter_estimate_sptr, -1.F);
+      if (!is_null_ptr(this->background_proj_data_sptr))
+        add_proj_data(*corrected_proj_data_sptr, *this->background_proj_data_sptr, -1.F);
+      this->multiplicative_normalisation_sptr->apply(*corrected_proj_data_sptr,
+                                                     time_frame_defs.get_start_time(), time_frame_defs.get_end_time());
+
+      analytic_reconstruction_ptr->set_input_data(corrected_proj_data_sptr);
+      target_sptr.reset(analytic_reconstruction_ptr->construct_target_image_ptr());
+    }
+  else
+    {
+      warning("ScatterEstimation: reconstruction method should be either iterative or analytic");
+      return Succeeded::no;
+    }
+
+  if (!this->reconstruction_is_set_up)
+    {
+      if (this->reconstruction_method_sptr->set_up(target_sptr) == Succeeded::no)
+        {
+          warning("ScatterEstimation: set-up of reconstruction failed");
+          return Succeeded::no;
+        }
+      // analytic reconstructions have new input data every time, so need a new set_up
+      this->reconstruction_is_set_up = !is_null_ptr(iterative_reconstruction_ptr);
+    }
+  if (this->reconstruction_method_sptr->reconstruct(target_sptr) == Succeeded::no)
+    {
+      warning("ScatterEstimation: reconstruction failed");
+      return Succeeded::no;
+    }
+  this->activity_image_sptr = target_sptr;
+  return Succeeded::yes;
+}
+
+Succeeded
+ScatterEstimation::
+estimate_scatter()
+{
+  // negative values do not make sense for the scatter simulation
+  shared_ptr<DiscretisedDensity<3,float> > activity_image_sptr(this->activity_image_sptr->clone());
+  threshold_lower(activity_image_sptr->begin_all(), activity_image_sptr->end_all(), 0.F);
+
+  // this only invalidates the cached activity integrals. Cached attenuation integrals
+  // and the scatter points are reused.
+  this->scatter_simulation_sptr->set_activity_image_sptr(activity_image_sptr);
+  if (this->scatter_simulation_sptr->process_data() == Succeeded::no)
+    return Succeeded::no;
+
+  ScatterEstimationByBin::
+    upsample_and_fit_scatter_estimate(*this->scatter_estimate_sptr,
+                                      *this->data_to_fit_sptr,
+                                      *this->low_resolution_scatter_sptr,
+                                      *this->normalisation_sptr,
+                                      *this->mask_proj_data_sptr,
+                                      this->min_scale_factor,
+                                      this->max_scale_factor,
+                                      static_cast<unsigned>(this->half_filter_width),
+                                      BSpline::linear,
+                                      this->remove_interleaving);
+  return Succeeded::yes;
+}
+
+Succeeded
+ScatterEstimation::
+process_data()
+{
+  if (this->set_up() == Succeeded::no)
+    return Succeeded::no;
+
+  if (is_null_ptr(this->activity_image_sptr))
+    {
+      info("ScatterEstimation: reconstructing initial activity image without scatter correction");
+      if (this->reconstruct_activity_image() == Succeeded::no)
+        return Succeeded::no;
+    }
+
+  for (int iteration_num=1; iteration_num<=this->num_scatter_iterations; ++iteration_num)
+    {
+      info(boost::format("ScatterEstimation: scatter iteration %1% of %2%")
+           % iteration_num % this->num_scatter_iterations);
+      if (this->estimate_scatter() == Succeeded::no)
+        return Succeeded::no;
+
+      if (this->write_all_scatter_estimates && this->output_scatter_estimate_filename_prefix.size() > 0)
+        write_proj_data(boost::str(boost::format("%1%_%2%") % this->output_scatter_estimate_filename_prefix % iteration_num),
+                        *this->scatter_estimate_sptr);
+
+      if (this->reconstruct_activity_image() == Succeeded::no)
+        return Succeeded::no;
+    }
+
+  if (this->output_scatter_estimate_filename_prefix.size() > 0)
+    write_proj_data(this->output_scatter_estimate_filename_prefix, *this->scatter_estimate_sptr);
+  if (this->output_activity_image_filename_prefix.size() > 0)
+    {
+      if (OutputFileFormat<DiscretisedDensity<3,float> >::default_sptr()->
+          write_to_file(this->output_activity_image_filename_prefix, *this->activity_image_sptr) == Succeeded::no)
+        return Succeeded::no;
+    }
+
+  return Succeeded::yes;
+}
+
+END_NAMESPACE_STIR
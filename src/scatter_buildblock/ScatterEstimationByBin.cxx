@@ -50,6 +50,7 @@ set_defaults()
   this->attenuation_threshold =  0.01 ;
   this->random = true;
   this->use_cache = true;
+  this->attenuation_integrals_cache_filename = "";
   this->energy_resolution = .22 ;
   this->reference_energy = 511.F;
   this->lower_energy_threshold = 350 ;
@@ -74,6 +75,7 @@ initialise_keymap()
   this->parser.add_key("random", &this->random);
 
   this->parser.add_key("use_cache", &this->use_cache);
+  this->parser.add_key("attenuation_integrals_cache_filename", &this->attenuation_integrals_cache_filename);
   this->parser.add_key("energy_resolution", &this->energy_resolution);
   this->parser.add_key("lower_energy_threshold", &this->lower_energy_threshold);
   this->parser.add_key("upper_energy_threshold", &this->upper_energy_threshold);
@@ -89,7 +91,9 @@ bool
 ScatterEstimationByBin::
 post_processing()
 {
-  this->set_activity_image(this->activity_image_filename);
+  // the activity image can be set later (e.g. by ScatterEstimation)
+  if (this->activity_image_filename.size() > 0)
+    this->set_activity_image(this->activity_image_filename);
   this->set_density_image(this->density_image_filename);
   this->set_density_image_for_scatter_points(this->density_image_for_scatter_points_filename);
         
@@ -100,7 +104,9 @@ post_processing()
 
   this->set_template_proj_data_info(this->template_proj_data_filename);
   // create output (has to be AFTER set_template_proj_data_info)
-  this->set_output_proj_data(this->output_proj_data_filename);
+  // if no filename is given, set_output_proj_data_sptr() has to be called later
+  if (this->output_proj_data_filename.size() > 0)
+    this->set_output_proj_data(this->output_proj_data_filename);
 
   return false;
 }
@@ -203,8 +209,8 @@ set_template_proj_data_info_sptr(const shared_ptr<ProjDataInfo>& new_sptr)
   this->total_detectors = 
     this->proj_data_info_ptr->get_scanner_ptr()->get_num_rings()*
     this->proj_data_info_ptr->get_scanner_ptr()->get_num_detectors_per_ring ();
-  // reserve space to avoid reallocation, but the actual size will grow dynamically
-  this->detection_points_vector.reserve(total_detectors);
+  // the actual coordinates will be filled in by process_data
+  this->detection_points_vector.clear();
 
   // remove any cached values as they'd be incorrect if the sizes changes
   this->remove_cache_for_integrals_over_attenuation();
@@ -222,14 +228,26 @@ set_template_proj_data_info(const std::string& filename)
   this->set_template_proj_data_info_sptr(template_proj_data_sptr->get_proj_data_info_ptr()->create_shared_clone());
 }
 
-/*
+shared_ptr<ProjDataInfo>
+ScatterEstimationByBin::
+get_template_proj_data_info_sptr() const
+{
+  return this->proj_data_info_ptr->create_shared_clone();
+}
+
 void
 ScatterEstimationByBin::
 set_output_proj_data_sptr(const shared_ptr<ProjData>& new_sptr)
 {
   this->output_proj_data_sptr = new_sptr;
 }
-*/
+
+shared_ptr<ProjData>
+ScatterEstimationByBin::
+get_output_proj_data_sptr() const
+{
+  return this->output_proj_data_sptr;
+}
 
 void
 ScatterEstimationByBin::
@@ -249,6 +267,11 @@ Succeeded
 ScatterEstimationByBin::
 process_data()
 {               
+  if (is_null_ptr(this->activity_image_sptr))
+    error("ScatterEstimationByBin: activity image not set");
+  if (is_null_ptr(this->output_proj_data_sptr))
+    error("ScatterEstimationByBin: output projection data not set");
+
   this->initialise_cache_for_scattpoint_det_integrals_over_attenuation();
   this->initialise_cache_for_scattpoint_det_integrals_over_activity();
  
@@ -302,6 +325,15 @@ process_data()
 #endif
   this->shift_detector_coordinates_to_origin =
     CartesianCoordinate3D<float>(this->proj_data_info_ptr->get_m(Bin(0,0,0,0)),0, 0);
+  // precompute all detector coordinates such that find_detectors() is a simple lookup
+  this->set_up_detection_points_vector();
+  // compute all integrals between scatter points and detectors up-front
+  this->precompute_cache_for_scattpoint_det_integrals();
+  // don't let the precomputation influence the estimate of the remaining time
+  wall_clock_timer.stop();
+  info(boost::format("Precomputing integrals took %1% sec") % wall_clock_timer.value());
+  previous_timer = wall_clock_timer.value();
+  wall_clock_timer.start();
 
   float total_scatter = 0 ;
 
@@ -343,13 +375,6 @@ process_data()
   wall_clock_timer.stop();
   this->write_log(wall_clock_timer.value(), total_scatter);
 
-  if (detection_points_vector.size() != static_cast<unsigned int>(total_detectors))
-    {
-      warning("Expected num detectors: %d, but found %d\n",
-              total_detectors, detection_points_vector.size());
-      return Succeeded::no;
-    }
-
   return Succeeded::yes;
 }
 
@@ -414,6 +439,9 @@ ScatterEstimationByBin::
 write_log(const double simulation_time, 
           const float total_scatter)
 {       
+  // no log if we are not writing to file
+  if (this->output_proj_data_filename.size() == 0)
+    return;
 
   std::string log_filename = 
     this->output_proj_data_filename + ".log";
@@ -29,6 +29,16 @@
 #include "stir/scatter/ScatterEstimationByBin.h"
 #include "stir/IndexRange.h" 
 #include "stir/Coordinate2D.h"
+#include "stir/VoxelsOnCartesianGrid.h"
+#include "stir/IO/read_data.h"
+#include "stir/IO/write_data.h"
+#include "stir/Succeeded.h"
+#include "stir/info.h"
+#include "stir/warning.h"
+#include <boost/crc.hpp>
+#include <boost/format.hpp>
+#include <fstream>
+#include <sstream>
 
 START_NAMESPACE_STIR
 
@@ -84,6 +94,180 @@ initialise_cache_for_scattpoint_det_integrals_over_activity()
   this->cached_activity_integral_scattpoint_det.fill(cache_init_value);
 }
 
+static const char * const attenuation_integrals_cache_magic = "STIR scatter attenuation integrals v1";
+
+boost::uint32_t
+ScatterEstimationByBin::
+get_checksum_for_attenuation_integrals() const
+{
+  boost::crc_32_type crc;
+  const VoxelsOnCartesianGrid<float>& image =
+    dynamic_cast<const VoxelsOnCartesianGrid<float>& >(*this->density_image_sptr);
+  const CartesianCoordinate3D<float> voxel_size = image.get_grid_spacing();
+  const CartesianCoordinate3D<float> origin = image.get_origin();
+  crc.process_bytes(&voxel_size[1], 3*sizeof(float));
+  crc.process_bytes(&origin[1], 3*sizeof(float));
+  for (int z=image.get_min_index(); z<=image.get_max_index(); ++z)
+    for (int y=image[z].get_min_index(); y<=image[z].get_max_index(); ++y)
+      {
+        const int min_x = image[z][y].get_min_index();
+        const int max_x = image[z][y].get_max_index();
+        crc.process_bytes(&z, sizeof(z));
+        crc.process_bytes(&y, sizeof(y));
+        crc.process_bytes(&min_x, sizeof(min_x));
+        crc.process_bytes(&max_x, sizeof(max_x));
+        for (int x=min_x; x<=max_x; ++x)
+          crc.process_bytes(&image[z][y][x], sizeof(float));
+      }
+  for (std::size_t i=0; i<this->scatt_points_vector.size(); ++i)
+    crc.process_bytes(&this->scatt_points_vector[i].coord[1], 3*sizeof(float));
+  for (std::size_t i=0; i<this->detection_points_vector.size(); ++i)
+    crc.process_bytes(&this->detection_points_vector[i][1], 3*sizeof(float));
+  return static_cast<boost::uint32_t>(crc.checksum());
+}
+
+Succeeded
+ScatterEstimationByBin::
+read_cache_for_scattpoint_det_integrals_over_attenuation(const std::string& filename)
+{
+  std::ifstream s(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!s)
+    return Succeeded::no;
+
+  std::string magic;
+  std::getline(s, magic);
+  std::string sizes_line;
+  std::getline(s, sizes_line);
+  std::istringstream sizes(sizes_line);
+  std::size_t num_scatter_points = 0;
+  int num_detectors = 0;
+  boost::uint32_t checksum = 0;
+  sizes >> num_scatter_points >> num_detectors >> checksum;
+  if (!s || !sizes || magic != attenuation_integrals_cache_magic)
+    {
+      warning(boost::format("ScatterEstimationByBin: '%1%' is not a file with cached attenuation integrals. It will be overwritten.")
+              % filename);
+      return Succeeded::no;
+    }
+  if (num_scatter_points != this->scatt_points_vector.size() ||
+      num_detectors != this->total_detectors ||
+      checksum != this->get_checksum_for_attenuation_integrals())
+    {
+      info(boost::format("ScatterEstimationByBin: cached attenuation integrals in '%1%' are for different "
+                         "attenuation image, scatter points or detectors. They will be recomputed.")
+           % filename);
+      return Succeeded::no;
+    }
+  if (read_data(s, this->cached_attenuation_integral_scattpoint_det, ByteOrder::little_endian) == Succeeded::no)
+    {
+      warning(boost::format("ScatterEstimationByBin: error reading cached attenuation integrals from '%1%'. They will be recomputed.")
+              % filename);
+      this->cached_attenuation_integral_scattpoint_det.fill(cache_init_value);
+      return Succeeded::no;
+    }
+  return Succeeded::yes;
+}
+
+Succeeded
+ScatterEstimationByBin::
+write_cache_for_scattpoint_det_integrals_over_attenuation(const std::string& filename) const
+{
+  std::ofstream s(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!s)
+    {
+      warning(boost::format("ScatterEstimationByBin: cannot open '%1%' for writing cached attenuation integrals")
+              % filename);
+      return Succeeded::no;
+    }
+  s << attenuation_integrals_cache_magic << '\n'
+    << this->scatt_points_vector.size() << ' '
+    << this->total_detectors << ' '
+    << this->get_checksum_for_attenuation_integrals() << '\n';
+  if (!s ||
+      write_data(s, this->cached_attenuation_integral_scattpoint_det, ByteOrder::little_endian) == Succeeded::no)
+    {
+      warning(boost::format("ScatterEstimationByBin: error writing cached attenuation integrals to '%1%'")
+              % filename);
+      return Succeeded::no;
+    }
+  return Succeeded::yes;
+}
+
+void
+ScatterEstimationByBin::
+precompute_cache_for_scattpoint_det_integrals()
+{
+  if (!this->use_cache)
+    return;
+
+  // cache_init_value is very negative, so the minimum is only equal to it
+  // if there are entries that have not been computed yet
+  bool attenuation_integrals_complete =
+    this->cached_attenuation_integral_scattpoint_det.find_min() != cache_init_value;
+  if (!attenuation_integrals_complete && !this->attenuation_integrals_cache_filename.empty())
+    {
+      if (this->read_cache_for_scattpoint_det_integrals_over_attenuation(this->attenuation_integrals_cache_filename)
+          == Succeeded::yes)
+        {
+          info(boost::format("ScatterEstimationByBin: read cached attenuation integrals from '%1%'")
+               % this->attenuation_integrals_cache_filename);
+          attenuation_integrals_complete = true;
+        }
+    }
+
+  const int num_scatter_points = static_cast<int>(this->scatt_points_vector.size());
+  info(boost::format("ScatterEstimationByBin: precomputing integrals for %1% scatter points and %2% detectors")
+       % num_scatter_points % this->total_detectors);
+
+  // Every scatter point corresponds to a different row in the caches, so we can
+  // compute these in parallel without any locking.
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int scatter_point_num=0; scatter_point_num<num_scatter_points; ++scatter_point_num)
+    {
+      const CartesianCoordinate3D<float>& scatter_point =
+        this->scatt_points_vector[scatter_point_num].coord;
+      std::vector<int> det_nums;
+      std::vector<CartesianCoordinate3D<float> > detector_coords;
+      std::vector<float> values;
+
+      for (int integral_type=0; integral_type<2; ++integral_type)
+        {
+          Array<1,float>& cache_row =
+            integral_type==0 
+            ? this->cached_attenuation_integral_scattpoint_det[scatter_point_num]
+            : this->cached_activity_integral_scattpoint_det[scatter_point_num];
+          // find entries that still need to be computed
+          det_nums.resize(0);
+          detector_coords.resize(0);
+          for (int det_num=0; det_num<this->total_detectors; ++det_num)
+            if (cache_row[det_num] == cache_init_value)
+              {
+                det_nums.push_back(det_num);
+                detector_coords.push_back(this->detection_points_vector[det_num]);
+              }
+          if (det_nums.empty())
+            continue;
+
+          if (integral_type==0)
+            this->exp_integrals_over_attenuation_image_between_scattpoint_and_dets(values, scatter_point, detector_coords);
+          else
+            this->integrals_over_activity_image_between_scattpoint_and_dets(values, scatter_point, detector_coords);
+          for (std::size_t i=0; i<det_nums.size(); ++i)
+            cache_row[det_nums[i]] = values[i];
+        }
+    }
+
+  if (!attenuation_integrals_complete && !this->attenuation_integrals_cache_filename.empty())
+    {
+      if (this->write_cache_for_scattpoint_det_integrals_over_attenuation(this->attenuation_integrals_cache_filename)
+          == Succeeded::yes)
+        info(boost::format("ScatterEstimationByBin: wrote cached attenuation integrals to '%1%'")
+             % this->attenuation_integrals_cache_filename);
+    }
+}
+
 float 
 ScatterEstimationByBin::
 cached_integral_over_activity_image_between_scattpoint_det(const unsigned scatter_point_num, 
@@ -35,47 +35,43 @@
 #include <iostream>
 
 START_NAMESPACE_STIR
-unsigned 
+void
 ScatterEstimationByBin::
-find_in_detection_points_vector(const CartesianCoordinate3D<float>& coord) const
+set_up_detection_points_vector()
 {
-  unsigned int ret_value = 0;
-#pragma omp critical(SCATTERESTIMATIONFINDDETECTIONPOINTS)
-  {
-  std::vector<CartesianCoordinate3D<float> >::const_iterator iter=
-    std::find(detection_points_vector.begin(),
-              detection_points_vector.end(),
-              coord);
-  if (iter != detection_points_vector.end())
-    {
-      ret_value = iter-detection_points_vector.begin();
-    }
-  else
-    {
-      if (detection_points_vector.size()==static_cast<std::size_t>(this->total_detectors))
-        error("More detection points than we think there are!\n");
-
-      detection_points_vector.push_back(coord);
-      ret_value = detection_points_vector.size()-1;
-    }
-  }
-  return ret_value;
+  const int num_rings =
+    this->proj_data_info_ptr->get_scanner_ptr()->get_num_rings();
+  const int num_detectors_per_ring =
+    this->proj_data_info_ptr->get_scanner_ptr()->get_num_detectors_per_ring();
+
+  this->detection_points_vector.resize(this->total_detectors);
+  for (int ring_num=0; ring_num<num_rings; ++ring_num)
+    for (int det_num=0; det_num<num_detectors_per_ring; ++det_num)
+      {
+        // the 2nd detector is irrelevant, we just use the opposite one
+        CartesianCoordinate3D<float> detector_coord, other_detector_coord;
+        this->proj_data_info_ptr->
+          find_cartesian_coordinates_given_scanner_coordinates(detector_coord, other_detector_coord,
+                                                               ring_num, ring_num,
+                                                               det_num, (det_num+num_detectors_per_ring/2)%num_detectors_per_ring);
+        this->detection_points_vector[ring_num*num_detectors_per_ring + det_num] =
+          detector_coord + this->shift_detector_coordinates_to_origin;
+      }
 }
 
 void
 ScatterEstimationByBin::
 find_detectors(unsigned& det_num_A, unsigned& det_num_B, const Bin& bin) const
 {
-  CartesianCoordinate3D<float> detector_coord_A, detector_coord_B;
+  int det_num_a, ring_a, det_num_b, ring_b;
   this->proj_data_info_ptr->
-    find_cartesian_coordinates_of_detection(
-                                            detector_coord_A,detector_coord_B,bin);
-  det_num_A =
-    this->find_in_detection_points_vector(detector_coord_A + 
-                                          this->shift_detector_coordinates_to_origin);
-  det_num_B =
-    this->find_in_detection_points_vector(detector_coord_B + 
-                                          this->shift_detector_coordinates_to_origin);
+    get_det_pair_for_bin(det_num_a, ring_a, det_num_b, ring_b, bin);
+  const int num_detectors_per_ring =
+    this->proj_data_info_ptr->get_scanner_ptr()->get_num_detectors_per_ring();
+  det_num_A = static_cast<unsigned>(ring_a*num_detectors_per_ring + det_num_a);
+  det_num_B = static_cast<unsigned>(ring_b*num_detectors_per_ring + det_num_b);
+  assert(det_num_A < this->detection_points_vector.size());
+  assert(det_num_B < this->detection_points_vector.size());
 }
 
 float
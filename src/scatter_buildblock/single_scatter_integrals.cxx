@@ -33,23 +33,32 @@
 #include "stir/VoxelsOnCartesianGrid.h"
 #include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
 #include "stir/recon_buildblock/RayTraceVoxelsOnCartesianGrid.h"
+#include <algorithm>
 START_NAMESPACE_STIR
 
-float 
-ScatterEstimationByBin::
-exp_integral_over_attenuation_image_between_scattpoint_det (const CartesianCoordinate3D<float>& scatter_point, 
-                         const CartesianCoordinate3D<float>& detector_coord)
-{       
+//! factor to convert line integrals through the attenuation image to the exponent of the attenuation factor
+static float
+get_attenuation_rescale(const DiscretisedDensity<3,float>& density)
+{
 #ifndef NEWSCALE                
   /* projectors work in pixel units, so convert attenuation data 
      from cm^-1 to pixel_units^-1 */
-  const float   rescale = 
-    dynamic_cast<const DiscretisedDensityOnCartesianGrid<3,float> &>(*density_image_sptr).
+  return
+    dynamic_cast<const DiscretisedDensityOnCartesianGrid<3,float> &>(density).
     get_grid_spacing()[3]/10;
 #else
-  const float   rescale = 
+  return 
     0.1F;
 #endif
+}
+
+float 
+ScatterEstimationByBin::
+exp_integral_over_attenuation_image_between_scattpoint_det (const CartesianCoordinate3D<float>& scatter_point, 
+                         const CartesianCoordinate3D<float>& detector_coord)
+{       
+  const float   rescale = 
+    get_attenuation_rescale(*density_image_sptr);
 
   return
     exp(-rescale*
@@ -59,6 +68,40 @@ exp_integral_over_attenuation_image_between_scattpoint_det (const CartesianCoord
         );
 }
 
+void
+ScatterEstimationByBin::
+exp_integrals_over_attenuation_image_between_scattpoint_and_dets(std::vector<float>& values,
+                                                                 const CartesianCoordinate3D<float>& scatter_point, 
+                                                                 const std::vector<CartesianCoordinate3D<float> >& detector_coords)
+{
+  const float   rescale = 
+    get_attenuation_rescale(*density_image_sptr);
+
+  integrals_between_point_and_points(values, *density_image_sptr, scatter_point, detector_coords);
+  for (std::size_t i=0; i<values.size(); ++i)
+    values[i] = exp(-rescale*values[i]);
+}
+
+
+void
+ScatterEstimationByBin::
+integrals_over_activity_image_between_scattpoint_and_dets(std::vector<float>& values,
+                                                          const CartesianCoordinate3D<float>& scatter_point, 
+                                                          const std::vector<CartesianCoordinate3D<float> >& detector_coords)
+{
+  integrals_between_point_and_points(values, *activity_image_sptr, scatter_point, detector_coords);
+  for (std::size_t i=0; i<values.size(); ++i)
+    {
+      const CartesianCoordinate3D<float> dist_vector = scatter_point - detector_coords[i] ;
+
+      const float dist_sp1_det_squared = norm_squared(dist_vector);
+
+      const float solid_angle_factor = 
+        std::min(static_cast<float>(_PI/2), 1.F  / dist_sp1_det_squared) ;
+
+      values[i] *= solid_angle_factor;
+    }
+}
 
 float
 ScatterEstimationByBin::
@@ -81,6 +124,53 @@ integral_over_activity_image_between_scattpoint_det (const CartesianCoordinate3D
   }
 }
 
+//! add up image values along the LOR (which has to be sorted)
+static float
+sum_along_lor(const VoxelsOnCartesianGrid<float>& image,
+              const ProjMatrixElemsForOneBin& lor)
+{
+  float sum = 0;  // add up values along LOR
+  {     
+    ProjMatrixElemsForOneBin::const_iterator element_ptr =lor.begin() ;
+    bool we_have_been_within_the_image = false;
+    while (element_ptr != lor.end())
+      {
+        const BasicCoordinate<3,int> coords = element_ptr->get_coords();                                
+        if (coords[1] >= image.get_min_index() && 
+            coords[1] <= image.get_max_index() &&
+            coords[2] >= image[coords[1]].get_min_index() && 
+            coords[2] <= image[coords[1]].get_max_index() &&
+            coords[3] >= image[coords[1]][coords[2]].get_min_index() && 
+            coords[3] <= image[coords[1]][coords[2]].get_max_index())
+          {
+            we_have_been_within_the_image = true;
+            sum += image[coords] * element_ptr->get_value();                            
+          }
+        else if (we_have_been_within_the_image)
+          {
+            // we jump out of the loop as we are now at the other side of 
+            // the image
+            //                                  break; 
+          }
+        ++element_ptr;          
+      }       
+  }             
+  return sum;   
+}
+
+//! origin used for ray tracing (i.e. with z=0 in the middle of the image)
+static CartesianCoordinate3D<float>
+get_origin_for_ray_tracing(const VoxelsOnCartesianGrid<float>& image)
+{
+  const CartesianCoordinate3D<float> voxel_size = image.get_grid_spacing();
+  CartesianCoordinate3D<float>  origin = 
+    image.get_origin();
+  const float z_to_middle =
+    (image.get_max_index() + image.get_min_index())*voxel_size.z()/2.F;
+  origin.z() -= z_to_middle;
+  return origin;
+}
+
 float 
 ScatterEstimationByBin::
 integral_between_2_points(const DiscretisedDensity<3,float>& density,
@@ -95,11 +185,8 @@ integral_between_2_points(const DiscretisedDensity<3,float>& density,
   
   const CartesianCoordinate3D<float> voxel_size = image.get_grid_spacing();
         
-  CartesianCoordinate3D<float>  origin = 
-    image.get_origin();
-  const float z_to_middle =
-    (image.get_max_index() + image.get_min_index())*voxel_size.z()/2.F;
-  origin.z() -= z_to_middle;
+  const CartesianCoordinate3D<float>  origin = 
+    get_origin_for_ray_tracing(image);
   /* TODO replace with image.get_index_coordinates_for_physical_coordinates */
   ProjMatrixElemsForOneBin lor;
   RayTraceVoxelsOnCartesianGrid(lor, 
@@ -113,33 +200,59 @@ integral_between_2_points(const DiscretisedDensity<3,float>& density,
 #endif
                                 );
   lor.sort();
-  float sum = 0;  // add up values along LOR
-  {     
-    ProjMatrixElemsForOneBin::iterator element_ptr =lor.begin() ;
-    bool we_have_been_within_the_image = false;
-    while (element_ptr != lor.end())
-      {
-        const BasicCoordinate<3,int> coords = element_ptr->get_coords();                                
-        if (coords[1] >= image.get_min_index() && 
-            coords[1] <= image.get_max_index() &&
-            coords[2] >= image[coords[1]].get_min_index() && 
-            coords[2] <= image[coords[1]].get_max_index() &&
-            coords[3] >= image[coords[1]][coords[2]].get_min_index() && 
-            coords[3] <= image[coords[1]][coords[2]].get_max_index())
-          {
-            we_have_been_within_the_image = true;
-            sum += image[coords] * element_ptr->get_value();                            
-          }
-        else if (we_have_been_within_the_image)
-          {
-            // we jump out of the loop as we are now at the other side of 
-            // the image
-            //                                  break; 
-          }
-        ++element_ptr;          
-      }       
-  }             
-  return sum;   
+  return sum_along_lor(image, lor);
 }                                                  
+
+void
+ScatterEstimationByBin::
+integrals_between_point_and_points(std::vector<float>& integrals,
+                                   const DiscretisedDensity<3,float>& density,
+                                   const CartesianCoordinate3D<float>& scatter_point, 
+                                   const std::vector<CartesianCoordinate3D<float> >& detector_coords)
+{
+  const VoxelsOnCartesianGrid<float>& image =
+    dynamic_cast<const VoxelsOnCartesianGrid<float>& >
+    (density);
+  
+  const CartesianCoordinate3D<float> voxel_size = image.get_grid_spacing();
+  const CartesianCoordinate3D<float>  origin = 
+    get_origin_for_ray_tracing(image);
+
+  integrals.resize(detector_coords.size());
+
+  // We trace a limited number of rays at the same time to avoid
+  // excessive memory usage for the LORs.
+  const std::size_t batch_size = 256;
+  std::vector<ProjMatrixElemsForOneBin> lors;
+  std::vector<CartesianCoordinate3D<float> > start_points;
+  std::vector<CartesianCoordinate3D<float> > end_points;
+  const CartesianCoordinate3D<float> start_point = (scatter_point-origin)/voxel_size;
+  for (std::size_t first=0; first<detector_coords.size(); first+=batch_size)
+    {
+      const std::size_t this_batch_size = std::min(batch_size, detector_coords.size()-first);
+      lors.resize(this_batch_size);
+      start_points.assign(this_batch_size, start_point);
+      end_points.resize(this_batch_size);
+      for (std::size_t i=0; i<this_batch_size; ++i)
+        {
+          lors[i].erase();
+          end_points[i] = (detector_coords[first+i]-origin)/voxel_size;
+        }
+      RayTraceVoxelsOnCartesianGrid(lors, start_points, end_points,
+                                    voxel_size, //should be in mm
+#ifdef NEWSCALE
+                                    1.F // normalise to mm
+#else
+                                    1/voxel_size.x() // normalise to some kind of 'pixel units'
+#endif
+                                    );
+      for (std::size_t i=0; i<this_batch_size; ++i)
+        {
+          lors[i].sort();
+          integrals[first+i] = sum_along_lor(image, lors[i]);
+        }
+    }
+}
+
 END_NAMESPACE_STIR
 
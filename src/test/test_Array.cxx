@@ -51,6 +51,7 @@
 #include "stir/ArrayFunction.h"
 #include "stir/array_index_functions.h"
 #include <functional>
+#include <vector>
 
 // for open_read/write_binary
 #include "stir/utilities.h"
@@ -623,6 +624,115 @@ ArrayTests::run_tests()
         Array<3,float>::const_full_iterator ctiter= titer; // this should compile
       }
     }
+    // contiguous storage
+    {
+      const IndexRange<3> range(Coordinate3D<int>(-1,1,4),Coordinate3D<int>(1,2,6));
+      Array<3,float> test(range);
+      check(test.is_contiguous(), "test is_contiguous() after construction");
+      {
+        float value = 1.F;
+        float * data_ptr = test.get_full_data_ptr();
+        for (size_t i=0; i<test.size_all(); ++i)
+          *data_ptr++ = value++;
+        test.release_full_data_ptr();
+        check_if_equal(test[-1][1][4], 1.F, "test get_full_data_ptr() first element");
+        check_if_equal(test[1][2][6], static_cast<float>(test.size_all()), "test get_full_data_ptr() last element");
+      }
+      {
+        Array<3,float> test_copy(test);
+        check(test_copy.is_contiguous(), "test is_contiguous() after copy");
+        check_if_equal(test_copy, test, "test copy of contiguous array");
+        test_copy[0] = test[1];
+        check(test_copy.is_contiguous(), "test is_contiguous() after assigning sub-array with same range");
+        check_if_equal(test_copy[0][2][5], test[1][2][5], "test assigning sub-array with same range");
+        test_copy[0][1].resize(-1,6);
+        check(!test_copy.is_contiguous(), "test is_contiguous() after resizing sub-array");
+        check_if_equal(test_copy[0][1][5], test[1][1][5], "test value after resizing sub-array");
+        check_if_zero(test_copy[0][1][-1], "test new value after resizing sub-array");
+        const Array<3,float> test_copy2(test_copy);
+        check(test_copy2.is_contiguous(), "test is_contiguous() after copy of irregular array");
+        check_if_equal(test_copy2, test_copy, "test copy of irregular array");
+      }
+      {
+        Array<3,float> test_resized(test);
+        test_resized.resize(IndexRange<3>(Coordinate3D<int>(0,0,4),Coordinate3D<int>(2,2,7)));
+        check(test_resized.is_contiguous(), "test is_contiguous() after resize");
+        check_if_equal(test_resized[1][2][6], test[1][2][6], "test value after resize");
+        check_if_zero(test_resized[2][0][7], "test new value after resize");
+      }
+      {
+        // use existing data
+        std::vector<float> data(range.size_all(), 1.F);
+        Array<3,float> test_view(range, &data[0], /*copy_data*/ false);
+        check(test_view.is_contiguous(), "test is_contiguous() for array using existing data");
+        check(!test_view[0][1].owns_memory_for_data(), "test array using existing data does not allocate");
+        test_view[1][2][6] = 3.F;
+        check_if_equal(data.back(), 3.F, "test modifying array using existing data");
+        Array<3,float> test_copied_data(range, &data[0], /*copy_data*/ true);
+        test_copied_data[1][2][6] = 4.F;
+        check_if_equal(data.back(), 3.F, "test modifying array using copied data");
+        check_if_equal(test_copied_data.sum(), data.size()+3.F, "test array using copied data");
+      }
+    }
+    // arithmetic operators (evaluated via ArrayExpression)
+    {
+      const IndexRange<3> range(Coordinate3D<int>(-1,1,4),Coordinate3D<int>(1,2,6));
+      Array<3,float> x(range), y(range), z(range);
+      {
+        float value = 1.F;
+        for (Array<3,float>::full_iterator iter=x.begin_all(); iter!=x.end_all(); ++iter)
+          *iter = value++;
+        y = x; y *= 2.F;
+        z = x; z += 1.F;
+      }
+      const float a = 1.5F, b = -2.F;
+      {
+        Array<3,float> result = a*x + b*y/z;
+        Array<3,float> ref(x); ref *= a;
+        Array<3,float> tmp(y); tmp /= z; tmp *= b;
+        ref += tmp;
+        check_if_equal(result, ref, "test a*x + b*y/z");
+        check(result.is_contiguous(), "test result of expression is contiguous");
+      }
+      {
+        Array<3,float> result(range);
+        result = x - 3.F*(y - z) + 2.F;
+        Array<3,float> ref(y); ref -= z; ref *= 3.F;
+        ref -= x; ref *= -1.F; ref += 2.F;
+        check_if_equal(result, ref, "test assignment of x - 3*(y - z) + 2");
+        result = 1.F - x;
+        ref = x; ref *= -1.F; ref += 1.F;
+        check_if_equal(result, ref, "test 1 - x");
+      }
+      {
+        // assign to one of the arguments
+        Array<3,float> result(x);
+        result = result*2.F + y;
+        Array<3,float> ref(x); ref *= 2.F; ref += y;
+        check_if_equal(result, ref, "test x = x*2 + y");
+        result = x;
+        result += a*y;
+        ref = y; ref *= a; ref += x;
+        check_if_equal(result, ref, "test x += a*y");
+      }
+      {
+        // arguments with different index ranges
+        Array<3,float> other(IndexRange<3>(Coordinate3D<int>(0,0,3),Coordinate3D<int>(2,1,5)));
+        other.fill(3.F);
+        other[1][0].resize(0,8);
+        other[1][0][8] = 4.F;
+        Array<3,float> ref(x); ref += other;
+        check_if_equal(Array<3,float>(x + other), ref, "test x + other with different index range");
+        ref = x; ref -= other;
+        check_if_equal(Array<3,float>(x - other), ref, "test x - other with different index range");
+        ref = other; ref *= x;
+        check_if_equal(Array<3,float>(other * x), ref, "test other * x with different index range");
+        Array<3,float> result(x);
+        result = result + other*2.F;
+        ref = other; ref *= 2.F; ref += x;
+        check_if_equal(result, ref, "test x = x + other*2 with different index range");
+      }
+    }
   }
 
 
@@ -761,6 +871,14 @@ ArrayTests::run_tests()
         for (int k=21; k<=30; k++)
           t1[i][j][k] = static_cast<float>(20000.*k*sin(i*j*k* _PI/ 3000.));
     run_IO_tests(t1);
+    // once more for an array that is not stored contiguously
+    Array<3,float> t1_row_by_row(t1);
+    {
+      Array<2,float> row(t1[2]);
+      t1_row_by_row[2].swap(row);
+    }
+    check(!t1_row_by_row.is_contiguous(), "test is_contiguous() after swapping sub-array");
+    run_IO_tests(t1_row_by_row);
   }
 #endif
 }
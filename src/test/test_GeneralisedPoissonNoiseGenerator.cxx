@@ -28,11 +28,16 @@
 #include "stir/RunTests.h"
 #include "stir/Array.h"
 #include "stir/GeneralisedPoissonNoiseGenerator.h"
+#include "stir/numerics/Philox4x32.h"
+#include "stir/IndexRange3D.h"
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics.hpp>
 #include <boost/format.hpp>
 #include <algorithm>
 #include <iostream>
+#ifdef STIR_OPENMP
+#include <omp.h>
+#endif
 
 START_NAMESPACE_STIR
 
@@ -40,13 +45,17 @@ START_NAMESPACE_STIR
 /*!
   \brief Tests GeneralisedPoissonNoiseGenerator functionality
   \ingroup test
-  Currently contains only simple tests to check mean and variance.
+  Contains simple tests to check mean and variance, and tests of the
+  counter-based generator.
 */
 class GeneralisedPoissonNoiseGeneratorTests : public RunTests
 {
 private:
   void
-  run_one_test(const int size, const float mu, const float scaling_factor, const bool preserve_mean);
+  run_one_test(const int size, const float mu, const float scaling_factor, const bool preserve_mean,
+               const bool counter_based);
+  void run_tests_Philox();
+  void run_tests_counter_based_reproducibility();
     
 public:
   void run_tests();
@@ -54,13 +63,15 @@ public:
 
 void
 GeneralisedPoissonNoiseGeneratorTests::
-run_one_test(const int size, const float mu, const float scaling_factor, const bool preserve_mean)
+run_one_test(const int size, const float mu, const float scaling_factor, const bool preserve_mean,
+             const bool counter_based)
 {
   Array<1,float> input(size);
   Array<1,float> output(size);
   input.fill(mu);
 
   GeneralisedPoissonNoiseGenerator generator(scaling_factor, preserve_mean);
+  generator.set_use_counter_based_generator(counter_based);
 
   generator.generate_random(output, input);
     
@@ -76,26 +87,113 @@ run_one_test(const int size, const float mu, const float scaling_factor, const b
   const float actual_mean = preserve_mean? mu : mu*scaling_factor;
   const float actual_variance = preserve_mean? mu/scaling_factor : actual_mean;
 
-  boost::format formatter("size %1%, mu %2%, scaling_factor %3%, preserve_mean %4%");
-  formatter % size % mu % scaling_factor % preserve_mean;
+  boost::format formatter("size %1%, mu %2%, scaling_factor %3%, preserve_mean %4%, counter_based %5%");
+  formatter % size % mu % scaling_factor % preserve_mean % counter_based;
     
   check_if_equal(mean(acc), actual_mean, "test mean with " + formatter.str());
   check_if_equal(variance(acc), actual_variance, "test variance with " + formatter.str());
 }
 
+void
+GeneralisedPoissonNoiseGeneratorTests::run_tests_Philox()
+{
+  // known answers from the Random123 library
+  const Philox4x32::value_type counters[3][4] =
+    { { 0u, 0u, 0u, 0u },
+      { 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu },
+      { 0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u } };
+  const Philox4x32::value_type keys[3][2] =
+    { { 0u, 0u },
+      { 0xffffffffu, 0xffffffffu },
+      { 0xa4093822u, 0x299f31d0u } };
+  const Philox4x32::value_type results[3][4] =
+    { { 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u },
+      { 0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu },
+      { 0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u } };
+  for (int test=0; test<3; ++test)
+    {
+      Philox4x32::counter_type counter;
+      Philox4x32::key_type key;
+      for (int i=0; i<4; ++i)
+        counter.v[i] = counters[test][i];
+      for (int i=0; i<2; ++i)
+        key.v[i] = keys[test][i];
+      const Philox4x32::counter_type result = Philox4x32::generate(counter, key);
+      for (int i=0; i<4; ++i)
+        check(result.v[i] == results[test][i],
+              boost::str(boost::format("test Philox4x32 known answer %1%, element %2%") % test % i));
+    }
+}
+
+void
+GeneralisedPoissonNoiseGeneratorTests::run_tests_counter_based_reproducibility()
+{
+  Array<3,float> input(IndexRange3D(0,4, -3,10, 0,30));
+  float mu = .1F;
+  for (Array<3,float>::full_iterator iter = input.begin_all(); iter != input.end_all(); ++iter)
+    {
+      *iter = mu;
+      // go over small and large values
+      mu = mu > 200 ? .1F : mu*1.1F;
+    }
+  Array<1,float> flat_input(static_cast<int>(input.size_all()));
+  std::copy(input.begin_all_const(), input.end_all_const(), flat_input.begin_all());
+
+  GeneralisedPoissonNoiseGenerator generator(2.F, true);
+  generator.set_use_counter_based_generator(true);
+  generator.seed(5u);
+  Array<3,float> output(input.get_index_range());
+  generator.generate_random(output, input);
+
+  // result only depends on the seed and the index of the element
+  generator.seed(5u);
+  Array<1,float> flat_output(flat_input.get_index_range());
+  generator.generate_random(flat_output, flat_input);
+  check(std::equal(output.begin_all_const(), output.end_all_const(), flat_output.begin_all_const()),
+        "test counter-based generator gives the same results for a reshaped array");
+
+  // a second call gives a different realisation
+  generator.generate_random(flat_output, flat_input);
+  check(!std::equal(output.begin_all_const(), output.end_all_const(), flat_output.begin_all_const()),
+        "test counter-based generator gives a different realisation when called again");
+
+  // single values use the same index
+  generator.seed(5u);
+  check_if_equal(generator.generate_random(*input.begin_all_const()), *output.begin_all_const(),
+                 "test counter-based generator for a single value");
+
+#ifdef STIR_OPENMP
+  // result is independent of the number of threads
+  const int num_threads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  generator.seed(5u);
+  Array<3,float> output_one_thread(input.get_index_range());
+  generator.generate_random(output_one_thread, input);
+  omp_set_num_threads(num_threads);
+  check(std::equal(output.begin_all_const(), output.end_all_const(), output_one_thread.begin_all_const()),
+        "test counter-based generator gives the same results with 1 thread");
+#endif
+}
+
 void
 GeneralisedPoissonNoiseGeneratorTests::run_tests()
 {
 
   std::cerr << "Testing GeneralisedPoissonNoiseGenerator\n";
 
-  run_one_test(1000, 100.0F, 1.0F, true);
-  run_one_test(1000, 100.0F, 3.0F, true);
-  run_one_test(1000, 100.0F, 3.0F, false);
+  for (int counter_based=0; counter_based<=1; ++counter_based)
+    {
+      run_one_test(1000, 100.0F, 1.0F, true, counter_based!=0);
+      run_one_test(1000, 100.0F, 3.0F, true, counter_based!=0);
+      run_one_test(1000, 100.0F, 3.0F, false, counter_based!=0);
+
+      run_one_test(1000, 4.2F, 1.0F, true, counter_based!=0);
+      run_one_test(1000, 4.2F, 3.0F, true, counter_based!=0);
+      run_one_test(1000, 4.2F, 3.0F, false, counter_based!=0);
+    }
 
-  run_one_test(1000, 4.2F, 1.0F, true);
-  run_one_test(1000, 4.2F, 3.0F, true);
-  run_one_test(1000, 4.2F, 3.0F, false);
+  run_tests_Philox();
+  run_tests_counter_based_reproducibility();
 }
 
 END_NAMESPACE_STIR
@@ -0,0 +1,148 @@
+//
+//
+/*!
+
+  \file
+  \ingroup test
+
+  \brief Test program for reading GATE ROOT files via stir::InputStreamFromROOTFile
+
+  \par Usage
+
+  <pre>
+  test_InputStreamFromROOTFile root_header.hroot
+  </pre>
+  The test is not run by ctest, as there is no GATE file in the STIR repository.
+  It can be run on the output of a GATE simulation, e.g. with
+  recon_test_pack/root_header.hroot after setting the environment variables
+  used by that header.
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+
+#include "stir/listmode/CListModeDataROOT.h"
+#include "stir/listmode/CListRecordROOT.h"
+#include "stir/IO/InputStreamFromROOTFile.h"
+#include "stir/DetectionPositionPair.h"
+#include "stir/RunTests.h"
+#include "stir/Succeeded.h"
+#include <iostream>
+#include <string>
+
+START_NAMESPACE_STIR
+
+
+/*!
+  \ingroup test
+  \brief Test class for InputStreamFromROOTFile
+
+  Reads all events from a GATE file, once with sequential decompression and once
+  with ROOT's implicit multi-threading, and checks that both give the same events.
+  Also checks that a reset gives the same events again.
+*/
+class InputStreamFromROOTFileTests : public RunTests
+{
+public:
+  InputStreamFromROOTFileTests(const std::string& filename)
+    : filename(filename)
+  {}
+  void run_tests();
+private:
+  //! read all events, returning the number of events and a checksum of their detectors
+  void read_all_events(CListModeDataROOT& lm_data,
+                       unsigned long& num_events, double& checksum);
+
+  std::string filename;
+};
+
+void
+InputStreamFromROOTFileTests::
+read_all_events(CListModeDataROOT& lm_data,
+                unsigned long& num_events, double& checksum)
+{
+  num_events = 0;
+  checksum = 0.;
+  shared_ptr<CListRecord> record_sptr = lm_data.get_empty_record_sptr();
+  CListRecordROOT& record = dynamic_cast<CListRecordROOT&>(*record_sptr);
+  DetectionPositionPair<> det_pos;
+  while (lm_data.get_next_record(record) == Succeeded::yes)
+    {
+      if (!record.is_event())
+        continue;
+      ++num_events;
+      record.event().get_detection_position(det_pos);
+      // weight the detectors differently, such that swapping them is noticed
+      checksum +=
+        (det_pos.pos1().tangential_coord() + 1000.*det_pos.pos1().axial_coord()) +
+        7.*(det_pos.pos2().tangential_coord() + 1000.*det_pos.pos2().axial_coord()) +
+        (record.event().is_prompt() ? 1. : -1.);
+    }
+}
+
+void
+InputStreamFromROOTFileTests::
+run_tests()
+{
+  std::cerr << "Tests for InputStreamFromROOTFile\n";
+
+  unsigned long num_events = 0;
+  double checksum = 0.;
+  {
+    CListModeDataROOT lm_data(filename);
+    read_all_events(lm_data, num_events, checksum);
+    check(num_events > 0, "there should be events in the file");
+
+    lm_data.reset();
+    unsigned long num_events_after_reset = 0;
+    double checksum_after_reset = 0.;
+    read_all_events(lm_data, num_events_after_reset, checksum_after_reset);
+    check_if_equal(num_events_after_reset, num_events, "number of events after reset");
+    check_if_equal(checksum_after_reset, checksum, "events after reset");
+  }
+
+  if (InputStreamFromROOTFile::enable_implicit_multi_threading(2) == Succeeded::no)
+    {
+      std::cerr << "ROOT was compiled without implicit multi-threading. Skipping those tests.\n";
+      return;
+    }
+  {
+    CListModeDataROOT lm_data(filename);
+    unsigned long num_events_MT = 0;
+    double checksum_MT = 0.;
+    read_all_events(lm_data, num_events_MT, checksum_MT);
+    check_if_equal(num_events_MT, num_events, "number of events with implicit multi-threading");
+    check_if_equal(checksum_MT, checksum, "events with implicit multi-threading");
+  }
+  InputStreamFromROOTFile::disable_implicit_multi_threading();
+}
+
+END_NAMESPACE_STIR
+
+
+USING_NAMESPACE_STIR
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+    {
+      std::cerr << "Usage : " << argv[0] << " root_header.hroot\n";
+      return EXIT_FAILURE;
+    }
+  InputStreamFromROOTFileTests tests(argv[1]);
+  tests.run_tests();
+  return tests.main_return_value();
+}
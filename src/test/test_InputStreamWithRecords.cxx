@@ -0,0 +1,204 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup test
+  \ingroup IO
+
+  \brief Test program for stir::InputStreamWithRecords
+*/
+
+#include "stir/IO/InputStreamWithRecords.h"
+#include "stir/RunTests.h"
+#include "stir/shared_ptr.h"
+#include <sstream>
+#include <vector>
+#include <iostream>
+
+START_NAMESPACE_STIR
+
+/*!
+  \ingroup test
+  \brief A record of variable size for testing InputStreamWithRecords
+
+  The first byte gives the size of the record, the other bytes are all equal to
+  the "value" of the record.
+*/
+class TestRecordWithVariableSize
+{
+public:
+  TestRecordWithVariableSize()
+    : size(0), value(0)
+  {}
+
+  std::size_t
+  size_of_record_at_ptr(const char * const buffer, const std::size_t, const int) const
+  {
+    return static_cast<std::size_t>(static_cast<unsigned char>(buffer[0]));
+  }
+
+  Succeeded
+  init_from_data_ptr(const char * const buffer, const std::size_t size_of_record, const int)
+  {
+    this->size = size_of_record;
+    this->value = static_cast<unsigned char>(buffer[1]);
+    for (std::size_t i=2; i<size_of_record; ++i)
+      if (static_cast<unsigned char>(buffer[i]) != this->value)
+        return Succeeded::no;
+    return Succeeded::yes;
+  }
+
+  std::size_t size;
+  int value;
+};
+
+/*!
+  \ingroup test
+  \brief Test class for InputStreamWithRecords
+
+  Records of different sizes are written to a string stream, and read back
+  one by one and in batches. Saving and setting positions is tested as well.
+  The number of records is such that the data do not fit in the internal buffer.
+*/
+class InputStreamWithRecordsTests : public RunTests
+{
+public:
+  void run_tests();
+
+private:
+  typedef InputStreamWithRecords<TestRecordWithVariableSize, int> StreamT;
+
+  static std::size_t size_of_record(const int record_num)
+  { return 2 + record_num % 37; }
+  static int value_of_record(const int record_num)
+  { return record_num % 251; }
+
+  //! check the next record, returns false if there was an error
+  bool check_next_record(const StreamT& stream, const int record_num, const std::string& str);
+};
+
+bool
+InputStreamWithRecordsTests::
+check_next_record(const StreamT& stream, const int record_num, const std::string& str)
+{
+  TestRecordWithVariableSize record;
+  return
+    check(stream.get_next_record(record) == Succeeded::yes, str + ": reading record") &&
+    check_if_equal(record.size, size_of_record(record_num), str + ": size of record") &&
+    check_if_equal(record.value, value_of_record(record_num), str + ": value of record");
+}
+
+void
+InputStreamWithRecordsTests::
+run_tests()
+{
+  std::cerr << "Tests for InputStreamWithRecords\n";
+
+  // write some data before the records to check the starting position
+  const std::string header = "header";
+  const int num_records = 100000;
+  shared_ptr<std::stringstream> stream_sptr(new std::stringstream);
+  {
+    std::string data = header;
+    for (int record_num=0; record_num<num_records; ++record_num)
+      {
+        data += static_cast<char>(size_of_record(record_num));
+        data.append(size_of_record(record_num)-1, static_cast<char>(value_of_record(record_num)));
+      }
+    stream_sptr->str(data);
+    stream_sptr->seekg(static_cast<std::streamoff>(header.size()));
+  }
+
+  StreamT stream(stream_sptr, 1, 40, 0);
+
+  std::cerr << "\tReading records one by one\n";
+  const int saved_record_num = num_records/2+3;
+  StreamT::SavedPosition saved_position = 0;
+  for (int record_num=0; record_num<num_records; ++record_num)
+    {
+      if (record_num == saved_record_num)
+        saved_position = stream.save_get_position();
+      if (!check_next_record(stream, record_num, "one by one"))
+        break;
+    }
+  {
+    TestRecordWithVariableSize record;
+    check(stream.get_next_record(record) == Succeeded::no, "reading past the end of the data");
+  }
+  const StreamT::SavedPosition end_position = stream.save_get_position();
+
+  std::cerr << "\tGoing back to a saved position\n";
+  check(stream.set_get_position(saved_position) == Succeeded::yes, "set_get_position");
+  check_next_record(stream, saved_record_num, "after set_get_position");
+  check_next_record(stream, saved_record_num+1, "after set_get_position");
+
+  std::cerr << "\tReading records in batches\n";
+  check(stream.reset() == Succeeded::yes, "reset");
+  {
+    std::vector<TestRecordWithVariableSize> records(1000);
+    int record_num = 0;
+    while (true)
+      {
+        const std::size_t num_read = stream.get_next_records(&records[0], records.size());
+        for (std::size_t i=0; i<num_read; ++i, ++record_num)
+          {
+            if (!check_if_equal(records[i].size, size_of_record(record_num), "batch: size of record") ||
+                !check_if_equal(records[i].value, value_of_record(record_num), "batch: value of record"))
+              break;
+          }
+        if (num_read < records.size())
+          break;
+      }
+    check_if_equal(record_num, num_records, "batch: number of records");
+  }
+
+  std::cerr << "\tGoing to the end\n";
+  check(stream.set_get_position(end_position) == Succeeded::yes, "set_get_position to end");
+  {
+    // saving the position straight away should again give the end of the data
+    const StreamT::SavedPosition new_end_position = stream.save_get_position();
+    check(stream.get_saved_get_positions()[new_end_position] == std::streampos(-1),
+          "save_get_position after set_get_position to end");
+  }
+  {
+    TestRecordWithVariableSize record;
+    check(stream.get_next_record(record) == Succeeded::no, "reading after going to the end");
+  }
+  {
+    // the saved positions are stream positions, so can be used with a new object
+    const std::vector<std::streampos> saved_positions = stream.get_saved_get_positions();
+    stream_sptr->clear();
+    stream_sptr->seekg(static_cast<std::streamoff>(header.size()));
+    StreamT other_stream(stream_sptr, 1, 40, 0);
+    other_stream.set_saved_get_positions(saved_positions);
+    check(other_stream.set_get_position(saved_position) == Succeeded::yes, "set_get_position on new object");
+    check_next_record(other_stream, saved_record_num, "new object after set_get_position");
+  }
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int main()
+{
+  InputStreamWithRecordsTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
@@ -0,0 +1,283 @@
+//
+//
+/*!
+
+  \file
+  \ingroup test
+  \ingroup listmode
+
+  \brief Test program for the single pass mode of stir::LmToProjData
+
+  \par Usage
+
+  <pre>
+  test_LmToProjData mMR_listmode.l.hdr
+  </pre>
+  The header is used as a template for a listmode file with pseudo-random events.
+  This file, the template projection data and the output of LmToProjData are
+  written in the current directory and removed at the end.
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+
+#include "stir/listmode/LmToProjData.h"
+#include "stir/listmode/CListModeData.h"
+#include "stir/listmode/ECAT8_32bit_test_data.h"
+#include "stir/ProjDataInterfile.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/SegmentBySinogram.h"
+#include "stir/ExamInfo.h"
+#include "stir/Scanner.h"
+#include "stir/IO/read_from_file.h"
+#include "stir/RunTests.h"
+#include <boost/format.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+
+START_NAMESPACE_STIR
+
+namespace detail
+{
+  //! LmToProjData which counts the events that are read
+  class LmToProjDataCountingEvents : public LmToProjData
+  {
+  public:
+    LmToProjDataCountingEvents()
+      : num_events_read(0)
+    {}
+    unsigned long get_num_events_read() const
+    { return num_events_read; }
+    //! name of the temporary file for a frame and segment
+    std::string get_spill_filename(const unsigned int frame_num, const int segment_num)
+    {
+      this->current_frame_num = frame_num;
+      return LmToProjData::get_spill_filename(segment_num);
+    }
+  protected:
+    virtual void get_bin_from_event(Bin& bin, const CListEvent& event) const
+    {
+      ++num_events_read;
+      LmToProjData::get_bin_from_event(bin, event);
+    }
+  private:
+    mutable unsigned long num_events_read;
+  };
+}
+
+/*!
+  \ingroup test
+  \brief Test class for the single pass mode of LmToProjData
+
+  A listmode file with pseudo-random events in the first 5 segments of the mMR is
+  binned (in 2 time frames) into 5 segments with all segments in memory, with 2
+  segments in memory in multiple passes, and with 2 segments in memory in a single
+  pass. All results have to be identical. The single pass has to read the events
+  only once, and has to remove its temporary files.
+*/
+class LmToProjDataTests : public RunTests
+{
+public:
+  LmToProjDataTests(const std::string& template_header_filename)
+    : template_header_filename(template_header_filename)
+  {}
+  void run_tests();
+private:
+  //! run LmToProjData (using \a extra_parameters in the parameter file)
+  bool process_data(detail::LmToProjDataCountingEvents& lm_to_projdata,
+                    const std::string& output_filename_prefix,
+                    const std::string& extra_parameters);
+  //! compare the output for 1 frame with the output with all segments in memory
+  void compare_output(const std::string& output_filename_prefix,
+                      const unsigned int frame_num, const std::string& str);
+  //! remove the output for 1 frame
+  static void remove_output(const std::string& output_filename_prefix, const unsigned int frame_num);
+
+  std::string template_header_filename;
+  std::string listmode_filename;
+  std::string template_proj_data_filename;
+  std::string frame_definition_filename;
+  std::string in_memory_output_filename_prefix;
+};
+
+static std::string
+get_output_filename(const std::string& output_filename_prefix, const unsigned int frame_num)
+{
+  return boost::str(boost::format("%1%_f%2%g1d0b0.hs") % output_filename_prefix % frame_num);
+}
+
+void
+LmToProjDataTests::
+remove_output(const std::string& output_filename_prefix, const unsigned int frame_num)
+{
+  const std::string filename = get_output_filename(output_filename_prefix, frame_num);
+  std::remove(filename.c_str());
+  std::remove((filename.substr(0, filename.size()-3) + ".s").c_str());
+}
+
+bool
+LmToProjDataTests::
+process_data(detail::LmToProjDataCountingEvents& lm_to_projdata,
+             const std::string& output_filename_prefix,
+             const std::string& extra_parameters)
+{
+  std::istringstream parameters(boost::str(boost::format(
+    "lm_to_projdata Parameters:=\n"
+    "input file := %1%\n"
+    "template_projdata := %2%\n"
+    "frame_definition file := %3%\n"
+    "output filename prefix := %4%\n"
+    "%5%"
+    "END:=\n")
+                                           % listmode_filename % template_proj_data_filename
+                                           % frame_definition_filename % output_filename_prefix
+                                           % extra_parameters));
+  if (!check(lm_to_projdata.parse(parameters), "parsing LmToProjData parameters"))
+    return false;
+  lm_to_projdata.process_data();
+  return true;
+}
+
+void
+LmToProjDataTests::
+compare_output(const std::string& output_filename_prefix,
+               const unsigned int frame_num, const std::string& str)
+{
+  const shared_ptr<ProjData> proj_data_sptr =
+    ProjData::read_from_file(get_output_filename(output_filename_prefix, frame_num));
+  const shared_ptr<ProjData> in_memory_proj_data_sptr =
+    ProjData::read_from_file(get_output_filename(in_memory_output_filename_prefix, frame_num));
+  for (int segment_num=in_memory_proj_data_sptr->get_min_segment_num();
+       segment_num<=in_memory_proj_data_sptr->get_max_segment_num();
+       ++segment_num)
+    {
+      const SegmentBySinogram<float> segment = in_memory_proj_data_sptr->get_segment_by_sinogram(segment_num);
+      check(segment.find_max() > 0.F, "segment should contain events");
+      check_if_equal(proj_data_sptr->get_segment_by_sinogram(segment_num), segment,
+                     boost::str(boost::format("%1% (frame %2%, segment %3%)") % str % frame_num % segment_num));
+    }
+}
+
+void
+LmToProjDataTests::
+run_tests()
+{
+  std::cerr << "Tests for the single pass mode of LmToProjData\n";
+
+  // 2000000 events in segments 0, -1, 1, -2 and 2 of the mMR, such that
+  // the buffers for the temporary files are written more than once
+  listmode_filename = "test_LmToProjData_listmode.hdr";
+  const unsigned long max_offset = 344UL*252*(64+63+63+62+62);
+  ecat::write_ECAT8_32bit_test_data(listmode_filename, template_header_filename,
+                                    max_offset, 2000000);
+
+  // template with 5 segments and view mashing to keep the test fast
+  template_proj_data_filename = "test_LmToProjData_template.hs";
+  {
+    shared_ptr<Scanner> scanner_sptr(
+      new Scanner(*read_from_file<CListModeData>(listmode_filename)->get_scanner_ptr()));
+    shared_ptr<ProjDataInfo> proj_data_info_sptr(
+      ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                    /*span=*/1,
+                                    /*max_delta=*/2,
+                                    /*num_views=*/scanner_sptr->get_num_detectors_per_ring()/4,
+                                    /*num_tang_poss=*/200,
+                                    /*arc_corrected=*/false));
+    ProjDataInterfile template_proj_data(shared_ptr<ExamInfo>(new ExamInfo), proj_data_info_sptr,
+                                         template_proj_data_filename, std::ios::out);
+  }
+
+  // 2 frames of .8 and 1.2 s (the events span 2 s)
+  frame_definition_filename = "test_LmToProjData.fdef";
+  {
+    std::ofstream frame_definitions(frame_definition_filename.c_str());
+    frame_definitions << "1 0.8\n1 1.2\n";
+  }
+  const unsigned int num_frames = 2;
+
+  in_memory_output_filename_prefix = "test_LmToProjData_in_memory";
+  const std::string multi_pass_output_filename_prefix = "test_LmToProjData_multi_pass";
+  const std::string single_pass_output_filename_prefix = "test_LmToProjData_single_pass";
+
+  // the bins contain integer numbers of events (prompts minus delayeds)
+  set_tolerance(0.);
+
+  std::cerr << "\tBinning with all segments in memory\n";
+  detail::LmToProjDataCountingEvents in_memory_lm_to_projdata;
+  if (!process_data(in_memory_lm_to_projdata, in_memory_output_filename_prefix, ""))
+    return;
+
+  std::cerr << "\tBinning in multiple passes\n";
+  {
+    detail::LmToProjDataCountingEvents lm_to_projdata;
+    if (!process_data(lm_to_projdata, multi_pass_output_filename_prefix,
+                      "num_segments_in_memory := 2\n"))
+      return;
+    check(lm_to_projdata.get_num_events_read() > in_memory_lm_to_projdata.get_num_events_read(),
+          "multiple passes should read the events more than once");
+    for (unsigned int frame_num=1; frame_num<=num_frames; ++frame_num)
+      compare_output(multi_pass_output_filename_prefix, frame_num, "multiple passes");
+  }
+
+  std::cerr << "\tBinning in a single pass\n";
+  {
+    detail::LmToProjDataCountingEvents lm_to_projdata;
+    if (!process_data(lm_to_projdata, single_pass_output_filename_prefix,
+                      "num_segments_in_memory := 2\nsingle pass := 1\n"))
+      return;
+    check_if_equal(lm_to_projdata.get_num_events_read(), in_memory_lm_to_projdata.get_num_events_read(),
+                   "single pass should read the events once");
+    for (unsigned int frame_num=1; frame_num<=num_frames; ++frame_num)
+      {
+        compare_output(single_pass_output_filename_prefix, frame_num, "single pass");
+        for (int segment_num=-2; segment_num<=2; ++segment_num)
+          check(!std::ifstream(lm_to_projdata.get_spill_filename(frame_num, segment_num).c_str()).good(),
+                boost::str(boost::format("temporary file for frame %1%, segment %2% should be removed")
+                           % frame_num % segment_num));
+      }
+  }
+
+  for (unsigned int frame_num=1; frame_num<=num_frames; ++frame_num)
+    {
+      remove_output(in_memory_output_filename_prefix, frame_num);
+      remove_output(multi_pass_output_filename_prefix, frame_num);
+      remove_output(single_pass_output_filename_prefix, frame_num);
+    }
+  std::remove(frame_definition_filename.c_str());
+  std::remove(template_proj_data_filename.c_str());
+  std::remove("test_LmToProjData_template.s");
+  std::remove(listmode_filename.c_str());
+  std::remove("test_LmToProjData_listmode.l");
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+    {
+      std::cerr << "Usage : " << argv[0] << " mMR_listmode.l.hdr\n";
+      return EXIT_FAILURE;
+    }
+  LmToProjDataTests tests(argv[1]);
+  tests.run_tests();
+  return tests.main_return_value();
+}
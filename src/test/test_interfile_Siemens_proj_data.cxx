@@ -0,0 +1,120 @@
+//
+//
+/*!
+
+  \file
+  \ingroup test
+
+  \brief Test program for reading Siemens Interfile projection data
+
+  \par Usage
+
+  <pre>
+  test_interfile_Siemens_proj_data Siemens-sinogram-header
+  </pre>
+  The header has to have <tt>%compression:=on</tt>, e.g.
+  examples/samples/mMR_sinogram.s.hdr.
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+
+#include "stir/IO/interfile.h"
+#include "stir/ProjDataFromStream.h"
+#include "stir/RunTests.h"
+#include "stir/utilities.h"
+#include "stir/is_null_ptr.h"
+#include "stir/shared_ptr.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+
+START_NAMESPACE_STIR
+
+
+/*!
+  \ingroup test
+  \brief Test class for reading Siemens Interfile projection data
+
+  Checks that compressed Siemens sinograms are refused, and that the same
+  header with the compression switched off is accepted (such that the
+  refusal is really due to the compression).
+*/
+class InterfileSiemensProjDataTests : public RunTests
+{
+public:
+  InterfileSiemensProjDataTests(const std::string& filename)
+    : filename(filename)
+  {}
+  void run_tests();
+private:
+  std::string filename;
+};
+
+void
+InterfileSiemensProjDataTests::
+run_tests()
+{
+  std::cerr << "Tests for reading Siemens Interfile projection data\n";
+
+  std::string header;
+  {
+    std::ifstream header_stream(filename.c_str());
+    if (!check(header_stream.good(), "opening " + filename))
+      return;
+    std::stringstream buffer;
+    buffer << header_stream.rdbuf();
+    header = buffer.str();
+  }
+  const std::string compression_on = "%compression:=on";
+  const std::string::size_type compression_pos = header.find(compression_on);
+  if (!check(compression_pos != std::string::npos, "header should have " + compression_on))
+    return;
+
+  const std::string directory_for_data = get_directory_name(filename);
+
+  {
+    std::istringstream input(header);
+    shared_ptr<ProjDataFromStream>
+      proj_data_sptr(read_interfile_PDFS(input, directory_for_data, std::ios::in));
+    check(is_null_ptr(proj_data_sptr), "compressed Siemens data should be refused");
+  }
+  {
+    std::string uncompressed_header(header);
+    uncompressed_header.replace(compression_pos, compression_on.size(), "%compression:=off");
+    std::istringstream input(uncompressed_header);
+    shared_ptr<ProjDataFromStream>
+      proj_data_sptr(read_interfile_PDFS(input, directory_for_data, std::ios::in));
+    check(!is_null_ptr(proj_data_sptr), "uncompressed Siemens data should be accepted");
+  }
+}
+
+END_NAMESPACE_STIR
+
+
+USING_NAMESPACE_STIR
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+    {
+      std::cerr << "Usage : " << argv[0] << " Siemens-sinogram-header\n";
+      return EXIT_FAILURE;
+    }
+  InterfileSiemensProjDataTests tests(argv[1]);
+  tests.run_tests();
+  return tests.main_return_value();
+}
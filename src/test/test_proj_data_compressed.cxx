@@ -0,0 +1,341 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup test
+  \ingroup projdata
+
+  \brief Test program for stir::ProjDataCompressed
+*/
+
+#include "stir/ProjDataCompressed.h"
+#include "stir/ProjDataInterfileCompressed.h"
+#include "stir/is_null_ptr.h"
+#include "stir/ExamInfo.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/Sinogram.h"
+#include "stir/Viewgram.h"
+#include "stir/SegmentByView.h"
+#include "stir/Succeeded.h"
+#include "stir/RunTests.h"
+#include "stir/Scanner.h"
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+START_NAMESPACE_STIR
+
+
+/*!
+  \ingroup test
+  \brief Test class for ProjDataCompressed
+
+  Synthetic data are written sinogram by sinogram and viewgram by viewgram to string
+  streams, and read back (as sinograms and viewgrams) via a new object. Writing
+  viewgrams should not make the data larger. Modifying data with set_viewgram(),
+  copying via segments, writing without byte shuffling and writing/reading via an
+  Interfile header are tested as well.
+*/
+class ProjDataCompressedTests: public RunTests
+{
+public:
+  void run_tests();
+private:
+  //! value used to fill the data. Different for every bin, but with some structure
+  static float get_test_value(const int segment_num, const int view_num,
+                              const int axial_pos_num, const int tangential_pos_num)
+  {
+    return segment_num*1000.F + view_num*100.F + axial_pos_num + tangential_pos_num/100.F;
+  }
+
+  void check_data(const ProjData& proj_data, const std::string& str);
+
+  shared_ptr<ProjDataInfo> proj_data_info_sptr;
+  shared_ptr<ExamInfo> exam_info_sptr;
+};
+
+void
+ProjDataCompressedTests::
+check_data(const ProjData& proj_data, const std::string& str)
+{
+  for (int segment_num = proj_data.get_min_segment_num();
+       segment_num <= proj_data.get_max_segment_num();
+       ++segment_num)
+    {
+      for (int axial_pos_num = proj_data.get_min_axial_pos_num(segment_num);
+           axial_pos_num <= proj_data.get_max_axial_pos_num(segment_num);
+           ++axial_pos_num)
+        {
+          const Sinogram<float> sinogram = proj_data.get_sinogram(axial_pos_num, segment_num);
+          for (int view_num = proj_data.get_min_view_num(); view_num <= proj_data.get_max_view_num(); ++view_num)
+            for (int tangential_pos_num = proj_data.get_min_tangential_pos_num();
+                 tangential_pos_num <= proj_data.get_max_tangential_pos_num();
+                 ++tangential_pos_num)
+              if (!check_if_equal(sinogram[view_num][tangential_pos_num],
+                                  get_test_value(segment_num, view_num, axial_pos_num, tangential_pos_num),
+                                  str + ": get_sinogram"))
+                return;
+        }
+      for (int view_num = proj_data.get_min_view_num(); view_num <= proj_data.get_max_view_num(); ++view_num)
+        {
+          const Viewgram<float> viewgram = proj_data.get_viewgram(view_num, segment_num);
+          for (int axial_pos_num = proj_data.get_min_axial_pos_num(segment_num);
+               axial_pos_num <= proj_data.get_max_axial_pos_num(segment_num);
+               ++axial_pos_num)
+            for (int tangential_pos_num = proj_data.get_min_tangential_pos_num();
+                 tangential_pos_num <= proj_data.get_max_tangential_pos_num();
+                 ++tangential_pos_num)
+              if (!check_if_equal(viewgram[axial_pos_num][tangential_pos_num],
+                                  get_test_value(segment_num, view_num, axial_pos_num, tangential_pos_num),
+                                  str + ": get_viewgram"))
+                return;
+        }
+    }
+}
+
+void
+ProjDataCompressedTests::
+run_tests()
+{
+  std::cerr << "-------- Testing ProjDataCompressed --------\n";
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  proj_data_info_sptr.reset(ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                                          /*span*/1, 2,/*views*/ 48, /*tang_pos*/64,
+                                                          /*arc_corrected*/ true));
+  exam_info_sptr.reset(new ExamInfo);
+
+  // use a segment sequence as for Siemens data, and an offset
+  std::vector<int> segment_sequence;
+  segment_sequence.push_back(0);
+  segment_sequence.push_back(-1);
+  segment_sequence.push_back(1);
+  segment_sequence.push_back(-2);
+  segment_sequence.push_back(2);
+  const std::streamoff offset = 5;
+
+  shared_ptr<std::stringstream> stream_sptr(new std::stringstream);
+  *stream_sptr << "12345";
+
+  std::cerr << "\tWriting sinograms\n";
+  boost::uint64_t compressed_size;
+  {
+    ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, stream_sptr, offset,
+                                 segment_sequence, std::ios::in | std::ios::out);
+    check(proj_data.is_writable(), "is_writable");
+    // write in a different order than the index
+    for (int segment_num = proj_data.get_max_segment_num();
+         segment_num >= proj_data.get_min_segment_num();
+         --segment_num)
+      for (int axial_pos_num = proj_data.get_min_axial_pos_num(segment_num);
+           axial_pos_num <= proj_data.get_max_axial_pos_num(segment_num);
+           ++axial_pos_num)
+        {
+          Sinogram<float> sinogram = proj_data.get_empty_sinogram(axial_pos_num, segment_num);
+          for (int view_num = sinogram.get_min_view_num(); view_num <= sinogram.get_max_view_num(); ++view_num)
+            for (int tangential_pos_num = sinogram.get_min_tangential_pos_num();
+                 tangential_pos_num <= sinogram.get_max_tangential_pos_num();
+                 ++tangential_pos_num)
+              sinogram[view_num][tangential_pos_num] =
+                get_test_value(segment_num, view_num, axial_pos_num, tangential_pos_num);
+          check(proj_data.set_sinogram(sinogram) == Succeeded::yes, "writing test data");
+        }
+    check_data(proj_data, "while writing");
+    compressed_size = proj_data.get_compressed_size();
+    boost::uint64_t uncompressed_size = 0;
+    for (int segment_num = proj_data.get_min_segment_num();
+         segment_num <= proj_data.get_max_segment_num();
+         ++segment_num)
+      uncompressed_size +=
+        static_cast<boost::uint64_t>(proj_data.get_num_axial_poss(segment_num)) *
+        proj_data.get_num_views() * proj_data.get_num_tangential_poss() * sizeof(float);
+    std::cerr << "\tcompressed size " << compressed_size << " bytes, uncompressed "
+              << uncompressed_size << " bytes\n";
+    check(compressed_size < uncompressed_size, "compressed data should be smaller than uncompressed data");
+  }
+  check(stream_sptr->str().substr(0,5) == "12345", "data before offset should be unchanged");
+
+  std::cerr << "\tWriting viewgrams\n";
+  {
+    shared_ptr<std::stringstream> viewgram_stream_sptr(new std::stringstream);
+    {
+      ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, viewgram_stream_sptr,
+                                   0, segment_sequence, std::ios::in | std::ios::out);
+      for (int segment_num = proj_data.get_min_segment_num();
+           segment_num <= proj_data.get_max_segment_num();
+           ++segment_num)
+        for (int view_num = proj_data.get_min_view_num(); view_num <= proj_data.get_max_view_num(); ++view_num)
+          {
+            Viewgram<float> viewgram = proj_data.get_empty_viewgram(view_num, segment_num);
+            for (int axial_pos_num = viewgram.get_min_axial_pos_num();
+                 axial_pos_num <= viewgram.get_max_axial_pos_num();
+                 ++axial_pos_num)
+              for (int tangential_pos_num = viewgram.get_min_tangential_pos_num();
+                   tangential_pos_num <= viewgram.get_max_tangential_pos_num();
+                   ++tangential_pos_num)
+                viewgram[axial_pos_num][tangential_pos_num] =
+                  get_test_value(segment_num, view_num, axial_pos_num, tangential_pos_num);
+            check(proj_data.set_viewgram(viewgram) == Succeeded::yes, "writing test data as viewgrams");
+          }
+      check_data(proj_data, "while writing viewgrams");
+    }
+    // every sinogram should have been compressed only once
+    const std::string::size_type viewgram_stream_size = viewgram_stream_sptr->str().size();
+    const std::string::size_type sinogram_stream_size = stream_sptr->str().size() - static_cast<std::size_t>(offset);
+    std::cerr << "\tsize after writing viewgrams " << viewgram_stream_size
+              << " bytes, after writing sinograms " << sinogram_stream_size << " bytes\n";
+    check(viewgram_stream_size <= sinogram_stream_size*11/10,
+          "size after writing viewgrams should be similar to the size after writing sinograms");
+    ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, viewgram_stream_sptr,
+                                 0, segment_sequence);
+    check_if_equal(proj_data.get_compressed_size(), compressed_size, "compressed size after writing viewgrams");
+    check_data(proj_data, "after writing viewgrams");
+  }
+
+  std::cerr << "\tReading via a new object\n";
+  {
+    ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, stream_sptr, offset,
+                                 segment_sequence);
+    check(!proj_data.is_writable(), "data should be read-only");
+    check_if_equal(proj_data.get_compressed_size(), compressed_size, "compressed size after reading");
+    check_data(proj_data, "after reading");
+    check(proj_data.set_sinogram(proj_data.get_sinogram(0,0)) == Succeeded::no,
+          "set_sinogram should fail for read-only data");
+
+    // copy via segments
+    shared_ptr<std::stringstream> copy_stream_sptr(new std::stringstream);
+    {
+      ProjDataCompressed copy(exam_info_sptr, proj_data_info_sptr, copy_stream_sptr,
+                              0, std::ios::in | std::ios::out);
+      copy.fill(proj_data);
+    }
+    ProjDataCompressed copy(exam_info_sptr, proj_data_info_sptr, copy_stream_sptr);
+    check_data(copy, "copy");
+    const SegmentByView<float> segment = copy.get_segment_by_view(1);
+    check_if_equal(segment[2][3][4], get_test_value(1, 2, 3, 4), "get_segment_by_view");
+  }
+
+  std::cerr << "\tWithout byte shuffling\n";
+  {
+    ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, stream_sptr, offset,
+                                 segment_sequence);
+    check(proj_data.get_byte_shuffle(), "byte shuffling should be used by default");
+    shared_ptr<std::stringstream> copy_stream_sptr(new std::stringstream);
+    {
+      ProjDataCompressed copy(exam_info_sptr, proj_data_info_sptr, copy_stream_sptr,
+                              0, std::ios::in | std::ios::out, /*compression_level*/ 1,
+                              /*byte_shuffle*/ false);
+      copy.fill(proj_data);
+    }
+    // byte_shuffle argument should be ignored for existing data
+    ProjDataCompressed copy(exam_info_sptr, proj_data_info_sptr, copy_stream_sptr,
+                            0, std::ios::in, 6, true);
+    check(!copy.get_byte_shuffle(), "byte shuffling setting should be read from the stream");
+    check_data(copy, "copy without byte shuffling");
+  }
+
+  std::cerr << "\tWriting and reading via Interfile\n";
+  {
+    {
+      ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, stream_sptr, offset,
+                                   segment_sequence);
+      ProjDataInterfileCompressed interfile_proj_data(exam_info_sptr, proj_data_info_sptr,
+                                                      "test_proj_data_compressed.hs");
+      interfile_proj_data.fill(proj_data);
+    }
+    shared_ptr<ProjData> proj_data_sptr = ProjData::read_from_file("test_proj_data_compressed.hs");
+    check(!is_null_ptr(dynamic_cast<ProjDataCompressed *>(proj_data_sptr.get())),
+          "ProjData::read_from_file should return a ProjDataCompressed object");
+    check(*proj_data_sptr->get_proj_data_info_ptr() == *proj_data_info_sptr,
+          "ProjDataInfo after reading via Interfile");
+    check_data(*proj_data_sptr, "after reading via Interfile");
+    proj_data_sptr.reset();
+
+    // scale factors are not supported for compressed data, so add one to the header
+    {
+      std::string header;
+      {
+        std::ifstream header_stream("test_proj_data_compressed.hs");
+        std::getline(header_stream, header, '\0');
+      }
+      const std::string::size_type end_pos = header.find("!END OF INTERFILE");
+      if (check(end_pos != std::string::npos, "end of Interfile header"))
+        {
+          header.insert(end_pos, "image scaling factor[1] := 2\n");
+          std::ofstream header_stream("test_proj_data_compressed.hs");
+          header_stream << header;
+        }
+    }
+    // this should call error, so we'll catch it
+    try
+      {
+        ProjData::read_from_file("test_proj_data_compressed.hs");
+        check(false, "reading compressed data with a scale factor should have thrown");
+      }
+    catch (...)
+      {
+        // ok
+      }
+    std::remove("test_proj_data_compressed.hs");
+    std::remove("test_proj_data_compressed.sz");
+  }
+
+  std::cerr << "\tModifying a viewgram\n";
+  {
+    ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, stream_sptr, offset,
+                                 segment_sequence, std::ios::in | std::ios::out);
+    Viewgram<float> viewgram = proj_data.get_empty_viewgram(1,-1);
+    viewgram.fill(-1.F);
+    check(proj_data.set_viewgram(viewgram) == Succeeded::yes, "set_viewgram");
+  }
+  {
+    ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, stream_sptr, offset,
+                                 segment_sequence);
+    check_if_equal(proj_data.get_viewgram(1,-1).find_max(), -1.F, "viewgram after set_viewgram");
+    const Viewgram<float> viewgram = proj_data.get_viewgram(2,-1);
+    const int axial_pos_num = proj_data.get_max_axial_pos_num(-1);
+    const int tangential_pos_num = proj_data.get_max_tangential_pos_num();
+    check_if_equal(viewgram[axial_pos_num][tangential_pos_num],
+                   get_test_value(-1, 2, axial_pos_num, tangential_pos_num),
+                   "other viewgram after set_viewgram");
+  }
+
+  std::cerr << "\tUnwritten sinograms\n";
+  {
+    shared_ptr<std::stringstream> empty_stream_sptr(new std::stringstream);
+    {
+      ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, empty_stream_sptr,
+                                   0, std::ios::in | std::ios::out);
+    }
+    ProjDataCompressed proj_data(exam_info_sptr, proj_data_info_sptr, empty_stream_sptr);
+    check_if_equal(proj_data.get_compressed_size(), static_cast<boost::uint64_t>(0), "size of empty data");
+    check_if_equal(proj_data.get_sinogram(0,0).find_max(), 0.F, "unwritten sinogram should be zero");
+  }
+}
+
+END_NAMESPACE_STIR
+
+
+USING_NAMESPACE_STIR
+
+int main()
+{
+  ProjDataCompressedTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
@@ -0,0 +1,292 @@
+//
+//
+/*!
+
+  \file
+  \ingroup test
+
+  \brief Test program for stir::ProjDataMemoryMapped and stir::ProjDataPositionalIO
+
+*/
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+
+#include "stir/ProjDataMemoryMapped.h"
+#ifdef HAVE_PREAD
+#include "stir/ProjDataPositionalIO.h"
+#endif
+#include "stir/ProjDataInterfile.h"
+#include "stir/ExamInfo.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/Sinogram.h"
+#include "stir/Viewgram.h"
+#include "stir/Succeeded.h"
+#include "stir/RunTests.h"
+#include "stir/Scanner.h"
+#include "stir/is_null_ptr.h"
+#include <cstdio>
+
+START_NAMESPACE_STIR
+
+
+/*!
+  \ingroup test
+  \brief Test class for ProjDataMemoryMapped and ProjDataPositionalIO
+
+  Writes an Interfile file with ProjDataInterfile, and checks that reading
+  it via memory-mapping (\c ",mmap") and via positional I/O (\c ",pread") gives
+  the same data, in both storage orders and for non-native byte order. Also checks
+  writing via both.
+
+  Backend-specific checks are get_const_data_ptr() for memory-mapping, and
+  reading all viewgrams in parallel (when OpenMP is enabled) for positional I/O.
+*/
+class ProjDataFileAccessTests: public RunTests
+{
+public:
+  void run_tests();
+private:
+  //! run the tests for one file via one backend
+  /*! \a suffix is \c ",mmap" or \c ",pread" */
+  void run_tests_for_1_file(const std::string& suffix,
+                            const ProjDataFromStream::StorageOrder storage_order,
+                            const ByteOrder byte_order);
+
+  void check_memory_mapped(const ProjData& proj_data, const ByteOrder byte_order);
+  void check_positional_io(const ProjData& proj_data);
+  //! read all viewgrams at the same time and check their values
+  void check_parallel_read(const ProjData& proj_data);
+
+  //! value used to fill the data. Different for every bin.
+  static float get_test_value(const int segment_num, const int view_num,
+                              const int axial_pos_num, const int tangential_pos_num)
+  {
+    return segment_num*1000.F + view_num*100.F + axial_pos_num + tangential_pos_num/100.F;
+  }
+
+  shared_ptr<ProjDataInfo> proj_data_info_sptr;
+  shared_ptr<ExamInfo> exam_info_sptr;
+};
+
+void
+ProjDataFileAccessTests::
+check_memory_mapped(const ProjData& proj_data, const ByteOrder byte_order)
+{
+  const ProjDataMemoryMapped * const mmap_ptr =
+    dynamic_cast<const ProjDataMemoryMapped *>(&proj_data);
+  if (!check(!is_null_ptr(mmap_ptr), "read_from_file with mmap should return ProjDataMemoryMapped"))
+    return;
+  check(!mmap_ptr->is_writable(), "data should be read-only");
+
+  const int segment_num = proj_data.get_max_segment_num();
+  const int view_num = proj_data.get_max_view_num();
+  const int axial_pos_num = proj_data.get_min_axial_pos_num(segment_num) + 1;
+  for (int tangential_pos_num = proj_data.get_min_tangential_pos_num();
+       tangential_pos_num <= proj_data.get_max_tangential_pos_num();
+       ++tangential_pos_num)
+    {
+      const float value = get_test_value(segment_num, view_num, axial_pos_num, tangential_pos_num);
+      const float * const data_ptr =
+        mmap_ptr->get_const_data_ptr(Bin(segment_num, view_num, axial_pos_num, tangential_pos_num));
+      if (byte_order.is_native_order())
+        {
+          if (check(!is_null_ptr(data_ptr), "get_const_data_ptr should work for native byte order"))
+            check_if_equal(*data_ptr, value, "get_const_data_ptr");
+        }
+      else
+        check(is_null_ptr(data_ptr), "get_const_data_ptr should return 0 for swapped byte order");
+    }
+}
+
+void
+ProjDataFileAccessTests::
+check_positional_io(const ProjData& proj_data)
+{
+#ifdef HAVE_PREAD
+  const ProjDataPositionalIO * const pio_ptr =
+    dynamic_cast<const ProjDataPositionalIO *>(&proj_data);
+  if (!check(!is_null_ptr(pio_ptr), "read_from_file with pread should return ProjDataPositionalIO"))
+    return;
+  check(!pio_ptr->is_writable(), "data should be read-only");
+  check(proj_data.supports_concurrent_access(), "supports_concurrent_access");
+  check_parallel_read(proj_data);
+#endif
+}
+
+void
+ProjDataFileAccessTests::
+check_parallel_read(const ProjData& proj_data)
+{
+  const int num_views = proj_data.get_num_views();
+  int num_errors = 0;
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:num_errors)
+#endif
+  for (int i=0; i<num_views*proj_data.get_num_segments(); ++i)
+    {
+      const int view_num = proj_data.get_min_view_num() + i % num_views;
+      const int segment_num = proj_data.get_min_segment_num() + i / num_views;
+      const Viewgram<float> viewgram = proj_data.get_viewgram(view_num, segment_num);
+      for (int axial_pos_num = viewgram.get_min_axial_pos_num();
+           axial_pos_num <= viewgram.get_max_axial_pos_num();
+           ++axial_pos_num)
+        for (int tangential_pos_num = viewgram.get_min_tangential_pos_num();
+             tangential_pos_num <= viewgram.get_max_tangential_pos_num();
+             ++tangential_pos_num)
+          if (viewgram[axial_pos_num][tangential_pos_num] !=
+              get_test_value(segment_num, view_num, axial_pos_num, tangential_pos_num))
+            ++num_errors;
+    }
+  check_if_equal(num_errors, 0, "number of wrong values when reading viewgrams in parallel");
+}
+
+void
+ProjDataFileAccessTests::
+run_tests_for_1_file(const std::string& suffix,
+                     const ProjDataFromStream::StorageOrder storage_order,
+                     const ByteOrder byte_order)
+{
+  const std::string filename = "test_proj_data_file_access.hs";
+  // write data
+  {
+    ProjDataInterfile proj_data(exam_info_sptr, proj_data_info_sptr, filename, std::ios::out,
+                                storage_order, NumericType::FLOAT, byte_order);
+    for (int segment_num = proj_data.get_min_segment_num();
+         segment_num <= proj_data.get_max_segment_num();
+         ++segment_num)
+      for (int view_num = proj_data.get_min_view_num();
+           view_num <= proj_data.get_max_view_num();
+           ++view_num)
+        {
+          Viewgram<float> viewgram = proj_data.get_empty_viewgram(view_num, segment_num);
+          for (int axial_pos_num = viewgram.get_min_axial_pos_num();
+               axial_pos_num <= viewgram.get_max_axial_pos_num();
+               ++axial_pos_num)
+            for (int tangential_pos_num = viewgram.get_min_tangential_pos_num();
+                 tangential_pos_num <= viewgram.get_max_tangential_pos_num();
+                 ++tangential_pos_num)
+              viewgram[axial_pos_num][tangential_pos_num] =
+                get_test_value(segment_num, view_num, axial_pos_num, tangential_pos_num);
+          check(proj_data.set_viewgram(viewgram) == Succeeded::yes, "writing test data");
+        }
+  }
+
+  // read via the backend
+  {
+    shared_ptr<ProjData> proj_data_sptr = ProjData::read_from_file(filename + suffix);
+
+    const int segment_num = proj_data_sptr->get_max_segment_num();
+    const int view_num = proj_data_sptr->get_max_view_num();
+    const int axial_pos_num = proj_data_sptr->get_min_axial_pos_num(segment_num) + 1;
+    const Viewgram<float> viewgram = proj_data_sptr->get_viewgram(view_num, segment_num);
+    const Sinogram<float> sinogram = proj_data_sptr->get_sinogram(axial_pos_num, segment_num);
+    for (int tangential_pos_num = proj_data_sptr->get_min_tangential_pos_num();
+         tangential_pos_num <= proj_data_sptr->get_max_tangential_pos_num();
+         ++tangential_pos_num)
+      {
+        const float value = get_test_value(segment_num, view_num, axial_pos_num, tangential_pos_num);
+        check_if_equal(viewgram[axial_pos_num][tangential_pos_num], value, "get_viewgram" + suffix);
+        check_if_equal(sinogram[view_num][tangential_pos_num], value, "get_sinogram" + suffix);
+      }
+    check(proj_data_sptr->set_viewgram(viewgram) == Succeeded::no,
+          "set_viewgram should fail for read-only data" + suffix);
+
+    if (suffix == ",mmap")
+      check_memory_mapped(*proj_data_sptr, byte_order);
+    else
+      check_positional_io(*proj_data_sptr);
+
+    // get_bin_value is not in the ProjData interface
+    const Bin bin(segment_num, view_num, axial_pos_num, proj_data_sptr->get_max_tangential_pos_num());
+    const float value = get_test_value(segment_num, view_num, axial_pos_num, bin.tangential_pos_num());
+    if (const ProjDataMemoryMapped * const ptr = dynamic_cast<const ProjDataMemoryMapped *>(proj_data_sptr.get()))
+      check_if_equal(ptr->get_bin_value(bin), value, "get_bin_value" + suffix);
+#ifdef HAVE_PREAD
+    if (const ProjDataPositionalIO * const ptr = dynamic_cast<const ProjDataPositionalIO *>(proj_data_sptr.get()))
+      check_if_equal(ptr->get_bin_value(bin), value, "get_bin_value" + suffix);
+#endif
+  }
+
+  // modify data via the backend
+  {
+    shared_ptr<ProjData> proj_data_sptr =
+      ProjData::read_from_file(filename + suffix, std::ios::in | std::ios::out);
+    Viewgram<float> viewgram = proj_data_sptr->get_empty_viewgram(0,0);
+    viewgram.fill(-1.F);
+    check(proj_data_sptr->set_viewgram(viewgram) == Succeeded::yes, "set_viewgram" + suffix);
+    Sinogram<float> sinogram = proj_data_sptr->get_empty_sinogram(proj_data_sptr->get_max_axial_pos_num(0), 0);
+    sinogram.fill(-2.F);
+    check(proj_data_sptr->set_sinogram(sinogram) == Succeeded::yes, "set_sinogram" + suffix);
+  }
+  {
+    // read without the backend
+    shared_ptr<ProjData> proj_data_sptr = ProjData::read_from_file(filename);
+    const int max_axial_pos_num = proj_data_sptr->get_max_axial_pos_num(0);
+    const Viewgram<float> viewgram = proj_data_sptr->get_viewgram(0,0);
+    check_if_equal(viewgram[0].find_max(), -1.F,
+                   "reading data written via set_viewgram" + suffix);
+    check_if_equal(viewgram[max_axial_pos_num].find_max(), -2.F,
+                   "reading data written via set_sinogram" + suffix);
+    check_if_equal(proj_data_sptr->get_sinogram(max_axial_pos_num, 0).find_min(), -2.F,
+                   "reading sinogram written via set_sinogram" + suffix);
+    check_if_equal(proj_data_sptr->get_viewgram(1,0)[0].find_max(),
+                   get_test_value(0, 1, 0, proj_data_sptr->get_max_tangential_pos_num()),
+                   "reading data not written" + suffix);
+  }
+
+  std::remove(filename.c_str());
+  std::remove("test_proj_data_file_access.s");
+}
+
+void
+ProjDataFileAccessTests::
+run_tests()
+{
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  proj_data_info_sptr.reset(ProjDataInfo::ProjDataInfoCTI(scanner_sptr,
+                                                          /*span*/1, 2,/*views*/ 48, /*tang_pos*/64,
+                                                          /*arc_corrected*/ true));
+  exam_info_sptr.reset(new ExamInfo);
+
+  std::vector<std::string> suffixes;
+  suffixes.push_back(",mmap");
+#ifdef HAVE_PREAD
+  suffixes.push_back(",pread");
+#endif
+  for (std::vector<std::string>::const_iterator iter = suffixes.begin(); iter != suffixes.end(); ++iter)
+    {
+      std::cerr << "-------- Testing reading with \"" << *iter << "\" --------\n";
+      std::cerr << "\tTesting Segment_View_AxialPos_TangPos\n";
+      run_tests_for_1_file(*iter, ProjDataFromStream::Segment_View_AxialPos_TangPos, ByteOrder::native);
+      std::cerr << "\tTesting Segment_AxialPos_View_TangPos\n";
+      run_tests_for_1_file(*iter, ProjDataFromStream::Segment_AxialPos_View_TangPos, ByteOrder::native);
+      std::cerr << "\tTesting swapped byte order\n";
+      run_tests_for_1_file(*iter, ProjDataFromStream::Segment_View_AxialPos_TangPos, ByteOrder::swapped);
+    }
+}
+
+END_NAMESPACE_STIR
+
+
+USING_NAMESPACE_STIR
+
+int main()
+{
+  ProjDataFileAccessTests tests;
+  tests.run_tests();
+  return tests.main_return_value();
+}
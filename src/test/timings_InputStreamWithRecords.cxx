@@ -0,0 +1,228 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup test
+
+  \brief Benchmark for reading list mode data with stir::InputStreamWithRecords
+
+  A synthetic list mode file with 4-byte records (as for the Siemens mMR) is written,
+  and read back in 3 ways:
+  - reading every record with 2 calls to the stream and a new buffer for every record
+    (which is how InputStreamWithRecords used to work)
+  - InputStreamWithRecords::get_next_record()
+  - InputStreamWithRecords::get_next_records() with batches of records
+
+  The same file is then decoded as ecat::CListRecordECAT8_32bit records with
+  get_next_record() and with get_next_records() with batches of 1 record
+  (as used by CListModeDataECAT8_32bit).
+
+  \par Usage
+  \verbatim
+  timings_InputStreamWithRecords [num_records [filename]]
+  \endverbatim
+  Defaults are 20000000 records and \c timings_InputStreamWithRecords.tmp in the
+  current directory. The file is removed at the end.
+
+  This program is not run as part of the tests.
+*/
+
+#include "stir/IO/InputStreamWithRecords.h"
+#include "stir/listmode/CListRecordECAT8_32bit.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/Scanner.h"
+#include "stir/HighResWallClockTimer.h"
+#include "stir/shared_ptr.h"
+#include "stir/Succeeded.h"
+#include "stir/error.h"
+#include <boost/shared_array.hpp>
+#include <boost/format.hpp>
+#include <boost/cstdint.hpp>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+START_NAMESPACE_STIR
+
+//! A 4-byte record, similar to the records of the Siemens mMR
+class TimingsRecord
+{
+public:
+  TimingsRecord() : data(0) {}
+
+  std::size_t
+  size_of_record_at_ptr(const char * const, const std::size_t, const bool) const
+  { return 4; }
+
+  Succeeded
+  init_from_data_ptr(const char * const buffer, const std::size_t, const bool)
+  {
+    std::memcpy(&this->data, buffer, 4);
+    return Succeeded::yes;
+  }
+
+  boost::uint32_t data;
+};
+
+// the way InputStreamWithRecords::get_next_record used to be implemented
+static Succeeded
+get_next_record_unbuffered(std::istream& stream, TimingsRecord& record)
+{
+  const std::size_t max_size_of_record = 4;
+  const std::size_t size_of_record_signature = 4;
+  boost::shared_array<char> data_sptr(new char[max_size_of_record]);
+  char * data_ptr = data_sptr.get();
+  stream.read(data_ptr, size_of_record_signature);
+  if (stream.gcount()<static_cast<std::streamsize>(size_of_record_signature))
+    return Succeeded::no;
+  const std::size_t size_of_record = record.size_of_record_at_ptr(data_ptr, size_of_record_signature, false);
+  if (size_of_record > size_of_record_signature)
+    stream.read(data_ptr + size_of_record_signature,
+                size_of_record - size_of_record_signature);
+  if (stream.eof())
+    return Succeeded::no;
+  return
+    record.init_from_data_ptr(data_ptr, size_of_record, false);
+}
+
+static void
+report(const std::string& method, const double time_in_secs,
+       const unsigned long num_records, const boost::uint32_t checksum)
+{
+  std::cout << boost::format("%|1$-40| %|2$10.3f| s %|3$10.1f| MB/s  (%4% records, checksum %5%)\n")
+    % method % time_in_secs % (num_records*4./1024/1024/time_in_secs) % num_records % checksum;
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int
+main(int argc, char **argv)
+{
+  if (argc>3)
+    {
+      std::cerr << "Usage: " << argv[0] << " [num_records [filename]]\n";
+      return EXIT_FAILURE;
+    }
+  const unsigned long num_records = argc>1 ? std::strtoul(argv[1], 0, 10) : 20000000UL;
+  const std::string filename = argc>2 ? argv[2] : "timings_InputStreamWithRecords.tmp";
+
+  {
+    std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+    std::vector<boost::uint32_t> block(1<<16);
+    unsigned long record_num = 0;
+    while (record_num < num_records)
+      {
+        std::size_t num_in_block = 0;
+        for (; num_in_block<block.size() && record_num<num_records; ++num_in_block, ++record_num)
+          block[num_in_block] = static_cast<boost::uint32_t>(record_num*2654435761UL);
+        out.write(reinterpret_cast<const char *>(&block[0]), num_in_block*4);
+      }
+    if (!out)
+      error("Error writing " + filename);
+  }
+
+  {
+    std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+    HighResWallClockTimer timer;
+    timer.start();
+    TimingsRecord record;
+    unsigned long count = 0;
+    boost::uint32_t checksum = 0;
+    while (get_next_record_unbuffered(in, record) == Succeeded::yes)
+      { ++count; checksum ^= record.data; }
+    timer.stop();
+    report("unbuffered, one record at a time", timer.value(), count, checksum);
+  }
+
+  typedef InputStreamWithRecords<TimingsRecord, bool> StreamT;
+  {
+    shared_ptr<std::istream> in_sptr(new std::ifstream(filename.c_str(), std::ios::in | std::ios::binary));
+    StreamT stream(in_sptr, 4, 4, false);
+    HighResWallClockTimer timer;
+    timer.start();
+    TimingsRecord record;
+    unsigned long count = 0;
+    boost::uint32_t checksum = 0;
+    while (stream.get_next_record(record) == Succeeded::yes)
+      { ++count; checksum ^= record.data; }
+    timer.stop();
+    report("get_next_record", timer.value(), count, checksum);
+  }
+  {
+    shared_ptr<std::istream> in_sptr(new std::ifstream(filename.c_str(), std::ios::in | std::ios::binary));
+    StreamT stream(in_sptr, 4, 4, false);
+    HighResWallClockTimer timer;
+    timer.start();
+    std::vector<TimingsRecord> records(10000);
+    unsigned long count = 0;
+    boost::uint32_t checksum = 0;
+    std::size_t num_read;
+    do
+      {
+        num_read = stream.get_next_records(&records[0], records.size());
+        for (std::size_t i=0; i<num_read; ++i)
+          checksum ^= records[i].data;
+        count += num_read;
+      }
+    while (num_read == records.size());
+    timer.stop();
+    report("get_next_records (batches of 10000)", timer.value(), count, checksum);
+  }
+
+  // the same data, but decoded as Siemens mMR records
+  typedef ecat::CListRecordECAT8_32bit RecordT;
+  typedef InputStreamWithRecords<RecordT, bool> RecordStreamT;
+  shared_ptr<ProjDataInfo>
+    proj_data_info_sptr(ProjDataInfo::construct_proj_data_info(shared_ptr<Scanner>(new Scanner(Scanner::Siemens_mMR)),
+                                                               1, 60, 252, 344, false));
+  {
+    shared_ptr<std::istream> in_sptr(new std::ifstream(filename.c_str(), std::ios::in | std::ios::binary));
+    RecordStreamT stream(in_sptr, 4, 4, false);
+    HighResWallClockTimer timer;
+    timer.start();
+    shared_ptr<CListRecord> record_sptr(new RecordT(proj_data_info_sptr));
+    unsigned long count = 0;
+    boost::uint32_t checksum = 0;
+    while (stream.get_next_record(static_cast<RecordT&>(*record_sptr)) == Succeeded::yes)
+      { ++count; checksum += record_sptr->is_time(); }
+    timer.stop();
+    report("mMR: get_next_record", timer.value(), count, checksum);
+  }
+  {
+    shared_ptr<std::istream> in_sptr(new std::ifstream(filename.c_str(), std::ios::in | std::ios::binary));
+    RecordStreamT stream(in_sptr, 4, 4, false);
+    HighResWallClockTimer timer;
+    timer.start();
+    shared_ptr<CListRecord> record_sptr(new RecordT(proj_data_info_sptr));
+    unsigned long count = 0;
+    boost::uint32_t checksum = 0;
+    while (stream.get_next_records(&static_cast<RecordT&>(*record_sptr), 1) == 1)
+      { ++count; checksum += record_sptr->is_time(); }
+    timer.stop();
+    report("mMR: get_next_records(1)", timer.value(), count, checksum);
+  }
+
+  std::remove(filename.c_str());
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+//
+//
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup test
+
+  \brief Benchmark for reading projection data from multiple threads with stir::ProjDataPositionalIO
+
+  A projection data file (span 1, all segments) is written in Interfile format and all
+  viewgrams are read from multiple threads (as in the reconstruction code) in 2 ways:
+  - via ProjDataFromStream, where the reads are serialised with a critical section
+  - via ProjDataPositionalIO, without any locking
+  This is repeated for 1, 2, 4, ... threads (up to the maximum number of OpenMP threads).
+
+  \par Usage
+  \verbatim
+  timings_ProjDataPositionalIO [max_ring_difference [filename_without_extension]]
+  \endverbatim
+  Defaults are 15 and \c timings_ProjDataPositionalIO in the current directory.
+  The files (with extensions .hs and .s) are removed at the end.
+
+  This program is not run as part of the tests. Note that the timings depend
+  a lot on whether the file is in the cache of the operating system.
+*/
+
+#include "stir/ProjDataPositionalIO.h"
+#include "stir/ProjDataInterfile.h"
+#include "stir/ExamInfo.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/Scanner.h"
+#include "stir/Viewgram.h"
+#include "stir/Succeeded.h"
+#include "stir/HighResWallClockTimer.h"
+#include "stir/error.h"
+#include <boost/format.hpp>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#ifdef STIR_OPENMP
+#include <omp.h>
+#endif
+
+START_NAMESPACE_STIR
+
+//! read all viewgrams in parallel, returns the sum of all values
+static double
+read_all_viewgrams(const ProjData& proj_data, const int num_threads)
+{
+  const int num_views = proj_data.get_num_views();
+  const bool use_critical = !proj_data.supports_concurrent_access();
+  double sum = 0;
+#ifdef STIR_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads) reduction(+:sum)
+#endif
+  for (int i=0; i<num_views*proj_data.get_num_segments(); ++i)
+    {
+      const int view_num = proj_data.get_min_view_num() + i % num_views;
+      const int segment_num = proj_data.get_min_segment_num() + i / num_views;
+      Viewgram<float> viewgram = proj_data.get_empty_viewgram(view_num, segment_num);
+      if (use_critical)
+        {
+#ifdef STIR_OPENMP
+#pragma omp critical(TIMINGS_VIEW)
+#endif
+          viewgram = proj_data.get_viewgram(view_num, segment_num);
+        }
+      else
+        viewgram = proj_data.get_viewgram(view_num, segment_num);
+      sum += viewgram.sum();
+    }
+  return sum;
+}
+
+static void
+report(const std::string& method, const int num_threads, const double time_in_secs, const double sum)
+{
+  std::cout << boost::format("%|1$-25| %|2$3| threads %|3$10.3f| s  (sum %4%)\n")
+    % method % num_threads % time_in_secs % sum;
+}
+
+END_NAMESPACE_STIR
+
+USING_NAMESPACE_STIR
+
+int
+main(int argc, char **argv)
+{
+  if (argc>3)
+    {
+      std::cerr << "Usage: " << argv[0] << " [max_ring_difference [filename_without_extension]]\n";
+      return EXIT_FAILURE;
+    }
+  const int max_ring_difference = argc>1 ? std::atoi(argv[1]) : 15;
+  const std::string name = argc>2 ? argv[2] : "timings_ProjDataPositionalIO";
+  const std::string filename = name + ".hs";
+  const std::string data_filename = name + ".s";
+
+  shared_ptr<Scanner> scanner_sptr(new Scanner(Scanner::E953));
+  shared_ptr<ProjDataInfo> proj_data_info_sptr(
+    ProjDataInfo::ProjDataInfoCTI(scanner_sptr, /*span*/1, max_ring_difference,
+                                  scanner_sptr->get_num_detectors_per_ring()/2,
+                                  scanner_sptr->get_default_num_arccorrected_bins(),
+                                  /*arc_corrected*/ false));
+  shared_ptr<ExamInfo> exam_info_sptr(new ExamInfo);
+
+  {
+    ProjDataInterfile proj_data(exam_info_sptr, proj_data_info_sptr, filename, std::ios::out);
+    for (int segment_num = proj_data.get_min_segment_num();
+         segment_num <= proj_data.get_max_segment_num();
+         ++segment_num)
+      for (int view_num = proj_data.get_min_view_num(); view_num <= proj_data.get_max_view_num(); ++view_num)
+        {
+          Viewgram<float> viewgram = proj_data.get_empty_viewgram(view_num, segment_num);
+          viewgram.fill(static_cast<float>(view_num + segment_num));
+          if (proj_data.set_viewgram(viewgram) != Succeeded::yes)
+            error("Error writing " + filename);
+        }
+  }
+
+#ifdef STIR_OPENMP
+  const int max_num_threads = omp_get_max_threads();
+#else
+  const int max_num_threads = 1;
+#endif
+  shared_ptr<ProjData> stream_sptr = ProjData::read_from_file(filename);
+  shared_ptr<ProjData> pread_sptr = ProjData::read_from_file(filename + ",pread");
+  for (int num_threads = 1; ; num_threads = std::min(2*num_threads, max_num_threads))
+    {
+      HighResWallClockTimer timer;
+      timer.start();
+      double sum = read_all_viewgrams(*stream_sptr, num_threads);
+      timer.stop();
+      report("ProjDataFromStream", num_threads, timer.value(), sum);
+      timer.reset();
+      timer.start();
+      sum = read_all_viewgrams(*pread_sptr, num_threads);
+      timer.stop();
+      report("ProjDataPositionalIO", num_threads, timer.value(), sum);
+      if (num_threads == max_num_threads)
+        break;
+    }
+
+  stream_sptr.reset();
+  pread_sptr.reset();
+  std::remove(filename.c_str());
+  std::remove(data_filename.c_str());
+  return EXIT_SUCCESS;
+}
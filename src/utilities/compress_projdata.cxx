@@ -0,0 +1,88 @@
+/*
+    Copyright (C) 2018, University College London
+    This file is part of STIR.
+
+    This file is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This file is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    See STIR/LICENSE.txt for details
+*/
+/*!
+  \file
+  \ingroup utilities
+
+  \brief A utility that writes projection data in compressed form
+
+  \par Usage
+  \verbatim
+  compress_projdata output_filename input_filename [compression_level [byte_shuffle]]
+  \endverbatim
+  The output is written using stir::ProjDataInterfileCompressed, i.e. an Interfile header
+  with a \c .sz file with the compressed data. \a compression_level is the zlib
+  compression level (1 to 9, default 6), \a byte_shuffle is 0 or 1 (default).
+
+  The output can be read by all STIR programs. To convert it back to uncompressed
+  data, use for instance
+  \verbatim
+  stir_math -s uncompressed.hs compressed.hs
+  \endverbatim
+
+  \warning This utility is only available when STIR is compiled with zlib.
+*/
+
+#include "stir/ProjDataInterfileCompressed.h"
+#include "stir/ProjDataInfo.h"
+#include "stir/SegmentBySinogram.h"
+#include "stir/Succeeded.h"
+#include "stir/error.h"
+#include <boost/format.hpp>
+#include <iostream>
+#include <cstdlib>
+
+USING_NAMESPACE_STIR
+
+int main(int argc, char *argv[])
+{
+  if (argc<3 || argc>5)
+    {
+      std::cerr << "Usage: " << argv[0]
+                << " output_filename input_filename [compression_level [byte_shuffle]]\n"
+                << "compression_level defaults to 6, byte_shuffle to 1\n";
+      return EXIT_FAILURE;
+    }
+  const std::string output_filename = argv[1];
+  const int compression_level = argc>3 ? atoi(argv[3]) : 6;
+  const bool byte_shuffle = argc>4 ? atoi(argv[4])!=0 : true;
+
+  shared_ptr<ProjData> input_sptr = ProjData::read_from_file(argv[2]);
+
+  ProjDataInterfileCompressed output(input_sptr->get_exam_info_sptr(),
+                                     input_sptr->get_proj_data_info_ptr()->create_shared_clone(),
+                                     output_filename,
+                                     compression_level, byte_shuffle);
+  double uncompressed_size = 0.;
+  for (int segment_num = output.get_min_segment_num();
+       segment_num <= output.get_max_segment_num();
+       ++segment_num)
+    {
+      const SegmentBySinogram<float> segment = input_sptr->get_segment_by_sinogram(segment_num);
+      if (output.set_segment(segment) == Succeeded::no)
+        error("compress_projdata: error writing segment %d", segment_num);
+      uncompressed_size += static_cast<double>(segment.size_all()) * sizeof(float);
+    }
+  if (output.flush() == Succeeded::no)
+    error("compress_projdata: error writing %s", output_filename.c_str());
+
+  const double compressed_size = static_cast<double>(output.get_compressed_size());
+  std::cout << boost::format("Compressed %1% MB to %2% MB (ratio %3$.2f)\n")
+    % (uncompressed_size/1024/1024) % (compressed_size/1024/1024)
+    % (compressed_size > 0 ? uncompressed_size/compressed_size : 0.);
+  return EXIT_SUCCESS;
+}
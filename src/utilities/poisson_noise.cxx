@@ -9,7 +9,7 @@
 
   Usage:
   \code
-  poisson_noise [-p | --preserve-mean] \
+  poisson_noise [-p | --preserve-mean] [--counter-based] \
         output_filename input_projdata_filename \
         scaling_factor seed-unsigned-int
   \endcode
@@ -20,7 +20,10 @@
   Without the -p option, the mean of the output data will
   be equal to <tt>scaling_factor*mean_of_input</tt>, otherwise it
   will be equal to mean_of_input.<br>
-  The options -p and --preserve-mean are identical.
+  The options -p and --preserve-mean are identical.<br>
+  With the --counter-based option, a counter-based random number generator is used, such
+  that the noise realisation only depends on the seed, and is generated in parallel
+  (when STIR is compiled with OpenMP). See stir::GeneralisedPoissonNoiseGenerator.
 */
 /*
     Copyright (C) 2000 - 2004, Hammersmith Imanet Ltd
@@ -48,12 +51,14 @@ USING_NAMESPACE_STIR
 void usage()
 {
     using std::cerr;
-    cerr <<"Usage: poisson_noise [-p | --preserve-mean] <output_filename (no extension)> <input_projdata_filename> scaling_factor seed-unsigned-int\n"
+    cerr <<"Usage: poisson_noise [-p | --preserve-mean] [--counter-based] <output_filename (no extension)> <input_projdata_filename> scaling_factor seed-unsigned-int\n"
          <<"The seed value for the random number generator has to be strictly positive.\n"
          << "Without the -p option, the mean of the output data will"
 	 << " be equal to\nscaling_factor*mean_of_input, otherwise it"
 	 << "will be equal to mean_of_input.\n"
-	 << "The options -p and --preserve-mean are identical.\n";
+	 << "The options -p and --preserve-mean are identical.\n"
+	 << "With --counter-based, the noise realisation only depends on the seed\n"
+	 << "(and is computed in parallel if STIR is compiled with OpenMP).\n";
 }
 
 int
@@ -66,20 +71,28 @@ main (int argc,char *argv[])
   }  
   
   bool preserve_mean = false;
+  bool counter_based = false;
 
   // option processing
-  if (argv[1][0] == '-')
+  while (argc>1 && argv[1][0] == '-')
     {
       if (strcmp(argv[1],"-p")==0 ||
 	  strcmp(argv[1],"--preserve-mean")==0)
 	preserve_mean = true;
+      else if (strcmp(argv[1],"--counter-based")==0)
+	counter_based = true;
       else
 	{
 	  usage();
 	  return(EXIT_FAILURE);
 	}  
-      ++argv;
+      ++argv; --argc;
     }
+  if(argc<5)
+  {
+    usage();
+    return(EXIT_FAILURE);
+  }  
 	  
   const char *const filename = argv[1];
   const float scaling_factor = static_cast<float>(atof(argv[3]));
@@ -88,6 +101,7 @@ main (int argc,char *argv[])
   unsigned int seed = atoi(argv[4]);
 
   GeneralisedPoissonNoiseGenerator generator(scaling_factor, preserve_mean);
+  generator.set_use_counter_based_generator(counter_based);
   generator.seed(seed);
 
   ProjDataInterfile new_data(in_data->get_exam_info_sptr(),in_data->get_proj_data_info_ptr()->create_shared_clone(), filename);